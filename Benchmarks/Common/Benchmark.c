@@ -0,0 +1,149 @@
+#include <stdlib.h>
+
+#include <System/PlatformDetect.h>
+
+#ifndef SYS_PLATFORM_WINDOWS
+#include <unistd.h>
+#endif
+
+#include <Engine/Config.h>
+#include <Engine/Version.h>
+#include <Engine/Application.h>
+#include <Scene/Scene.h>
+#include <System/Log.h>
+#include <System/Memory.h>
+
+#include "Benchmark.h"
+#include "Engine/ECS.h"
+
+NE_APPLICATION("NekoEngine Benchmark", E_CPY_STR, E_VER_MAJOR, E_VER_MINOR, E_VER_BUILD, E_VER_REVISION);
+
+bool App_EarlyInit(int argc, char *argv[]) { return true; }
+bool App_InitApplication(int argc, char *argv[]) { return true; }
+void App_Frame(void) { }
+void App_TermApplication(void) { }
+
+bool
+Bench_Init(int argc, char *argv[], struct NeBenchOptions *opt)
+{
+	int c;
+	const char *configFile = NULL;
+
+	while ((c = getopt(argc, argv, "c:w:n:")) != -1) {
+		switch (c) {
+		case 'c': configFile = optarg; break;
+		case 'w': opt->maxWorkers = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 'n': opt->iterations = strtoull(optarg, NULL, 10); break;
+		default:
+			fprintf(stderr, "usage: %s [-c config] [-w max workers] [-n iterations]\n", argv[0]);
+			return false;
+		}
+	}
+
+	if (!opt->maxWorkers)
+		opt->maxWorkers = BENCH_DEFAULT_WORKERS;
+
+	E_InitConfig(configFile);
+
+	if (!Sys_InitMemory())
+		return false;
+
+	return Sys_InitLog(E_GetCVarStr("Bench_LogFile", "Benchmark.log")->str);
+}
+
+void
+Bench_ResetFrameHeap(void)
+{
+	Sys_ResetHeap(MH_Frame);
+}
+
+void
+Bench_Term(void)
+{
+	Sys_TermMemory();
+	E_TermConfig();
+}
+
+struct NeScene *
+Bench_CreateScene(bool archetypes)
+{
+	struct NeScene *s = Sys_Alloc(sizeof(*s), 1, MH_Scene);
+	if (!s)
+		return NULL;
+
+	Sys_InitAtomicLock(&s->lock.comp);
+	Sys_InitAtomicLock(&s->lock.newComp);
+	Sys_InitAtomicLock(&s->lock.entity);
+	Sys_InitAtomicLock(&s->lock.newEntity);
+	strlcpy(s->name, "Benchmark", sizeof(s->name));
+	s->archetypeStorage = archetypes;
+
+	if (!E_InitSceneComponents(s))
+		goto error;
+
+	if (!E_InitSceneEntities(s)) {
+		E_TermSceneComponents(s);
+		goto error;
+	}
+
+	if (!E_InitSceneQueries(s)) {
+		E_TermSceneEntities(s);
+		E_TermSceneComponents(s);
+		goto error;
+	}
+
+	return s;
+
+error:
+	fprintf(stderr, "Failed to create the scene\n");
+	Sys_Free(s);
+	return NULL;
+}
+
+void
+Bench_DestroyScene(struct NeScene *s)
+{
+	Scn_TermTransforms(s);
+	E_TermSceneQueries(s);
+	E_TermSceneEntities(s);
+	E_TermSceneComponents(s);
+	Sys_Free(s);
+}
+
+/* NekoEngine
+ *
+ * Benchmark.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
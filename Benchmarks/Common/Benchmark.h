@@ -0,0 +1,75 @@
+#ifndef NE_BENCHMARK_H
+#define NE_BENCHMARK_H
+
+#include <Engine/Types.h>
+#include <System/System.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BENCH_DEFAULT_WORKERS	8
+
+struct NeBenchOptions
+{
+	uint32_t maxWorkers;
+	uint64_t iterations;
+};
+
+/*
+ * Headless initialization; no window, renderer or audio. Only the configuration, logging
+ * and the main thread's heaps are set up, everything else is up to the benchmark.
+ */
+bool Bench_Init(int argc, char *argv[], struct NeBenchOptions *opt);
+void Bench_ResetFrameHeap(void);
+void Bench_Term(void);
+
+// A scene that is not registered with the scene manager; it has no renderer data and is not loaded from a file
+struct NeScene *Bench_CreateScene(bool archetypes);
+void Bench_DestroyScene(struct NeScene *s);
+
+static inline double Bench_Seconds(uint64_t start, uint64_t end) { return (double)(end - start) * 1e-9; }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NE_BENCHMARK_H */
+
+/* NekoEngine
+ *
+ * Benchmark.h
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Engine/IO.h>
+#include <Engine/Job.h>
+#include <Engine/Event.h>
+#include <Engine/Config.h>
+#include <Engine/Entity.h>
+#include <Engine/ECSystem.h>
+#include <Scene/Scene.h>
+#include <System/Memory.h>
+
+#include "Benchmark.h"
+#include "Engine/ECS.h"
+
+#define BENCH_FRAMES		100
+#define BENCH_INTEGRATE		"Bench_Integrate"
+#define BENCH_DAMP			"Bench_Damp"
+#define DEFAULT_ITERATIONS	100000
+
+/*
+ * Runs the same workload on a scene that stores components in per-type arrays and on one that uses archetype storage.
+ * Every entity has a position and a velocity, one in four also has a mass and one in three a tag, so the entities are
+ * spread over four archetypes. The add and remove passes attach a mass to every entity that does not have one and
+ * remove it again, each followed by the commit that moves the entities between archetypes.
+ */
+
+struct BenchPosition
+{
+	NE_COMPONENT_BASE;
+	float x, y, z;
+};
+
+struct BenchVelocity
+{
+	NE_COMPONENT_BASE;
+	float x, y, z;
+};
+
+struct BenchMass
+{
+	NE_COMPONENT_BASE;
+	float invMass;
+};
+
+struct BenchTag
+{
+	NE_COMPONENT_BASE;
+	uint32_t tag;
+};
+
+struct NeLayoutResult
+{
+	double create, integrate, damp, lookup, add, remove;
+};
+
+static NeCompTypeId f_position, f_velocity, f_mass, f_tag;
+
+static void Integrate(void **comp, const float *dt);
+static void Damp(void **comp, const float *dt);
+static bool RunLayout(bool archetypes, uint64_t count, struct NeLayoutResult *r);
+
+int
+main(int argc, char *argv[])
+{
+	struct NeLayoutResult perType, archetype;
+	struct NeBenchOptions opt = { .iterations = DEFAULT_ITERATIONS };
+	if (!Bench_Init(argc, argv, &opt))
+		return -1;
+
+	E_SetCVarI32("Engine_MaxJobWorkers", (int32_t)opt.maxWorkers);
+	if (!E_InitJobSystem() || !E_InitEventSystem() || !E_InitIOSystem() || !E_InitECSystems()) {
+		fprintf(stderr, "Failed to initialize the engine\n");
+		return -1;
+	}
+
+	if (!E_RegisterComponent("BenchPosition", sizeof(struct BenchPosition), 16, NULL, NULL, NULL, &f_position) ||
+			!E_RegisterComponent("BenchVelocity", sizeof(struct BenchVelocity), 16, NULL, NULL, NULL, &f_velocity) ||
+			!E_RegisterComponent("BenchMass", sizeof(struct BenchMass), 16, NULL, NULL, NULL, &f_mass) ||
+			!E_RegisterComponent("BenchTag", sizeof(struct BenchTag), 16, NULL, NULL, NULL, &f_tag)) {
+		fprintf(stderr, "Failed to register the benchmark components\n");
+		return -1;
+	}
+
+	const NeCompTypeId integrateTypes[] = { f_position, f_velocity };
+	if (!E_RegisterSystemId(BENCH_INTEGRATE, ECSYS_GROUP_MANUAL_HASH, integrateTypes, 2, (NeECSysExecProc)Integrate, 0, false) ||
+			!E_RegisterSystemId(BENCH_DAMP, ECSYS_GROUP_MANUAL_HASH, &f_velocity, 1, (NeECSysExecProc)Damp, 0, false)) {
+		fprintf(stderr, "Failed to register the benchmark systems\n");
+		return -1;
+	}
+
+	if (!RunLayout(false, opt.iterations, &perType) || !RunLayout(true, opt.iterations, &archetype))
+		return -1;
+
+	printf("%llu entities, %u workers, %u frames\n\n", (unsigned long long)opt.iterations, E_JobWorkerThreads(), BENCH_FRAMES);
+	printf("%-22s %14s %14s\n", "ms", "per-type", "archetype");
+	printf("%-22s %14.03f %14.03f\n", "create + commit", perType.create, archetype.create);
+	printf("%-22s %14.03f %14.03f\n", "2 types / frame", perType.integrate, archetype.integrate);
+	printf("%-22s %14.03f %14.03f\n", "1 type / frame", perType.damp, archetype.damp);
+	printf("%-22s %14.03f %14.03f\n", "E_ComponentPtrS all", perType.lookup, archetype.lookup);
+	printf("%-22s %14.03f %14.03f\n", "add + commit", perType.add, archetype.add);
+	printf("%-22s %14.03f %14.03f\n", "remove + commit", perType.remove, archetype.remove);
+
+	E_TermECSystems();
+	E_TermIOSystem();
+	E_TermEventSystem();
+	E_TermJobSystem();
+	Bench_Term();
+
+	return 0;
+}
+
+static void
+Integrate(void **comp, const float *dt)
+{
+	struct BenchPosition *pos = comp[0];
+	const struct BenchVelocity *vel = comp[1];
+
+	pos->x += vel->x * *dt;
+	pos->y += vel->y * *dt;
+	pos->z += vel->z * *dt;
+}
+
+static void
+Damp(void **comp, const float *dt)
+{
+	struct BenchVelocity *vel = comp[0];
+
+	vel->x -= vel->x * *dt;
+	vel->y -= vel->y * *dt;
+	vel->z -= vel->z * *dt;
+}
+
+static bool
+RunLayout(bool archetypes, uint64_t count, struct NeLayoutResult *r)
+{
+	NeCompTypeId types[4];
+	float dt = 1.f / 60.f;
+
+	struct NeScene *s = Bench_CreateScene(archetypes);
+	if (!s)
+		return false;
+
+	NeEntityHandle *entities = Sys_Alloc(sizeof(*entities), count, MH_System);
+	if (!entities)
+		return false;
+
+	uint64_t start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i) {
+		uint8_t typeCount = 0;
+		types[typeCount++] = f_position;
+		types[typeCount++] = f_velocity;
+
+		if (!(i % 4))
+			types[typeCount++] = f_mass;
+
+		if (!(i % 3))
+			types[typeCount++] = f_tag;
+
+		entities[i] = E_CreateEntityWithArgsS(s, NULL, types, NULL, typeCount);
+	}
+	Scn_Commit(s);
+	r->create = Bench_Seconds(start, Sys_Time()) * 1000.0;
+	Bench_ResetFrameHeap();
+
+	const uint64_t integrate = Rt_HashString(BENCH_INTEGRATE), damp = Rt_HashString(BENCH_DAMP);
+
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i)
+		E_ExecuteSystemS(s, integrate, &dt);
+	r->integrate = Bench_Seconds(start, Sys_Time()) * 1000.0 / BENCH_FRAMES;
+
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i)
+		E_ExecuteSystemS(s, damp, &dt);
+	r->damp = Bench_Seconds(start, Sys_Time()) * 1000.0 / BENCH_FRAMES;
+
+	float sum = 0.f;
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i) {
+		const struct BenchPosition *pos = E_ComponentPtrS(s, E_GetComponentHandle(entities[i], f_position));
+		sum += pos->x;
+	}
+	r->lookup = Bench_Seconds(start, Sys_Time()) * 1000.0;
+
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		if (i % 4)
+			E_AddNewComponentS(s, entities[i], f_mass, NULL);
+	Scn_Commit(s);
+	r->add = Bench_Seconds(start, Sys_Time()) * 1000.0;
+	Bench_ResetFrameHeap();
+
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		if (i % 4)
+			E_RemoveComponentS(s, entities[i], f_mass);
+	Scn_Commit(s);
+	r->remove = Bench_Seconds(start, Sys_Time()) * 1000.0;
+	Bench_ResetFrameHeap();
+
+	// keep the lookup loop from being optimized out
+	if (sum != sum)
+		printf("NaN\n");
+
+	Sys_Free(entities);
+	Bench_DestroyScene(s);
+
+	return true;
+}
+
+/* NekoEngine
+ *
+ * ArchetypeBenchmark.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
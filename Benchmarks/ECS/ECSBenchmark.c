@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Engine/IO.h>
+#include <Engine/Job.h>
+#include <Engine/Event.h>
+#include <Engine/Config.h>
+#include <Engine/ECSystem.h>
+#include <Scene/Scene.h>
+#include <System/Memory.h>
+
+#include "Benchmark.h"
+#include "Engine/ECS.h"
+
+#define BENCH_FRAMES		100
+#define BENCH_SYSTEM		"Bench_Integrate"
+#define DEFAULT_ITERATIONS	100000
+
+/*
+ * Every entity has a position, three out of four have a velocity and one out of four also
+ * has the mass the integration system requires. The legacy path is the filter that ran
+ * before every multi-component system execution, followed by a component lookup per
+ * entity and type; the query path executes the system through its cached query.
+ */
+
+struct BenchPosition
+{
+	NE_COMPONENT_BASE;
+	float x, y, z;
+};
+
+struct BenchVelocity
+{
+	NE_COMPONENT_BASE;
+	float x, y, z;
+};
+
+struct BenchMass
+{
+	NE_COMPONENT_BASE;
+	float invMass;
+};
+
+struct NeLegacyArgs
+{
+	struct NeScene *s;
+	const struct NeArray *entities;
+	float dt;
+};
+
+static NeCompTypeId f_types[3];
+
+static void Integrate(void **comp, const float *dt);
+static void FilterEntities(struct NeScene *s, struct NeArray *ent);
+static void LegacyExec(int worker, uint64_t begin, uint64_t end, struct NeLegacyArgs *args);
+
+int
+main(int argc, char *argv[])
+{
+	struct NeBenchOptions opt = { .iterations = DEFAULT_ITERATIONS };
+	if (!Bench_Init(argc, argv, &opt))
+		return -1;
+
+	E_SetCVarI32("Engine_MaxJobWorkers", (int32_t)opt.maxWorkers);
+	if (!E_InitJobSystem() || !E_InitEventSystem() || !E_InitIOSystem() || !E_InitECSystems()) {
+		fprintf(stderr, "Failed to initialize the engine\n");
+		return -1;
+	}
+
+	if (!E_RegisterComponent("BenchPosition", sizeof(struct BenchPosition), 16, NULL, NULL, NULL, &f_types[0]) ||
+			!E_RegisterComponent("BenchVelocity", sizeof(struct BenchVelocity), 16, NULL, NULL, NULL, &f_types[1]) ||
+			!E_RegisterComponent("BenchMass", sizeof(struct BenchMass), 16, NULL, NULL, NULL, &f_types[2]) ||
+			!E_RegisterSystemId(BENCH_SYSTEM, ECSYS_GROUP_MANUAL_HASH, f_types, 3, (NeECSysExecProc)Integrate, 0, false)) {
+		fprintf(stderr, "Failed to register the benchmark components\n");
+		return -1;
+	}
+
+	struct NeScene *s = Bench_CreateScene(false);
+	if (!s)
+		return -1;
+
+	for (uint64_t i = 0; i < opt.iterations; ++i) {
+		const uint8_t count = (i % 4) ? ((i % 2) ? 2 : 3) : 1;
+		E_CreateEntityWithArgsS(s, NULL, f_types, NULL, count);
+	}
+
+	uint64_t start = Sys_Time();
+	Scn_Commit(s);
+	const double commit = Bench_Seconds(start, Sys_Time());
+
+	struct NeArray entities;
+	Rt_InitPtrArray(&entities, opt.iterations, MH_System);
+
+	float dt = 1.f / 60.f;
+	struct NeLegacyArgs la = { .s = s, .entities = &entities, .dt = dt };
+	double filter = 0.0, legacy = 0.0;
+
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i) {
+		start = Sys_Time();
+
+		Sys_AtomicLockRead(&s->lock.comp);
+		FilterEntities(s, &entities);
+		const uint64_t filtered = Sys_Time();
+
+		E_ParallelFor(0, entities.count, 0, (NeParallelForProc)LegacyExec, &la);
+		Sys_AtomicUnlockRead(&s->lock.comp);
+
+		const uint64_t end = Sys_Time();
+		filter += Bench_Seconds(start, filtered);
+		legacy += Bench_Seconds(start, end);
+	}
+
+	const uint64_t hash = Rt_HashString(BENCH_SYSTEM);
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i)
+		E_ExecuteSystemS(s, hash, &dt);
+	const double query = Bench_Seconds(start, Sys_Time());
+
+	printf("%llu entities, %llu matching, %u workers, %u frames\n\n", (unsigned long long)opt.iterations,
+			(unsigned long long)entities.count, E_JobWorkerThreads(), BENCH_FRAMES);
+	printf("%-10s %14s %14s\n", "mode", "ms/frame", "filter ms");
+	printf("%-10s %14.03f %14.03f\n", "legacy", legacy * 1000.0 / BENCH_FRAMES, filter * 1000.0 / BENCH_FRAMES);
+	printf("%-10s %14.03f %14.03f\n", "query", query * 1000.0 / BENCH_FRAMES, 0.0);
+	printf("\ncommit: %.03f ms, including the query update\n", commit * 1000.0);
+
+	Rt_TermArray(&entities);
+	Bench_DestroyScene(s);
+
+	E_TermECSystems();
+	E_TermIOSystem();
+	E_TermEventSystem();
+	E_TermJobSystem();
+	Bench_Term();
+
+	return 0;
+}
+
+static void
+Integrate(void **comp, const float *dt)
+{
+	struct BenchPosition *pos = comp[0];
+	const struct BenchVelocity *vel = comp[1];
+	const struct BenchMass *mass = comp[2];
+
+	const float t = *dt * mass->invMass;
+	pos->x += vel->x * t;
+	pos->y += vel->y * t;
+	pos->z += vel->z * t;
+}
+
+static void
+FilterEntities(struct NeScene *s, struct NeArray *ent)
+{
+	NeCompTypeId type = f_types[0];
+	size_t minCount = SIZE_MAX;
+
+	for (size_t i = 0; i < NE_ARRAY_SIZE(f_types); ++i) {
+		const size_t count = ((struct NeArray *)Rt_ArrayGet(&s->compData, f_types[i]))->count;
+		if (count >= minCount)
+			continue;
+
+		type = f_types[i];
+		minCount = count;
+	}
+
+	Rt_ClearArray(ent, false);
+	const struct NeArray *components = E_GetAllComponentsS(s, type);
+
+	for (size_t i = 0; i < components->count; ++i) {
+		const struct NeCompBase *comp = Rt_ArrayGet(components, i);
+		if (!comp->_owner || !comp->_valid || !comp->_enabled)
+			continue;
+
+		bool valid = true;
+		for (size_t j = 0; j < NE_ARRAY_SIZE(f_types) && valid; ++j)
+			valid = ECS_GetComponent(s, comp->_owner, f_types[j]) != NULL;
+
+		if (valid)
+			Rt_ArrayAddPtr(ent, comp->_owner);
+	}
+}
+
+static void
+LegacyExec(int worker, uint64_t begin, uint64_t end, struct NeLegacyArgs *args)
+{
+	void *components[NE_ARRAY_SIZE(f_types)];
+
+	for (uint64_t i = begin; i < end; ++i) {
+		NeEntityHandle handle = Rt_ArrayGetPtr(args->entities, i);
+
+		for (size_t j = 0; j < NE_ARRAY_SIZE(f_types); ++j)
+			components[j] = ECS_GetComponent(args->s, handle, f_types[j]);
+
+		Integrate(components, &args->dt);
+	}
+}
+
+/* NekoEngine
+ *
+ * ECSBenchmark.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
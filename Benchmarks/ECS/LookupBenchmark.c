@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Engine/IO.h>
+#include <Engine/Job.h>
+#include <Engine/Event.h>
+#include <Engine/Config.h>
+#include <Engine/Entity.h>
+#include <Engine/ECSystem.h>
+#include <Scene/Scene.h>
+#include <System/Memory.h>
+
+#include "Benchmark.h"
+#include "Engine/ECS.h"
+
+#define BENCH_TYPES			64
+#define BENCH_ENTITIES		10000
+#define DEFAULT_ITERATIONS	10000000
+
+/*
+ * Looks up components by type on entities with 10, 30 and 64 components each; counts above
+ * MAX_ENTITY_COMPONENTS are skipped. The entities get their types in a shuffled order and every
+ * lookup asks for a different type. The scan column is the linear search through the entity's
+ * components that E_GetComponent used before, the index column is E_GetComponentHandle
+ * followed by E_ComponentPtrS, which is what E_GetComponent does now.
+ */
+
+struct BenchComp
+{
+	NE_COMPONENT_BASE;
+	uint64_t value;
+};
+
+static NeCompTypeId f_types[BENCH_TYPES];
+
+static bool Run(uint32_t compCount, uint64_t lookups);
+static inline void *ScanLookup(struct NeScene *s, NeEntityHandle handle, NeCompTypeId type);
+
+int
+main(int argc, char *argv[])
+{
+	char name[32];
+	const uint32_t counts[] = { 10, 30, 64 };
+	struct NeBenchOptions opt = { .iterations = DEFAULT_ITERATIONS };
+	if (!Bench_Init(argc, argv, &opt))
+		return -1;
+
+	E_SetCVarI32("Engine_MaxJobWorkers", (int32_t)opt.maxWorkers);
+	if (!E_InitJobSystem() || !E_InitEventSystem() || !E_InitIOSystem() || !E_InitECSystems()) {
+		fprintf(stderr, "Failed to initialize the engine\n");
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < BENCH_TYPES; ++i) {
+		snprintf(name, sizeof(name), "BenchComp%u", i);
+		if (!E_RegisterComponent(name, sizeof(struct BenchComp), 16, NULL, NULL, NULL, &f_types[i])) {
+			fprintf(stderr, "Failed to register the benchmark components\n");
+			return -1;
+		}
+	}
+
+	printf("%u entities, %llu lookups\n\n", BENCH_ENTITIES, (unsigned long long)opt.iterations);
+	printf("%-12s %16s %16s\n", "components", "scan Mlookup/s", "index Mlookup/s");
+
+	for (size_t i = 0; i < NE_ARRAY_SIZE(counts); ++i) {
+		if (counts[i] > MAX_ENTITY_COMPONENTS) {
+			printf("%-12u %33s\n", counts[i], "skipped, over MAX_ENTITY_COMPONENTS");
+			continue;
+		}
+
+		if (!Run(counts[i], opt.iterations))
+			return -1;
+	}
+
+	E_TermECSystems();
+	E_TermIOSystem();
+	E_TermEventSystem();
+	E_TermJobSystem();
+	Bench_Term();
+
+	return 0;
+}
+
+static bool
+Run(uint32_t compCount, uint64_t lookups)
+{
+	NeCompTypeId types[BENCH_TYPES];
+	uint64_t sum = 0;
+
+	struct NeScene *s = Bench_CreateScene(false);
+	if (!s)
+		return false;
+
+	NeEntityHandle *entities = Sys_Alloc(sizeof(*entities), BENCH_ENTITIES, MH_System);
+	if (!entities)
+		return false;
+
+	memcpy(types, f_types, sizeof(types));
+	srand(compCount);
+
+	for (uint32_t i = 0; i < BENCH_ENTITIES; ++i) {
+		for (uint32_t j = compCount - 1; j > 0; --j) {
+			const uint32_t k = (uint32_t)rand() % (j + 1);
+			const NeCompTypeId t = types[j];
+			types[j] = types[k];
+			types[k] = t;
+		}
+
+		entities[i] = E_CreateEntityWithArgsS(s, NULL, types, NULL, (uint8_t)compCount);
+	}
+	Scn_Commit(s);
+	Bench_ResetFrameHeap();
+
+	uint64_t start = Sys_Time();
+	for (uint64_t i = 0; i < lookups; ++i) {
+		const struct BenchComp *comp = ScanLookup(s, entities[i % BENCH_ENTITIES], f_types[(i * 7) % compCount]);
+		sum += comp->value;
+	}
+	const double scan = Bench_Seconds(start, Sys_Time());
+
+	start = Sys_Time();
+	for (uint64_t i = 0; i < lookups; ++i) {
+		const NeCompHandle handle = E_GetComponentHandle(entities[i % BENCH_ENTITIES], f_types[(i * 7) % compCount]);
+		const struct BenchComp *comp = E_ComponentPtrS(s, handle);
+		sum += comp->value;
+	}
+	const double index = Bench_Seconds(start, Sys_Time());
+
+	printf("%-12u %16.02f %16.02f\n", compCount, (double)lookups / scan * 1e-6, (double)lookups / index * 1e-6);
+
+	// keep the lookups from being optimized out
+	if (sum)
+		printf("%llu\n", (unsigned long long)sum);
+
+	Sys_Free(entities);
+	Bench_DestroyScene(s);
+
+	return true;
+}
+
+static inline void *
+ScanLookup(struct NeScene *s, NeEntityHandle handle, NeCompTypeId type)
+{
+	const struct NeEntity *ent = ECS_EntityPtr(handle);
+	for (uint8_t i = 0; i < ent->compCount; ++i)
+		if (ent->comp[i].type == type)
+			return E_ComponentPtrS(s, ent->comp[i].handle);
+
+	return NULL;
+}
+
+/* NekoEngine
+ *
+ * LookupBenchmark.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
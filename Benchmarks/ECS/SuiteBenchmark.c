@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include <Engine/IO.h>
+#include <Engine/Job.h>
+#include <Engine/Event.h>
+#include <Engine/Config.h>
+#include <Engine/Entity.h>
+#include <Engine/Version.h>
+#include <Engine/ECSystem.h>
+#include <Scene/Scene.h>
+#include <System/Memory.h>
+
+#include "Benchmark.h"
+#include "Engine/ECS.h"
+
+#define BENCH_FRAMES		10
+#define BENCH_INTEGRATE		"Bench_Integrate"
+#define BENCH_DAMP			"Bench_Damp"
+#define BENCH_EVENT			"Bench_Event"
+#define BENCH_MESSAGE		1
+#define BENCH_MESSAGES		100000
+#define BENCH_NAME_SIZE		16
+#define DEFAULT_ITERATIONS	1000000
+
+/*
+ * Runs the core ECS operations at 1k, 10k, 100k and 1M entities, up to the -n count, for both component storage
+ * layouts and writes the results to stdout as JSON, so runs of different engine revisions can be compared; the log
+ * goes to Bench_LogFile. Every entity has a name, a position and a velocity. The operations that change the scene
+ * include the commit that applies the change; system iteration is averaged over BENCH_FRAMES executions. The message
+ * bus frames send BENCH_MESSAGES messages from all workers to entities spread over the scene, then deliver them.
+ */
+
+struct BenchPosition
+{
+	NE_COMPONENT_BASE;
+	float x, y, z;
+};
+
+struct BenchVelocity
+{
+	NE_COMPONENT_BASE;
+	float x, y, z;
+};
+
+struct BenchMass
+{
+	NE_COMPONENT_BASE;
+	float invMass;
+	uint32_t messages;
+};
+
+struct NeBenchMessages
+{
+	const NeEntityHandle *entities;
+	uint64_t count;
+};
+
+struct NeBenchRun
+{
+	const char *layout;
+	uint64_t entities;
+	bool first;
+};
+
+static NeCompTypeId f_position, f_velocity, f_mass;
+static _Atomic uint64_t f_events;
+
+static void Integrate(void **comp, const float *dt);
+static void Damp(void **comp, const float *dt);
+static void MessageHandler(struct BenchMass *mass, uint32_t msg, const void *data);
+static void EventHandler(void *user, void *args);
+static void SendMessages(int worker, uint64_t begin, uint64_t end, const struct NeBenchMessages *args);
+static bool RunLayout(bool archetypes, uint64_t count, char (*names)[BENCH_NAME_SIZE], bool *first);
+static void Report(struct NeBenchRun *run, const char *name, uint64_t start, uint64_t end, uint64_t ops);
+static void EndFrame(void);
+
+int
+main(int argc, char *argv[])
+{
+	const uint64_t counts[] = { 1000, 10000, 100000, 1000000 };
+	struct NeBenchOptions opt = { .iterations = DEFAULT_ITERATIONS };
+	if (!Bench_Init(argc, argv, &opt))
+		return -1;
+
+	E_SetCVarI32("Engine_MaxJobWorkers", (int32_t)opt.maxWorkers);
+	if (!E_InitJobSystem() || !E_InitEventSystem() || !E_InitIOSystem() || !E_InitEntities() || !E_InitECSystems()) {
+		fprintf(stderr, "Failed to initialize the engine\n");
+		return -1;
+	}
+
+	if (!E_RegisterComponent("BenchPosition", sizeof(struct BenchPosition), 16, NULL, NULL, NULL, &f_position) ||
+			!E_RegisterComponent("BenchVelocity", sizeof(struct BenchVelocity), 16, NULL, NULL, NULL, &f_velocity) ||
+			!E_RegisterComponent("BenchMass", sizeof(struct BenchMass), 16, NULL, (NeCompMessageHandlerProc)MessageHandler, NULL, &f_mass)) {
+		fprintf(stderr, "Failed to register the benchmark components\n");
+		return -1;
+	}
+
+	const NeCompTypeId integrateTypes[] = { f_position, f_velocity };
+	if (!E_RegisterSystemId(BENCH_INTEGRATE, ECSYS_GROUP_MANUAL_HASH, integrateTypes, 2, (NeECSysExecProc)Integrate, 0, false) ||
+			!E_RegisterSystemId(BENCH_DAMP, ECSYS_GROUP_MANUAL_HASH, &f_velocity, 1, (NeECSysExecProc)Damp, 0, false)) {
+		fprintf(stderr, "Failed to register the benchmark systems\n");
+		return -1;
+	}
+
+	const uint64_t handler = E_RegisterHandler(BENCH_EVENT, EventHandler, NULL);
+
+	const uint64_t maxCount = opt.iterations < counts[NE_ARRAY_SIZE(counts) - 1] ? opt.iterations : counts[NE_ARRAY_SIZE(counts) - 1];
+	char (*names)[BENCH_NAME_SIZE] = Sys_Alloc(BENCH_NAME_SIZE, maxCount, MH_System);
+	if (!names)
+		return -1;
+
+	for (uint64_t i = 0; i < maxCount; ++i)
+		snprintf(names[i], BENCH_NAME_SIZE, "Bench%llu", (unsigned long long)i);
+
+	printf("{\n");
+	printf("\t\"engine\": \"%d.%d.%d.%d\",\n", E_VER_MAJOR, E_VER_MINOR, E_VER_BUILD, E_VER_REVISION);
+	printf("\t\"workers\": %u,\n", E_JobWorkerThreads());
+	printf("\t\"frames\": %u,\n", BENCH_FRAMES);
+	printf("\t\"results\": [");
+
+	bool first = true;
+	for (size_t i = 0; i < NE_ARRAY_SIZE(counts) && counts[i] <= maxCount; ++i)
+		if (!RunLayout(false, counts[i], names, &first) || !RunLayout(true, counts[i], names, &first))
+			return -1;
+
+	printf("\n\t]\n}\n");
+
+	Sys_Free(names);
+
+	E_UnregisterHandler(handler);
+	E_TermECSystems();
+	E_TermEntities();
+	E_TermIOSystem();
+	E_TermEventSystem();
+	E_TermJobSystem();
+	Bench_Term();
+
+	return 0;
+}
+
+static void
+Integrate(void **comp, const float *dt)
+{
+	struct BenchPosition *pos = comp[0];
+	const struct BenchVelocity *vel = comp[1];
+
+	pos->x += vel->x * *dt;
+	pos->y += vel->y * *dt;
+	pos->z += vel->z * *dt;
+}
+
+static void
+Damp(void **comp, const float *dt)
+{
+	struct BenchVelocity *vel = comp[0];
+
+	vel->x -= vel->x * *dt;
+	vel->y -= vel->y * *dt;
+	vel->z -= vel->z * *dt;
+}
+
+static void
+MessageHandler(struct BenchMass *mass, uint32_t msg, const void *data)
+{
+	mass->messages += msg;
+}
+
+static void
+EventHandler(void *user, void *args)
+{
+	atomic_fetch_add_explicit(&f_events, 1, memory_order_relaxed);
+}
+
+static void
+SendMessages(int worker, uint64_t begin, uint64_t end, const struct NeBenchMessages *args)
+{
+	for (uint64_t i = begin; i < end; ++i)
+		E_SendMessage(args->entities[(i * 2654435761u) % args->count], BENCH_MESSAGE, NULL);
+}
+
+static bool
+RunLayout(bool archetypes, uint64_t count, char (*names)[BENCH_NAME_SIZE], bool *first)
+{
+	const NeCompTypeId types[] = { f_position, f_velocity };
+	struct NeBenchRun run = { .layout = archetypes ? "archetype" : "per-type", .entities = count, .first = *first };
+	float dt = 1.f / 60.f;
+	uint64_t start;
+
+	struct NeScene *s = Bench_CreateScene(archetypes);
+	if (!s)
+		return false;
+
+	NeEntityHandle *entities = Sys_Alloc(sizeof(*entities), count, MH_System);
+	if (!entities)
+		return false;
+
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		entities[i] = E_CreateEntityWithArgsS(s, names[i], types, NULL, 2);
+	Scn_Commit(s);
+	Report(&run, "entity_create", start, Sys_Time(), count);
+	EndFrame();
+
+	const uint64_t integrate = Rt_HashString(BENCH_INTEGRATE), damp = Rt_HashString(BENCH_DAMP);
+
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i)
+		E_ExecuteSystemS(s, damp, &dt);
+	Report(&run, "system_1_type", start, Sys_Time(), count * BENCH_FRAMES);
+
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i)
+		E_ExecuteSystemS(s, integrate, &dt);
+	Report(&run, "system_2_types", start, Sys_Time(), count * BENCH_FRAMES);
+
+	uint64_t found = 0;
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		found += E_FindEntityS(s, names[i]) == entities[i];
+	Report(&run, "find_entity", start, Sys_Time(), count);
+
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		E_AddNewComponentS(s, entities[i], f_mass, NULL);
+	Scn_Commit(s);
+	Report(&run, "component_add", start, Sys_Time(), count);
+	EndFrame();
+
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		E_SendMessage(entities[i], BENCH_MESSAGE, NULL);
+	Report(&run, "message_send", start, Sys_Time(), count);
+
+	start = Sys_Time();
+	E_DistributeMessages();
+	E_ProcessMessages(s);
+	Report(&run, "message_distribute", start, Sys_Time(), count);
+
+	const struct NeBenchMessages bm = { .entities = entities, .count = count };
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i) {
+		E_ParallelFor(0, BENCH_MESSAGES, 0, (NeParallelForProc)SendMessages, (void *)&bm);
+		E_DistributeMessages();
+		E_ProcessMessages(s);
+	}
+	Report(&run, "message_bus_frame", start, Sys_Time(), (uint64_t)BENCH_MESSAGES * BENCH_FRAMES);
+
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		E_RemoveComponentS(s, entities[i], f_mass);
+	Scn_Commit(s);
+	Report(&run, "component_remove", start, Sys_Time(), count);
+	EndFrame();
+
+	atomic_store(&f_events, 0);
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		E_Broadcast(BENCH_EVENT, NULL);
+	E_ProcessEvents();
+	Report(&run, "event_broadcast", start, Sys_Time(), count);
+	Bench_ResetFrameHeap();
+
+	start = Sys_Time();
+	for (uint64_t i = 0; i < count; ++i)
+		E_DestroyEntityS(s, entities[i]);
+	Scn_Commit(s);
+	Report(&run, "entity_destroy", start, Sys_Time(), count);
+	EndFrame();
+
+	*first = run.first;
+
+	// every operation has to reach every entity
+	if (found != count || atomic_load(&f_events) != count)
+		fprintf(stderr, "%s, %llu entities: found %llu names, received %llu events\n", run.layout, (unsigned long long)count,
+				(unsigned long long)found, (unsigned long long)atomic_load(&f_events));
+
+	Sys_Free(entities);
+	Bench_DestroyScene(s);
+
+	return true;
+}
+
+static void
+Report(struct NeBenchRun *run, const char *name, uint64_t start, uint64_t end, uint64_t ops)
+{
+	const double ms = Bench_Seconds(start, end) * 1000.0;
+
+	printf("%s\n\t\t{ \"benchmark\": \"%s\", \"layout\": \"%s\", \"entities\": %llu, \"ms\": %.04f, \"ns_per_op\": %.02f }",
+			run->first ? "" : ",", name, run->layout, (unsigned long long)run->entities, ms, ms * 1e6 / (double)ops);
+	run->first = false;
+}
+
+static void
+EndFrame(void)
+{
+	// the commit broadcasts an event for every component it adds, these are not part of the measurements
+	E_ProcessEvents();
+	Bench_ResetFrameHeap();
+}
+
+/* NekoEngine
+ *
+ * SuiteBenchmark.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include <Engine/Job.h>
+#include <Engine/Config.h>
+#include <System/Thread.h>
+
+#include "Benchmark.h"
+#include "LegacyJob.h"
+
+#define JOB_WORK			64
+#define SPAWN_COUNT			64
+#define SPAWN_WAVE			8
+#define DISPATCH_BATCH		256
+#define DISPATCH_SYNC		64
+#define DEFAULT_ITERATIONS	1000000
+
+struct NeScheduler
+{
+	const char *name;
+	bool (*init)(void);
+	void (*term)(void);
+	uint64_t (*execute)(NeJobProc proc, void *args, NeJobCompletedProc completed, void *completionArgs);
+	uint64_t (*dispatch)(uint64_t count, NeJobProc proc, void **args, NeJobCompletedProc completed, void *completionArgs);
+	void (*parallelFor)(uint64_t begin, uint64_t end, uint64_t grain, NeParallelForProc proc, void *userData);
+};
+
+static const struct NeScheduler f_schedulers[] =
+{
+	{ "legacy", LJ_InitJobSystem, LJ_TermJobSystem, LJ_ExecuteJob, LJ_DispatchJobs, NULL },
+	{ "stealing", E_InitJobSystem, E_TermJobSystem, E_ExecuteJob, E_DispatchJobs, E_ParallelFor }
+};
+
+static const struct NeScheduler *f_sched;
+static NE_ALIGN(64) _Atomic uint64_t f_completed;
+
+static void WorkJob(int worker, void *args);
+static void SpawnJob(int worker, void *args);
+static void WorkRange(int worker, uint64_t begin, uint64_t end, void *userData);
+static inline void WaitForJobs(uint64_t count);
+static double ExecuteTest(uint64_t count);
+static double DispatchTest(uint64_t count);
+static double SpawnTest(uint64_t count);
+static double ParallelForTest(uint64_t count);
+
+int
+main(int argc, char *argv[])
+{
+	struct NeBenchOptions opt = { .iterations = DEFAULT_ITERATIONS };
+	if (!Bench_Init(argc, argv, &opt))
+		return -1;
+
+	const struct {
+		const char *name;
+		double (*proc)(uint64_t count);
+	} tests[] = {
+		{ "execute", ExecuteTest },
+		{ "dispatch", DispatchTest },
+		{ "spawn", SpawnTest },
+		{ "for", ParallelForTest }
+	};
+
+	printf("%-10s %8s %-10s %14s\n", "scheduler", "workers", "test", "jobs/s");
+
+	for (uint32_t workers = 1; ; workers = workers * 2 < opt.maxWorkers ? workers * 2 : opt.maxWorkers) {
+		for (size_t i = 0; i < NE_ARRAY_SIZE(f_schedulers); ++i) {
+			f_sched = &f_schedulers[i];
+
+			E_SetCVarI32("Engine_MaxJobWorkers", (int32_t)workers);
+			if (!f_sched->init()) {
+				fprintf(stderr, "Failed to initialize the %s scheduler\n", f_sched->name);
+				return -1;
+			}
+
+			for (size_t j = 0; j < NE_ARRAY_SIZE(tests); ++j) {
+				const double seconds = tests[j].proc(opt.iterations);
+				if (seconds < 0.0)
+					continue;
+
+				printf("%-10s %8u %-10s %14.0f\n", f_sched->name, workers, tests[j].name, (double)opt.iterations / seconds);
+			}
+
+			f_sched->term();
+		}
+
+		if (workers == opt.maxWorkers)
+			break;
+	}
+
+	Bench_Term();
+
+	return 0;
+}
+
+static void
+WorkJob(int worker, void *args)
+{
+	volatile uint32_t acc = 0;
+	for (uint32_t i = 0; i < JOB_WORK; ++i)
+		acc += i;
+
+	atomic_fetch_add_explicit(&f_completed, 1, memory_order_relaxed);
+}
+
+static void
+SpawnJob(int worker, void *args)
+{
+	for (uint32_t i = 0; i < SPAWN_COUNT; ++i)
+		f_sched->execute(WorkJob, NULL, NULL, NULL);
+}
+
+static void
+WorkRange(int worker, uint64_t begin, uint64_t end, void *userData)
+{
+	for (uint64_t i = begin; i < end; ++i)
+		WorkJob(worker, userData);
+}
+
+static inline void
+WaitForJobs(uint64_t count)
+{
+	while (atomic_load_explicit(&f_completed, memory_order_acquire) < count)
+		Sys_Yield();
+}
+
+static double
+ExecuteTest(uint64_t count)
+{
+	atomic_store(&f_completed, 0);
+
+	const uint64_t start = Sys_Time();
+
+	for (uint64_t i = 0; i < count; ++i)
+		f_sched->execute(WorkJob, NULL, NULL, NULL);
+	WaitForJobs(count);
+
+	return Bench_Seconds(start, Sys_Time());
+}
+
+static double
+DispatchTest(uint64_t count)
+{
+	uint64_t submitted = 0, batches = 0;
+	atomic_store(&f_completed, 0);
+
+	const uint64_t start = Sys_Time();
+
+	while (submitted < count) {
+		const uint64_t batch = count - submitted < DISPATCH_BATCH ? count - submitted : DISPATCH_BATCH;
+		f_sched->dispatch(batch, WorkJob, NULL, NULL, NULL);
+		submitted += batch;
+
+		// the dispatch arguments live in the frame heap
+		if (++batches % DISPATCH_SYNC)
+			continue;
+
+		WaitForJobs(submitted);
+		Bench_ResetFrameHeap();
+	}
+	WaitForJobs(count);
+
+	const uint64_t end = Sys_Time();
+	Bench_ResetFrameHeap();
+
+	return Bench_Seconds(start, end);
+}
+
+static double
+SpawnTest(uint64_t count)
+{
+	const uint64_t parents = count / SPAWN_COUNT;
+	atomic_store(&f_completed, 0);
+
+	const uint64_t start = Sys_Time();
+
+	/*
+	 * Submit the parents in waves; a worker that fills the legacy scheduler's fixed size ring
+	 * from inside a job waits for space forever if it's the only one left to consume it.
+	 */
+	for (uint64_t i = 0; i < parents; i += SPAWN_WAVE) {
+		const uint64_t wave = parents - i < SPAWN_WAVE ? parents - i : SPAWN_WAVE;
+		for (uint64_t j = 0; j < wave; ++j)
+			f_sched->execute(SpawnJob, NULL, NULL, NULL);
+		WaitForJobs((i + wave) * SPAWN_COUNT);
+	}
+
+	return Bench_Seconds(start, Sys_Time());
+}
+
+static double
+ParallelForTest(uint64_t count)
+{
+	if (!f_sched->parallelFor)
+		return -1.0;
+
+	atomic_store(&f_completed, 0);
+
+	const uint64_t start = Sys_Time();
+	f_sched->parallelFor(0, count, 0, WorkRange, NULL);
+	const uint64_t end = Sys_Time();
+
+	Bench_ResetFrameHeap();
+
+	return Bench_Seconds(start, end);
+}
+
+/* NekoEngine
+ *
+ * JobBenchmark.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
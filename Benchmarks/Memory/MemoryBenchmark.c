@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Engine/Job.h>
+#include <Engine/Config.h>
+#include <System/Memory.h>
+
+#include "Benchmark.h"
+
+#define MAX_COMPONENTS		6
+#define SCRIPT_ALLOCS		8
+#define DEFAULT_ITERATIONS	100000
+
+/*
+ * A scene load, as far as the allocator is concerned: every entity gets its own block, a
+ * component pointer array that grows one component at a time, the components themselves,
+ * a resource name and, now and then, an asset buffer too large for the pool. The scripts
+ * attached to it allocate and grow small objects. Unloading frees everything in a different
+ * order than it was allocated, on the main thread.
+ */
+
+struct NeBenchEntity
+{
+	void *entity, *name, *asset;
+	void **components;
+	void *script[SCRIPT_ALLOCS];
+	uint32_t componentCount;
+};
+
+struct NeAllocator
+{
+	const char *name;
+	bool pool;
+};
+
+static const struct NeAllocator f_allocators[] =
+{
+	{ "system", false },
+	{ "pool", true }
+};
+
+static struct NeBenchEntity *f_entities;
+static NE_ALIGN(64) _Atomic uint64_t f_operations;
+
+static inline uint32_t Random(uint32_t *state);
+static void LoadRange(int worker, uint64_t begin, uint64_t end, void *userData);
+static uint64_t Unload(uint64_t count);
+static double LoadTest(uint64_t count, uint64_t *operations);
+
+int
+main(int argc, char *argv[])
+{
+	struct NeBenchOptions opt = { .iterations = DEFAULT_ITERATIONS };
+	if (!Bench_Init(argc, argv, &opt))
+		return -1;
+
+	f_entities = calloc(opt.iterations, sizeof(*f_entities));
+	if (!f_entities)
+		return -1;
+
+	printf("%-10s %8s %14s %14s\n", "allocator", "workers", "ops/s", "entities/s");
+
+	for (uint32_t workers = 1; ; workers = workers * 2 < opt.maxWorkers ? workers * 2 : opt.maxWorkers) {
+		for (size_t i = 0; i < NE_ARRAY_SIZE(f_allocators); ++i) {
+			E_SetCVarBln("Engine_PoolAllocator", f_allocators[i].pool);
+			E_SetCVarI32("Engine_MaxJobWorkers", (int32_t)workers);
+
+			// the setting is read when the workers initialize their heaps
+			if (!E_InitJobSystem()) {
+				fprintf(stderr, "Failed to initialize the job system\n");
+				return -1;
+			}
+
+			uint64_t operations = 0;
+			const double seconds = LoadTest(opt.iterations, &operations);
+			printf("%-10s %8u %14.0f %14.0f\n", f_allocators[i].name, workers,
+					(double)operations / seconds, (double)opt.iterations / seconds);
+
+			E_TermJobSystem();
+		}
+
+		if (workers == opt.maxWorkers)
+			break;
+	}
+
+	struct NeMemoryPoolStatistics ps;
+	Sys_PoolStatistics(&ps);
+	printf("\npool: %llu spans, %llu B reserved, %.02f%% internal / %.02f%% external fragmentation after unload\n",
+			(unsigned long long)ps.spans, (unsigned long long)ps.reserved,
+			ps.internalFragmentation * 100.0, ps.externalFragmentation * 100.0);
+
+	free(f_entities);
+	Bench_Term();
+
+	return 0;
+}
+
+static inline uint32_t
+Random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void
+LoadRange(int worker, uint64_t begin, uint64_t end, void *userData)
+{
+	uint64_t operations = 0;
+
+	for (uint64_t i = begin; i < end; ++i) {
+		struct NeBenchEntity *e = &f_entities[i];
+		uint32_t rng = (uint32_t)i * 2654435761u + 1;
+
+		e->entity = Sys_Alloc(192, 1, MH_Scene);
+		e->componentCount = 2 + Random(&rng) % (MAX_COMPONENTS - 1);
+		for (uint32_t j = 0; j < e->componentCount; ++j) {
+			e->components = Sys_ReAlloc(e->components, j + 1, sizeof(*e->components), MH_Scene);
+			e->components[j] = Sys_Alloc(64u << (Random(&rng) % 4), 1, MH_Scene);
+		}
+
+		e->name = Sys_Alloc(32 + Random(&rng) % 96, 1, MH_Asset);
+		if (!(Random(&rng) % 16))
+			e->asset = Sys_Alloc(4096 + Random(&rng) % (60 * 1024), 1, MH_Asset);
+
+		for (uint32_t j = 0; j < SCRIPT_ALLOCS; ++j) {
+			const size_t size = 16 + Random(&rng) % 240;
+			e->script[j] = Sys_AllocNoZero(size, 1, MH_Script);
+			if (j % 4)
+				continue;
+
+			e->script[j] = Sys_ReAlloc(e->script[j], size * 2, 1, MH_Script);
+			++operations;
+		}
+
+		operations += 2 + e->componentCount * 2 + (e->asset != NULL) + SCRIPT_ALLOCS;
+	}
+
+	atomic_fetch_add_explicit(&f_operations, operations, memory_order_relaxed);
+}
+
+static uint64_t
+Unload(uint64_t count)
+{
+	uint64_t operations = 0;
+
+	// a prime stride visits every entity, out of allocation order
+	const uint64_t stride = count % 7919 ? 7919 : 1;
+
+	for (uint64_t i = 0, idx = 0; i < count; ++i, idx = (idx + stride) % count) {
+		struct NeBenchEntity *e = &f_entities[idx];
+
+		for (uint32_t j = 0; j < SCRIPT_ALLOCS; ++j)
+			Sys_Free(e->script[j]);
+
+		for (uint32_t j = 0; j < e->componentCount; ++j)
+			Sys_Free(e->components[j]);
+
+		Sys_Free(e->components);
+		Sys_Free(e->name);
+		Sys_Free(e->asset);
+		Sys_Free(e->entity);
+
+		operations += 3 + e->componentCount + (e->asset != NULL) + SCRIPT_ALLOCS;
+		memset(e, 0, sizeof(*e));
+	}
+
+	return operations;
+}
+
+static double
+LoadTest(uint64_t count, uint64_t *operations)
+{
+	atomic_store(&f_operations, 0);
+
+	const uint64_t start = Sys_Time();
+
+	E_ParallelFor(0, count, 0, LoadRange, NULL);
+	const uint64_t unloaded = Unload(count);
+
+	const uint64_t end = Sys_Time();
+
+	*operations = atomic_load(&f_operations) + unloaded;
+	return Bench_Seconds(start, end);
+}
+
+/* NekoEngine
+ *
+ * MemoryBenchmark.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
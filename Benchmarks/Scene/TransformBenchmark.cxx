@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Engine/IO.h>
+#include <Engine/Job.h>
+#include <Engine/Event.h>
+#include <Engine/Config.h>
+#include <Engine/Entity.h>
+#include <Engine/ECSystem.h>
+#include <Scene/Scene.h>
+#include <Scene/Transform.h>
+#include <Scene/Components.h>
+#include <System/Memory.h>
+
+#include "Benchmark.h"
+#include "Engine/ECS.h"
+
+#define BENCH_FRAMES		100
+#define BENCH_RECURSIVE		"Bench_RecursiveTransform"
+#define BENCH_SPINE			16
+#define BENCH_LIMBS			4
+#define BENCH_LIMB			12
+#define BENCH_SKELETON		(BENCH_SPINE + BENCH_LIMBS * BENCH_LIMB)
+#define DEFAULT_ITERATIONS	100000
+
+/*
+ * Compares the depth-first update that ran as a system over the root transforms with the level-ordered update of
+ * Scn_UpdateTransforms. The wide scene has a root with three children for every four entities; the skeleton scene is
+ * made of 64 bone hierarchies, a spine with four limbs hanging from it; the mixed scene has both, and in the single
+ * tree scene every skeleton hangs from one root, so the recursive update has a single root to work with. The roots
+ * are moved every frame, then one in ten of them.
+ */
+
+enum NeSceneShape
+{
+	SHAPE_WIDE,
+	SHAPE_SKELETON,
+	SHAPE_MIXED,
+	SHAPE_TREE,
+	SHAPE_COUNT
+};
+
+struct NeShapeResult
+{
+	double build, recursive, levels, recursiveSparse, levelsSparse;
+};
+
+static const char *f_shapeNames[SHAPE_COUNT] = { "wide", "skeletons", "mixed", "single tree" };
+
+static void RecursiveUpdate(struct NeScene *s, struct NeTransform *t, bool parentChanged);
+static void UpdateRoots(void **comp, struct NeScene *s);
+static bool RunShape(enum NeSceneShape shape, uint64_t count, struct NeShapeResult *r);
+static void LinkWide(struct NeScene *s, const NeEntityHandle *entities, uint64_t count);
+static void LinkSkeleton(struct NeScene *s, const NeEntityHandle *entities, NeEntityHandle root);
+static void MoveRoots(struct NeScene *s, const NeEntityHandle *roots, uint64_t count, uint32_t step, float offset);
+
+int
+main(int argc, char *argv[])
+{
+	struct NeShapeResult r[SHAPE_COUNT];
+	struct NeBenchOptions opt = { .iterations = DEFAULT_ITERATIONS };
+	if (!Bench_Init(argc, argv, &opt))
+		return -1;
+
+	E_SetCVarI32("Engine_MaxJobWorkers", (int32_t)opt.maxWorkers);
+	if (!E_InitJobSystem() || !E_InitEventSystem() || !E_InitIOSystem() || !E_InitECSystems()) {
+		fprintf(stderr, "Failed to initialize the engine\n");
+		return -1;
+	}
+
+	const NeCompTypeId types[] = { NE_TRANSFORM_ID };
+	if (!E_RegisterSystemId(BENCH_RECURSIVE, ECSYS_GROUP_MANUAL_HASH, types, 1, (NeECSysExecProc)UpdateRoots, 0, 0)) {
+		fprintf(stderr, "Failed to register the benchmark system\n");
+		return -1;
+	}
+
+	for (int i = 0; i < SHAPE_COUNT; ++i)
+		if (!RunShape((enum NeSceneShape)i, opt.iterations, &r[i]))
+			return -1;
+
+	printf("~%llu transforms, %u workers, %u frames\n\n", (unsigned long long)opt.iterations, E_JobWorkerThreads(), BENCH_FRAMES);
+	printf("%-14s %12s %14s %14s %14s %14s\n", "ms", "build", "recursive", "levels", "recursive 10%", "levels 10%");
+	for (int i = 0; i < SHAPE_COUNT; ++i)
+		printf("%-14s %12.03f %14.03f %14.03f %14.03f %14.03f\n", f_shapeNames[i],
+			r[i].build, r[i].recursive, r[i].levels, r[i].recursiveSparse, r[i].levelsSparse);
+
+	E_TermECSystems();
+	E_TermIOSystem();
+	E_TermEventSystem();
+	E_TermJobSystem();
+	Bench_Term();
+
+	return 0;
+}
+
+static void
+RecursiveUpdate(struct NeScene *s, struct NeTransform *t, bool parentChanged)
+{
+	// depth-first like Xform_Update, with the change passed down so the grandchildren of a moved root are updated too
+	const struct NeTransform *parent = (struct NeTransform *)E_ComponentPtrS(s, t->parent);
+	const bool changed = t->dirty || parentChanged;
+
+	if (t->parent != NE_INVALID_HANDLE && !changed)
+		return;
+
+	XMMATRIX mat = XMMatrixMultiply(XMMatrixScaling(t->scale.x, t->scale.y, t->scale.z),
+		XMMatrixRotationQuaternion(M_Load(&t->rotation)));
+	mat = XMMatrixMultiply(mat, XMMatrixTranslation(t->position.x, t->position.y, t->position.z));
+
+	if (parent)
+		mat = XMMatrixMultiply(mat, M_Load(&parent->mat));
+
+	M_Store(&t->mat, mat);
+
+	if (changed && !t->dirty)
+		E_MarkComponentChangedS(s, E_ComponentHandle(t));
+
+	for (size_t i = 0; i < t->children.count; ++i)
+		RecursiveUpdate(s, (struct NeTransform *)E_ComponentPtrS(s, *((NeCompHandle *)Rt_ArrayGet(&t->children, i))), changed);
+
+	t->dirty = false;
+}
+
+static void
+UpdateRoots(void **comp, struct NeScene *s)
+{
+	struct NeTransform *xform = (struct NeTransform *)comp[0];
+
+	if (xform->parent == NE_INVALID_HANDLE)
+		RecursiveUpdate(s, xform, false);
+}
+
+static bool
+RunShape(enum NeSceneShape shape, uint64_t count, struct NeShapeResult *r)
+{
+	struct NeScene *s = Bench_CreateScene(false);
+	if (!s)
+		return false;
+
+	const uint64_t tree = shape == SHAPE_TREE;
+	const uint64_t wide = (shape == SHAPE_WIDE ? count : shape == SHAPE_MIXED ? count / 2 : 0) & ~3llu;
+	const uint64_t skeletons = shape == SHAPE_WIDE ? 0 : (count - tree - wide) / BENCH_SKELETON;
+	const uint64_t total = tree + wide + skeletons * BENCH_SKELETON;
+
+	NeEntityHandle *entities = (NeEntityHandle *)Sys_Alloc(sizeof(*entities), total, MH_System);
+	NeEntityHandle *roots = (NeEntityHandle *)Sys_Alloc(sizeof(*roots), total, MH_System);
+	if (!entities || !roots)
+		return false;
+
+	const NeCompTypeId types[] = { NE_TRANSFORM_ID };
+	uint64_t rootCount = 0;
+
+	// the parents are set after the commit; until then, every lookup searches the new components
+	uint64_t start = Sys_Time();
+	for (uint64_t i = 0; i < total; ++i)
+		entities[i] = E_CreateEntityWithArgsS(s, NULL, types, NULL, 1);
+	Scn_Commit(s);
+
+	if (tree)
+		roots[rootCount++] = entities[0];
+
+	LinkWide(s, entities + tree, wide);
+	for (uint64_t i = tree; i < tree + wide; i += 4)
+		roots[rootCount++] = entities[i];
+
+	for (uint64_t i = 0; i < skeletons; ++i) {
+		const NeEntityHandle *bones = entities + tree + wide + i * BENCH_SKELETON;
+		LinkSkeleton(s, bones, tree ? entities[0] : NULL);
+
+		if (!tree)
+			roots[rootCount++] = bones[0];
+	}
+
+	Scn_UpdateTransforms(s);
+	r->build = Bench_Seconds(start, Sys_Time()) * 1000.0;
+	Bench_ResetFrameHeap();
+
+	const uint64_t recursive = Rt_HashString(BENCH_RECURSIVE);
+
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i) {
+		MoveRoots(s, roots, rootCount, 1, .01f);
+		E_ExecuteSystemS(s, recursive, s);
+	}
+	r->recursive = Bench_Seconds(start, Sys_Time()) * 1000.0 / BENCH_FRAMES;
+
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i) {
+		MoveRoots(s, roots, rootCount, 1, .01f);
+		Scn_UpdateTransforms(s);
+	}
+	r->levels = Bench_Seconds(start, Sys_Time()) * 1000.0 / BENCH_FRAMES;
+
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i) {
+		MoveRoots(s, roots, rootCount, 10, .01f);
+		E_ExecuteSystemS(s, recursive, s);
+	}
+	r->recursiveSparse = Bench_Seconds(start, Sys_Time()) * 1000.0 / BENCH_FRAMES;
+
+	start = Sys_Time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; ++i) {
+		MoveRoots(s, roots, rootCount, 10, .01f);
+		Scn_UpdateTransforms(s);
+	}
+	r->levelsSparse = Bench_Seconds(start, Sys_Time()) * 1000.0 / BENCH_FRAMES;
+	Bench_ResetFrameHeap();
+
+	Sys_Free(roots);
+	Sys_Free(entities);
+	Bench_DestroyScene(s);
+
+	return true;
+}
+
+static void
+LinkWide(struct NeScene *s, const NeEntityHandle *entities, uint64_t count)
+{
+	for (uint64_t i = 0; i < count; ++i)
+		if (i % 4)
+			Scn_SetParent(s, entities[i], entities[i & ~3llu]);
+}
+
+static void
+LinkSkeleton(struct NeScene *s, const NeEntityHandle *entities, NeEntityHandle root)
+{
+	uint32_t bone = 0;
+
+	// a spine, with the limbs attached to every fourth vertebra
+	for (; bone < BENCH_SPINE; ++bone) {
+		const NeEntityHandle parent = bone ? entities[bone - 1] : root;
+		if (parent)
+			Scn_SetParent(s, entities[bone], parent);
+	}
+
+	for (uint32_t i = 0; i < BENCH_LIMBS; ++i)
+		for (uint32_t j = 0; j < BENCH_LIMB; ++j, ++bone)
+			Scn_SetParent(s, entities[bone], j ? entities[bone - 1] : entities[i * (BENCH_SPINE / BENCH_LIMBS)]);
+}
+
+static void
+MoveRoots(struct NeScene *s, const NeEntityHandle *roots, uint64_t count, uint32_t step, float offset)
+{
+	// the benchmark scene is not registered, so Xform_Move would not find it to mark the transform changed
+	for (uint64_t i = 0; i < count; i += step) {
+		struct NeTransform *t = (struct NeTransform *)E_ComponentPtrS(s, E_GetComponentHandle(roots[i], NE_TRANSFORM_ID));
+		t->position.x += offset;
+		t->dirty = true;
+	}
+}
+
+/* NekoEngine
+ *
+ * TransformBenchmark.cxx
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
@@ -38,7 +38,7 @@ Asset_Import(const char *path, const struct NeAssetImportOptions *options, void
 			args->options = *options;
 
 		f_importInProgress = true;
-		E_ExecuteJob((NeJobProc)ImportJob, args, (NeJobCompletedProc)ImportCompleted, completed);
+		E_ExecuteDependentJob(JP_Background, (NeJobProc)ImportJob, args, (NeJobCompletedProc)ImportCompleted, completed, NULL, NULL);
 
 		return;
 	}
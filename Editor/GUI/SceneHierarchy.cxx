@@ -30,8 +30,8 @@ GUI_InitSceneHierarchy(void)
 	f_entityCreateHandler = E_RegisterHandler(EVT_ENTITY_CREATED, (NeEventHandlerProc) NeSceneHierarchy::EntityCreated, f_dlg);
 	f_entityDestroyHandler = E_RegisterHandler(EVT_ENTITY_DESTROYED,
 											   (NeEventHandlerProc) NeSceneHierarchy::EntityDestroyed, f_dlg);
-	f_componentCreateHandler = E_RegisterHandler(EVT_COMPONENT_CREATED,
-												 (NeEventHandlerProc) NeSceneHierarchy::ComponentCreated, f_dlg);
+	f_componentCreateHandler = E_RegisterHandler(EVT_COMPONENTS_CREATED,
+												 (NeEventHandlerProc) NeSceneHierarchy::ComponentsCreated, f_dlg);
 
 	Sys_InitFutex(&f_ftx);
 
@@ -147,12 +147,13 @@ NeSceneHierarchy::EntityDestroyed(NeSceneHierarchy *shd, NeEntityHandle eh)
 }
 
 void
-NeSceneHierarchy::ComponentCreated(NeSceneHierarchy *shd, const struct NeComponentCreationData *ccd)
+NeSceneHierarchy::ComponentsCreated(NeSceneHierarchy *shd, const struct NeComponentCreationBatch *ccb)
 {
-	if (ccd->type != NE_TRANSFORM_ID)
+	if (ccb->type != NE_TRANSFORM_ID)
 		return;
 
-	EntityCreated(shd, ccd->owner);
+	for (uint32_t i = 0; i < ccb->count; ++i)
+		EntityCreated(shd, ccb->components[i].owner);
 }
 
 void
@@ -160,11 +161,10 @@ NeSceneHierarchy::SceneActivated(NeSceneHierarchy *shd, struct NeScene *scn)
 {
 	NeFutexLock lock(f_ftx);
 
-	const struct NeTransform *xform = NULL;
-	const struct NeArray *transforms = E_GetAllComponentsS(scn, NE_TRANSFORM_ID);
-
-	Rt_ArrayForEach(xform, transforms, const struct NeTransform *)
-		shd->_AddTransform(xform, nullptr);
+	E_ForEachComponentS(scn, NE_TRANSFORM_ID, [](void *xform, void *shd) -> bool {
+		((NeSceneHierarchy *)shd)->_AddTransform((const struct NeTransform *)xform, nullptr);
+		return true;
+	}, shd);
 }
 
 /* NekoEditor
@@ -22,7 +22,7 @@ public:
 
 	static void EntityCreated(NeSceneHierarchy *shd, NeEntityHandle eh);
 	static void EntityDestroyed(NeSceneHierarchy *shd, NeEntityHandle eh);
-	static void ComponentCreated(NeSceneHierarchy *shd, const struct NeComponentCreationData *ccd);
+	static void ComponentsCreated(NeSceneHierarchy *shd, const struct NeComponentCreationBatch *ccb);
 	static void SceneActivated(NeSceneHierarchy *shd, struct NeScene *scn);
 
 public slots:
@@ -152,7 +152,7 @@ TermListener(struct NeAudioListener *l)
 	l->enabled = false;
 }
 
-NE_SYSTEM(AU_UPDATE_LISTENER, ECSYS_GROUP_POST_LOGIC, 0, true, void, 2, NE_TRANSFORM, NE_AUDIO_LISTENER)
+NE_SYSTEM(AU_UPDATE_LISTENER, ECSYS_GROUP_POST_LOGIC, 0, true, void, 2, ECSYS_READ(NE_TRANSFORM), NE_AUDIO_LISTENER)
 {
 	float orientation[6];
 	struct NeVec3 velocity{ 0.f, 0.f, 0.f };
@@ -173,7 +173,7 @@ NE_SYSTEM(AU_UPDATE_LISTENER, ECSYS_GROUP_POST_LOGIC, 0, true, void, 2, NE_TRANS
 	}
 }
 
-NE_SYSTEM(AU_UPDATE_SOURCES, ECSYS_GROUP_POST_LOGIC, 10, true, void, 2, NE_TRANSFORM, NE_AUDIO_SOURCE)
+NE_SYSTEM(AU_UPDATE_SOURCES, ECSYS_GROUP_POST_LOGIC, 10, true, void, 2, ECSYS_READ(NE_TRANSFORM), NE_AUDIO_SOURCE)
 {
 	const struct NeTransform *xform = (struct NeTransform *)comp[0];
 	struct NeAudioSource *s = (struct NeAudioSource *)comp[1];
@@ -6,6 +6,7 @@
 #include <Engine/IO.h>
 #include <System/Thread.h>
 #include <Engine/Config.h>
+#include <Engine/Prefab.h>
 #include <Script/Interface.h>
 
 #include <Editor/Editor.h>
@@ -19,7 +20,9 @@ static struct NeArray f_componentTypes;
 #define EVT_COMPONENT_REGISTERED_PTR	"ComponentRegisteredPTR"
 
 static inline bool InitArray(void);
+static inline struct NeCompBase *SlotComponent(struct NeScene *s, NeCompTypeId type, uint32_t id);
 static void ComponentRegistered(struct NeScene *s, struct NeCompType *type);
+static bool TermComponent(struct NeCompBase *comp, const struct NeCompType *type);
 static void LoadScript(const char *path);
 static bool ScriptCompInit(struct NeScriptComponent *comp, const void **args, const char *type, const char *script);
 static void ScriptCompTerm(struct NeScriptComponent *comp, const char *type, const char *script);
@@ -59,7 +62,7 @@ E_CreateComponentIdS(struct NeScene *s, NeCompTypeId typeId, NeEntityHandle owne
 		comp->_handleId = idx;
 	} else {
 		uint64_t *offset = Rt_ArrayGet(&s->newCompOffset, typeId);
-		comp->_handleId = a->count + (*offset)++;
+		comp->_handleId = ECS_ComponentIdCount(s, typeId) + (*offset)++;
 	}
 
 	Sys_AtomicUnlockWrite(&s->lock.newComp);
@@ -112,9 +115,21 @@ E_DestroyComponentS(struct NeScene *s, NeCompHandle handle)
 		return;
 
 	Sys_AtomicLockWrite(&s->lock.comp);
-	comp = Rt_ArrayGet(a, idx);
+	comp = s->archetypeStorage ? ECS_ArchetypeComponentPtr(s, handle) : ECS_SlotComponent(s, E_HANDLE_TYPE(handle), (uint32_t)idx);
+	struct NeEntity *owner = comp && comp->_valid && !s->archetypeStorage ? ECS_EntityPtr(comp->_owner) : NULL;
+	if (owner)
+		ECS_QueryComponentRemoved(s, owner, E_HANDLE_TYPE(handle));
 	Sys_AtomicUnlockWrite(&s->lock.comp);
 
+	const bool committed = comp && comp->_valid;
+
+	// components created this frame are still in the pending array
+	if (!committed)
+		comp = E_ComponentPtrS(s, handle);
+
+	if (!comp || !comp->_valid)
+		return;
+
 	if (type->term) {
 		if (!type->script)
 			type->term(comp);
@@ -125,7 +140,14 @@ E_DestroyComponentS(struct NeScene *s, NeCompHandle handle)
 	comp->_valid = false;
 
 	Sys_AtomicLockWrite(&s->lock.comp);
-	Rt_QueuePush(fl, &idx);
+	// with archetype storage, the row and the slot are released when Scn_Commit moves the owner
+	if (committed && s->archetypeStorage) {
+		ECS_ArchetypeComponentDestroyed(s, handle);
+	} else {
+		Rt_QueuePush(fl, &idx);
+		if (committed)
+			((struct NeCompCompaction *)Rt_ArrayGet(&s->compCompact, E_HANDLE_TYPE(handle)))->fragmented = true;
+	}
 	Sys_AtomicUnlockWrite(&s->lock.comp);
 
 	E_Broadcast(EVT_COMPONENT_DESTROYED, (void *)handle);
@@ -138,17 +160,22 @@ E_ComponentPtrS(struct NeScene *s, NeCompHandle handle)
 	if (E_HANDLE_TYPE(handle) >= s->compData.count)
 		return NULL;
 
-	struct NeArray *compData = (struct NeArray *)s->compData.data;
+	ECS_CheckAccess(E_HANDLE_TYPE(handle));
+
 	struct NeArray *newCompData = (struct NeArray *)s->newCompData.data;
 	Sys_AtomicLockRead(&s->lock.comp);
 	{
-		comp = Rt_ArrayGet(&compData[E_HANDLE_TYPE(handle)], E_HANDLE_ID(handle));
+		if (s->archetypeStorage)
+			comp = ECS_ArchetypeComponentPtr(s, handle);
+		else
+			comp = SlotComponent(s, E_HANDLE_TYPE(handle), E_HANDLE_ID(handle));
+
 		if ((!comp || !comp->_valid) && newCompData[E_HANDLE_TYPE(handle)].count) {
 			Sys_AtomicLockRead(&s->lock.newComp);
 			{
 				const size_t id = E_HANDLE_ID(handle);
 				Rt_ArrayForEach(comp, &newCompData[E_HANDLE_TYPE(handle)]) {
-					if (comp->_handleId == id)
+					if (comp->_handleId == id && comp->_valid)
 						break;
 
 					comp = NULL;
@@ -194,7 +221,7 @@ size_t
 E_ComponentCountS(struct NeScene *s, NeCompTypeId type)
 {
 	Sys_AtomicLockRead(&s->lock.comp);
-	size_t r = ((struct NeArray *)Rt_ArrayGet(&s->compData, type))->count;
+	size_t r = s->archetypeStorage ? ECS_ArchetypeSlotCount(s, type) : ((struct NeArray *)Rt_ArrayGet(&s->compData, type))->count;
 	Sys_AtomicUnlockRead(&s->lock.comp);
 
 	return r;
@@ -259,21 +286,108 @@ E_RegisterComponent(const char *name, size_t size, size_t alignment, NeCompInitP
 	return true;
 }
 
+bool
+E_SetComponentInstantiateProc(NeCompTypeId typeId, NeCompInstantiateProc instantiate)
+{
+	struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, typeId);
+	if (!type)
+		return false;
+
+	type->instantiate = instantiate;
+	return true;
+}
+
+bool
+E_SetComponentTemplateProc(NeCompTypeId typeId, NeCompInitProc initTemplate)
+{
+	struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, typeId);
+	if (!type)
+		return false;
+
+	type->initTemplate = initTemplate;
+	return true;
+}
+
+bool
+E_SetComponentSortProc(NeCompTypeId typeId, NeCompSortKeyProc sortKey)
+{
+	struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, typeId);
+	if (!type)
+		return false;
+
+	type->sortKey = sortKey;
+	return true;
+}
+
+bool
+E_SetComponentFields(NeCompTypeId typeId, const struct NeComponentField *fields, uint32_t count)
+{
+	struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, typeId);
+	if (!type)
+		return false;
+
+	struct NeComponentField *copy = Sys_Alloc(sizeof(*copy), count, MH_System);
+	if (!copy)
+		return false;
+
+	memcpy(copy, fields, sizeof(*copy) * count);
+
+	Sys_Free(type->fields);
+	type->fields = copy;
+	type->fieldCount = count;
+
+	return true;
+}
+
+const struct NeComponentField *
+E_ComponentFields(NeCompTypeId typeId, uint32_t *count)
+{
+	const struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, typeId);
+	*count = type ? type->fieldCount : 0;
+	return type ? type->fields : NULL;
+}
+
 const struct NeArray *
 E_GetAllComponentsS(struct NeScene *s, NeCompTypeId type)
 {
-	if (type >= s->compData.count)
+	if (type >= s->compData.count || s->archetypeStorage)
 		return NULL;
 
 	return Rt_ArrayGet(&s->compData, type);
 }
 
+void
+E_ForEachComponentS(struct NeScene *s, NeCompTypeId type, NeCompIteratorProc proc, void *user)
+{
+	if (type >= s->compData.count)
+		return;
+
+	Sys_AtomicLockRead(&s->lock.comp);
+
+	if (s->archetypeStorage) {
+		ECS_ArchetypeForEach(s, type, proc, user);
+	} else {
+		struct NeCompBase *comp;
+		Rt_ArrayForEach(comp, (struct NeArray *)Rt_ArrayGet(&s->compData, type))
+			if (comp->_valid && !proc(comp, user))
+				break;
+	}
+
+	Sys_AtomicUnlockRead(&s->lock.comp);
+}
+
 const struct NeCompType *
 ECS_ComponentType(NeCompTypeId typeId)
 {
 	return Rt_ArrayGet(&f_componentTypes, typeId);
 }
 
+size_t
+ECS_ComponentTypeCount(void)
+{
+	return f_componentTypes.count;
+}
+
 bool
 E_InitComponents(void)
 {
@@ -290,8 +404,10 @@ void
 E_TermComponents(void)
 {
 	struct NeCompType *type;
-	Rt_ArrayForEach(type, &f_componentTypes)
+	Rt_ArrayForEach(type, &f_componentTypes) {
 		Sys_Free(type->script);
+		Sys_Free(type->fields);
+	}
 
 	Rt_TermArray(&f_componentTypes);
 }
@@ -311,11 +427,25 @@ E_InitSceneComponents(struct NeScene *s)
 	if (!Rt_InitArray(&s->compFree, f_componentTypes.count, sizeof(struct NeQueue), MH_Scene))
 		return false;
 
+	if (!Rt_InitArray(&s->compSlot, f_componentTypes.count, sizeof(struct NeArray), MH_Scene))
+		return false;
+
+	if (!Rt_InitArray(&s->compCompact, f_componentTypes.count, sizeof(struct NeCompCompaction), MH_Scene))
+		return false;
+
 	Rt_FillArray(&s->compData);
 	Rt_FillArray(&s->compFree);
+	Rt_FillArray(&s->compSlot);
+	Rt_FillArray(&s->compCompact);
 	Rt_FillArray(&s->newCompData);
 	Rt_FillArray(&s->newCompOffset);
 
+	if (s->archetypeStorage && !E_InitSceneArchetypes(s, f_componentTypes.count))
+		return false;
+
+	if (!E_InitSceneChanges(s) || !E_InitSceneSystems(s))
+		return false;
+
 	for (size_t i = 0; i < f_componentTypes.count; ++i) {
 		struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, i);
 
@@ -326,6 +456,12 @@ E_InitSceneComponents(struct NeScene *s)
 		a = Rt_ArrayGet(&s->newCompData, i);
 		if (!Rt_InitAlignedArray(a, 10, type->size, type->alignment, MH_Scene))
 			return false;
+
+		if (!Rt_InitQueue(Rt_ArrayGet(&s->compFree, i), 10, sizeof(size_t), MH_Scene))
+			return false;
+
+		if (!Rt_InitArray(Rt_ArrayGet(&s->compSlot, i), 10, sizeof(uint32_t), MH_Scene))
+			return false;
 	}
 
 	E_RegisterHandler(EVT_COMPONENT_REGISTERED_PTR, (NeEventHandlerProc)ComponentRegistered, s);
@@ -336,6 +472,16 @@ E_InitSceneComponents(struct NeScene *s)
 void
 E_TermSceneComponents(struct NeScene *s)
 {
+	if (s->archetypeStorage) {
+		for (size_t i = 0; i < s->compData.count; ++i) {
+			const struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, i);
+			if (type->term)
+				ECS_ArchetypeForEach(s, i, (NeCompIteratorProc)TermComponent, (void *)type);
+		}
+
+		E_TermSceneArchetypes(s);
+	}
+
 	for (size_t i = 0; i < s->compData.count; ++i) {
 		struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, i);
 		struct NeArray *a = Rt_ArrayGet(&s->compData, i);
@@ -358,31 +504,45 @@ E_TermSceneComponents(struct NeScene *s)
 
 		Rt_TermArray(a);
 		Rt_TermArray(Rt_ArrayGet(&s->newCompData, i));
+		Rt_TermQueue(Rt_ArrayGet(&s->compFree, i));
+		Rt_TermArray(Rt_ArrayGet(&s->compSlot, i));
 	}
 
+	E_TermSceneChanges(s);
+	E_TermSceneSystems(s);
+
 	Rt_TermArray(&s->newCompOffset);
 	Rt_TermArray(&s->newCompData);
 	Rt_TermArray(&s->compFree);
+	Rt_TermArray(&s->compSlot);
+	Rt_TermArray(&s->compCompact);
 	Rt_TermArray(&s->compData);
 }
 
 void *
 ECS_CommitedComponentPtr(struct NeScene *s, NeCompHandle handle)
 {
-	struct NeArray *compData = (struct NeArray *)s->compData.data;
-	return Rt_ArrayGet(compData, E_HANDLE_ID(handle));
+	struct NeCompBase *comp = NULL;
+
+	if (s->archetypeStorage) {
+		comp = ECS_ArchetypeComponentPtr(s, handle);
+	} else if (E_HANDLE_TYPE(handle) < s->compData.count) {
+		comp = SlotComponent(s, E_HANDLE_TYPE(handle), E_HANDLE_ID(handle));
+	}
+
+	return comp && comp->_valid ? comp : NULL;
 }
 
 void *
 ECS_ComponentPtr(struct NeScene *s, NeCompHandle handle)
 {
-	struct NeArray *compData = (struct NeArray *)s->compData.data;
 	struct NeArray *newCompData = (struct NeArray *)s->newCompData.data;
-	struct NeCompBase *comp = Rt_ArrayGet(&compData[E_HANDLE_TYPE(handle)], E_HANDLE_ID(handle));
+	struct NeCompBase *comp = s->archetypeStorage ? ECS_ArchetypeComponentPtr(s, handle) :
+							SlotComponent(s, E_HANDLE_TYPE(handle), E_HANDLE_ID(handle));
 	if ((!comp || !comp->_valid) && newCompData[E_HANDLE_TYPE(handle)].count) {
 		const size_t id = E_HANDLE_ID(handle);
 		Rt_ArrayForEach(comp, &newCompData[E_HANDLE_TYPE(handle)]) {
-			if (comp->_handleId == id)
+			if (comp->_handleId == id && comp->_valid)
 				break;
 			comp = NULL;
 		}
@@ -390,12 +550,160 @@ ECS_ComponentPtr(struct NeScene *s, NeCompHandle handle)
 	return comp;
 }
 
+void *
+ECS_SlotComponent(struct NeScene *s, NeCompTypeId type, uint32_t id)
+{
+	return SlotComponent(s, type, id);
+}
+
+uint32_t *
+ECS_GrowSlots(struct NeScene *s, NeCompTypeId type, uint32_t id)
+{
+	struct NeArray *sa = Rt_ArrayGet(&s->compSlot, type);
+	if (!sa)
+		return NULL;
+
+	if (id >= sa->count) {
+		if (id >= sa->size && !Rt_ResizeArray(sa, id < sa->size * 2 ? sa->size * 2 : id + 1))
+			return NULL;
+
+		// all bits set is ECS_INVALID_SLOT
+		memset(sa->data + sa->elemSize * sa->count, 0xFF, sa->elemSize * (id + 1 - sa->count));
+		sa->count = id + 1;
+	}
+
+	return Rt_ArrayGet(sa, id);
+}
+
+size_t
+ECS_ComponentIdCount(struct NeScene *s, NeCompTypeId type)
+{
+	if (s->archetypeStorage)
+		return ECS_ArchetypeSlotCount(s, type);
+
+	const struct NeArray *sa = Rt_ArrayGet(&s->compSlot, type);
+	return sa ? sa->count : 0;
+}
+
+bool
+ECS_CreateComponents(struct NeScene *s, const struct NePrefabComp *pc, const NeEntityHandle *owners,
+	const struct NePrefabTransform *xforms, NeCompHandle *handles, uint32_t count, size_t *first)
+{
+	const struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, pc->type);
+	struct NeArray *a = Rt_ArrayGet(&s->compData, pc->type);
+	struct NeArray *na = Rt_ArrayGet(&s->newCompData, pc->type);
+	struct NeQueue *fl = Rt_ArrayGet(&s->compFree, pc->type);
+	uint64_t *offset = Rt_ArrayGet(&s->newCompOffset, pc->type);
+
+	if (!type || !a || !na || !fl || !offset)
+		return false;
+
+	Sys_AtomicLockWrite(&s->lock.newComp);
+
+	if (na->count + count > na->size && !Rt_ResizeArray(na, na->count + count)) {
+		Sys_AtomicUnlockWrite(&s->lock.newComp);
+		return false;
+	}
+
+	*first = na->count;
+	na->count += count;
+
+	const size_t ids = ECS_ComponentIdCount(s, pc->type);
+	for (uint32_t i = 0; i < count; ++i) {
+		struct NeCompBase *comp = Rt_ArrayGet(na, *first + i);
+
+		if (pc->data)
+			memcpy(comp, pc->data, na->elemSize);
+		else
+			Sys_ZeroMemory(comp, na->elemSize);
+
+		comp->_handleId = fl->count ? *((size_t *)Rt_QueuePop(fl)) : ids + (*offset)++;
+		comp->_owner = owners[i];
+		comp->_valid = 1;
+		comp->_enabled = 1;
+		comp->_typeId = pc->type;
+		comp->_sceneId = s->id;
+
+		handles[i] = E_ComponentHandle(comp);
+	}
+
+	Sys_AtomicUnlockWrite(&s->lock.newComp);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		void *comp = Rt_ArrayGet(na, *first + i);
+		bool rc = true;
+
+		if (pc->data && type->instantiate)
+			rc = type->instantiate(comp, xforms ? &xforms[i] : NULL);
+		else if (!pc->data && type->init)
+			rc = !type->script ? type->init(comp, pc->args) : type->initScript(comp, pc->args, type->name, type->script);
+
+		if (!rc) {
+			ECS_ReleaseComponents(s, pc->type, *first, i, count);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void
+ECS_ReleaseComponents(struct NeScene *s, NeCompTypeId typeId, size_t first, uint32_t initialized, uint32_t count)
+{
+	const struct NeCompType *type = Rt_ArrayGet(&f_componentTypes, typeId);
+	struct NeArray *na = Rt_ArrayGet(&s->newCompData, typeId);
+	struct NeQueue *fl = Rt_ArrayGet(&s->compFree, typeId);
+
+	for (uint32_t i = 0; i < initialized; ++i)
+		if (type->term)
+			TermComponent(Rt_ArrayGet(na, first + i), type);
+
+	Sys_AtomicLockWrite(&s->lock.newComp);
+	for (uint32_t i = 0; i < count; ++i) {
+		struct NeCompBase *comp = Rt_ArrayGet(na, first + i);
+		size_t idx = comp->_handleId;
+
+		comp->_valid = false;
+		Rt_QueuePush(fl, &idx);
+	}
+	Sys_AtomicUnlockWrite(&s->lock.newComp);
+}
+
+const void **
+ECS_CopyComponentArgs(const void **args, enum NeMemoryHeap heap)
+{
+	size_t count = 0, size = 0;
+	for (; args[count]; ++count)
+		size += strlen(args[count]) + 1;
+
+	const void **copy = Sys_Alloc(1, sizeof(*copy) * (count + 1) + size, heap);
+	if (!copy)
+		return NULL;
+
+	char *str = (char *)(copy + count + 1);
+	for (size_t i = 0; i < count; ++i) {
+		const size_t len = strlen(args[i]) + 1;
+		copy[i] = memcpy(str, args[i], len);
+		str += len;
+	}
+
+	return copy;
+}
+
 static inline bool
 InitArray(void)
 {
 	return Rt_InitArray(&f_componentTypes, 40, sizeof(struct NeCompType), MH_System);
 }
 
+static inline struct NeCompBase *
+SlotComponent(struct NeScene *s, NeCompTypeId type, uint32_t id)
+{
+	const struct NeArray *sa = (const struct NeArray *)s->compSlot.data + type;
+	const uint32_t slot = id < sa->count ? ((const uint32_t *)sa->data)[id] : ECS_INVALID_SLOT;
+	return slot != ECS_INVALID_SLOT ? Rt_ArrayGet((const struct NeArray *)s->compData.data + type, slot) : NULL;
+}
+
 void
 ComponentRegistered(struct NeScene *s, struct NeCompType *type)
 {
@@ -425,8 +733,29 @@ ComponentRegistered(struct NeScene *s, struct NeCompType *type)
 		return;
 	}
 
-	if (Rt_InitQueue(q, 10, sizeof(size_t), MH_Scene))
+	if (!Rt_InitQueue(q, 10, sizeof(size_t), MH_Scene))
 		Sys_LogEntry(COMP_MOD, LOG_CRITICAL, "Failed to initialize free list for registered component in scene %s", s->name);
+
+	a = Rt_ArrayAllocate(&s->compSlot);
+	if (!a || !Rt_InitArray(a, 10, sizeof(uint32_t), MH_Scene))
+		Sys_LogEntry(COMP_MOD, LOG_CRITICAL, "Failed to initialize slot table for registered component in scene %s", s->name);
+
+	if (!Rt_ArrayAllocate(&s->compCompact))
+		Sys_LogEntry(COMP_MOD, LOG_CRITICAL, "Failed to allocate compaction state for registered component in scene %s", s->name);
+
+	if (s->archetypeStorage && !ECS_ArchetypeTypeRegistered(s))
+		Sys_LogEntry(COMP_MOD, LOG_CRITICAL, "Failed to initialize location table for registered component in scene %s", s->name);
+}
+
+static bool
+TermComponent(struct NeCompBase *comp, const struct NeCompType *type)
+{
+	if (!type->script)
+		type->term(comp);
+	else
+		type->termScript(comp, type->name, type->script);
+
+	return true;
 }
 
 static void
@@ -496,17 +825,18 @@ ScriptCompInit(struct NeScriptComponent *comp, const void **args, const char *ty
 {
 	bool rc = true;
 
-	lua_State *vm = Sc_CreateVM();
+	lua_State *vm = Sc_AcquireVM();
+	if (!vm)
+		return false;
 
 	char buff[256];
 	snprintf(buff, sizeof(buff), "require \"%s\"", type);
 	(void)luaL_dostring(vm, buff);
 
-	Sc_LoadScriptFile(vm, script);
-
-	lua_getglobal(vm, "Init");
-	if (!lua_isfunction(vm, lua_gettop(vm)))
-		goto exit;
+	if (!Sc_PushScriptFunction(vm, script, "Init")) {
+		Sc_ReleaseVM(vm);
+		return true;
+	}
 
 	Sc_PushScriptWrapper(vm, comp, type);
 
@@ -554,7 +884,7 @@ ScriptCompInit(struct NeScriptComponent *comp, const void **args, const char *ty
 
 exit:
 	lua_pop(vm, 1);
-	Sc_DestroyVM(vm);
+	Sc_ReleaseVM(vm);
 
 	return rc;
 }
@@ -562,27 +892,26 @@ exit:
 static void
 ScriptCompTerm(struct NeScriptComponent *comp, const char *type, const char *script)
 {
-	lua_State *vm = Sc_CreateVM();
+	lua_State *vm = Sc_AcquireVM();
+	if (!vm) {
+		Rt_TermArray(&comp->fields);
+		return;
+	}
 
 	char buff[256];
 	snprintf(buff, sizeof(buff), "require \"%s\"", type);
 	(void)luaL_dostring(vm, buff);
 
-	Sc_LoadScriptFile(vm, script);
-
-	lua_getglobal(vm, "Term");
-	if (lua_isfunction(vm, lua_gettop(vm))) {
+	if (Sc_PushScriptFunction(vm, script, "Term")) {
 		Sc_PushScriptWrapper(vm, comp, type);
 		if (lua_pcall(vm, 1, 0, 0)) {
 			lua_pop(vm, 1);
 		}
-	} else {
-		lua_pop(vm, 1);
 	}
 
 	Rt_TermArray(&comp->fields);
 
-	Sc_DestroyVM(vm);
+	Sc_ReleaseVM(vm);
 }
 
 /* NekoEngine
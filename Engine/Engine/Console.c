@@ -9,15 +9,25 @@
 #include <Interfaces/ConsoleOutput.h>
 #include <Engine/Plugin.h>
 #include <System/Log.h>
+#include <System/Memory.h>
 
 #define CONSOLE_MOD		"Console"
 
+#define CONSOLE_ALLOC_SITES			20
+#define CONSOLE_MAX_ALLOC_SITES		8192
+
 static bool f_visible, f_enabled;
 static lua_State *f_consoleVM;
 static struct NeArray f_text, f_line, f_history;
 static uint32_t f_lineLength = 81, f_screenBufferSize;
 static size_t f_historyId = 0;
 static struct NeConsoleOutput *f_output;
+static bool *f_memoryOverlay;
+
+static void PrintMemoryStatistics(void);
+static void PrintAllocationSites(void);
+static int AllocationSiteCompare(const void *a, const void *b);
+static void DrawMemoryOverlay(void);
 
 static inline void
 AppendText(const char *text)
@@ -35,6 +45,8 @@ E_InitConsole(void)
 	if (!f_enabled)
 		return true;
 
+	f_memoryOverlay = &E_GetCVarBln("Console_MemoryOverlay", false)->bln;
+
 	f_output = E_GetInterface(NEIF_CONSOLE_OUTPUT);
 	if (!f_output) {
 		Sys_LogEntry(CONSOLE_MOD, LOG_CRITICAL, "Console output interface not found. The console will not be available");
@@ -52,7 +64,7 @@ E_InitConsole(void)
 	Rt_InitArray(&f_line, f_lineLength, sizeof(char), MH_System);
 	Rt_InitArray(&f_history, 10, f_lineLength * sizeof(char), MH_System);
 
-	return f_output->Init(f_screenBufferSize + 2);
+	return f_output->Init(f_screenBufferSize + 2 + MH_Count + 1);
 }
 
 void
@@ -155,6 +167,12 @@ E_ConsoleExec(const char *line)
 
 			cv = cv->next;
 		}
+	} else if (!strcmp(line, "memstats")) {
+		PrintMemoryStatistics();
+	} else if (!strcmp(line, "allocsites")) {
+		PrintAllocationSites();
+	} else if (!strcmp(line, "memoverlay")) {
+		*f_memoryOverlay = !*f_memoryOverlay;
 	} else if (!strncmp(line, "exec ", 5)) {
 		const char *err = Sc_ExecuteFile(f_consoleVM, line + 5);
 		if (err)
@@ -169,7 +187,13 @@ E_ConsoleExec(const char *line)
 void
 E_DrawConsole(void)
 {
-	if (!f_enabled || !f_visible)
+	if (!f_enabled || !f_output)
+		return;
+
+	if (*f_memoryOverlay)
+		DrawMemoryOverlay();
+
+	if (!f_visible)
 		return;
 
 	const uint32_t lh = f_output->LineHeight();
@@ -275,6 +299,84 @@ E_ConsoleKey(enum NeButton key, bool down)
 	return true;
 }
 
+static void
+PrintMemoryStatistics(void)
+{
+	struct NeMemoryHeapStatistics hs;
+
+	E_ConsolePrint("%-14s %12s %10s %12s %8s %8s", "heap", "in use", "allocs", "peak", "alloc/f", "free/f");
+	for (enum NeMemoryHeap i = MH_Transient; i < MH_Count; ++i) {
+		Sys_HeapStatistics(i, &hs);
+		if (!hs.totalAllocations)
+			continue;
+
+		E_ConsolePrint("%-14s %12llu %10llu %12llu %8llu %8llu", Sys_MemoryHeapName(i),
+						hs.inUse, hs.allocations, hs.peak, hs.frameAllocations, hs.frameFrees);
+	}
+}
+
+static void
+PrintAllocationSites(void)
+{
+	struct NeAllocationSite *sites = Sys_Alloc(sizeof(*sites), CONSOLE_MAX_ALLOC_SITES, MH_Transient);
+	const uint32_t count = Sys_AllocationSites(sites, CONSOLE_MAX_ALLOC_SITES);
+
+	if (!count) {
+		E_ConsolePrint("Allocation tracing is not enabled in this build");
+		return;
+	}
+
+	qsort(sites, count, sizeof(*sites), AllocationSiteCompare);
+
+	E_ConsolePrint("%-32s %-10s %8s %12s %8s %8s", "site", "heap", "alloc/f", "bytes", "allocs", "steady");
+	for (uint32_t i = 0; i < count && i < CONSOLE_ALLOC_SITES; ++i) {
+		const char *file = sites[i].file;
+		for (const char *p = file; *p; ++p)
+			if (*p == '/' || *p == '\\')
+				file = p + 1;
+
+		E_ConsolePrint("%-26s:%-5d %-10s %8llu %12lld %8lld %8llu", file, sites[i].line, Sys_MemoryHeapName(sites[i].heap),
+						sites[i].frameAllocations, sites[i].bytes, sites[i].allocations, sites[i].steadyStateAllocations);
+	}
+}
+
+static int
+AllocationSiteCompare(const void *a, const void *b)
+{
+	const struct NeAllocationSite *sa = a, *sb = b;
+
+	if (sa->frameAllocations != sb->frameAllocations)
+		return sa->frameAllocations < sb->frameAllocations ? 1 : -1;
+
+	return sa->bytes < sb->bytes ? 1 : (sa->bytes > sb->bytes ? -1 : 0);
+}
+
+static void
+DrawMemoryOverlay(void)
+{
+	struct NeMemoryHeapStatistics hs;
+	const uint32_t lh = f_output->LineHeight();
+	uint32_t y = 10;
+
+	char *buff = Sys_Alloc(sizeof(*buff), f_lineLength, MH_Transient);
+
+	snprintf(buff, f_lineLength, "%-14s %10s %8s %10s %6s %6s", "heap", "KiB", "allocs", "peak KiB", "a/f", "f/f");
+	f_output->Puts(buff, 10, y);
+	y += lh;
+
+	for (enum NeMemoryHeap i = MH_Transient; i < MH_Count; ++i) {
+		Sys_HeapStatistics(i, &hs);
+		if (!hs.totalAllocations)
+			continue;
+
+		snprintf(buff, f_lineLength, "%-14s %10llu %8llu %10llu %6llu %6llu", Sys_MemoryHeapName(i),
+					(unsigned long long)hs.inUse / 1024, (unsigned long long)hs.allocations, (unsigned long long)hs.peak / 1024,
+					(unsigned long long)hs.frameAllocations, (unsigned long long)hs.frameFrees);
+		f_output->Puts(buff, 10, y);
+		y += lh;
+	}
+}
+
 void
 E_TermConsole(void)
 {
@@ -2,10 +2,12 @@
 #define _NE_ENGINE_ECS_H_
 
 #include <Runtime/Array.h>
+#include <System/AtomicLock.h>
 
 #include <Engine/Types.h>
 #include <Engine/Entity.h>
 #include <Engine/Component.h>
+#include <Engine/ECSystem.h>
 #include <Script/Script.h>
 
 #ifdef __cplusplus
@@ -22,14 +24,44 @@ struct NeEntityMessage
 	const void *data;
 };
 
+/*
+ * Entity handles hold a slot in the entity table and the generation of the slot; the generation changes when the
+ * entity is destroyed, so handles to destroyed entities resolve to NULL. The table is allocated in pages that are
+ * never moved, so it can be read without a lock.
+ */
+#if UINTPTR_MAX > UINT32_MAX
+#	define ECS_ENTITY_SLOT_BITS		32
+#	define ECS_MAX_ENTITY_PAGES		1024
+#else
+#	define ECS_ENTITY_SLOT_BITS		20
+#	define ECS_MAX_ENTITY_PAGES		256
+#endif
+
+#define ECS_ENTITY_PAGE_BITS		12
+#define ECS_ENTITY_PAGE_SIZE		(1 << ECS_ENTITY_PAGE_BITS)
+#define ECS_ENTITY_GENERATION_MASK	(UINTPTR_MAX >> ECS_ENTITY_SLOT_BITS)
+
+#define ECS_ENTITY_HANDLE(slot, gen)	((NeEntityHandle)(((uintptr_t)(gen) << ECS_ENTITY_SLOT_BITS) | (uintptr_t)(slot)))
+#define ECS_ENTITY_SLOT(h)				(uint32_t)((uintptr_t)(h) & (((uintptr_t)1 << ECS_ENTITY_SLOT_BITS) - 1))
+#define ECS_ENTITY_GENERATION(h)		(uint32_t)((uintptr_t)(h) >> ECS_ENTITY_SLOT_BITS)
+
+struct NeEntitySlot
+{
+	struct NeEntity *ent;
+	uint32_t generation;
+	uint32_t nextFree;
+};
+
 struct NeEntity
 {
 	size_t id;
+	NeEntityHandle handle;
 	uint32_t sceneId;
 	uint32_t compCount;
 	struct NeEntityComp comp[MAX_ENTITY_COMPONENTS];
-	struct NeQueue mbox;
 	uint64_t hash;
+	uint32_t compIndexSize;
+	uint8_t *compIndex;
 	char name[MAX_ENTITY_NAME];
 };
 
@@ -55,35 +87,271 @@ struct NeCompType
 		NeCompTermProc term;
 		NeScriptCompTermProc termScript;
 	};
+	NeCompInstantiateProc instantiate;
+	NeCompInitProc initTemplate;
+	NeCompSortKeyProc sortKey;
+	struct NeComponentField *fields;
+	uint32_t fieldCount;
 	char *script, name[MAX_ENTITY_NAME];
 };
 
+// Components of the types that do not own resources, or that can acquire them with instantiate, are copied from data
+struct NePrefabComp
+{
+	NeCompTypeId type;
+	void *data;
+	const void **args;
+};
+
+struct NePrefab
+{
+	uint32_t compCount;
+	struct NePrefabComp comp[MAX_ENTITY_COMPONENTS];
+	char name[MAX_ENTITY_NAME];
+};
+
+// Progress of a time-sliced system in a scene; frame counts the executions of amortized systems and itemTime is the
+// average time, in nanoseconds, a budgeted system spends on one item
+struct NeSystemSlice
+{
+	uint64_t cursor, frame;
+	float itemTime;
+};
+
+// Script systems in a batch mode receive up to SC_VIEW_CAPACITY components of each type per call
+enum NeScriptBatch
+{
+	ECSYS_BATCH_NONE,
+	ECSYS_BATCH_VIEW,
+	ECSYS_BATCH_COLUMNS
+};
+
 struct NeECSystem
 {
 	NeECSysExecProc exec;
-	union {
-		lua_State *vm;
-		lua_State **vms;
-	};
+	char *script;
 	uint64_t nameHash;
 	uint64_t groupHash;
 	size_t typeCount;
-	bool singleThread, enabled;
+	bool singleThread, exclusive, enabled, accessReported;
+	uint8_t batch;
 	int32_t priority;
+	uint32_t query, readOnly, changed, changeSlot;
+	uint32_t amortize, sliceSlot;
+	uint64_t budget;
+	struct NeSystemStats stats;
+	struct NeAtomicLock statsLock;
 	NeCompTypeId compTypes[MAX_ENTITY_COMPONENTS];
 	uint64_t scriptHash;
-	char *reload;
+	char *reload, name[MAX_ENTITY_NAME];
+};
+
+#define ECS_INVALID_QUERY		UINT32_MAX
+#define ECS_INVALID_ARCHETYPE	UINT32_MAX
+#define ECS_INVALID_SLOT		UINT32_MAX
+#define ECS_CHUNK_SIZE			16384
+#define ECS_CHANGE_BLOCK_BITS	6
+
+struct NeECSQueryCache
+{
+	struct NeArray rows, slots, archetypes;
+};
+
+struct NeArchetypeChunk
+{
+	uint32_t count;
+	uint8_t *data;
+};
+
+struct NeArchetype
+{
+	uint64_t hash;
+	uint32_t typeCount, capacity, freeChunk;
+	size_t dataSize, alignment;
+	NeCompTypeId compTypes[MAX_ENTITY_COMPONENTS];
+	size_t offset[MAX_ENTITY_COMPONENTS], size[MAX_ENTITY_COMPONENTS];
+	struct NeArray chunks;
+};
+
+struct NeCompLocation
+{
+	uint32_t archetype, chunk;
+	uint16_t row, column;
+};
+
+// Progress of the compaction of a type in per-type storage; the slots in [write, read) are free
+struct NeCompCompaction
+{
+	uint32_t write, read;
+	bool active, fragmented, unsorted;
+};
+
+// Archetypes of a query's cache, with the column of each of the query's types
+struct NeQueryArchetype
+{
+	uint32_t archetype;
+	uint8_t columns[MAX_ENTITY_COMPONENTS];
 };
 
 typedef bool (*NeCompSysRegisterAllProc)(void);
 
-extern struct NeQueue *ECS_mboxes;
+extern struct NeArray *ECS_mboxes;
+extern bool ECS_validateAccess;
+extern uint64_t ECS_compactionBudget;
 
 const struct NeCompType *ECS_ComponentType(NeCompTypeId typeId);
+size_t ECS_ComponentTypeCount(void);
 void *ECS_CommitedComponentPtr(struct NeScene *s, NeCompHandle handle);
 void *ECS_ComponentPtr(struct NeScene *s, NeCompHandle handle);
 void *ECS_GetComponent(struct NeScene *s, NeEntityHandle handle, NeCompTypeId type);
 
+// In per-type storage the handle id indexes the slot table of the type, which holds the slot of the component in
+// the type's array, or ECS_INVALID_SLOT; ids taken from the free list keep their slot until the storage is compacted
+void *ECS_SlotComponent(struct NeScene *s, NeCompTypeId type, uint32_t id);
+uint32_t *ECS_GrowSlots(struct NeScene *s, NeCompTypeId type, uint32_t id);
+size_t ECS_ComponentIdCount(struct NeScene *s, NeCompTypeId type);
+
+static inline bool ECS_CopyableComponent(const struct NeCompType *type) { return !type->script && (!type->term || type->instantiate); }
+
+// Creates count components from a prefab's component; they take count pending slots, starting at first
+bool ECS_CreateComponents(struct NeScene *s, const struct NePrefabComp *pc, const NeEntityHandle *owners,
+	const struct NePrefabTransform *xforms, NeCompHandle *handles, uint32_t count, size_t *first);
+
+// Destroys components created by ECS_CreateComponents before they are committed; the first ones are terminated
+void ECS_ReleaseComponents(struct NeScene *s, NeCompTypeId type, size_t first, uint32_t initialized, uint32_t count);
+
+// Copies the NULL terminated argument array in one allocation, the strings after the array
+const void **ECS_CopyComponentArgs(const void **args, enum NeMemoryHeap heap);
+
+extern struct NeEntitySlot *ECS_entitySlots[ECS_MAX_ENTITY_PAGES];
+
+static inline struct NeEntity *
+ECS_EntityPtr(NeEntityHandle handle)
+{
+	const uint32_t slot = ECS_ENTITY_SLOT(handle);
+	if (slot >= ECS_MAX_ENTITY_PAGES * ECS_ENTITY_PAGE_SIZE)
+		return NULL;
+
+	const struct NeEntitySlot *page = ECS_entitySlots[slot >> ECS_ENTITY_PAGE_BITS];
+	if (!page)
+		return NULL;
+
+	const struct NeEntitySlot *es = &page[slot & (ECS_ENTITY_PAGE_SIZE - 1)];
+	return es->generation == ECS_ENTITY_GENERATION(handle) ? es->ent : NULL;
+}
+
+/*
+ * compIndex is a sparse set over comp: it holds the position + 1 in comp of each component type that was registered
+ * when the entity was created, or 0 if the entity doesn't have one. Types registered later are searched for.
+ */
+static inline uint32_t
+ECS_EntityComponentIndex(const struct NeEntity *ent, NeCompTypeId type)
+{
+	if (type < ent->compIndexSize)
+		return (uint32_t)ent->compIndex[type] - 1;
+
+	for (uint32_t i = 0; i < ent->compCount; ++i)
+		if (ent->comp[i].type == type)
+			return i;
+
+	return UINT32_MAX;
+}
+
+uint32_t ECS_RegisterQuery(const NeCompTypeId *compTypes, size_t typeCount);
+
+// The functions below must be called with the scene's component lock held for writing
+void ECS_SyncQueries(struct NeScene *s);
+void ECS_QueryComponentAdded(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type);
+void ECS_QueryComponentRemoved(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type);
+void ECS_QueryArchetypeAdded(struct NeScene *s, uint32_t archetype);
+
+// Query rows hold the owner entity followed by the slot of each component, in the order of the query's types
+static inline NeEntityHandle ECS_QueryRowOwner(const uint8_t *row) { return *(NeEntityHandle *)row; }
+static inline const uint32_t *ECS_QueryRowSlots(const uint8_t *row) { return (const uint32_t *)(row + sizeof(NeEntityHandle)); }
+
+void *ECS_ArchetypeComponentPtr(struct NeScene *s, NeCompHandle handle);
+void ECS_ArchetypeForEach(struct NeScene *s, NeCompTypeId type, NeCompIteratorProc proc, void *user);
+size_t ECS_ArchetypeSlotCount(struct NeScene *s, NeCompTypeId type);
+bool ECS_ArchetypeTypeRegistered(struct NeScene *s);
+void ECS_ArchetypeStorageInfo(struct NeScene *s, NeCompTypeId type, struct NeCompStorageInfo *info);
+
+// The functions below must be called with the scene's component lock held for writing
+void ECS_ArchetypeComponentMoved(struct NeScene *s, NeCompHandle handle);
+void ECS_ArchetypeComponentDestroyed(struct NeScene *s, NeCompHandle handle);
+void ECS_CommitArchetypes(struct NeScene *s);
+bool ECS_CompactArchetype(struct NeScene *s, uint32_t archetype);
+void ECS_CompactStorage(struct NeScene *s, uint64_t budget);
+
+// A chunk holds the owner of each row followed by one column per component type
+static inline NeEntityHandle *ECS_ChunkOwners(const struct NeArchetypeChunk *c) { return (NeEntityHandle *)c->data; }
+static inline uint8_t *ECS_ChunkColumn(const struct NeArchetype *a, const struct NeArchetypeChunk *c, uint32_t column) { return c->data + a->offset[column]; }
+
+// Versions of the components of the types a system filters with ECSYS_CHANGED, in the order of its types
+struct NeChangeFilter
+{
+	uint32_t since, typeCount;
+	uint32_t column[MAX_ENTITY_COMPONENTS];
+	size_t count[MAX_ENTITY_COMPONENTS];
+	const uint32_t *versions[MAX_ENTITY_COMPONENTS], *blocks[MAX_ENTITY_COMPONENTS];
+};
+
+uint32_t ECS_RegisterChangeFilter(const struct NeECSystem *sys);
+bool ECS_BeginChangeFilter(struct NeScene *s, const struct NeECSystem *sys, struct NeChangeFilter *f);
+
+// The functions below must be called with the scene's component lock held for writing
+void ECS_CommitChanges(struct NeScene *s);
+void ECS_ComponentCreated(struct NeScene *s, NeCompHandle handle);
+
+// Versions wrap around, a version is newer if it is less than half of the range ahead
+static inline bool ECS_VersionNewer(uint32_t version, uint32_t since) { return (int32_t)(version - since) >= 0; }
+
+static inline bool
+ECS_SlotChanged(const struct NeChangeFilter *f, uint32_t i, uint32_t slot)
+{
+	// slots without a version were committed before the type was tracked
+	if (slot >= f->count[i])
+		return true;
+
+	return ECS_VersionNewer(f->blocks[i][slot >> ECS_CHANGE_BLOCK_BITS], f->since) && ECS_VersionNewer(f->versions[i][slot], f->since);
+}
+
+// True if any of the filtered components changed; slots are in the order of the system's types
+static inline bool
+ECS_SlotsChanged(const struct NeChangeFilter *f, const uint32_t *slots)
+{
+	for (uint32_t i = 0; i < f->typeCount; ++i)
+		if (ECS_SlotChanged(f, i, slots[f->column[i]]))
+			return true;
+	return false;
+}
+
+// Returns the first slot in [slot, end) that holds a changed component of the first filtered type, or end
+static inline uint64_t
+ECS_NextChangedSlot(const struct NeChangeFilter *f, uint64_t slot, uint64_t end)
+{
+	while (slot < end && slot < f->count[0]) {
+		if (!ECS_VersionNewer(f->blocks[0][slot >> ECS_CHANGE_BLOCK_BITS], f->since))
+			slot = ((slot >> ECS_CHANGE_BLOCK_BITS) + 1) << ECS_CHANGE_BLOCK_BITS;
+		else if (ECS_VersionNewer(f->versions[0][slot], f->since))
+			return slot;
+		else
+			++slot;
+	}
+
+	return slot < end ? slot : end;
+}
+
+// Logs lookups of component types the system running on the calling thread didn't declare
+void ECS_ValidateAccess(NeCompTypeId type);
+static inline void ECS_CheckAccess(NeCompTypeId type) { if (ECS_validateAccess) ECS_ValidateAccess(type); }
+
+// Releases the name tables replaced since the last call; called by Scn_Commit, when no lookups are running
+void ECS_ReleaseEntityNames(struct NeScene *s);
+
+// Run the deferred entity commands; Scn_Commit runs the parent commands after the new components are committed
+void ECS_ExecuteCommands(struct NeScene *s);
+void ECS_ExecuteParentCommands(struct NeScene *s);
+
 void E_DistributeMessages(void);
 void E_ProcessMessages(struct NeScene *s);
 
@@ -99,10 +367,31 @@ void E_TermSceneComponents(struct NeScene *s);
 bool E_InitSceneEntities(struct NeScene *s);
 void E_TermSceneEntities(struct NeScene *s);
 
+bool E_InitSceneArchetypes(struct NeScene *s, size_t typeCount);
+void E_TermSceneArchetypes(struct NeScene *s);
+
+bool E_InitQueries(void);
+void E_TermQueries(void);
+
+bool E_InitSceneQueries(struct NeScene *s);
+void E_TermSceneQueries(struct NeScene *s);
+
+bool E_InitChanges(void);
+void E_TermChanges(void);
+
+bool E_InitSceneChanges(struct NeScene *s);
+void E_TermSceneChanges(struct NeScene *s);
+
 bool E_InitECSystems(void);
 void E_ReloadSystemScripts(void);
 void E_TermECSystems(void);
 
+bool E_InitSceneSystems(struct NeScene *s);
+void E_TermSceneSystems(struct NeScene *s);
+
+// Adds the progress of the time-sliced systems registered since the last commit; called with the component lock held
+void ECS_CommitSlices(struct NeScene *s);
+
 #ifdef __cplusplus
 }
 #endif
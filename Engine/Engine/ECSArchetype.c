@@ -0,0 +1,680 @@
+#include <System/Log.h>
+#include <Runtime/Runtime.h>
+#include <Scene/Scene.h>
+#include <Engine/Events.h>
+#include <Engine/Entity.h>
+#include <Engine/Component.h>
+
+#include "ECS.h"
+
+#define ARCH_MOD	"ECSArchetype"
+
+// Location of a component created this frame; the chunk field holds its index in the pending array
+#define PENDING_ARCHETYPE	(ECS_INVALID_ARCHETYPE - 1)
+
+/*
+ * Archetype storage keeps the components of entities with the same set of component types together, in chunks of
+ * about ECS_CHUNK_SIZE bytes. A chunk starts with the column of owners, followed by one column per component type, so
+ * a system reads each of its components sequentially. Components that are not attached to an entity are stored alone,
+ * in the archetype of their type. The location of every component is kept in a table indexed by the handle id, which
+ * is how E_ComponentPtrS finds a component; E_ComponentHandle is unaffected because the handle is stored in the
+ * component. Structural changes are deferred to Scn_Commit: destroyed components stay in their row and keep their slot
+ * until then, and entities move between archetypes only when the scene is committed, so component pointers remain
+ * valid for the rest of the frame as they do with the per-type arrays.
+ */
+
+static inline struct NeCompLocation *LocationPtr(struct NeScene *s, NeCompTypeId type, uint32_t id);
+static inline struct NeCompLocation *GrowLocation(struct NeScene *s, NeCompTypeId type, uint32_t id);
+static inline struct NeCompBase *RowComponent(const struct NeArchetype *a, const struct NeArchetypeChunk *c, uint32_t column, uint32_t row);
+static uint32_t FindArchetype(struct NeScene *s, const NeCompTypeId *types, uint32_t count);
+static bool InitArchetype(struct NeArchetype *a, const NeCompTypeId *types, uint32_t count);
+static bool AllocRow(struct NeArchetype *a, uint32_t *chunk, uint32_t *row);
+static void RemoveRow(struct NeScene *s, const struct NeCompLocation *loc);
+static void PlaceEntity(struct NeScene *s, struct NeEntity *ent, struct NeArray *removed);
+static void PlaceComponent(struct NeScene *s, struct NeCompBase *comp);
+static inline void CopyRows(const struct NeArchetype *a, struct NeArchetypeChunk *dst, uint32_t dstRow,
+	const struct NeArchetypeChunk *src, uint32_t srcRow, uint32_t count);
+static void UpdateLocations(struct NeScene *s, uint32_t id, const struct NeArchetype *a, uint32_t chunk, uint32_t row, uint32_t count);
+static void ReleaseChunks(struct NeArchetype *a);
+static int PtrCmp(const void *a, const void *b);
+static int RowCmp(const void *a, const void *b);
+
+void *
+ECS_ArchetypeComponentPtr(struct NeScene *s, NeCompHandle handle)
+{
+	const struct NeCompLocation *l = LocationPtr(s, E_HANDLE_TYPE(handle), E_HANDLE_ID(handle));
+	if (!l || l->archetype >= s->archetypes.count)
+		return NULL;
+
+	const struct NeArchetype *a = Rt_ArrayGet(&s->archetypes, l->archetype);
+	return RowComponent(a, Rt_ArrayGet(&a->chunks, l->chunk), l->column, l->row);
+}
+
+void
+ECS_ArchetypeForEach(struct NeScene *s, NeCompTypeId type, NeCompIteratorProc proc, void *user)
+{
+	const struct NeArchetype *a;
+	Rt_ArrayForEach(a, &s->archetypes) {
+		uint32_t column = 0;
+		while (column < a->typeCount && a->compTypes[column] != type)
+			++column;
+
+		if (column == a->typeCount)
+			continue;
+
+		const struct NeArchetypeChunk *c;
+		Rt_ArrayForEach(c, &a->chunks) {
+			for (uint32_t i = 0; i < c->count; ++i) {
+				struct NeCompBase *comp = RowComponent(a, c, column, i);
+				if (comp->_valid && !proc(comp, user))
+					return;
+			}
+		}
+	}
+}
+
+void
+ECS_ArchetypeComponentMoved(struct NeScene *s, NeCompHandle handle)
+{
+	if (!Rt_ArrayAdd(&s->movedComp, &handle))
+		Sys_LogEntry(ARCH_MOD, LOG_CRITICAL, "Failed to record component move in scene %s", s->name);
+}
+
+void
+ECS_ArchetypeComponentDestroyed(struct NeScene *s, NeCompHandle handle)
+{
+	if (!Rt_ArrayAdd(&s->destroyedComp, &handle))
+		Sys_LogEntry(ARCH_MOD, LOG_CRITICAL, "Failed to record component destruction in scene %s", s->name);
+}
+
+void
+ECS_CommitArchetypes(struct NeScene *s)
+{
+	NeCompHandle *handle;
+	struct NeArray owners, removed;
+
+	if (!Rt_InitPtrArray(&owners, 100, MH_Frame) || !Rt_InitArray(&removed, 100, sizeof(struct NeCompLocation), MH_Frame)) {
+		Sys_LogEntry(ARCH_MOD, LOG_CRITICAL, "Failed to commit scene %s: out of memory", s->name);
+		return;
+	}
+
+	// mark the components created this frame; the owners are placed together with their existing components
+	for (size_t i = 0; i < s->newCompData.count; ++i) {
+		const struct NeArray *nc = Rt_ArrayGet(&s->newCompData, i);
+		for (size_t j = 0; j < nc->count; ++j) {
+			const struct NeCompBase *comp = Rt_ArrayGet(nc, j);
+
+			// the table covers the slots of components destroyed before the commit too, as they are in the free list
+			struct NeCompLocation *l = GrowLocation(s, i, comp->_handleId);
+			if (!l) {
+				Sys_LogEntry(ARCH_MOD, LOG_CRITICAL, "Failed to allocate location for component in scene %s", s->name);
+				continue;
+			}
+
+			if (!comp->_valid)
+				continue;
+
+			*l = (struct NeCompLocation){ .archetype = PENDING_ARCHETYPE, .chunk = (uint32_t)j };
+
+			if (comp->_owner)
+				Rt_ArrayAddPtr(&owners, comp->_owner);
+		}
+	}
+
+	Rt_ArrayForEach(handle, &s->movedComp) {
+		const struct NeCompBase *comp = ECS_ArchetypeComponentPtr(s, *handle);
+		if (comp && comp->_valid && comp->_owner)
+			Rt_ArrayAddPtr(&owners, comp->_owner);
+	}
+
+	// rows without a valid component belong to destroyed entities and are not dereferenced
+	Rt_ArrayForEach(handle, &s->destroyedComp) {
+		const struct NeCompLocation *l = LocationPtr(s, E_HANDLE_TYPE(*handle), E_HANDLE_ID(*handle));
+		if (!l || l->archetype >= s->archetypes.count)
+			continue;
+
+		const struct NeArchetype *a = Rt_ArrayGet(&s->archetypes, l->archetype);
+		const struct NeArchetypeChunk *c = Rt_ArrayGet(&a->chunks, l->chunk);
+
+		bool alive = false;
+		for (uint32_t i = 0; i < a->typeCount && !alive; ++i)
+			alive = RowComponent(a, c, i, l->row)->_valid;
+
+		if (alive)
+			Rt_ArrayAddPtr(&owners, ECS_ChunkOwners(c)[l->row]);
+		else
+			Rt_ArrayAdd(&removed, l);
+	}
+
+	Rt_ArraySort(&owners, PtrCmp);
+	for (size_t i = 0; i < owners.count; ++i) {
+		const NeEntityHandle owner = Rt_ArrayGetPtr(&owners, i);
+		struct NeEntity *ent = ECS_EntityPtr(owner);
+		if (ent && (!i || owner != Rt_ArrayGetPtr(&owners, i - 1)))
+			PlaceEntity(s, ent, &removed);
+	}
+
+	// components that are not in the component list of their owner
+	for (size_t i = 0; i < s->newCompData.count; ++i) {
+		const struct NeArray *nc = Rt_ArrayGet(&s->newCompData, i);
+		for (size_t j = 0; j < nc->count; ++j) {
+			struct NeCompBase *comp = Rt_ArrayGet(nc, j);
+			if (!comp->_valid)
+				continue;
+
+			const struct NeCompLocation *l = LocationPtr(s, i, comp->_handleId);
+			if (l && l->archetype == PENDING_ARCHETYPE && l->chunk == j)
+				PlaceComponent(s, comp);
+		}
+	}
+
+	// the rows are removed from the end of each chunk, so the locations collected above remain valid
+	Rt_ArraySort(&removed, RowCmp);
+	for (size_t i = 0; i < removed.count; ++i)
+		if (!i || RowCmp(Rt_ArrayGet(&removed, i), Rt_ArrayGet(&removed, i - 1)))
+			RemoveRow(s, Rt_ArrayGet(&removed, i));
+
+	Rt_ArrayForEach(handle, &s->destroyedComp) {
+		struct NeCompLocation *l = LocationPtr(s, E_HANDLE_TYPE(*handle), E_HANDLE_ID(*handle));
+		if (l)
+			l->archetype = ECS_INVALID_ARCHETYPE;
+
+		size_t idx = E_HANDLE_ID(*handle);
+		Rt_QueuePush(Rt_ArrayGet(&s->compFree, E_HANDLE_TYPE(*handle)), &idx);
+	}
+
+	Rt_ClearArray(&s->movedComp, false);
+	Rt_ClearArray(&s->destroyedComp, false);
+	Rt_TermArray(&owners);
+	Rt_TermArray(&removed);
+}
+
+/*
+ * Moves rows from the first chunk that has rows after the first chunk with free space to the end of the latter, and
+ * the rows left in the source to its start, so the rows keep their order. Returns false if the archetype is compact,
+ * after the empty chunks at its end are released.
+ */
+bool
+ECS_CompactArchetype(struct NeScene *s, uint32_t id)
+{
+	struct NeArchetype *a = Rt_ArrayGet(&s->archetypes, id);
+	struct NeArchetypeChunk *dst = NULL, *src = NULL;
+	uint32_t dstChunk, srcChunk;
+
+	// the chunks before freeChunk are full
+	for (dstChunk = a->freeChunk; dstChunk < a->chunks.count; ++dstChunk)
+		if ((dst = Rt_ArrayGet(&a->chunks, dstChunk))->count < a->capacity)
+			break;
+
+	a->freeChunk = dstChunk;
+
+	for (srcChunk = dstChunk + 1; srcChunk < a->chunks.count; ++srcChunk)
+		if ((src = Rt_ArrayGet(&a->chunks, srcChunk))->count)
+			break;
+
+	if (srcChunk >= a->chunks.count) {
+		ReleaseChunks(a);
+		return false;
+	}
+
+	const uint32_t space = a->capacity - dst->count;
+	const uint32_t count = space < src->count ? space : src->count;
+
+	CopyRows(a, dst, dst->count, src, 0, count);
+	UpdateLocations(s, id, a, dstChunk, dst->count, count);
+	dst->count += count;
+
+	src->count -= count;
+	if (src->count) {
+		CopyRows(a, src, 0, src, count, src->count);
+		UpdateLocations(s, id, a, srcChunk, 0, src->count);
+	}
+
+	return true;
+}
+
+void
+ECS_ArchetypeStorageInfo(struct NeScene *s, NeCompTypeId type, struct NeCompStorageInfo *info)
+{
+	const struct NeArchetype *a;
+	Rt_ArrayForEach(a, &s->archetypes) {
+		uint32_t column = 0;
+		while (column < a->typeCount && a->compTypes[column] != type)
+			++column;
+
+		if (column == a->typeCount)
+			continue;
+
+		size_t count = 0;
+		const struct NeArchetypeChunk *c;
+		Rt_ArrayForEach(c, &a->chunks) {
+			// iteration only reads the rows of a chunk
+			if (c->count)
+				info->span += a->capacity;
+			count += c->count;
+		}
+
+		info->count += count;
+		info->minSpan += (count + a->capacity - 1) / a->capacity * a->capacity;
+		info->memory += a->dataSize * a->chunks.count;
+	}
+}
+
+size_t
+ECS_ArchetypeSlotCount(struct NeScene *s, NeCompTypeId type)
+{
+	const struct NeArray *la = Rt_ArrayGet(&s->compLocation, type);
+	return la ? la->count : 0;
+}
+
+bool
+ECS_ArchetypeTypeRegistered(struct NeScene *s)
+{
+	return Rt_InitArray(Rt_ArrayAllocate(&s->compLocation), 10, sizeof(struct NeCompLocation), MH_Scene);
+}
+
+bool
+E_InitSceneArchetypes(struct NeScene *s, size_t typeCount)
+{
+	if (!Rt_InitArray(&s->archetypes, 10, sizeof(struct NeArchetype), MH_Scene))
+		return false;
+
+	if (!Rt_InitArray(&s->compLocation, typeCount ? typeCount : 10, sizeof(struct NeArray), MH_Scene))
+		return false;
+
+	if (!Rt_InitArray(&s->movedComp, 10, sizeof(NeCompHandle), MH_Scene))
+		return false;
+
+	if (!Rt_InitArray(&s->destroyedComp, 10, sizeof(NeCompHandle), MH_Scene))
+		return false;
+
+	for (size_t i = 0; i < typeCount; ++i)
+		if (!ECS_ArchetypeTypeRegistered(s))
+			return false;
+
+	return true;
+}
+
+void
+E_TermSceneArchetypes(struct NeScene *s)
+{
+	struct NeArchetype *a;
+	Rt_ArrayForEach(a, &s->archetypes) {
+		struct NeArchetypeChunk *c;
+		Rt_ArrayForEach(c, &a->chunks)
+			Sys_Free(c->data);
+		Rt_TermArray(&a->chunks);
+	}
+
+	struct NeArray *la;
+	Rt_ArrayForEach(la, &s->compLocation)
+		Rt_TermArray(la);
+
+	Rt_TermArray(&s->destroyedComp);
+	Rt_TermArray(&s->movedComp);
+	Rt_TermArray(&s->compLocation);
+	Rt_TermArray(&s->archetypes);
+}
+
+static inline struct NeCompLocation *
+LocationPtr(struct NeScene *s, NeCompTypeId type, uint32_t id)
+{
+	const struct NeArray *la = Rt_ArrayGet(&s->compLocation, type);
+	return la ? Rt_ArrayGet(la, id) : NULL;
+}
+
+static inline struct NeCompLocation *
+GrowLocation(struct NeScene *s, NeCompTypeId type, uint32_t id)
+{
+	struct NeArray *la = Rt_ArrayGet(&s->compLocation, type);
+	if (!la)
+		return NULL;
+
+	if (id >= la->count) {
+		if (id >= la->size && !Rt_ResizeArray(la, id < la->size * 2 ? la->size * 2 : id + 1))
+			return NULL;
+
+		// all bits set is ECS_INVALID_ARCHETYPE
+		memset(la->data + la->elemSize * la->count, 0xFF, la->elemSize * (id + 1 - la->count));
+		la->count = id + 1;
+	}
+
+	return Rt_ArrayGet(la, id);
+}
+
+static inline struct NeCompBase *
+RowComponent(const struct NeArchetype *a, const struct NeArchetypeChunk *c, uint32_t column, uint32_t row)
+{
+	return (struct NeCompBase *)(ECS_ChunkColumn(a, c, column) + a->size[column] * row);
+}
+
+static uint32_t
+FindArchetype(struct NeScene *s, const NeCompTypeId *types, uint32_t count)
+{
+	const uint64_t hash = Rt_HashMemory((const uint8_t *)types, sizeof(*types) * count);
+
+	for (uint32_t i = 0; i < s->archetypes.count; ++i) {
+		const struct NeArchetype *a = Rt_ArrayGet(&s->archetypes, i);
+		if (a->hash == hash && a->typeCount == count && !memcmp(a->compTypes, types, sizeof(*types) * count))
+			return i;
+	}
+
+	struct NeArchetype *a = Rt_ArrayAllocate(&s->archetypes);
+	if (!a || !InitArchetype(a, types, count)) {
+		Sys_LogEntry(ARCH_MOD, LOG_CRITICAL, "Failed to create archetype in scene %s", s->name);
+		if (a)
+			--s->archetypes.count;
+		return ECS_INVALID_ARCHETYPE;
+	}
+
+	a->hash = hash;
+
+	const uint32_t id = (uint32_t)s->archetypes.count - 1;
+	ECS_QueryArchetypeAdded(s, id);
+
+	return id;
+}
+
+static bool
+InitArchetype(struct NeArchetype *a, const NeCompTypeId *types, uint32_t count)
+{
+	size_t rowSize = sizeof(NeEntityHandle);
+
+	a->typeCount = count;
+	a->alignment = NE_DEFAULT_ALIGNMENT;
+	memcpy(a->compTypes, types, sizeof(*types) * count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		const struct NeCompType *type = ECS_ComponentType(types[i]);
+		a->size[i] = type->size;
+		rowSize += type->size;
+
+		if (type->alignment > a->alignment)
+			a->alignment = type->alignment;
+	}
+
+	a->capacity = ECS_CHUNK_SIZE / rowSize;
+	if (!a->capacity)
+		a->capacity = 1;
+	else if (a->capacity > UINT16_MAX)
+		a->capacity = UINT16_MAX;
+
+	// the alignment padding between columns may not fit; components larger than a chunk get a chunk of their own
+	for (;;) {
+		size_t offset = sizeof(NeEntityHandle) * a->capacity;
+		for (uint32_t i = 0; i < count; ++i) {
+			offset = NE_ROUND_UP(offset, ECS_ComponentType(types[i])->alignment);
+			a->offset[i] = offset;
+			offset += a->size[i] * a->capacity;
+		}
+
+		if (offset <= ECS_CHUNK_SIZE || a->capacity == 1) {
+			a->dataSize = offset;
+			break;
+		}
+
+		--a->capacity;
+	}
+
+	return Rt_InitArray(&a->chunks, 4, sizeof(struct NeArchetypeChunk), MH_Scene);
+}
+
+static bool
+AllocRow(struct NeArchetype *a, uint32_t *chunk, uint32_t *row)
+{
+	struct NeArchetypeChunk *c = NULL;
+
+	for (; a->freeChunk < a->chunks.count; ++a->freeChunk) {
+		c = Rt_ArrayGet(&a->chunks, a->freeChunk);
+		if (c->count < a->capacity)
+			break;
+		c = NULL;
+	}
+
+	if (!c) {
+		if (!(c = Rt_ArrayAllocate(&a->chunks)))
+			return false;
+
+		if (!(c->data = Sys_AlignedAllocNoZero(a->dataSize, 1, a->alignment, MH_Scene))) {
+			--a->chunks.count;
+			return false;
+		}
+
+		a->freeChunk = (uint32_t)a->chunks.count - 1;
+	}
+
+	*chunk = a->freeChunk;
+	*row = c->count++;
+
+	return true;
+}
+
+static void
+RemoveRow(struct NeScene *s, const struct NeCompLocation *loc)
+{
+	struct NeArchetype *a = Rt_ArrayGet(&s->archetypes, loc->archetype);
+	struct NeArchetypeChunk *c = Rt_ArrayGet(&a->chunks, loc->chunk);
+	const uint32_t last = --c->count;
+
+	if (loc->row != last) {
+		ECS_ChunkOwners(c)[loc->row] = ECS_ChunkOwners(c)[last];
+
+		for (uint32_t i = 0; i < a->typeCount; ++i) {
+			struct NeCompBase *comp = RowComponent(a, c, i, loc->row);
+			memcpy(comp, RowComponent(a, c, i, last), a->size[i]);
+
+			// the location of a component that moved to another row in this commit no longer points here
+			struct NeCompLocation *l = LocationPtr(s, a->compTypes[i], comp->_handleId);
+			if (l && l->archetype == loc->archetype && l->chunk == loc->chunk && l->row == last)
+				l->row = loc->row;
+		}
+	}
+
+	if (loc->chunk < a->freeChunk)
+		a->freeChunk = loc->chunk;
+}
+
+static void
+PlaceEntity(struct NeScene *s, struct NeEntity *ent, struct NeArray *removed)
+{
+	uint32_t count = 0, committed = 0, chunk, row;
+	NeCompTypeId types[MAX_ENTITY_COMPONENTS];
+	struct NeCompBase *src[MAX_ENTITY_COMPONENTS];
+	struct NeCompLocation old[MAX_ENTITY_COMPONENTS];
+
+	for (uint32_t i = 0; i < ent->compCount; ++i) {
+		const NeCompTypeId type = ent->comp[i].type;
+		const struct NeCompLocation *l = LocationPtr(s, type, E_HANDLE_ID(ent->comp[i].handle));
+		struct NeCompBase *comp = NULL;
+
+		if (!l) {
+			continue;
+		} else if (l->archetype == PENDING_ARCHETYPE) {
+			comp = Rt_ArrayGet(Rt_ArrayGet(&s->newCompData, type), l->chunk);
+		} else if (l->archetype != ECS_INVALID_ARCHETYPE) {
+			comp = ECS_ArchetypeComponentPtr(s, ent->comp[i].handle);
+			if (comp && comp->_valid && comp->_owner == ent->handle)
+				old[committed++] = *l;
+		}
+
+		if (!comp || !comp->_valid || comp->_owner != ent->handle)
+			continue;
+
+		// keep the types sorted, so the same set always maps to the same archetype
+		uint32_t j = count++;
+		for (; j && types[j - 1] > type; --j) {
+			types[j] = types[j - 1];
+			src[j] = src[j - 1];
+		}
+		types[j] = type;
+		src[j] = comp;
+	}
+
+	if (!count) {
+		for (uint32_t i = 0; i < committed; ++i)
+			Rt_ArrayAdd(removed, &old[i]);
+		return;
+	}
+
+	const uint32_t id = FindArchetype(s, types, count);
+	if (id == ECS_INVALID_ARCHETYPE)
+		return;
+
+	// attached to an entity that did not change
+	if (committed == count && old[0].archetype == id) {
+		bool same = true;
+		for (uint32_t i = 1; i < committed && same; ++i)
+			same = old[i].chunk == old[0].chunk && old[i].row == old[0].row && old[i].archetype == id;
+
+		if (same)
+			return;
+	}
+
+	struct NeArchetype *a = Rt_ArrayGet(&s->archetypes, id);
+	if (!AllocRow(a, &chunk, &row)) {
+		Sys_LogEntry(ARCH_MOD, LOG_CRITICAL, "Failed to allocate chunk in scene %s", s->name);
+		return;
+	}
+
+	const struct NeArchetypeChunk *c = Rt_ArrayGet(&a->chunks, chunk);
+	ECS_ChunkOwners(c)[row] = ent->handle;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		memcpy(RowComponent(a, c, i, row), src[i], a->size[i]);
+		*LocationPtr(s, types[i], src[i]->_handleId) =
+			(struct NeCompLocation){ .archetype = id, .chunk = chunk, .row = (uint16_t)row, .column = (uint16_t)i };
+	}
+
+	for (uint32_t i = 0; i < committed; ++i)
+		Rt_ArrayAdd(removed, &old[i]);
+}
+
+static void
+PlaceComponent(struct NeScene *s, struct NeCompBase *comp)
+{
+	uint32_t chunk, row;
+	const NeCompTypeId type = comp->_typeId;
+
+	const uint32_t id = FindArchetype(s, &type, 1);
+	if (id == ECS_INVALID_ARCHETYPE)
+		return;
+
+	struct NeArchetype *a = Rt_ArrayGet(&s->archetypes, id);
+	if (!AllocRow(a, &chunk, &row)) {
+		Sys_LogEntry(ARCH_MOD, LOG_CRITICAL, "Failed to allocate chunk in scene %s", s->name);
+		return;
+	}
+
+	const struct NeArchetypeChunk *c = Rt_ArrayGet(&a->chunks, chunk);
+	ECS_ChunkOwners(c)[row] = comp->_owner;
+	memcpy(RowComponent(a, c, 0, row), comp, a->size[0]);
+
+	*LocationPtr(s, type, comp->_handleId) = (struct NeCompLocation){ .archetype = id, .chunk = chunk, .row = (uint16_t)row };
+}
+
+static inline void
+CopyRows(const struct NeArchetype *a, struct NeArchetypeChunk *dst, uint32_t dstRow,
+	const struct NeArchetypeChunk *src, uint32_t srcRow, uint32_t count)
+{
+	memmove(ECS_ChunkOwners(dst) + dstRow, ECS_ChunkOwners(src) + srcRow, sizeof(NeEntityHandle) * count);
+
+	for (uint32_t i = 0; i < a->typeCount; ++i)
+		memmove(RowComponent(a, dst, i, dstRow), RowComponent(a, src, i, srcRow), a->size[i] * count);
+}
+
+static void
+UpdateLocations(struct NeScene *s, uint32_t id, const struct NeArchetype *a, uint32_t chunk, uint32_t row, uint32_t count)
+{
+	const struct NeArchetypeChunk *c = Rt_ArrayGet(&a->chunks, chunk);
+
+	for (uint32_t i = 0; i < a->typeCount; ++i) {
+		for (uint32_t r = row; r < row + count; ++r) {
+			const struct NeCompBase *comp = RowComponent(a, c, i, r);
+
+			// the location of a component destroyed since the last commit may already be reused
+			struct NeCompLocation *l = LocationPtr(s, a->compTypes[i], comp->_handleId);
+			if (l && l->archetype == id && l->column == i) {
+				l->chunk = chunk;
+				l->row = (uint16_t)r;
+			}
+		}
+	}
+}
+
+static void
+ReleaseChunks(struct NeArchetype *a)
+{
+	// one empty chunk is kept, so an archetype that empties and fills every frame does not reallocate it
+	while (a->chunks.count > 1) {
+		const struct NeArchetypeChunk *last = (const struct NeArchetypeChunk *)Rt_ArrayLast(&a->chunks);
+		const struct NeArchetypeChunk *prev = Rt_ArrayGet(&a->chunks, a->chunks.count - 2);
+		if (last->count || prev->count)
+			break;
+
+		Sys_Free(last->data);
+		--a->chunks.count;
+	}
+
+	if (a->freeChunk > a->chunks.count)
+		a->freeChunk = (uint32_t)a->chunks.count;
+}
+
+static int
+PtrCmp(const void *a, const void *b)
+{
+	const uintptr_t pa = *(const uintptr_t *)a, pb = *(const uintptr_t *)b;
+	return (pa > pb) - (pa < pb);
+}
+
+static int
+RowCmp(const void *a, const void *b)
+{
+	const struct NeCompLocation *la = a, *lb = b;
+
+	// descending order, so removing a row never moves another row that is waiting to be removed
+	if (la->archetype != lb->archetype)
+		return la->archetype < lb->archetype ? 1 : -1;
+	if (la->chunk != lb->chunk)
+		return la->chunk < lb->chunk ? 1 : -1;
+	if (la->row != lb->row)
+		return la->row < lb->row ? 1 : -1;
+	return 0;
+}
+
+/* NekoEngine
+ *
+ * ECSArchetype.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
@@ -0,0 +1,328 @@
+#include <stdatomic.h>
+
+#include <System/Log.h>
+#include <Runtime/Runtime.h>
+#include <Scene/Scene.h>
+#include <Engine/Component.h>
+
+#include "ECS.h"
+
+#define CHANGE_MOD			"ECSChange"
+#define CHANGE_CLAMP_PERIOD	(1u << 29)
+#define CHANGE_CLAMP_AGE	(1u << 30)
+
+/*
+ * Change tracking for the component types systems filter with ECSYS_CHANGED. Every scene has a version counter that
+ * is incremented each time a filtering system runs; for each tracked type it keeps the version at which the component
+ * in every slot last changed, and the newest version of every block of 64 slots, so a filter skips unchanged blocks
+ * without reading their slots. A system sees the changes made from the start of its previous run, including its own,
+ * and runs for every component the first time. Components are stamped when Scn_Commit adds them; a component is marked
+ * by E_MarkComponentChangedS, which must not run concurrently with a system that filters on the component's type (the
+ * system scheduler guarantees this for systems that declare the type as writable). Parallel systems can mark
+ * components in the same block, so the version words are only raised, with a compare and swap.
+ *
+ * Versions are compared across the wrap around, which only works while they are less than 2^31 apart; every 2^29
+ * versions, Scn_Commit raises the ones older than 2^30 to that age. A component or a system that old then looks as
+ * if it changed or ran at the same version, so a filter may run once more for it but never misses a change.
+ */
+struct NeChangeSet
+{
+	bool tracked;
+	struct NeArray versions, blocks;
+};
+
+struct NeSceneChanges
+{
+	_Atomic uint32_t version;
+	uint32_t clamped;
+	struct NeArray types, systems;
+};
+
+static struct NeArray f_trackedTypes;
+static uint32_t f_filterCount;
+
+static inline bool IsTracked(NeCompTypeId type);
+static inline bool GrowChangeSet(struct NeChangeSet *cs, size_t count, uint32_t version);
+static inline void StoreNewer(uint32_t *word, uint32_t version);
+static inline void ClampVersions(uint32_t *words, size_t count, uint32_t oldest);
+
+void
+E_MarkComponentChangedS(struct NeScene *s, NeCompHandle comp)
+{
+	if (!s || !s->changes)
+		return;
+
+	struct NeSceneChanges *ch = s->changes;
+	const struct NeChangeSet *cs = Rt_ArrayGet(&ch->types, E_HANDLE_TYPE(comp));
+	const uint32_t id = E_HANDLE_ID(comp);
+
+	// untracked types have no versions; components created this frame are stamped by Scn_Commit
+	if (!cs || id >= cs->versions.count)
+		return;
+
+	const uint32_t version = atomic_load_explicit(&ch->version, memory_order_relaxed);
+	StoreNewer(&((uint32_t *)cs->versions.data)[id], version);
+	StoreNewer(&((uint32_t *)cs->blocks.data)[id >> ECS_CHANGE_BLOCK_BITS], version);
+}
+
+uint32_t
+ECS_RegisterChangeFilter(const struct NeECSystem *sys)
+{
+	for (size_t i = 0; i < sys->typeCount; ++i) {
+		if (!(sys->changed & (1u << i)))
+			continue;
+
+		if (!IsTracked(sys->compTypes[i]) && !Rt_ArrayAdd(&f_trackedTypes, &sys->compTypes[i]))
+			Sys_LogEntry(CHANGE_MOD, LOG_CRITICAL, "Failed to track changes of %s", E_ComponentTypeName(sys->compTypes[i]));
+	}
+
+	return f_filterCount++;
+}
+
+bool
+ECS_BeginChangeFilter(struct NeScene *s, const struct NeECSystem *sys, struct NeChangeFilter *f)
+{
+	struct NeSceneChanges *ch = s->changes;
+
+	// systems registered since the last commit run unfiltered
+	uint32_t *last = Rt_ArrayGet(&ch->systems, sys->changeSlot);
+	if (!last)
+		return false;
+
+	// 0 is reserved for systems that never ran
+	uint32_t version = atomic_fetch_add(&ch->version, 1) + 1;
+	if (!version)
+		version = atomic_fetch_add(&ch->version, 1) + 1;
+
+	f->since = *last;
+	*last = version;
+
+	if (!f->since)
+		return false;
+
+	f->typeCount = 0;
+	for (uint32_t i = 0; i < sys->typeCount; ++i) {
+		if (!(sys->changed & (1u << i)))
+			continue;
+
+		const struct NeChangeSet *cs = Rt_ArrayGet(&ch->types, sys->compTypes[i]);
+		const uint32_t n = f->typeCount++;
+
+		f->column[n] = i;
+		f->count[n] = cs ? cs->versions.count : 0;
+		f->versions[n] = cs ? (const uint32_t *)cs->versions.data : NULL;
+		f->blocks[n] = cs ? (const uint32_t *)cs->blocks.data : NULL;
+	}
+
+	return true;
+}
+
+void
+ECS_CommitChanges(struct NeScene *s)
+{
+	struct NeSceneChanges *ch = s->changes;
+	const uint32_t version = atomic_load_explicit(&ch->version, memory_order_relaxed);
+
+	while (ch->types.count < ECS_ComponentTypeCount()) {
+		struct NeChangeSet *cs = Rt_ArrayAllocate(&ch->types);
+		if (!cs || !Rt_InitArray(&cs->versions, 10, sizeof(uint32_t), MH_Scene) ||
+				!Rt_InitArray(&cs->blocks, 1, sizeof(uint32_t), MH_Scene)) {
+			Sys_LogEntry(CHANGE_MOD, LOG_CRITICAL, "Failed to allocate change set in scene %s", s->name);
+			return;
+		}
+	}
+
+	while (ch->systems.count < f_filterCount) {
+		const uint32_t never = 0;
+		if (!Rt_ArrayAdd(&ch->systems, &never)) {
+			Sys_LogEntry(CHANGE_MOD, LOG_CRITICAL, "Failed to allocate change filter in scene %s", s->name);
+			return;
+		}
+	}
+
+	// types tracked after their components were committed start out as changed
+	const NeCompTypeId *type;
+	Rt_ArrayForEach(type, &f_trackedTypes) {
+		struct NeChangeSet *cs = Rt_ArrayGet(&ch->types, *type);
+		cs->tracked = true;
+
+		if (!GrowChangeSet(cs, ECS_ComponentIdCount(s, *type), version))
+			Sys_LogEntry(CHANGE_MOD, LOG_CRITICAL, "Failed to grow change set in scene %s", s->name);
+	}
+
+	if (version - ch->clamped < CHANGE_CLAMP_PERIOD)
+		return;
+
+	// 0 marks the systems that never ran, so it is not used as the oldest version
+	uint32_t oldest = version - CHANGE_CLAMP_AGE;
+	if (!oldest)
+		--oldest;
+
+	struct NeChangeSet *cs;
+	Rt_ArrayForEach(cs, &ch->types) {
+		ClampVersions((uint32_t *)cs->versions.data, cs->versions.count, oldest);
+		ClampVersions((uint32_t *)cs->blocks.data, cs->blocks.count, oldest);
+	}
+
+	uint32_t *last;
+	Rt_ArrayForEach(last, &ch->systems)
+		if (*last && !ECS_VersionNewer(*last, oldest))
+			*last = oldest;
+
+	ch->clamped = version;
+}
+
+void
+ECS_ComponentCreated(struct NeScene *s, NeCompHandle handle)
+{
+	struct NeSceneChanges *ch = s->changes;
+	struct NeChangeSet *cs = Rt_ArrayGet(&ch->types, E_HANDLE_TYPE(handle));
+	const uint32_t id = E_HANDLE_ID(handle);
+	if (!cs || !cs->tracked)
+		return;
+
+	const uint32_t version = atomic_load_explicit(&ch->version, memory_order_relaxed);
+	if (!GrowChangeSet(cs, (size_t)id + 1, version)) {
+		Sys_LogEntry(CHANGE_MOD, LOG_CRITICAL, "Failed to grow change set in scene %s", s->name);
+		return;
+	}
+
+	((uint32_t *)cs->versions.data)[id] = version;
+	((uint32_t *)cs->blocks.data)[id >> ECS_CHANGE_BLOCK_BITS] = version;
+}
+
+bool
+E_InitChanges(void)
+{
+	f_filterCount = 0;
+	return Rt_InitArray(&f_trackedTypes, 10, sizeof(NeCompTypeId), MH_System);
+}
+
+void
+E_TermChanges(void)
+{
+	Rt_TermArray(&f_trackedTypes);
+}
+
+bool
+E_InitSceneChanges(struct NeScene *s)
+{
+	struct NeSceneChanges *ch = Sys_Alloc(sizeof(*ch), 1, MH_Scene);
+	if (!ch)
+		return false;
+
+	atomic_init(&ch->version, 1);
+	ch->clamped = 1;
+	s->changes = ch;
+
+	return Rt_InitArray(&ch->types, ECS_ComponentTypeCount() ? ECS_ComponentTypeCount() : 10, sizeof(struct NeChangeSet), MH_Scene) &&
+			Rt_InitArray(&ch->systems, 10, sizeof(uint32_t), MH_Scene);
+}
+
+void
+E_TermSceneChanges(struct NeScene *s)
+{
+	struct NeSceneChanges *ch = s->changes;
+	if (!ch)
+		return;
+
+	struct NeChangeSet *cs;
+	Rt_ArrayForEach(cs, &ch->types) {
+		Rt_TermArray(&cs->versions);
+		Rt_TermArray(&cs->blocks);
+	}
+
+	Rt_TermArray(&ch->types);
+	Rt_TermArray(&ch->systems);
+	Sys_Free(ch);
+
+	s->changes = NULL;
+}
+
+static inline bool
+IsTracked(NeCompTypeId type)
+{
+	const NeCompTypeId *t;
+	Rt_ArrayForEach(t, &f_trackedTypes)
+		if (*t == type)
+			return true;
+	return false;
+}
+
+static inline bool
+GrowChangeSet(struct NeChangeSet *cs, size_t count, uint32_t version)
+{
+	const size_t first = cs->versions.count;
+	if (first >= count)
+		return true;
+
+	while (cs->versions.count < count)
+		if (!Rt_ArrayAdd(&cs->versions, &version))
+			return false;
+
+	// the new slots may share a block with the existing ones
+	const size_t blocks = (count + (1 << ECS_CHANGE_BLOCK_BITS) - 1) >> ECS_CHANGE_BLOCK_BITS;
+	while (cs->blocks.count < blocks)
+		if (!Rt_ArrayAdd(&cs->blocks, &version))
+			return false;
+
+	((uint32_t *)cs->blocks.data)[first >> ECS_CHANGE_BLOCK_BITS] = version;
+	return true;
+}
+
+static inline void
+StoreNewer(uint32_t *word, uint32_t version)
+{
+	// the version of the scene only grows, but a worker can be preempted between reading and storing it
+	_Atomic uint32_t *w = (_Atomic uint32_t *)word;
+	uint32_t current = atomic_load_explicit(w, memory_order_relaxed);
+	while (!ECS_VersionNewer(current, version) &&
+			!atomic_compare_exchange_weak_explicit(w, &current, version, memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+static inline void
+ClampVersions(uint32_t *words, size_t count, uint32_t oldest)
+{
+	for (size_t i = 0; i < count; ++i)
+		if (!ECS_VersionNewer(words[i], oldest))
+			words[i] = oldest;
+}
+
+/* NekoEngine
+ *
+ * ECSChange.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
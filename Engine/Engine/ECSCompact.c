@@ -0,0 +1,370 @@
+#include <System/Log.h>
+#include <System/System.h>
+#include <Runtime/Runtime.h>
+#include <Scene/Scene.h>
+#include <Engine/Component.h>
+
+#include "ECS.h"
+
+#define COMPACT_MOD		"ECSCompact"
+#define COMPACT_GRAIN	256
+
+/*
+ * Removal leaves holes in the component storage that iteration walks over. In archetype storage, compaction moves
+ * the rows of an archetype's chunks towards its first chunk, keeping their order, and updates the location of the
+ * moved components. In per-type storage the handle id indexes the slot table of the type; compaction sweeps the
+ * array from its start, moving the live components over the holes in order and updating their slots, and releases
+ * the free slots at its end. Types that have a sort key (see E_SetComponentSortProc) are then sorted by it, so that
+ * e.g. transforms are stored in the order of the hierarchy. The handles stay the same in both storages, and the ids
+ * at the end of the tables are released when they are free. The work is split in steps, so that a call stops when
+ * its budget is spent and the next one continues from there; sorting a type is a single step. Compaction is off
+ * unless Engine_CompactionBudget is set.
+ */
+
+struct NeSlotKey
+{
+	uint64_t key;
+	uint32_t slot;
+};
+
+uint64_t ECS_compactionBudget;
+
+static bool CompactSlots(struct NeScene *s, NeCompTypeId type);
+static bool SortSlots(struct NeScene *s, NeCompTypeId type, NeCompSortKeyProc sortKey);
+static inline void ReleaseSlot(struct NeArray *sa, const struct NeCompBase *comp, uint32_t slot);
+static bool TrimIds(struct NeScene *s, NeCompTypeId type);
+static inline bool IdFree(struct NeScene *s, NeCompTypeId type, const struct NeArray *ids, size_t id);
+static inline size_t FreeId(const struct NeQueue *q, size_t i);
+static int IdCmp(const void *a, const void *b);
+static int KeyCmp(const void *a, const void *b);
+
+bool
+E_ComponentStorageInfoS(struct NeScene *s, NeCompTypeId type, struct NeCompStorageInfo *info)
+{
+	if (type >= s->compData.count)
+		return false;
+
+	memset(info, 0x0, sizeof(*info));
+
+	Sys_AtomicLockRead(&s->lock.comp);
+
+	if (s->archetypeStorage) {
+		ECS_ArchetypeStorageInfo(s, type, info);
+	} else {
+		const struct NeArray *a = Rt_ArrayGet(&s->compData, type);
+		const struct NeArray *sa = Rt_ArrayGet(&s->compSlot, type);
+
+		const struct NeCompBase *comp;
+		Rt_ArrayForEach(comp, a)
+			info->count += comp->_valid;
+
+		info->span = a->count;
+		info->minSpan = info->count;
+		info->memory = a->size * a->elemSize + sa->size * sa->elemSize;
+	}
+
+	Sys_AtomicUnlockRead(&s->lock.comp);
+
+	info->fragmentation = info->span ? 1.f - (float)info->minSpan / (float)info->span : 0.f;
+
+	return true;
+}
+
+void
+E_CompactComponentsS(struct NeScene *s, uint64_t budget)
+{
+	Sys_AtomicLockWrite(&s->lock.comp);
+	Sys_AtomicLockWrite(&s->lock.newComp);
+
+	ECS_CompactStorage(s, budget);
+
+	Sys_AtomicUnlockWrite(&s->lock.newComp);
+	Sys_AtomicUnlockWrite(&s->lock.comp);
+}
+
+void
+E_ComponentOrderChangedS(struct NeScene *s, NeCompTypeId type)
+{
+	struct NeCompCompaction *cc = Rt_ArrayGet(&s->compCompact, type);
+	if (cc)
+		cc->unsorted = true;
+}
+
+void
+ECS_CompactStorage(struct NeScene *s, uint64_t budget)
+{
+	const uint64_t end = Sys_Time() + budget;
+
+	// the archetypes hold the components systems iterate, so they are compacted first
+	const uint32_t archetypeCount = (uint32_t)s->archetypes.count;
+	for (uint32_t i = 0; i < archetypeCount; ++i) {
+		const uint32_t archetype = (s->compactArchetype + i) % archetypeCount;
+
+		while (ECS_CompactArchetype(s, archetype)) {
+			if (Sys_Time() >= end) {
+				s->compactArchetype = archetype;
+				return;
+			}
+		}
+	}
+
+	const uint32_t typeCount = (uint32_t)s->compData.count;
+	for (uint32_t i = 0; i < typeCount; ++i) {
+		const uint32_t type = (s->compactType + i) % typeCount;
+
+		while (!s->archetypeStorage && CompactSlots(s, type)) {
+			if (Sys_Time() >= end) {
+				s->compactType = type;
+				return;
+			}
+		}
+
+		if (TrimIds(s, type) && Sys_Time() >= end) {
+			s->compactType = type + 1;
+			return;
+		}
+	}
+}
+
+/*
+ * Moves up to COMPACT_GRAIN live components from the read cursor to the write cursor; the slots the read cursor
+ * passed are not in the slot table anymore, so components committed between the steps are written at the end of the
+ * array or over the holes outside [write, read). Returns false if the type is compact and sorted.
+ */
+static bool
+CompactSlots(struct NeScene *s, NeCompTypeId type)
+{
+	struct NeCompCompaction *cc = Rt_ArrayGet(&s->compCompact, type);
+	struct NeArray *a = Rt_ArrayGet(&s->compData, type);
+	struct NeArray *sa = Rt_ArrayGet(&s->compSlot, type);
+	uint32_t *slots = (uint32_t *)sa->data;
+	const NeCompSortKeyProc sortKey = ECS_ComponentType(type)->sortKey;
+
+	if (!cc->active) {
+		if (!cc->fragmented && !(sortKey && cc->unsorted))
+			return false;
+
+		cc->active = true;
+		cc->fragmented = false;
+		cc->write = cc->read = 0;
+	}
+
+	if (cc->read < a->count) {
+		const uint32_t end = a->count - cc->read > COMPACT_GRAIN ? cc->read + COMPACT_GRAIN : (uint32_t)a->count;
+
+		for (; cc->read < end; ++cc->read) {
+			struct NeCompBase *comp = Rt_ArrayGet(a, cc->read);
+
+			if (!comp->_valid) {
+				ReleaseSlot(sa, comp, cc->read);
+				continue;
+			}
+
+			if (cc->write != cc->read) {
+				memcpy(Rt_ArrayGet(a, cc->write), comp, a->elemSize);
+				slots[comp->_handleId] = cc->write;
+				comp->_valid = false;
+			}
+
+			++cc->write;
+		}
+
+		return true;
+	}
+
+	a->count = cc->write;
+	cc->active = false;
+
+	if (sortKey && cc->unsorted) {
+		cc->unsorted = false;
+		if (!SortSlots(s, type, sortKey))
+			Sys_LogEntry(COMPACT_MOD, LOG_WARNING, "Failed to sort the components of %s in scene %s", E_ComponentTypeName(type), s->name);
+	}
+
+	return true;
+}
+
+static bool
+SortSlots(struct NeScene *s, NeCompTypeId type, NeCompSortKeyProc sortKey)
+{
+	struct NeArray *a = Rt_ArrayGet(&s->compData, type);
+	struct NeArray *sa = Rt_ArrayGet(&s->compSlot, type);
+	uint32_t *slots = (uint32_t *)sa->data;
+	if (!a->count)
+		return true;
+
+	struct NeSlotKey *keys = Sys_Alloc(sizeof(*keys), a->count, MH_Transient);
+	if (!keys)
+		return false;
+
+	// holes left by the components destroyed during the sweep are dropped
+	bool sorted = true;
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < a->count; ++i) {
+		const struct NeCompBase *comp = Rt_ArrayGet(a, i);
+		if (!comp->_valid) {
+			ReleaseSlot(sa, comp, i);
+			sorted = false;
+			continue;
+		}
+
+		keys[count] = (struct NeSlotKey){ sortKey(s, comp), i };
+		sorted &= !count || keys[count - 1].key <= keys[count].key;
+		++count;
+	}
+
+	if (sorted) {
+		Sys_Free(keys);
+		return true;
+	}
+
+	struct NeArray dst;
+	if (!Rt_InitAlignedArray(&dst, a->size, a->elemSize, ECS_ComponentType(type)->alignment, MH_Scene)) {
+		Sys_Free(keys);
+		return false;
+	}
+
+	// the slot breaks ties, so components with the same key keep their order
+	qsort(keys, count, sizeof(*keys), KeyCmp);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		const struct NeCompBase *comp = Rt_ArrayGet(a, keys[i].slot);
+		memcpy(dst.data + dst.elemSize * i, comp, dst.elemSize);
+		slots[comp->_handleId] = i;
+	}
+
+	dst.count = count;
+
+	Rt_TermArray(a);
+	*a = dst;
+
+	Sys_Free(keys);
+	return true;
+}
+
+// A destroyed component keeps its slot until its id is reused or released
+static inline void
+ReleaseSlot(struct NeArray *sa, const struct NeCompBase *comp, uint32_t slot)
+{
+	uint32_t *entry = Rt_ArrayGet(sa, comp->_handleId);
+	if (entry && *entry == slot)
+		*entry = ECS_INVALID_SLOT;
+}
+
+static bool
+TrimIds(struct NeScene *s, NeCompTypeId type)
+{
+	struct NeArray *ids = Rt_ArrayGet(s->archetypeStorage ? &s->compLocation : &s->compSlot, type);
+	struct NeQueue *fl = Rt_ArrayGet(&s->compFree, type);
+	const struct NeArray *na = Rt_ArrayGet(&s->newCompData, type);
+
+	// the ids of the pending components depend on the id count and on the order of the free list
+	if (!ids || !fl->count || na->count)
+		return false;
+
+	size_t count = ids->count;
+	while (count && IdFree(s, type, ids, count - 1))
+		--count;
+
+	bool sorted = count == ids->count;
+	for (size_t i = 1; sorted && i < fl->count; ++i)
+		sorted = FreeId(fl, i - 1) < FreeId(fl, i);
+
+	if (sorted)
+		return false;
+
+	size_t *freeIds = Sys_Alloc(sizeof(*freeIds), fl->size, fl->heap);
+	if (!freeIds) {
+		Sys_LogEntry(COMPACT_MOD, LOG_WARNING, "Failed to compact the ids of %s in scene %s", E_ComponentTypeName(type), s->name);
+		return false;
+	}
+
+	size_t freeCount = 0;
+	for (size_t i = 0; i < fl->count; ++i)
+		freeIds[freeCount++] = FreeId(fl, i);
+
+	qsort(freeIds, freeCount, sizeof(*freeIds), IdCmp);
+
+	// the ids are sorted, so the released ids are the last ones
+	while (freeCount && freeIds[freeCount - 1] >= count)
+		--freeCount;
+
+	Sys_Free(fl->data);
+	fl->data = (uint8_t *)freeIds;
+	fl->start = 0;
+	fl->end = fl->count = freeCount;
+
+	ids->count = count;
+
+	return true;
+}
+
+static inline bool
+IdFree(struct NeScene *s, NeCompTypeId type, const struct NeArray *ids, size_t id)
+{
+	if (s->archetypeStorage)
+		return ((const struct NeCompLocation *)Rt_ArrayGet(ids, id))->archetype == ECS_INVALID_ARCHETYPE;
+
+	const struct NeCompBase *comp = ECS_SlotComponent(s, type, (uint32_t)id);
+	return !comp || !comp->_valid;
+}
+
+static inline size_t
+FreeId(const struct NeQueue *q, size_t i)
+{
+	return *(const size_t *)(q->data + q->elemSize * ((q->start + i) % q->size));
+}
+
+static int
+IdCmp(const void *a, const void *b)
+{
+	const size_t x = *(const size_t *)a, y = *(const size_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int
+KeyCmp(const void *a, const void *b)
+{
+	const struct NeSlotKey *x = a, *y = b;
+	if (x->key != y->key)
+		return x->key < y->key ? -1 : 1;
+	return x->slot < y->slot ? -1 : x->slot > y->slot;
+}
+
+/* NekoEngine
+ *
+ * ECSCompact.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
@@ -0,0 +1,373 @@
+#include <System/Log.h>
+#include <Runtime/Runtime.h>
+#include <Scene/Scene.h>
+#include <Engine/Entity.h>
+#include <Engine/Component.h>
+
+#include "ECS.h"
+
+#define QUERY_MOD	"ECSQuery"
+
+/*
+ * A query is the ordered list of component types a system iterates. Every scene keeps a cache per query: a dense
+ * array of rows (owner entity followed by the handle id of each component, see ECS_QueryRowSlots) and a map from the
+ * id of the first component type to the row, used to find the row of an entity in O(1) when a component is removed.
+ * The rows hold ids rather than slots, so compaction does not change them.
+ * The caches are built once and updated when components are committed, attached or destroyed. Scenes that use
+ * archetype storage cache the archetypes that have all of the query's types instead, which only change when an
+ * archetype is created; queries with a single type are only cached for these scenes.
+ */
+struct NeECSQuery
+{
+	uint32_t typeCount;
+	size_t rowSize;
+	NeCompTypeId compTypes[MAX_ENTITY_COMPONENTS];
+};
+
+static struct NeArray f_queries;
+static struct NeAtomicLock f_queryLock;
+
+static inline bool HasType(const struct NeECSQuery *q, NeCompTypeId type);
+static inline bool CommittedSlot(struct NeScene *s, const struct NeEntity *ent, NeCompTypeId type, uint32_t *slot);
+static inline bool MatchEntity(struct NeScene *s, const struct NeECSQuery *q, const struct NeEntity *ent, uint32_t *slots);
+static inline bool MatchArchetype(const struct NeECSQuery *q, const struct NeArchetype *a, struct NeQueryArchetype *qa);
+static inline uint32_t *SlotEntry(struct NeArray *map, uint32_t slot);
+static inline void AddRow(struct NeECSQueryCache *qc, const struct NeECSQuery *q, struct NeEntity *ent, const uint32_t *slots);
+static inline void RemoveRow(struct NeECSQueryCache *qc, size_t row);
+static bool BuildCache(struct NeScene *s, const struct NeECSQuery *q, struct NeECSQueryCache *qc);
+
+uint32_t
+ECS_RegisterQuery(const NeCompTypeId *compTypes, size_t typeCount)
+{
+	uint32_t id = ECS_INVALID_QUERY;
+
+	if (!typeCount || typeCount > MAX_ENTITY_COMPONENTS)
+		return ECS_INVALID_QUERY;
+
+	Sys_AtomicLockWrite(&f_queryLock);
+
+	for (size_t i = 0; i < f_queries.count; ++i) {
+		const struct NeECSQuery *q = Rt_ArrayGet(&f_queries, i);
+		if (q->typeCount == typeCount && !memcmp(q->compTypes, compTypes, sizeof(*compTypes) * typeCount)) {
+			Sys_AtomicUnlockWrite(&f_queryLock);
+			return (uint32_t)i;
+		}
+	}
+
+	struct NeECSQuery *q = Rt_ArrayAllocate(&f_queries);
+	if (q) {
+		q->typeCount = (uint32_t)typeCount;
+		q->rowSize = NE_ROUND_UP(sizeof(NeEntityHandle) + sizeof(uint32_t) * typeCount, sizeof(NeEntityHandle));
+		memcpy(q->compTypes, compTypes, sizeof(*compTypes) * typeCount);
+		id = (uint32_t)f_queries.count - 1;
+	}
+
+	Sys_AtomicUnlockWrite(&f_queryLock);
+
+	if (id == ECS_INVALID_QUERY) {
+		Sys_LogEntry(QUERY_MOD, LOG_CRITICAL, "Failed to register query");
+		return ECS_INVALID_QUERY;
+	}
+
+	// scenes that are still initializing build the cache in their next Scn_Commit
+	for (uint32_t i = 0; i < UINT8_MAX; ++i) {
+		struct NeScene *s = Scn_GetScene((uint8_t)i);
+		if (!s)
+			continue;
+
+		Sys_AtomicLockWrite(&s->lock.comp);
+		ECS_SyncQueries(s);
+		Sys_AtomicUnlockWrite(&s->lock.comp);
+	}
+
+	return id;
+}
+
+void
+ECS_SyncQueries(struct NeScene *s)
+{
+	Sys_AtomicLockRead(&f_queryLock);
+
+	for (size_t i = s->queries.count; i < f_queries.count; ++i) {
+		struct NeECSQueryCache *qc = Rt_ArrayAllocate(&s->queries);
+		if (!qc || !BuildCache(s, Rt_ArrayGet(&f_queries, i), qc)) {
+			Sys_LogEntry(QUERY_MOD, LOG_CRITICAL, "Failed to build query cache for scene %s", s->name);
+			if (qc)
+				--s->queries.count;
+			break;
+		}
+	}
+
+	Sys_AtomicUnlockRead(&f_queryLock);
+}
+
+void
+ECS_QueryComponentAdded(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type)
+{
+	uint32_t slots[MAX_ENTITY_COMPONENTS];
+
+	Sys_AtomicLockRead(&f_queryLock);
+
+	for (size_t i = 0; i < s->queries.count; ++i) {
+		const struct NeECSQuery *q = Rt_ArrayGet(&f_queries, i);
+		if (q->typeCount > 1 && HasType(q, type) && MatchEntity(s, q, ent, slots))
+			AddRow(Rt_ArrayGet(&s->queries, i), q, ent, slots);
+	}
+
+	Sys_AtomicUnlockRead(&f_queryLock);
+}
+
+void
+ECS_QueryComponentRemoved(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type)
+{
+	uint32_t slot;
+
+	Sys_AtomicLockRead(&f_queryLock);
+
+	for (size_t i = 0; i < s->queries.count; ++i) {
+		const struct NeECSQuery *q = Rt_ArrayGet(&f_queries, i);
+		if (q->typeCount < 2 || !HasType(q, type) || !CommittedSlot(s, ent, q->compTypes[0], &slot))
+			continue;
+
+		struct NeECSQueryCache *qc = Rt_ArrayGet(&s->queries, i);
+		uint32_t *entry = Rt_ArrayGet(&qc->slots, slot);
+		if (!entry || !*entry)
+			continue;
+
+		RemoveRow(qc, *entry - 1);
+		*entry = 0;
+	}
+
+	Sys_AtomicUnlockRead(&f_queryLock);
+}
+
+void
+ECS_QueryArchetypeAdded(struct NeScene *s, uint32_t archetype)
+{
+	struct NeQueryArchetype qa = { .archetype = archetype };
+	const struct NeArchetype *a = Rt_ArrayGet(&s->archetypes, archetype);
+
+	Sys_AtomicLockRead(&f_queryLock);
+
+	for (size_t i = 0; i < s->queries.count; ++i) {
+		struct NeECSQueryCache *qc = Rt_ArrayGet(&s->queries, i);
+		if (MatchArchetype(Rt_ArrayGet(&f_queries, i), a, &qa) && !Rt_ArrayAdd(&qc->archetypes, &qa))
+			Sys_LogEntry(QUERY_MOD, LOG_CRITICAL, "Failed to add archetype to query cache for scene %s", s->name);
+	}
+
+	Sys_AtomicUnlockRead(&f_queryLock);
+}
+
+bool
+E_InitQueries(void)
+{
+	Sys_InitAtomicLock(&f_queryLock);
+	return Rt_InitArray(&f_queries, 40, sizeof(struct NeECSQuery), MH_System);
+}
+
+void
+E_TermQueries(void)
+{
+	Rt_TermArray(&f_queries);
+}
+
+bool
+E_InitSceneQueries(struct NeScene *s)
+{
+	if (!Rt_InitArray(&s->queries, f_queries.count ? f_queries.count : 10, sizeof(struct NeECSQueryCache), MH_Scene))
+		return false;
+
+	ECS_SyncQueries(s);
+
+	return true;
+}
+
+void
+E_TermSceneQueries(struct NeScene *s)
+{
+	struct NeECSQueryCache *qc;
+	Rt_ArrayForEach(qc, &s->queries) {
+		Rt_TermArray(&qc->rows);
+		Rt_TermArray(&qc->slots);
+		Rt_TermArray(&qc->archetypes);
+	}
+
+	Rt_TermArray(&s->queries);
+}
+
+static inline bool
+HasType(const struct NeECSQuery *q, NeCompTypeId type)
+{
+	for (uint32_t i = 0; i < q->typeCount; ++i)
+		if (q->compTypes[i] == type)
+			return true;
+	return false;
+}
+
+static inline bool
+CommittedSlot(struct NeScene *s, const struct NeEntity *ent, NeCompTypeId type, uint32_t *slot)
+{
+	const uint32_t i = ECS_EntityComponentIndex(ent, type);
+	if (i == UINT32_MAX)
+		return false;
+
+	// components waiting for Scn_Commit are not in the data arrays yet
+	const uint32_t id = E_HANDLE_ID(ent->comp[i].handle);
+	const struct NeCompBase *comp = ECS_SlotComponent(s, type, id);
+	if (!comp || !comp->_valid || comp->_owner != ent->handle)
+		return false;
+
+	*slot = id;
+	return true;
+}
+
+static inline bool
+MatchEntity(struct NeScene *s, const struct NeECSQuery *q, const struct NeEntity *ent, uint32_t *slots)
+{
+	for (uint32_t i = 0; i < q->typeCount; ++i)
+		if (!CommittedSlot(s, ent, q->compTypes[i], &slots[i]))
+			return false;
+	return true;
+}
+
+static inline bool
+MatchArchetype(const struct NeECSQuery *q, const struct NeArchetype *a, struct NeQueryArchetype *qa)
+{
+	for (uint32_t i = 0; i < q->typeCount; ++i) {
+		uint32_t column = 0;
+		while (column < a->typeCount && a->compTypes[column] != q->compTypes[i])
+			++column;
+
+		if (column == a->typeCount)
+			return false;
+
+		qa->columns[i] = (uint8_t)column;
+	}
+
+	return true;
+}
+
+static inline uint32_t *
+SlotEntry(struct NeArray *map, uint32_t slot)
+{
+	if (slot >= map->count) {
+		if (slot >= map->size && !Rt_ResizeArray(map, slot < map->size * 2 ? map->size * 2 : slot + 1))
+			return NULL;
+
+		memset(map->data + map->elemSize * map->count, 0x0, map->elemSize * (slot + 1 - map->count));
+		map->count = slot + 1;
+	}
+
+	return Rt_ArrayGet(map, slot);
+}
+
+static inline void
+AddRow(struct NeECSQueryCache *qc, const struct NeECSQuery *q, struct NeEntity *ent, const uint32_t *slots)
+{
+	uint32_t *entry = SlotEntry(&qc->slots, slots[0]);
+	if (!entry || *entry)
+		return;
+
+	uint8_t *row = Rt_ArrayAllocate(&qc->rows);
+	if (!row)
+		return;
+
+	*(NeEntityHandle *)row = ent->handle;
+	memcpy(row + sizeof(NeEntityHandle), slots, sizeof(*slots) * q->typeCount);
+
+	*entry = (uint32_t)qc->rows.count;
+}
+
+static inline void
+RemoveRow(struct NeECSQueryCache *qc, size_t row)
+{
+	const size_t last = qc->rows.count - 1;
+
+	if (row != last) {
+		uint8_t *dst = Rt_ArrayGet(&qc->rows, row);
+		memcpy(dst, Rt_ArrayGet(&qc->rows, last), qc->rows.elemSize);
+		*(uint32_t *)Rt_ArrayGet(&qc->slots, ECS_QueryRowSlots(dst)[0]) = (uint32_t)row + 1;
+	}
+
+	--qc->rows.count;
+}
+
+static bool
+BuildCache(struct NeScene *s, const struct NeECSQuery *q, struct NeECSQueryCache *qc)
+{
+	uint32_t slots[MAX_ENTITY_COMPONENTS];
+	const struct NeArray *a = Rt_ArrayGet(&s->compData, q->compTypes[0]);
+	const size_t count = a && q->typeCount > 1 ? a->count : 0;
+
+	if (!Rt_InitArray(&qc->rows, count ? count : 10, q->rowSize, MH_Scene))
+		return false;
+
+	if (!Rt_InitArray(&qc->slots, count ? count : 10, sizeof(uint32_t), MH_Scene)) {
+		Rt_TermArray(&qc->rows);
+		return false;
+	}
+
+	if (!Rt_InitArray(&qc->archetypes, 10, sizeof(struct NeQueryArchetype), MH_Scene)) {
+		Rt_TermArray(&qc->slots);
+		Rt_TermArray(&qc->rows);
+		return false;
+	}
+
+	if (s->archetypeStorage) {
+		struct NeQueryArchetype qa;
+		for (uint32_t i = 0; i < s->archetypes.count; ++i) {
+			qa.archetype = i;
+			if (MatchArchetype(q, Rt_ArrayGet(&s->archetypes, i), &qa) && !Rt_ArrayAdd(&qc->archetypes, &qa))
+				Sys_LogEntry(QUERY_MOD, LOG_CRITICAL, "Failed to add archetype to query cache for scene %s", s->name);
+		}
+
+		return true;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		const struct NeCompBase *comp = Rt_ArrayGet(a, i);
+		struct NeEntity *owner = comp->_valid ? ECS_EntityPtr(comp->_owner) : NULL;
+		if (owner && MatchEntity(s, q, owner, slots) && slots[0] == comp->_handleId)
+			AddRow(qc, q, owner, slots);
+	}
+
+	return true;
+}
+
+/* NekoEngine
+ *
+ * ECSQuery.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
@@ -5,6 +5,7 @@
 #include <Scene/Scene.h>
 #include <Engine/IO.h>
 #include <Engine/Job.h>
+#include <Engine/Config.h>
 #include <Engine/Entity.h>
 #include <Engine/ECSystem.h>
 #include <Engine/Component.h>
@@ -12,19 +13,19 @@
 
 #include "ECS.h"
 
-#define ECSYS_MOD	"ECSystem"
+#define ECSYS_MOD			"ECSystem"
+#define ECSYS_BUDGET_PROBE	16		// items a budgeted system visits before it has a time estimate
 
 struct NeExecArgs
 {
+	struct NeScene *s;
 	struct NeECSystem *sys;
-	void *components[MAX_ENTITY_COMPONENTS];
+	const struct NeArray *items;
+	const struct NeChangeFilter *changes;
 	void *args;
-};
-
-struct NeJobCompletedArgs
-{
-	bool done;
-	struct NeScene *scene;
+	uint8_t *data[MAX_ENTITY_COMPONENTS];
+	size_t stride[MAX_ENTITY_COMPONENTS];
+	const uint32_t *slots[MAX_ENTITY_COMPONENTS];
 };
 
 struct NeSystemInitInfo
@@ -35,33 +36,89 @@ struct NeSystemInitInfo
 	size_t numComp;
 	NeECSysExecProc proc;
 	int32_t priority;
-	bool singleThread;
+	uint32_t flags;
+};
+
+/*
+ * The systems of a group that access the same component type, with at least one of them writing it, can't run
+ * at the same time; neither can exclusive systems and any other system. Each system of the group is a node of a DAG with an edge to every later system it conflicts
+ * with; the DAG is rebuilt when a system is registered.
+ */
+struct NeSystemNode
+{
+	size_t system;
+	uint32_t firstEdge, edgeCount, predecessors;
+};
+
+struct NeSystemGroup
+{
+	uint64_t hash;
+	uint32_t version;
+	struct NeArray nodes, edges;
 };
 
+struct NeSystemRun
+{
+	struct NeScene *s;
+	const struct NeSystemGroup *grp;
+	const struct NeSystemNode *node;
+	struct NeSystemRun *runs;
+	struct NeJobCounter ready;
+};
+
+typedef void (*NeExecRangeProc)(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea);
+
+bool ECS_validateAccess;
+
 static struct NeArray f_systems;
-static struct NeArray f_filteredEntities;
 static struct NeArray f_initInfo;
+static struct NeArray f_groups;
 static struct NeTSArray f_newSystems;
+static _Atomic uint32_t f_systemsVersion;
+static bool f_parallelGroups;
+static uint32_t f_sliceCount;
 static void *f_dirWatch;
+static THREAD_LOCAL struct NeECSystem *f_activeSystem;
 
 static int ECSysInsertCmp(const void *item, const void *data);
+static inline NeCompTypeId SystemComponentTypeId(const char *name);
+static const struct NeSystemGroup *GetGroup(uint64_t hash);
+static void BuildGroup(struct NeSystemGroup *grp);
+static inline bool SystemsConflict(const struct NeECSystem *a, const struct NeECSystem *b);
+static void RunSystem(int worker, struct NeSystemRun *run);
+static inline void ExecSystem(struct NeScene *s, struct NeECSystem *sys, void *args);
 static inline void SysExec(struct NeScene *s, struct NeECSystem *sys, void *args);
-static inline bool *SysExecJobs(struct NeScene *s, struct NeECSystem *sys, void *args);
-static inline void FilterEntities(struct NeScene *s, struct NeArray *ent, NeCompTypeId *compTypes, size_t typeCount);
-static void ExecJob(int worker, struct NeExecArgs *ea);
-static void JobCompleted(uint64_t id, struct NeJobCompletedArgs *args);
-static inline void Exec(struct NeECSystem *sys, void **components, void *args);
+static inline void SysExecJobs(struct NeScene *s, struct NeECSystem *sys, void *args);
+static inline void ExecArchetypes(struct NeExecArgs *ea, bool parallel);
+static void ExecSlices(struct NeExecArgs *ea, uint64_t count, NeExecRangeProc proc, bool parallel);
+static inline void ExecRange(const struct NeExecArgs *ea, NeExecRangeProc proc, uint64_t begin, uint64_t end, bool parallel);
+static inline void SetSchedule(struct NeECSystem *sys, uint32_t amortize, uint32_t budget);
+static inline const struct NeArray *QueryRows(struct NeScene *s, struct NeECSystem *sys, struct NeExecArgs *ea);
+static inline size_t ComponentRange(struct NeScene *s, struct NeECSystem *sys, struct NeExecArgs *ea);
+static inline struct NeCompBase *NextComponent(const struct NeExecArgs *ea, uint64_t *i, uint64_t end);
+static inline size_t QueryChunks(struct NeScene *s, struct NeECSystem *sys, struct NeExecArgs *ea);
+static void ExecComponents(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea);
+static void ExecValidComponents(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea);
+static void ExecEntities(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea);
+static void ExecChunks(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea);
+static void ExecChunkRows(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea);
+static inline void ExecChunk(const struct NeExecArgs *ea, lua_State *vm, const struct NeArchetype *a, const struct NeQueryArchetype *qa,
+							 const struct NeArchetypeChunk *c, uint32_t begin, uint32_t end);
+static inline void Exec(struct NeECSystem *sys, lua_State *vm, void **components, void *args);
+static void ValidatedExec(struct NeECSystem *sys, lua_State *vm, void **comp, void *args);
 static inline bool LoadSystemInfo(const char *path, struct NeECSystem *sys);
 static void LoadScript(const char *path);
-static lua_State *CreateVM(struct NeECSystem *sys, const char *script);
+static lua_State *AcquireScriptVM(const struct NeECSystem *sys);
 static inline void ScriptExec(lua_State *vm, struct NeECSystem *sys, void **comp, void *args);
+static void ScriptFlush(lua_State *vm, const struct NeECSystem *sys, void *args);
+static inline void ReleaseScriptVM(const struct NeECSystem *sys, lua_State *vm, void *args);
 static inline void FileChanged(const char *path, enum NeFSEvent event, void *ud);
 
 bool
 E_RegisterSystem(const char *name, uint64_t group,
 	const char **comp, size_t numComp,
 	NeECSysExecProc proc, int32_t priority,
-	bool singleThread)
+	uint32_t flags)
 {
 	NeCompTypeId types[MAX_ENTITY_COMPONENTS];
 
@@ -70,14 +127,14 @@ E_RegisterSystem(const char *name, uint64_t group,
 
 	if (f_systems.data) {
 		for (size_t i = 0; i < numComp; ++i) {
-			types[i] = E_ComponentTypeId(comp[i]);
+			types[i] = SystemComponentTypeId(comp[i]);
 			if (types[i] == NE_INVALID_HANDLE) {
 				Sys_LogEntry(ECSYS_MOD, LOG_CRITICAL, "Failed to register system %s. Component type for %s not found.", name, comp[i]);
 				return false;
 			}
 		}
 
-		return E_RegisterSystemId(name, group, types, numComp, proc, priority, singleThread);
+		return E_RegisterSystemId(name, group, types, numComp, proc, priority, flags);
 	} else {
 		// this branch is taken during initialization, before E_InitECSystems is called
 
@@ -91,7 +148,7 @@ E_RegisterSystem(const char *name, uint64_t group,
 		init->numComp = numComp;
 		init->proc = proc;
 		init->priority = priority;
-		init->singleThread = singleThread;
+		init->flags = flags;
 
 		for (size_t i = 0; i < numComp; ++i)
 			init->comp[i] = comp[i];
@@ -104,7 +161,7 @@ bool
 E_RegisterSystemId(const char *name, uint64_t group,
 	const NeCompTypeId *comp, size_t numComp,
 	NeECSysExecProc proc, int32_t priority,
-	bool singleThread)
+	uint32_t flags)
 {
 	struct NeECSystem sys = { 0 };
 
@@ -116,15 +173,34 @@ E_RegisterSystemId(const char *name, uint64_t group,
 	--f_systems.count;
 
 	sys.nameHash = Rt_HashString(name);
+	strlcpy(sys.name, name, sizeof(sys.name));
 	sys.groupHash = group;
-	sys.singleThread = singleThread;
+	sys.singleThread = flags & ECSYS_SINGLE_THREAD;
+	sys.exclusive = flags & ECSYS_EXCLUSIVE;
 	sys.enabled = true;
 
-	memcpy(sys.compTypes, comp, sizeof(NeCompTypeId) * numComp);
+	for (size_t i = 0; i < numComp; ++i) {
+		sys.compTypes[i] = comp[i] & ~(ECSYS_READ_ONLY_BIT | ECSYS_CHANGED_BIT);
+		if (comp[i] & ECSYS_READ_ONLY_BIT)
+			sys.readOnly |= 1u << i;
+		if (comp[i] & ECSYS_CHANGED_BIT)
+			sys.changed |= 1u << i;
+	}
+
 	sys.typeCount = numComp;
 	sys.exec = proc;
 	sys.priority = priority;
 
+	SetSchedule(&sys, (flags >> 8) & 0xff, flags >> 16);
+
+	// single type systems iterate the component array directly, unless the scene uses archetype storage
+	sys.query = ECS_RegisterQuery(sys.compTypes, numComp);
+	if (sys.query == ECS_INVALID_QUERY)
+		return false;
+
+	if (sys.changed)
+		sys.changeSlot = ECS_RegisterChangeFilter(&sys);
+
 	size_t pos = Rt_ArrayFindId(&f_systems, &priority, ECSysInsertCmp);
 	if (pos == RT_NOT_FOUND)
 		pos = f_systems.count;
@@ -132,6 +208,7 @@ E_RegisterSystemId(const char *name, uint64_t group,
 	if (!Rt_ArrayInsert(&f_systems, &sys, pos))
 		return false;
 
+	++f_systemsVersion;
 	return true;
 }
 
@@ -145,34 +222,80 @@ E_ExecuteSystemS(struct NeScene *s, uint64_t hash, void *args)
 		sys = NULL;
 	}
 
-	if (!sys || !sys->enabled)
-		return;
+	if (sys)
+		ExecSystem(s, sys, args);
+}
 
-	if (sys->singleThread) {
-		SysExec(s, sys, args);
-	} else {
-		bool *done = SysExecJobs(s, sys, args);
-		while (done && !*done)
-			Sys_Yield();
+bool
+E_SystemStats(uint64_t hash, struct NeSystemStats *stats)
+{
+	const struct NeECSystem *sys;
+	Rt_ArrayForEach(sys, &f_systems) {
+		if (sys->nameHash != hash)
+			continue;
+
+		Sys_AtomicLockRead((struct NeAtomicLock *)&sys->statsLock);
+		memcpy(stats, &sys->stats, sizeof(*stats));
+		Sys_AtomicUnlockRead((struct NeAtomicLock *)&sys->statsLock);
+		return true;
 	}
+
+	return false;
 }
 
 void
 E_ExecuteSystemGroupS(struct NeScene *s, uint64_t hash)
 {
-	struct NeECSystem *sys;
-	Rt_ArrayForEach(sys, &f_systems) {
-		if (!sys->enabled || sys->groupHash != hash)
+	const struct NeSystemGroup *grp = GetGroup(hash);
+	if (!grp || !grp->nodes.count)
+		return;
+
+	struct NeSystemRun *runs = NULL;
+	if (f_parallelGroups && E_JobWorkerThreads() && grp->nodes.count > 1)
+		runs = Sys_Alloc(sizeof(*runs), grp->nodes.count, MH_Frame);
+
+	if (!runs) {
+		const struct NeSystemNode *node;
+		Rt_ArrayForEach(node, &grp->nodes)
+			ExecSystem(s, Rt_ArrayGet(&f_systems, node->system), NULL);
+		return;
+	}
+
+	struct NeJobCounter done;
+	E_InitJobCounter(&done);
+
+	for (size_t i = 0; i < grp->nodes.count; ++i) {
+		struct NeSystemRun *run = &runs[i];
+
+		run->s = s;
+		run->grp = grp;
+		run->node = Rt_ArrayGet(&grp->nodes, i);
+		run->runs = runs;
+
+		E_InitJobCounter(&run->ready);
+		if (run->node->predecessors)
+			E_RetainJobCounter(&run->ready, run->node->predecessors);
+	}
+
+	// a system starts when the last of the systems it conflicts with finished
+	for (size_t i = 0; i < grp->nodes.count; ++i) {
+		const struct NeECSystem *sys = Rt_ArrayGet(&f_systems, runs[i].node->system);
+		if (!sys->singleThread)
+			E_ExecuteDependentJob(JP_FrameCritical, (NeJobProc)RunSystem, &runs[i], NULL, NULL,
+								  runs[i].node->predecessors ? &runs[i].ready : NULL, &done);
+	}
+
+	// the single threaded systems run here in priority order; this thread executes jobs while it waits for them
+	for (size_t i = 0; i < grp->nodes.count; ++i) {
+		const struct NeECSystem *sys = Rt_ArrayGet(&f_systems, runs[i].node->system);
+		if (!sys->singleThread)
 			continue;
 
-		if (sys->singleThread) {
-			SysExec(s, sys, NULL);
-		} else {
-			bool *done = SysExecJobs(s, sys, NULL);
-			while (done && !*done)
-				Sys_Yield();
-		}
+		E_WaitForJobCounter(&runs[i].ready);
+		RunSystem(E_WorkerId(), &runs[i]);
 	}
+
+	E_WaitForJobCounter(&done);
 }
 
 bool
@@ -181,12 +304,19 @@ E_InitECSystems(void)
 	if (!Rt_InitArray(&f_systems, 40, sizeof(struct NeECSystem), MH_System))
 		return false;
 
-	if (!Rt_InitPtrArray(&f_filteredEntities, 100, MH_System))
+	if (!Rt_InitArray(&f_groups, 5, sizeof(struct NeSystemGroup), MH_System))
+		return false;
+
+	f_parallelGroups = E_GetCVarBln("Engine_ParallelSystemGroups", true)->bln;
+	ECS_validateAccess = E_GetCVarBln("Engine_ValidateSystemAccess", false)->bln;
+	ECS_compactionBudget = (uint64_t)E_GetCVarU32("Engine_CompactionBudget", 0)->u32 * 1000;
+
+	if (!E_InitQueries() || !E_InitChanges())
 		return false;
 
 	struct NeSystemInitInfo *info;
 	Rt_ArrayForEach(info, &f_initInfo)
-		E_RegisterSystem(info->name, info->group, info->comp, info->numComp, info->proc, info->priority, info->singleThread);
+		E_RegisterSystem(info->name, info->group, info->comp, info->numComp, info->proc, info->priority, info->flags);
 	Rt_TermArray(&f_initInfo);
 
 	E_ProcessFiles("/Scripts/Systems", "lua", true, LoadScript);
@@ -214,19 +344,14 @@ E_ReloadSystemScripts(void)
 			continue;
 		}
 
-		if (sys->singleThread) {
-			Sc_DestroyVM(sys->vm);
-			if (!(sys->vm = CreateVM(sys, path)))
-				sys->enabled = false;
-		} else {
-			for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
-				Sc_DestroyVM(sys->vms[i]);
-				if (!(sys->vms[i] = CreateVM(sys, path)))
-					sys->enabled = false;
-			}
-		}
+		// the pooled VMs compile the script again on their next checkout
+		Sc_InvalidateScripts();
+
+		lua_State *vm = AcquireScriptVM(sys);
+		sys->enabled = vm != NULL;
+		Sc_ReleaseVM(vm);
 
-		sys->enabled = true;
+		++f_systemsVersion;
 		Sys_LogEntry(ECSYS_MOD, LOG_DEBUG, "%s reloaded", path);
 	}
 
@@ -248,26 +373,52 @@ E_ReloadSystemScripts(void)
 void
 E_TermECSystems(void)
 {
-	E_RemoveWatch(f_dirWatch);
+	if (f_dirWatch)
+		E_RemoveWatch(f_dirWatch);
 
 	struct NeECSystem *sys = NULL;
-	Rt_ArrayForEach(sys, &f_systems) {
-		if (sys->vm) {
-			if (sys->singleThread) {
-				Sc_DestroyVM(sys->vm);
-			} else {
-				for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i)
-					Sc_DestroyVM(sys->vms[i]);
-				Sys_Free(sys->vms);
-			}
-		}
-	}
+	Rt_ArrayForEach(sys, &f_systems)
+		Sys_Free(sys->script);
 
 	if (f_newSystems.a.data)
 		Rt_TermTSArray(&f_newSystems);
 
+	struct NeSystemGroup *grp;
+	Rt_ArrayForEach(grp, &f_groups) {
+		Rt_TermArray(&grp->nodes);
+		Rt_TermArray(&grp->edges);
+	}
+	Rt_TermArray(&f_groups);
+
 	Rt_TermArray(&f_systems);
-	Rt_TermArray(&f_filteredEntities);
+	E_TermChanges();
+	E_TermQueries();
+}
+
+bool
+E_InitSceneSystems(struct NeScene *s)
+{
+	return Rt_InitArray(&s->systemSlices, f_sliceCount ? f_sliceCount : 10, sizeof(struct NeSystemSlice), MH_Scene);
+}
+
+void
+E_TermSceneSystems(struct NeScene *s)
+{
+	Rt_TermArray(&s->systemSlices);
+}
+
+void
+ECS_CommitSlices(struct NeScene *s)
+{
+	while (s->systemSlices.count < f_sliceCount) {
+		struct NeSystemSlice *sl = Rt_ArrayAllocate(&s->systemSlices);
+		if (!sl) {
+			Sys_LogEntry(ECSYS_MOD, LOG_CRITICAL, "Failed to allocate system progress in scene %s", s->name);
+			return;
+		}
+
+		memset(sl, 0, sizeof(*sl));
+	}
 }
 
 static int
@@ -279,172 +430,572 @@ ECSysInsertCmp(const void *item, const void *data)
 	return sys->priority - priority;
 }
 
-static inline void
-SysExec(struct NeScene *s, struct NeECSystem *sys, void *args)
+static inline NeCompTypeId
+SystemComponentTypeId(const char *name)
 {
-	struct NeCompBase *compBase = NULL;
-	const struct NeArray *comp = NULL;
-	void *components[MAX_ENTITY_COMPONENTS];
+	const bool readOnly = !strncmp(name, ECSYS_READ_ONLY_PREFIX, sizeof(ECSYS_READ_ONLY_PREFIX) - 1);
+	if (readOnly)
+		name += sizeof(ECSYS_READ_ONLY_PREFIX) - 1;
 
-	Sys_AtomicLockRead(&s->lock.comp);
+	const bool changed = !strncmp(name, ECSYS_CHANGED_PREFIX, sizeof(ECSYS_CHANGED_PREFIX) - 1);
+	if (changed)
+		name += sizeof(ECSYS_CHANGED_PREFIX) - 1;
 
-	if (sys->typeCount == 1) {
-		comp = E_GetAllComponentsS(s, sys->compTypes[0]);
+	NeCompTypeId type = E_ComponentTypeId(name);
+	if (type == NE_INVALID_HANDLE)
+		return NE_INVALID_HANDLE;
 
-		if (!comp)
-			goto exit;
+	if (readOnly)
+		type = ECSYS_READ_ID(type);
 
-		for (size_t i = 0; i < comp->count; ++i) {
-			compBase = Rt_ArrayGet(comp, i);
-			if (compBase->_valid)
-				Exec(sys, (void **)&compBase, args);
+	return changed ? ECSYS_CHANGED_ID(type) : type;
+}
+
+static const struct NeSystemGroup *
+GetGroup(uint64_t hash)
+{
+	struct NeSystemGroup *grp = NULL;
+	Rt_ArrayForEach(grp, &f_groups) {
+		if (grp->hash == hash)
+			break;
+		grp = NULL;
+	}
+
+	if (!grp) {
+		if (!(grp = Rt_ArrayAllocate(&f_groups)))
+			return NULL;
+
+		grp->hash = hash;
+		if (!Rt_InitArray(&grp->nodes, 10, sizeof(struct NeSystemNode), MH_System) ||
+				!Rt_InitArray(&grp->edges, 10, sizeof(uint32_t), MH_System))
+			return NULL;
+	} else if (grp->version == f_systemsVersion) {
+		return grp;
+	}
+
+	BuildGroup(grp);
+	return grp;
+}
+
+static void
+BuildGroup(struct NeSystemGroup *grp)
+{
+	Rt_ClearArray(&grp->nodes, false);
+	Rt_ClearArray(&grp->edges, false);
+
+	for (size_t i = 0; i < f_systems.count; ++i) {
+		const struct NeECSystem *sys = Rt_ArrayGet(&f_systems, i);
+		if (sys->groupHash != grp->hash)
+			continue;
+
+		const struct NeSystemNode node = { .system = i };
+		Rt_ArrayAdd(&grp->nodes, &node);
+	}
+
+	// f_systems is sorted by priority, so the edges only go forward & the node order is a valid execution order
+	for (uint32_t i = 0; i < grp->nodes.count; ++i) {
+		struct NeSystemNode *node = Rt_ArrayGet(&grp->nodes, i);
+		const struct NeECSystem *sys = Rt_ArrayGet(&f_systems, node->system);
+
+		node->firstEdge = (uint32_t)grp->edges.count;
+
+		for (uint32_t j = i + 1; j < grp->nodes.count; ++j) {
+			struct NeSystemNode *next = Rt_ArrayGet(&grp->nodes, j);
+			if (!SystemsConflict(sys, Rt_ArrayGet(&f_systems, next->system)))
+				continue;
+
+			Rt_ArrayAdd(&grp->edges, &j);
+			++next->predecessors;
 		}
-	} else {
-		FilterEntities(s, &f_filteredEntities, sys->compTypes, sys->typeCount);
 
-		for (size_t i = 0; i < f_filteredEntities.count; ++i) {
-			NeEntityHandle handle = (NeEntityHandle *)Rt_ArrayGetPtr(&f_filteredEntities, i);
+		node->edgeCount = (uint32_t)grp->edges.count - node->firstEdge;
+	}
 
-			for (size_t j = 0; j < sys->typeCount; ++j)
-				components[j] = ECS_GetComponent(s, handle, sys->compTypes[j]);
+	grp->version = f_systemsVersion;
+}
 
-			Exec(sys, components, args);
+static inline bool
+SystemsConflict(const struct NeECSystem *a, const struct NeECSystem *b)
+{
+	// single threaded systems run one after another on the same thread
+	if (a->singleThread && b->singleThread)
+		return false;
+
+	if (a->exclusive || b->exclusive)
+		return true;
+
+	for (size_t i = 0; i < a->typeCount; ++i) {
+		for (size_t j = 0; j < b->typeCount; ++j) {
+			if (a->compTypes[i] != b->compTypes[j])
+				continue;
+
+			if (!(a->readOnly & (1u << i)) || !(b->readOnly & (1u << j)))
+				return true;
 		}
 	}
 
-exit:
+	return false;
+}
+
+static void
+RunSystem(int worker, struct NeSystemRun *run)
+{
+	ExecSystem(run->s, Rt_ArrayGet(&f_systems, run->node->system), NULL);
+
+	const uint32_t *next = (const uint32_t *)run->grp->edges.data + run->node->firstEdge;
+	for (uint32_t i = 0; i < run->node->edgeCount; ++i)
+		E_ReleaseJobCounter(&run->runs[next[i]].ready);
+}
+
+static inline void
+ExecSystem(struct NeScene *s, struct NeECSystem *sys, void *args)
+{
+	if (!sys->enabled)
+		return;
+
+	if (sys->singleThread) {
+		SysExec(s, sys, args);
+	} else {
+		SysExecJobs(s, sys, args);
+	}
+}
+
+static inline void
+SysExec(struct NeScene *s, struct NeECSystem *sys, void *args)
+{
+	struct NeChangeFilter cf;
+	struct NeExecArgs ea = { .s = s, .sys = sys, .args = args };
+
+	Sys_AtomicLockRead(&s->lock.comp);
+
+	if (sys->changed && ECS_BeginChangeFilter(s, sys, &cf))
+		ea.changes = &cf;
+
+	if (s->archetypeStorage) {
+		ExecArchetypes(&ea, false);
+	} else if (sys->typeCount == 1) {
+		if ((ea.items = E_GetAllComponentsS(s, sys->compTypes[0])))
+			ExecSlices(&ea, ComponentRange(s, sys, &ea), ExecValidComponents, false);
+	} else if ((ea.items = QueryRows(s, sys, &ea))) {
+		ExecSlices(&ea, ea.items->count, ExecEntities, false);
+	}
+
 	Sys_AtomicUnlockRead(&s->lock.comp);
 }
 
-static inline bool *
+static inline void
 SysExecJobs(struct NeScene *s, struct NeECSystem *sys, void *args)
 {
-	const struct NeArray *comp = NULL;
-	struct NeExecArgs **ea;
-	size_t count = 0;
+	struct NeChangeFilter cf;
+	struct NeExecArgs ea = { .s = s, .sys = sys, .args = args };
+	const char *label = E_SetJobLabel(sys->name);
 
 	Sys_AtomicLockRead(&s->lock.comp);
 
-	if (sys->typeCount == 1) {
-		comp = E_GetAllComponentsS(s, sys->compTypes[0]);
+	if (sys->changed && ECS_BeginChangeFilter(s, sys, &cf))
+		ea.changes = &cf;
 
-		if (!comp || !comp->count)
-			goto exit;
+	if (s->archetypeStorage) {
+		ExecArchetypes(&ea, true);
+	} else if (sys->typeCount == 1) {
+		if ((ea.items = E_GetAllComponentsS(s, sys->compTypes[0])))
+			ExecSlices(&ea, ComponentRange(s, sys, &ea), ExecComponents, true);
+	} else if ((ea.items = QueryRows(s, sys, &ea))) {
+		ExecSlices(&ea, ea.items->count, ExecEntities, true);
+	}
 
-		ea = Sys_Alloc(sizeof(*ea), comp->count, MH_Frame);
-		for (size_t i = 0; i < comp->count; ++i) {
-			struct NeCompBase *compBase = Rt_ArrayGet(comp, i);
-			if (!compBase->_valid || !compBase->_enabled)
-				continue;
+	Sys_AtomicUnlockRead(&s->lock.comp);
+	E_SetJobLabel(label);
+}
 
-			ea[count] = Sys_Alloc(sizeof(*ea[0]), 1, MH_Frame);
-			ea[count]->sys = sys;
-			ea[count]->args = args;
-			ea[count]->components[0] = compBase;
-			++count;
-		}
+static inline void
+ExecArchetypes(struct NeExecArgs *ea, bool parallel)
+{
+	const size_t chunks = QueryChunks(ea->s, ea->sys, ea);
+	if (!chunks)
+		return;
+
+	if (!ea->sys->amortize && !ea->sys->budget) {
+		ExecSlices(ea, chunks, ExecChunks, parallel);
+		return;
+	}
+
+	uint64_t rows = 0;
+	const struct NeQueryArchetype *qa;
+	Rt_ArrayForEach(qa, ea->items) {
+		const struct NeArchetype *a = Rt_ArrayGet(&ea->s->archetypes, qa->archetype);
+
+		const struct NeArchetypeChunk *c;
+		Rt_ArrayForEach(c, &a->chunks)
+			rows += c->count;
+	}
+
+	ExecSlices(ea, rows, ExecChunkRows, parallel);
+}
+
+/*
+ * Executes the items of a time-sliced system that are due in this run, or all of them for the other systems, and
+ * updates the statistics of the system. The progress is kept per scene; time-sliced systems must not run concurrently
+ * with themselves in the same scene.
+ */
+static void
+ExecSlices(struct NeExecArgs *ea, uint64_t count, NeExecRangeProc proc, bool parallel)
+{
+	struct NeECSystem *sys = ea->sys;
+	uint64_t begin = 0, end = count;
+	bool pass = true;
+
+	// systems registered since the last commit have no progress in the scene yet, so they run every item
+	struct NeSystemSlice *sl = sys->amortize || sys->budget ? Rt_ArrayGet(&ea->s->systemSlices, sys->sliceSlot) : NULL;
+
+	const uint64_t start = Sys_Time();
+
+	if (sl && sys->amortize) {
+		const uint64_t k = sl->frame++ % sys->amortize;
+
+		begin = count * k / sys->amortize;
+		end = count * (k + 1) / sys->amortize;
+		pass = k == sys->amortize - 1;
+	} else if (sl && sys->budget && count) {
+		uint64_t n = sl->itemTime > 0.f ? (uint64_t)((float)sys->budget / sl->itemTime) : ECSYS_BUDGET_PROBE;
+		n = n < 1 ? 1 : (n > count ? count : n);
+
+		// the components might have been removed since the previous run
+		begin = sl->cursor < count ? sl->cursor : 0;
+		end = begin + n;
+		pass = end >= count;
+		sl->cursor = pass ? end - count : end;
+	}
+
+	if (end > count) {
+		ExecRange(ea, proc, begin, count, parallel);
+		ExecRange(ea, proc, 0, end - count, parallel);
 	} else {
-		FilterEntities(s, &f_filteredEntities, sys->compTypes, sys->typeCount);
+		ExecRange(ea, proc, begin, end, parallel);
+	}
 
-		if (!f_filteredEntities.count)
-			goto exit;
+	const uint64_t time = Sys_Time() - start;
 
-		count = f_filteredEntities.count;
-		ea = Sys_Alloc(sizeof(*ea), count, MH_Frame);
-		for (size_t i = 0; i < count; ++i) {
-			NeEntityHandle handle = (NeEntityHandle *)Rt_ArrayGetPtr(&f_filteredEntities, i);
-			ea[i] = Sys_Alloc(sizeof(*ea[0]), 1, MH_Frame);
-			ea[i]->sys = sys;
-			ea[i]->args = args;
+	if (sl && sys->budget && end > begin) {
+		const float itemTime = (float)time / (float)(end - begin);
+		sl->itemTime = sl->itemTime > 0.f ? sl->itemTime * .75f + itemTime * .25f : itemTime;
+	}
 
-			for (size_t j = 0; j < sys->typeCount; ++j)
-				ea[i]->components[j] = ECS_GetComponent(s, handle, sys->compTypes[j]);
-		}
+	// the system can run in more than one scene at the same time
+	Sys_AtomicLockWrite(&sys->statsLock);
+
+	struct NeSystemStats *st = &sys->stats;
+	st->items = end - begin;
+	st->lastTime = time;
+	st->averageTime = st->runs ? (st->averageTime * 7 + time) / 8 : time;
+	st->maxTime = time > st->maxTime ? time : st->maxTime;
+	st->passes += pass;
+	++st->runs;
+
+	Sys_AtomicUnlockWrite(&sys->statsLock);
+}
+
+static inline void
+ExecRange(const struct NeExecArgs *ea, NeExecRangeProc proc, uint64_t begin, uint64_t end, bool parallel)
+{
+	if (begin >= end)
+		return;
+
+	if (parallel)
+		E_ParallelFor(begin, end, 0, (NeParallelForProc)proc, (void *)ea);
+	else
+		proc(0, begin, end, ea);
+}
+
+static inline void
+SetSchedule(struct NeECSystem *sys, uint32_t amortize, uint32_t budget)
+{
+	// amortizing over one frame is the same as running every component
+	sys->amortize = amortize > 1 ? amortize : 0;
+	sys->budget = sys->amortize ? 0 : (uint64_t)budget * 1000;
+
+	if (sys->changed && (sys->amortize || sys->budget)) {
+		Sys_LogEntry(ECSYS_MOD, LOG_WARNING, "System %s filters changed components, it can't be time-sliced", sys->name);
+		sys->amortize = sys->budget = 0;
+	}
+
+	// a reloaded system starts over in every scene
+	if (sys->amortize || sys->budget)
+		sys->sliceSlot = f_sliceCount++;
+}
+
+static inline const struct NeArray *
+QueryRows(struct NeScene *s, struct NeECSystem *sys, struct NeExecArgs *ea)
+{
+	const struct NeECSQueryCache *qc = Rt_ArrayGet(&s->queries, sys->query);
+	if (!qc)
+		return NULL;
+
+	// resolve the component arrays once; the rows only store handle ids
+	for (size_t i = 0; i < sys->typeCount; ++i) {
+		const struct NeArray *a = Rt_ArrayGet(&s->compData, sys->compTypes[i]);
+		ea->data[i] = a->data;
+		ea->stride[i] = a->elemSize;
+		ea->slots[i] = (const uint32_t *)((const struct NeArray *)Rt_ArrayGet(&s->compSlot, sys->compTypes[i]))->data;
 	}
 
-	struct NeJobCompletedArgs *jca = Sys_Alloc(sizeof(*jca), 1, MH_Frame);
-	jca->done = false;
-	jca->scene = s;
-	E_DispatchJobs(count, (NeJobProc)ExecJob, (void **)ea, (NeJobCompletedProc)JobCompleted, jca);
+	return &qc->rows;
+}
 
-	return &jca->done;
+// Systems with a single type walk the slots of its array, or its handle ids when they filter changed components
+static inline size_t
+ComponentRange(struct NeScene *s, struct NeECSystem *sys, struct NeExecArgs *ea)
+{
+	if (!ea->changes)
+		return ea->items->count;
+
+	const struct NeArray *sa = Rt_ArrayGet(&s->compSlot, sys->compTypes[0]);
+	ea->slots[0] = (const uint32_t *)sa->data;
+	return sa->count;
+}
+
+static inline struct NeCompBase *
+NextComponent(const struct NeExecArgs *ea, uint64_t *i, uint64_t end)
+{
+	if (!ea->changes)
+		return Rt_ArrayGet(ea->items, *i);
+
+	for (; (*i = ECS_NextChangedSlot(ea->changes, *i, end)) < end; ++*i)
+		if (ea->slots[0][*i] != ECS_INVALID_SLOT)
+			return Rt_ArrayGet(ea->items, ea->slots[0][*i]);
 
-exit:
-	Sys_AtomicUnlockRead(&s->lock.comp);
 	return NULL;
 }
 
-static inline void
-FilterEntities(struct NeScene *s, struct NeArray *ent, NeCompTypeId *compTypes, size_t typeCount)
+static inline size_t
+QueryChunks(struct NeScene *s, struct NeECSystem *sys, struct NeExecArgs *ea)
 {
-	const struct NeArray *components;
-	NeCompTypeId type = -1;
-	size_t min_count = SIZE_MAX;
-	struct NeCompBase *comp = NULL;
-	bool valid = false;
+	size_t count = 0;
+	const struct NeQueryArchetype *qa;
+	const struct NeECSQueryCache *qc = Rt_ArrayGet(&s->queries, sys->query);
+	if (!qc)
+		return 0;
 
-	for (size_t i = 0; i < typeCount; ++i) {
-		const size_t count = E_ComponentCountS(s, compTypes[i]);
+	// the chunks of all matching archetypes are executed as a single range
+	Rt_ArrayForEach(qa, &qc->archetypes)
+		count += ((const struct NeArchetype *)Rt_ArrayGet(&s->archetypes, qa->archetype))->chunks.count;
 
-		if (count >= min_count)
-			continue;
+	ea->items = &qc->archetypes;
+	return count;
+}
+
+static void
+ExecComponents(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea)
+{
+	lua_State *vm = AcquireScriptVM(ea->sys);
+
+	for (uint64_t i = begin; i < end; ++i) {
+		struct NeCompBase *compBase = NextComponent(ea, &i, end);
+		if (!compBase)
+			break;
 
-		type = compTypes[i];
-		min_count = count;
+		if (compBase->_valid && compBase->_enabled)
+			Exec(ea->sys, vm, (void **)&compBase, ea->args);
 	}
 
-	if (type == -1) {
-		Sys_LogEntry(ECSYS_MOD, LOG_CRITICAL, "_filterEntities: Entity with least components not found. Is typeCount set ?");
-		return;
+	ReleaseScriptVM(ea->sys, vm, ea->args);
+}
+
+// Single threaded systems visit the disabled components too
+static void
+ExecValidComponents(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea)
+{
+	lua_State *vm = AcquireScriptVM(ea->sys);
+
+	for (uint64_t i = begin; i < end; ++i) {
+		struct NeCompBase *compBase = NextComponent(ea, &i, end);
+		if (!compBase)
+			break;
+
+		if (compBase->_valid)
+			Exec(ea->sys, vm, (void **)&compBase, ea->args);
 	}
 
-	Rt_ClearArray(ent, false);
-	components = E_GetAllComponentsS(s, type);
+	ReleaseScriptVM(ea->sys, vm, ea->args);
+}
 
-	if (ent->size < components->count)
-		Rt_ResizeArray(ent, components->count);
+static void
+ExecEntities(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea)
+{
+	void *components[MAX_ENTITY_COMPONENTS];
+	const size_t typeCount = ea->sys->typeCount;
+	lua_State *vm = AcquireScriptVM(ea->sys);
 
-	for (size_t i = 0; i < components->count; ++i) {
-		comp = Rt_ArrayGet(components, i);
+	for (uint64_t i = begin; i < end; ++i) {
+		const uint32_t *ids = ECS_QueryRowSlots(ea->items->data + ea->items->elemSize * i);
+		bool enabled = true;
 
-		if (!comp->_owner || !comp->_valid || !comp->_enabled)
+		if (ea->changes && !ECS_SlotsChanged(ea->changes, ids))
 			continue;
 
-		valid = true;
-
 		for (size_t j = 0; j < typeCount; ++j) {
-			if (ECS_GetComponent(s, comp->_owner, compTypes[j]))
-				continue;
+			struct NeCompBase *comp = (struct NeCompBase *)(ea->data[j] + ea->stride[j] * ea->slots[j][ids[j]]);
+			enabled &= comp->_enabled;
+			components[j] = comp;
+		}
+
+		if (enabled)
+			Exec(ea->sys, vm, components, ea->args);
+	}
+
+	ReleaseScriptVM(ea->sys, vm, ea->args);
+}
+
+static void
+ExecChunks(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea)
+{
+	lua_State *vm = AcquireScriptVM(ea->sys);
+	uint64_t first = 0;
 
-			valid = false;
+	const struct NeQueryArchetype *qa;
+	Rt_ArrayForEach(qa, ea->items) {
+		if (first >= end)
 			break;
+
+		const struct NeArchetype *a = Rt_ArrayGet(&ea->s->archetypes, qa->archetype);
+		const uint64_t last = first + a->chunks.count;
+
+		for (uint64_t i = begin > first ? begin : first; i < end && i < last; ++i) {
+			const struct NeArchetypeChunk *c = Rt_ArrayGet(&a->chunks, i - first);
+			ExecChunk(ea, vm, a, qa, c, 0, c->count);
 		}
 
-		if (valid)
-			Rt_ArrayAddPtr(ent, comp->_owner);
+		first = last;
 	}
+
+	ReleaseScriptVM(ea->sys, vm, ea->args);
 }
 
+// Time-sliced systems split archetype storage by rows, because a chunk can take longer than the budget
 static void
-ExecJob(int worker, struct NeExecArgs *ea)
+ExecChunkRows(int worker, uint64_t begin, uint64_t end, const struct NeExecArgs *ea)
 {
-	Exec(ea->sys, ea->components, ea->args);
+	lua_State *vm = AcquireScriptVM(ea->sys);
+	uint64_t first = 0;
+
+	const struct NeQueryArchetype *qa;
+	Rt_ArrayForEach(qa, ea->items) {
+		const struct NeArchetype *a = Rt_ArrayGet(&ea->s->archetypes, qa->archetype);
+
+		const struct NeArchetypeChunk *c;
+		Rt_ArrayForEach(c, &a->chunks) {
+			if (first >= end)
+				goto exit;
+
+			const uint64_t last = first + c->count;
+			if (last > begin)
+				ExecChunk(ea, vm, a, qa, c, begin > first ? (uint32_t)(begin - first) : 0, (uint32_t)((end < last ? end : last) - first));
+
+			first = last;
+		}
+	}
+
+exit:
+	ReleaseScriptVM(ea->sys, vm, ea->args);
 }
 
-static void
-JobCompleted(uint64_t id, struct NeJobCompletedArgs *args)
+static inline void
+ExecChunk(const struct NeExecArgs *ea, lua_State *vm, const struct NeArchetype *a, const struct NeQueryArchetype *qa,
+		  const struct NeArchetypeChunk *c, uint32_t begin, uint32_t end)
 {
-	Sys_AtomicUnlockRead(&args->scene->lock.comp);
-	args->done = true;
+	void *components[MAX_ENTITY_COMPONENTS];
+	uint8_t *data[MAX_ENTITY_COMPONENTS];
+	size_t stride[MAX_ENTITY_COMPONENTS];
+	const size_t typeCount = ea->sys->typeCount;
+
+	for (size_t j = 0; j < typeCount; ++j) {
+		data[j] = ECS_ChunkColumn(a, c, qa->columns[j]);
+		stride[j] = a->size[qa->columns[j]];
+	}
+
+	// destroyed components keep their row until the scene is committed
+	for (uint32_t row = begin; row < end; ++row) {
+		uint32_t slots[MAX_ENTITY_COMPONENTS];
+		bool enabled = true;
+
+		for (size_t j = 0; j < typeCount; ++j) {
+			struct NeCompBase *comp = (struct NeCompBase *)(data[j] + stride[j] * row);
+			enabled &= comp->_valid & comp->_enabled;
+			components[j] = comp;
+			slots[j] = comp->_handleId;
+		}
+
+		if (enabled && (!ea->changes || ECS_SlotsChanged(ea->changes, slots)))
+			Exec(ea->sys, vm, components, ea->args);
+	}
 }
 
 static inline void
-Exec(struct NeECSystem *sys, void **comp, void *args)
+Exec(struct NeECSystem *sys, lua_State *vm, void **comp, void *args)
 {
-	if (sys->exec)
+	if (unlikely(ECS_validateAccess))
+		ValidatedExec(sys, vm, comp, args);
+	else if (sys->exec)
 		sys->exec(comp, args);
-	else
-		ScriptExec(sys->singleThread ? sys->vm : sys->vms[E_WorkerId()], sys, comp, args);
+	else if (vm)
+		ScriptExec(vm, sys, comp, args);
+}
+
+static void
+ValidatedExec(struct NeECSystem *sys, lua_State *vm, void **comp, void *args)
+{
+	uint64_t hash[MAX_ENTITY_COMPONENTS];
+	struct NeECSystem *active = f_activeSystem;
+
+	// the component base belongs to the engine, only the data after it is checked
+	for (size_t i = 0; i < sys->typeCount; ++i)
+		if (sys->readOnly & (1u << i))
+			hash[i] = Rt_HashMemory((uint8_t *)comp[i] + sizeof(struct NeCompBase),
+									E_ComponentTypeSize(sys->compTypes[i]) - sizeof(struct NeCompBase));
+
+	f_activeSystem = sys;
+
+	if (sys->exec) {
+		sys->exec(comp, args);
+	} else if (vm) {
+		// batches are executed right away, so the check covers the components of this call
+		ScriptExec(vm, sys, comp, args);
+		if (sys->batch)
+			ScriptFlush(vm, sys, args);
+	}
+
+	f_activeSystem = active;
+
+	for (size_t i = 0; i < sys->typeCount; ++i) {
+		if (!(sys->readOnly & (1u << i)) || sys->accessReported)
+			continue;
+
+		if (hash[i] != Rt_HashMemory((uint8_t *)comp[i] + sizeof(struct NeCompBase),
+									 E_ComponentTypeSize(sys->compTypes[i]) - sizeof(struct NeCompBase))) {
+			sys->accessReported = true;
+			Sys_LogEntry(ECSYS_MOD, LOG_WARNING, "System %s modified %s, which it declared as read-only",
+						 sys->name, E_ComponentTypeName(sys->compTypes[i]));
+		}
+	}
+}
+
+void
+ECS_ValidateAccess(NeCompTypeId type)
+{
+	struct NeECSystem *sys = f_activeSystem;
+	if (!sys || sys->accessReported)
+		return;
+
+	for (size_t i = 0; i < sys->typeCount; ++i)
+		if (sys->compTypes[i] == type)
+			return;
+
+	// the groups are rebuilt before their next execution, with the system running alone
+	sys->accessReported = true;
+	sys->exclusive = true;
+	atomic_fetch_add_explicit(&f_systemsVersion, 1, memory_order_relaxed);
+
+	Sys_LogEntry(ECSYS_MOD, LOG_WARNING, "System %s accessed %s, which it didn't declare", sys->name, E_ComponentTypeName(type));
 }
 
 static inline bool
@@ -475,6 +1026,7 @@ LoadSystemInfo(const char *path, struct NeECSystem *sys)
 		goto exit;
 	}
 
+	uint32_t readOnly = 0, changed = 0;
 	NeCompTypeId *types = Sys_Alloc(sizeof(*types), typeCount, MH_Transient);
 	for (uint32_t i = 0; i < typeCount; ++i) {
 		lua_rawgeti(vm, f, i + 1);
@@ -486,24 +1038,60 @@ LoadSystemInfo(const char *path, struct NeECSystem *sys)
 		}
 
 		const char *type = lua_tostring(vm, v);
-		if ((types[i] = E_ComponentTypeId(type)) == -1) {
+		if ((types[i] = SystemComponentTypeId(type)) == NE_INVALID_HANDLE) {
 			Sys_LogEntry(ECSYS_MOD, LOG_CRITICAL, "Error while loading system %s: Component %s not registered", name, type);
 			goto exit;
 		}
 
+		if (types[i] & ECSYS_READ_ONLY_BIT) {
+			types[i] &= ~ECSYS_READ_ONLY_BIT;
+			readOnly |= 1u << i;
+		}
+
+		if (types[i] & ECSYS_CHANGED_BIT) {
+			types[i] &= ~ECSYS_CHANGED_BIT;
+			changed |= 1u << i;
+		}
+
 		lua_remove(vm, v);
 	}
 	SIF_POPFIELD(f);
 
+	const uint32_t query = ECS_RegisterQuery(types, typeCount);
+	if (query == ECS_INVALID_QUERY) {
+		Sys_LogEntry(ECSYS_MOD, LOG_CRITICAL, "Error while loading system %s: failed to register query", name);
+		goto exit;
+	}
+
 	// all good, commit
 	memcpy(sys->compTypes, types, sizeof(*types) * typeCount);
 	sys->typeCount = typeCount;
+	sys->readOnly = readOnly;
+	sys->changed = changed;
+	sys->query = query;
+
+	// a reloaded system gets a new filter, so it runs for all components once
+	if (changed)
+		sys->changeSlot = ECS_RegisterChangeFilter(sys);
 
 	sys->nameHash = Rt_HashString(name);
+	strlcpy(sys->name, name, sizeof(sys->name));
 	sys->groupHash = SIF_OPTU64FIELD(t, "group", ECSYS_GROUP_LOGIC_HASH);
 	sys->singleThread = SIF_OPTBOOLFIELD(t, "singleThread", false);
+	sys->exclusive = true;
 	sys->priority = SIF_OPTINTFIELD(t, "priority", 0);
 
+	SetSchedule(sys, (uint32_t)SIF_OPTINTFIELD(t, "amortize", 0), (uint32_t)SIF_OPTINTFIELD(t, "budget", 0));
+
+	const char *batch = SIF_OPTSTRINGFIELD(t, "batch", NULL);
+	sys->batch = ECSYS_BATCH_NONE;
+	if (batch && !strcmp(batch, "view"))
+		sys->batch = ECSYS_BATCH_VIEW;
+	else if (batch && !strcmp(batch, "columns"))
+		sys->batch = ECSYS_BATCH_COLUMNS;
+	else if (batch)
+		Sys_LogEntry(ECSYS_MOD, LOG_WARNING, "Unknown batch mode %s for system %s", batch, sys->name);
+
 	rc = true;
 exit:
 	lua_close(vm);
@@ -522,18 +1110,14 @@ LoadScript(const char *path)
 	--f_systems.count;
 
 	sys.scriptHash = Rt_HashString(strrchr(Rt_StrDup(path, MH_Transient), '/') + 1);
+	sys.script = Rt_StrDup(path, MH_System);
 	sys.enabled = true;
 
-	if (sys.singleThread) {
-		sys.vm = CreateVM(&sys, path);
-		if (!sys.vm)
-			goto error;
-	} else {
-		sys.vms = Sys_Alloc(sizeof(*sys.vms), E_JobWorkerThreads(), MH_System);
-		for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i)
-			if (!(sys.vms[i] = CreateVM(&sys, path)))
-				goto error;
-	}
+	// the system runs in pooled VMs; check the script once here
+	lua_State *vm = AcquireScriptVM(&sys);
+	if (!vm)
+		goto error;
+	Sc_ReleaseVM(vm);
 
 	size_t pos = Rt_ArrayFindId(&f_systems, &sys.priority, ECSysInsertCmp);
 	if (pos == RT_NOT_FOUND)
@@ -542,49 +1126,72 @@ LoadScript(const char *path)
 	if (!Rt_ArrayInsert(&f_systems, &sys, pos))
 		goto error;
 
+	++f_systemsVersion;
 	return;
 error:
-	if (sys.vm) {
-		if (sys.singleThread) {
-			Sc_DestroyVM(sys.vm);
-		} else {
-			for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i)
-				Sc_DestroyVM(sys.vms[i]);
-			Sys_Free(sys.vms);
-		}
-	}
+	Sys_Free(sys.script);
 }
 
 static lua_State *
-CreateVM(struct NeECSystem *sys, const char *script)
+AcquireScriptVM(const struct NeECSystem *sys)
 {
-	lua_State *vm = Sc_CreateVM();
+	if (sys->exec)
+		return NULL;
+
+	lua_State *vm = Sc_AcquireVM();
 	if (!vm)
 		return NULL;
 
-	if (!Sc_LoadScriptFile(vm, script)) {
-		lua_close(vm);
+	if (!Sc_PushScriptFunction(vm, sys->script, "Execute")) {
+		Sys_LogEntry(ECSYS_MOD, LOG_CRITICAL, "Execute function not found in script %s", sys->script);
+		Sc_ReleaseVM(vm);
 		return NULL;
 	}
 
-	lua_getglobal(vm, "Execute");
+	if (!sys->batch) {
+		for (uint32_t i = 0; i < sys->typeCount; ++i)
+			Sc_PushScriptWrapper(vm, NULL, E_ComponentTypeName(sys->compTypes[i]));
 
-	if (!lua_isfunction(vm, lua_gettop(vm))) {
-		Sys_LogEntry(ECSYS_MOD, LOG_CRITICAL, "Execute function not found in script %s", script);
-		lua_pop(vm, 1);
-		lua_close(vm);
-		return NULL;
+		return vm;
 	}
 
-	for (uint32_t i = 0; i < sys->typeCount; ++i)
-		Sc_PushScriptWrapper(vm, NULL, E_ComponentTypeName(sys->compTypes[i]));
+	for (uint32_t i = 0; i < sys->typeCount; ++i) {
+		struct NeScriptView *v = lua_newuserdatauv(vm, sizeof(*v), 0);
+		luaL_setmetatable(vm, sys->batch == ECSYS_BATCH_COLUMNS ? SIF_NE_COMPONENT_COLUMNS : SIF_NE_COMPONENT_VIEW);
+
+		v->type = sys->compTypes[i];
+		v->count = 0;
+		v->readOnly = (sys->readOnly & (1u << i)) != 0;
+	}
 
 	return vm;
 }
 
+static inline void
+ReleaseScriptVM(const struct NeECSystem *sys, lua_State *vm, void *args)
+{
+	if (vm && sys->batch)
+		ScriptFlush(vm, sys, args);
+
+	Sc_ReleaseVM(vm);
+}
+
 static inline void
 ScriptExec(lua_State *vm, struct NeECSystem *sys, void **comp, void *args)
 {
+	if (sys->batch) {
+		struct NeScriptView *v = NULL;
+		for (size_t i = 0; i < sys->typeCount; ++i) {
+			v = lua_touserdata(vm, (int)i - (int)sys->typeCount);
+			v->comp[v->count++] = comp[i];
+		}
+
+		if (v->count == SC_VIEW_CAPACITY)
+			ScriptFlush(vm, sys, args);
+
+		return;
+	}
+
 	const int sp = -(1 + (int32_t)sys->typeCount);
 	lua_pushvalue(vm, sp);
 
@@ -602,6 +1209,36 @@ ScriptExec(lua_State *vm, struct NeECSystem *sys, void **comp, void *args)
 	}
 }
 
+/*
+ * Calls Execute(view1, ..., viewN, count, args) with the components gathered by ScriptExec. The views are reused for
+ * the next batch, so scripts must not keep them or the columns taken from them past the call.
+ */
+static void
+ScriptFlush(lua_State *vm, const struct NeECSystem *sys, void *args)
+{
+	const int sp = -(1 + (int32_t)sys->typeCount);
+	const struct NeScriptView *last = lua_touserdata(vm, -1);
+	const uint32_t count = last->count;
+
+	if (!count)
+		return;
+
+	lua_pushvalue(vm, sp);
+	for (size_t i = 0; i < sys->typeCount; ++i)
+		lua_pushvalue(vm, sp);
+	lua_pushinteger(vm, count);
+	lua_pushlightuserdata(vm, args);
+
+	if (lua_pcall(vm, (int)sys->typeCount + 2, 0, 0) && lua_gettop(vm)) {
+		Sys_LogEntry(ECSYS_MOD, LOG_CRITICAL, "Failed to execute script system: %s", lua_tostring(vm, -1));
+		Sc_LogStackDump(vm, LOG_CRITICAL);
+		lua_pop(vm, 1);
+	}
+
+	for (size_t i = 0; i < sys->typeCount; ++i)
+		((struct NeScriptView *)lua_touserdata(vm, (int)i - (int)sys->typeCount))->count = 0;
+}
+
 static inline void
 FileChanged(const char *path, enum NeFSEvent event, void *ud)
 {
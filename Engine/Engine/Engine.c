@@ -284,6 +284,8 @@ E_Frame(void)
 	E_deltaTime = now - f_prevTime;
 	f_prevTime = now;
 
+	Sys_UpdateHeapStatistics();
+
 	if (!Scn_activeScene || Scn_activeScene->camera == NE_INVALID_HANDLE) {
 		E_ProcessEvents();
 		App_Frame();
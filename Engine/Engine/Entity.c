@@ -1,8 +1,11 @@
+#include <stdatomic.h>
+
 #include <Engine/IO.h>
 #include <Engine/Job.h>
 #include <Engine/Types.h>
 #include <Engine/Entity.h>
 #include <Engine/Events.h>
+#include <Engine/Prefab.h>
 #include <Engine/Component.h>
 #include <Scene/Scene.h>
 #include <System/Log.h>
@@ -12,33 +15,170 @@
 
 #define ENT_MOD	"Entity"
 
-struct NeQueue *ECS_mboxes = NULL;
+#define MIN_NAME_TABLE	64
+
+/*
+ * The name index is an open addressing table of name hash & entity handle pairs. Lookups don't take a lock; writers
+ * only fill empty entries and clear the handle of removed ones, so a reader never sees a handle paired with another
+ * name. When the table fills up with names & removed entries, it is rebuilt and the old one is released in Scn_Commit.
+ */
+struct NeEntityName
+{
+	_Atomic uint64_t key;
+	atomic_uintptr_t handle;
+};
+
+struct NeEntityNameTable
+{
+	struct NeEntityNameTable *retired;
+	size_t mask, used, count;
+	struct NeEntityName names[];
+};
+
+struct NeEntityNameIndex
+{
+	struct NeEntityNameTable *_Atomic table;
+	struct NeAtomicLock lock;
+};
+
+enum NeEntityCommandType
+{
+	ECMD_CREATE_ENTITY,
+	ECMD_ADD_COMPONENT,
+	ECMD_REMOVE_COMPONENT,
+	ECMD_DESTROY_ENTITY,
+	ECMD_SET_PARENT
+};
+
+struct NeEntityCommand
+{
+	enum NeEntityCommandType type;
+	NeEntityHandle entity;
+	union {
+		struct {
+			NeCompTypeId type;
+			const void **args;
+		} comp;
+		NeEntityHandle parent;
+		char name[MAX_ENTITY_NAME];
+	};
+};
+
+/*
+ * Messages are appended to a buffer of the sending worker, without locking; the threads outside the pool share one
+ * buffer, guarded by f_mboxLock. E_DistributeMessages moves them to the
+ * bus and sorts it by recipient, keeping the order in which each worker sent them, so E_ProcessMessages can split the
+ * bus in ranges that each hold all the messages of their recipients. The messages of entities in other scenes stay
+ * on the bus until their scene processes them.
+ */
+struct NeArray *ECS_mboxes = NULL;
+struct NeEntitySlot *ECS_entitySlots[ECS_MAX_ENTITY_PAGES];
+
+static struct NeArray f_messageBus, f_messageScratch;
+static _Atomic uint64_t f_otherSceneMessages;
 
 static struct NeArray f_entityTypes;
-static struct NeAtomicLock f_entityTypeLock;
+static struct NeAtomicLock f_entityTypeLock, f_slotLock, f_mboxLock;
+static uint32_t f_slotCount, f_freeSlot = UINT32_MAX;
 
-static inline bool AddComponent(struct NeScene *s, struct NeEntity *, NeCompTypeId, NeCompHandle);
+static inline bool AddComponent(struct NeScene *s, struct NeEntity *, NeCompTypeId, NeCompHandle, bool);
 static inline bool CreateComponent(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type, const void **args);
+static inline bool RecordCommand(struct NeScene *s, const struct NeEntityCommand *cmd);
+static inline void ExecuteCommand(struct NeScene *s, const struct NeEntityCommand *cmd);
+static inline void SetName(struct NeScene *s, struct NeEntity *ent, const char *name);
+static inline void InsertName(struct NeEntityNameIndex *idx, uint64_t key, NeEntityHandle handle);
+static inline void RemoveName(struct NeEntityNameIndex *idx, uint64_t key, NeEntityHandle handle);
+static struct NeEntityNameTable *AllocNameTable(size_t size);
 static void LoadEntity(const char *path);
-static void ProcessEntityMessages(int workerId, struct NeEntity *ent);
+static void SortMessages(void);
+static void ProcessEntityMessages(int workerId, uint64_t begin, uint64_t end, struct NeScene *s);
+static inline void ScriptMessageHandler(const struct NeCompType *type, void *comp, const struct NeEntityMessage *msg);
+
+static inline uint64_t NameKey(uint64_t hash) { return hash ? hash : 1; }
+static inline struct NeEntitySlot *SlotPtr(uint32_t slot) { return &ECS_entitySlots[slot >> ECS_ENTITY_PAGE_BITS][slot & (ECS_ENTITY_PAGE_SIZE - 1)]; }
+
+// Must be called with the slot lock held
+static inline NeEntityHandle
+TakeSlot(struct NeEntity *ent)
+{
+	uint32_t slot;
+
+	if (f_freeSlot != UINT32_MAX) {
+		slot = f_freeSlot;
+		f_freeSlot = SlotPtr(slot)->nextFree;
+	} else {
+		const uint32_t page = f_slotCount >> ECS_ENTITY_PAGE_BITS;
+		if (page == ECS_MAX_ENTITY_PAGES ||
+				(!ECS_entitySlots[page] && !(ECS_entitySlots[page] = Sys_Alloc(sizeof(struct NeEntitySlot), ECS_ENTITY_PAGE_SIZE, MH_System))))
+			return ES_INVALID_ENTITY;
+
+		slot = f_slotCount++;
+		SlotPtr(slot)->generation = 1;
+	}
+
+	struct NeEntitySlot *es = SlotPtr(slot);
+	es->ent = ent;
+
+	return ECS_ENTITY_HANDLE(slot, es->generation);
+}
+
+static inline NeEntityHandle
+AllocSlot(struct NeEntity *ent)
+{
+	Sys_AtomicLockWrite(&f_slotLock);
+	const NeEntityHandle handle = TakeSlot(ent);
+	Sys_AtomicUnlockWrite(&f_slotLock);
+
+	if (!handle)
+		Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to allocate entity slot");
+
+	return handle;
+}
+
+static inline void
+FreeSlot(NeEntityHandle handle)
+{
+	const uint32_t slot = ECS_ENTITY_SLOT(handle);
+
+	Sys_AtomicLockWrite(&f_slotLock);
+
+	struct NeEntitySlot *es = SlotPtr(slot);
+	es->ent = NULL;
+
+	// generation 0 is never handed out, so the NULL handle stays invalid
+	es->generation = (uint32_t)((es->generation + 1) & ECS_ENTITY_GENERATION_MASK);
+	if (!es->generation)
+		es->generation = 1;
+
+	es->nextFree = f_freeSlot;
+	f_freeSlot = slot;
+
+	Sys_AtomicUnlockWrite(&f_slotLock);
+}
+
+static inline void
+FreeEntity(struct NeEntity *ent)
+{
+	FreeSlot(ent->handle);
+	Sys_Free(ent);
+}
 
 static inline bool
 AddEntity(struct NeScene *s, struct NeEntity *ent, const char *name, bool broadcast)
 {
-	Rt_InitQueue(&ent->mbox, 10, sizeof(struct NeEntityMessage), MH_Scene);
-	E_RenameEntity(ent, name ? name : "unnamed");
-
 	Sys_AtomicLockWrite(&s->lock.newEntity);
 	bool rc = Rt_ArrayAddPtr(&s->newEntities, ent);
 	Sys_AtomicUnlockWrite(&s->lock.newEntity);
 
 	if (!rc) {
-		Sys_Free(ent);
+		FreeEntity(ent);
 		return false;
 	}
 
+	SetName(s, ent, name ? name : "unnamed");
+
 	if (broadcast)
-		E_Broadcast(EVT_ENTITY_CREATED, ent);
+		E_Broadcast(EVT_ENTITY_CREATED, ent->handle);
 
 	return true;
 }
@@ -46,20 +186,90 @@ AddEntity(struct NeScene *s, struct NeEntity *ent, const char *name, bool broadc
 static inline struct NeEntity *
 AllocEntity(struct NeScene *s)
 {
-	struct NeEntity *ent = Sys_Alloc(1, sizeof(*ent), MH_Scene);
+	// the component index is stored after the entity
+	const size_t typeCount = ECS_ComponentTypeCount();
+	struct NeEntity *ent = Sys_Alloc(1, sizeof(*ent) + typeCount, MH_Scene);
 	if (!ent)
 		return NULL;
 
+	if (!(ent->handle = AllocSlot(ent))) {
+		Sys_Free(ent);
+		return NULL;
+	}
+
 	ent->sceneId = s->id;
+	ent->compIndexSize = (uint32_t)typeCount;
+	ent->compIndex = (uint8_t *)(ent + 1);
 	return ent;
 }
 
+static bool
+AllocEntities(struct NeScene *s, struct NeEntity **ents, uint32_t count)
+{
+	const size_t typeCount = ECS_ComponentTypeCount();
+	uint32_t allocated = 0, slots = 0;
+
+	for (; allocated < count; ++allocated)
+		if (!(ents[allocated] = Sys_Alloc(1, sizeof(**ents) + typeCount, MH_Scene)))
+			goto error;
+
+	Sys_AtomicLockWrite(&f_slotLock);
+	for (; slots < count; ++slots)
+		if (!(ents[slots]->handle = TakeSlot(ents[slots])))
+			break;
+	Sys_AtomicUnlockWrite(&f_slotLock);
+
+	if (slots < count) {
+		Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to allocate entity slot");
+		goto error;
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		ents[i]->sceneId = s->id;
+		ents[i]->compIndexSize = (uint32_t)typeCount;
+		ents[i]->compIndex = (uint8_t *)(ents[i] + 1);
+	}
+
+	return true;
+
+error:
+	for (uint32_t i = 0; i < allocated; ++i) {
+		if (i < slots)
+			FreeEntity(ents[i]);
+		else
+			Sys_Free(ents[i]);
+	}
+
+	return false;
+}
+
+static bool
+AddEntities(struct NeScene *s, struct NeEntity **ents, uint32_t count, const char *name)
+{
+	Sys_AtomicLockWrite(&s->lock.newEntity);
+	const bool rc = s->newEntities.count + count <= s->newEntities.size || Rt_ResizeArray(&s->newEntities, s->newEntities.count + count);
+	for (uint32_t i = 0; rc && i < count; ++i)
+		Rt_ArrayAddPtr(&s->newEntities, ents[i]);
+	Sys_AtomicUnlockWrite(&s->lock.newEntity);
+
+	if (!rc)
+		return false;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		SetName(s, ents[i], name);
+		E_Broadcast(EVT_ENTITY_CREATED, ents[i]->handle);
+	}
+
+	return true;
+}
+
 NeEntityHandle
 E_CreateEntityS(struct NeScene *s, const char *name, const char *typeName)
 {
 	uint64_t hash = 0;
 	struct NeEntity *ent = NULL;
 	struct NeEntityType *type = NULL;
+	NeEntityHandle handle = ES_INVALID_ENTITY;
 
 	if (typeName) {
 		Sys_AtomicLockRead(&f_entityTypeLock);
@@ -67,20 +277,23 @@ E_CreateEntityS(struct NeScene *s, const char *name, const char *typeName)
 		hash = Rt_HashString(typeName);
 		type = Rt_ArrayFind(&f_entityTypes, &hash, Rt_U64CmpFunc);
 		if (!type) {
-			Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Entity type %s not found");
+			Sys_AtomicUnlockRead(&f_entityTypeLock);
+			Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Entity type %s not found", typeName);
 			return ES_INVALID_ENTITY;
 		}
 
-		ent = E_CreateEntityWithArgArrayS(s, name, type->compTypes, type->initialArguments, type->compCount);
+		handle = E_CreateEntityWithArgArrayS(s, name, type->compTypes, type->initialArguments, type->compCount);
 
 		Sys_AtomicUnlockRead(&f_entityTypeLock);
 	} else {
 		ent = AllocEntity(s);
 		if (!ent || !AddEntity(s, ent, name, true))
 			return ES_INVALID_ENTITY;
+
+		handle = ent->handle;
 	}
 
-	return ent;
+	return handle;
 }
 
 NeEntityHandle
@@ -96,12 +309,12 @@ E_CreateEntityWithArgsS(struct NeScene *s, const char *name, const NeCompTypeId
 
 	for (uint8_t i = 0; i < count; ++i) {
 		if (!CreateComponent(s, ent, compTypes[i], compArgs ? compArgs[i] : NULL)) {
-			Sys_Free(ent);
+			FreeEntity(ent);
 			return ES_INVALID_ENTITY;
 		}
 	}
 
-	return AddEntity(s, ent, name, true) ? ent : ES_INVALID_ENTITY;
+	return AddEntity(s, ent, name, true) ? ent->handle : ES_INVALID_ENTITY;
 }
 
 NeEntityHandle
@@ -117,12 +330,12 @@ E_CreateEntityWithArgArrayS(struct NeScene *s, const char *name, const NeCompTyp
 
 	for (uint8_t i = 0; i < count; ++i) {
 		if (!CreateComponent(s, ent, compTypes[i], compArgs ? (const void **)compArgs[i].data : NULL)) {
-			Sys_Free(ent);
+			FreeEntity(ent);
 			return ES_INVALID_ENTITY;
 		}
 	}
 
-	return AddEntity(s, ent, name, true) ? ent : ES_INVALID_ENTITY;
+	return AddEntity(s, ent, name, true) ? ent->handle : ES_INVALID_ENTITY;
 }
 
 NeEntityHandle
@@ -138,12 +351,12 @@ E_CreateEntityVS(struct NeScene *s, const char *name, int count, const struct Ne
 
 	for (int i = 0; i < count; ++i) {
 		if (!CreateComponent(s, ent, E_ComponentTypeId(info[i].type), info[i].args)) {
-			Sys_Free(ent);
+			FreeEntity(ent);
 			return ES_INVALID_ENTITY;
 		}
 	}
 
-	return AddEntity(s, ent, name, true) ? ent : ES_INVALID_ENTITY;
+	return AddEntity(s, ent, name, true) ? ent->handle : ES_INVALID_ENTITY;
 }
 
 NeEntityHandle
@@ -163,8 +376,8 @@ E_CreateEntityWithComponentsS(struct NeScene *s, const char *name, int count, ..
 	for (int i = 0; i < count; ++i) {
 		handle = va_arg(va, NeCompHandle);
 
-		if (!AddComponent(s, ent, E_ComponentTypeS(s, handle), handle)) {
-			Sys_Free(ent);
+		if (!AddComponent(s, ent, E_ComponentTypeS(s, handle), handle, true)) {
+			FreeEntity(ent);
 			return ES_INVALID_ENTITY;
 		}
 	}
@@ -173,56 +386,127 @@ E_CreateEntityWithComponentsS(struct NeScene *s, const char *name, int count, ..
 		return ES_INVALID_ENTITY;
 
 	for (uint32_t i = 0; i < ent->compCount; ++i)
-		E_SetComponentOwnerS(s, ent->comp[i].handle, ent);
+		E_SetComponentOwnerS(s, ent->comp[i].handle, ent->handle);
 
-	E_Broadcast(EVT_ENTITY_CREATED, ent);
+	E_Broadcast(EVT_ENTITY_CREATED, ent->handle);
 
-	return ent;
+	return ent->handle;
+}
+
+bool
+E_InstantiatePrefabS(struct NeScene *s, const struct NePrefab *p, uint32_t count, const struct NePrefabTransform *xforms, NeEntityHandle *entities)
+{
+	size_t first[MAX_ENTITY_COMPONENTS];
+	uint32_t created = 0;
+
+	if (!count)
+		return true;
+
+	// the entities, their handles and the handles of their components of one type
+	struct NeEntity **ents = Sys_Alloc(sizeof(*ents) + sizeof(NeEntityHandle) + sizeof(NeCompHandle), count, MH_Scene);
+	if (!ents)
+		return false;
+
+	NeEntityHandle *owners = (NeEntityHandle *)(ents + count);
+	NeCompHandle *handles = (NeCompHandle *)(owners + count);
+
+	if (!AllocEntities(s, ents, count)) {
+		Sys_Free(ents);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+		owners[i] = ents[i]->handle;
+
+	for (; created < p->compCount; ++created) {
+		const struct NePrefabComp *pc = &p->comp[created];
+		if (!ECS_CreateComponents(s, pc, owners, xforms, handles, count, &first[created]))
+			goto error;
+
+		// the entities and the components are new, so AddComponent's checks are not needed
+		for (uint32_t i = 0; i < count; ++i) {
+			struct NeEntity *ent = ents[i];
+			ent->comp[ent->compCount++] = (struct NeEntityComp){ .type = pc->type, .handle = handles[i] };
+
+			if (pc->type < ent->compIndexSize)
+				ent->compIndex[pc->type] = (uint8_t)ent->compCount;
+		}
+	}
+
+	if (!AddEntities(s, ents, count, p->name))
+		goto error;
+
+	if (entities)
+		memcpy(entities, owners, sizeof(*owners) * count);
+
+	Sys_Free(ents);
+	return true;
+
+error:
+	Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to instantiate %u entities from prefab %s", count, p->name);
+
+	for (uint32_t i = 0; i < created; ++i)
+		ECS_ReleaseComponents(s, p->comp[i].type, first[i], count, count);
+
+	for (uint32_t i = 0; i < count; ++i)
+		FreeEntity(ents[i]);
+
+	Sys_Free(ents);
+	return false;
 }
 
 bool
 E_AddComponent(NeEntityHandle handle, NeCompTypeId type, NeCompHandle comp)
 {
-	struct NeEntity *ent = handle;
-	return AddComponent(Scn_GetScene(ent->sceneId), ent, type, comp);
+	struct NeEntity *ent = ECS_EntityPtr(handle);
+	return ent ? AddComponent(Scn_GetScene(ent->sceneId), ent, type, comp, true) : false;
 }
 
 bool
 E_AddNewComponent(NeEntityHandle handle, NeCompTypeId type, const void **args)
 {
-	struct NeEntity *ent = handle;
-	return CreateComponent(Scn_GetScene(ent->sceneId), ent, type, args);
+	struct NeEntity *ent = ECS_EntityPtr(handle);
+	return ent ? CreateComponent(Scn_GetScene(ent->sceneId), ent, type, args) : false;
+}
+
+bool
+E_AddNewComponentS(struct NeScene *s, NeEntityHandle handle, NeCompTypeId type, const void **args)
+{
+	struct NeEntity *ent = ECS_EntityPtr(handle);
+	return ent ? CreateComponent(s, ent, type, args) : false;
 }
 
 void *
 E_GetComponent(NeEntityHandle handle, NeCompTypeId type)
 {
-	struct NeEntity *ent = handle;
-	struct NeScene *scn = Scn_GetScene(ent->sceneId);
-
-	for (uint8_t i = 0; i < ent->compCount; ++i)
-		if (ent->comp[i].type == type)
-			return E_ComponentPtrS(scn, ent->comp[i].handle);
+	const struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (!ent)
+		return NULL;
 
-	return NULL;
+	const uint32_t id = ECS_EntityComponentIndex(ent, type);
+	return id != UINT32_MAX ? E_ComponentPtrS(Scn_GetScene(ent->sceneId), ent->comp[id].handle) : NULL;
 }
 
 NeCompHandle
 E_GetComponentHandle(NeEntityHandle handle, NeCompTypeId type)
 {
-	struct NeEntity *ent = handle;
-
-	for (uint8_t i = 0; i < ent->compCount; ++i)
-		if (ent->comp[i].type == type)
-			return ent->comp[i].handle;
+	const struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (!ent)
+		return NE_INVALID_HANDLE;
 
-	return NE_INVALID_HANDLE;
+	const uint32_t id = ECS_EntityComponentIndex(ent, type);
+	return id != UINT32_MAX ? ent->comp[id].handle : NE_INVALID_HANDLE;
 }
 
 void
 E_GetComponents(NeEntityHandle handle, struct NeArray *comp)
 {
-	struct NeEntity *ent = handle;
+	const struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (!ent) {
+		memset(comp, 0x0, sizeof(*comp));
+		return;
+	}
+
 	Rt_InitArray(comp, ent->compCount, sizeof(struct NeEntityComp), MH_Frame);
 	memcpy(comp->data, ent->comp, Rt_ArrayByteSize(comp));
 	comp->count = comp->size;
@@ -231,47 +515,79 @@ E_GetComponents(NeEntityHandle handle, struct NeArray *comp)
 void
 E_RemoveComponent(NeEntityHandle handle, NeCompTypeId type)
 {
-	uint32_t id;
-	struct NeEntity *ent = handle;
-	struct NeScene *scn = Scn_GetScene(ent->sceneId);
+	struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (ent)
+		E_RemoveComponentS(Scn_GetScene(ent->sceneId), handle, type);
+}
 
-	for (id = 0; id < ent->compCount; ++id)
-		if (ent->comp[id].type == type)
-			break;
+void
+E_RemoveComponentS(struct NeScene *scn, NeEntityHandle handle, NeCompTypeId type)
+{
+	struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (!ent)
+		return;
+
+	const uint32_t id = ECS_EntityComponentIndex(ent, type);
+	if (id == UINT32_MAX)
+		return;
 
 	E_DestroyComponentS(scn, ent->comp[id].handle);
 	--ent->compCount;
 
+	if (type < ent->compIndexSize)
+		ent->compIndex[type] = 0;
+
 	if (id == ent->compCount)
 		return;
 
-	memcpy(&ent->comp[id], &ent->compCount, sizeof(struct NeEntityComp));
+	// swap with the last one & patch its index
+	memcpy(&ent->comp[id], &ent->comp[ent->compCount], sizeof(struct NeEntityComp));
+	if (ent->comp[id].type < ent->compIndexSize)
+		ent->compIndex[ent->comp[id].type] = (uint8_t)(id + 1);
 }
 
 void
 E_DestroyEntity(NeEntityHandle handle)
 {
-	struct NeEntity *ent = handle;
-	struct NeScene *scn = Scn_GetScene(ent->sceneId);
+	struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (ent)
+		E_DestroyEntityS(Scn_GetScene(ent->sceneId), handle);
+}
+
+void
+E_DestroyEntityS(struct NeScene *scn, NeEntityHandle handle)
+{
+	struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (!ent)
+		return;
 
 	for (uint8_t i = 0; i < ent->compCount; ++i)
 		E_DestroyComponentS(scn, ent->comp[i].handle);
 
-	Rt_TermQueue(&ent->mbox);
-
-	const size_t dst_id = ent->id;
-	Sys_Free(ent);
+	Sys_AtomicLockWrite(&scn->entityNames->lock);
+	RemoveName(scn->entityNames, NameKey(ent->hash), handle);
+	Sys_AtomicUnlockWrite(&scn->entityNames->lock);
 
 	Sys_AtomicLockWrite(&scn->lock.entity);
 
-	memcpy(Rt_ArrayGet(&scn->entities, dst_id), Rt_ArrayLast(&scn->entities), scn->entities.elemSize);
-
-	ent = Rt_ArrayGetPtr(&scn->entities, dst_id);
-	ent->id = dst_id;
-	--scn->entities.count;
+	// ent->id is the position in the entity list, set by Scn_Commit; entities created this frame are not in it yet
+	if (ent->id < scn->entities.count && Rt_ArrayGetPtr(&scn->entities, ent->id) == ent) {
+		struct NeEntity *last = Rt_ArrayGetPtr(&scn->entities, scn->entities.count - 1);
+		memcpy(Rt_ArrayGet(&scn->entities, ent->id), &last, scn->entities.elemSize);
+		last->id = ent->id;
+		--scn->entities.count;
+	} else {
+		Sys_AtomicLockWrite(&scn->lock.newEntity);
+		const size_t id = Rt_PtrArrayFindId(&scn->newEntities, ent);
+		if (id != RT_NOT_FOUND)
+			Rt_ArrayRemove(&scn->newEntities, id);
+		Sys_AtomicUnlockWrite(&scn->lock.newEntity);
+	}
 
 	Sys_AtomicUnlockWrite(&scn->lock.entity);
 
+	FreeEntity(ent);
+
 	E_Broadcast(EVT_ENTITY_DESTROYED, handle);
 }
 
@@ -297,14 +613,7 @@ E_RegisterEntityType(const char *typeName, const NeCompTypeId *compTypes, uint8_
 void *
 E_EntityPtr(NeEntityHandle handle)
 {
-	struct NeEntity *ent = handle;
-	struct NeScene *scn = Scn_GetScene(ent->sceneId);
-
-	Sys_AtomicLockRead(&scn->lock.entity);
-	void *ptr = Rt_ArrayGetPtr(&scn->entities, ent->id);
-	Sys_AtomicUnlockRead(&scn->lock.entity);
-
-	return ptr;
+	return ECS_EntityPtr(handle);
 }
 
 uint32_t
@@ -320,40 +629,156 @@ E_EntityCountS(struct NeScene *s)
 const char *
 E_EntityName(NeEntityHandle handle)
 {
-	struct NeEntity *ent = handle;
-	return ent->name;
+	const struct NeEntity *ent = ECS_EntityPtr(handle);
+	return ent ? ent->name : NULL;
 }
 
 void
 E_RenameEntity(NeEntityHandle handle, const char *name)
 {
-	struct NeEntity *ent = handle;
-	strlcpy(ent->name, name, MAX_ENTITY_NAME);
-	ent->hash = Rt_HashString(ent->name);
+	struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (ent)
+		SetName(Scn_GetScene(ent->sceneId), ent, name);
 }
 
 NeEntityHandle
 E_FindEntityS(struct NeScene *s, const char *name)
 {
-	struct NeEntity *ent = NULL;
-	uint64_t hash = Rt_HashString(name);
+	const uint64_t key = NameKey(Rt_HashString(name));
+	const struct NeEntityNameTable *t = atomic_load_explicit(&s->entityNames->table, memory_order_acquire);
 
-	Sys_AtomicLockRead(&s->lock.entity);
-	Rt_ArrayForEachPtr(ent, &s->entities) {
-		if (ent->hash == hash)
-			break;
-		ent = NULL;
-	}
-	Sys_AtomicUnlockRead(&s->lock.entity);
+	// the table always has empty entries, which end the search
+	for (size_t i = key & t->mask;; i = (i + 1) & t->mask) {
+		const uint64_t k = atomic_load_explicit(&t->names[i].key, memory_order_acquire);
+		if (!k)
+			return ES_INVALID_ENTITY;
 
-	return ent;
+		if (k != key)
+			continue;
+
+		const NeEntityHandle handle = (NeEntityHandle)atomic_load_explicit(&t->names[i].handle, memory_order_relaxed);
+		if (ECS_EntityPtr(handle))
+			return handle;
+	}
 }
 
 void
 E_SendMessage(NeEntityHandle dst, uint32_t msg, const void *data)
 {
 	struct NeEntityMessage em = { dst, msg, data };
-	Rt_QueuePush(&ECS_mboxes[E_WorkerId()], &em);
+	const uint32_t worker = E_WorkerId();
+	const bool shared = worker == E_JobWorkerThreads();
+
+	if (shared)
+		Sys_AtomicLockWrite(&f_mboxLock);
+	Rt_ArrayAdd(&ECS_mboxes[worker], &em);
+	if (shared)
+		Sys_AtomicUnlockWrite(&f_mboxLock);
+}
+
+NeEntityHandle
+E_DeferCreateEntityS(struct NeScene *s, const char *name)
+{
+	// the entity is allocated now, so the handle is known; it is added to the scene when the command runs
+	struct NeEntity *ent = AllocEntity(s);
+	if (!ent)
+		return ES_INVALID_ENTITY;
+
+	struct NeEntityCommand cmd = { .type = ECMD_CREATE_ENTITY, .entity = ent->handle };
+	strlcpy(cmd.name, name ? name : "unnamed", sizeof(cmd.name));
+
+	if (!RecordCommand(s, &cmd)) {
+		FreeEntity(ent);
+		return ES_INVALID_ENTITY;
+	}
+
+	return ent->handle;
+}
+
+void
+E_DeferAddComponentS(struct NeScene *s, NeEntityHandle ent, NeCompTypeId type, const void **args)
+{
+	// the command runs after the caller returns, so the arguments are copied to the frame heap
+	const void **copy = NULL;
+	if (args && *args && !(copy = ECS_CopyComponentArgs(args, MH_Frame))) {
+		Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to copy the arguments of an entity command in scene %s", s->name);
+		return;
+	}
+
+	const struct NeEntityCommand cmd = { .type = ECMD_ADD_COMPONENT, .entity = ent, .comp = { type, copy } };
+	RecordCommand(s, &cmd);
+}
+
+void
+E_DeferRemoveComponentS(struct NeScene *s, NeEntityHandle ent, NeCompTypeId type)
+{
+	const struct NeEntityCommand cmd = { .type = ECMD_REMOVE_COMPONENT, .entity = ent, .comp = { type, NULL } };
+	RecordCommand(s, &cmd);
+}
+
+void
+E_DeferDestroyEntityS(struct NeScene *s, NeEntityHandle ent)
+{
+	const struct NeEntityCommand cmd = { .type = ECMD_DESTROY_ENTITY, .entity = ent };
+	RecordCommand(s, &cmd);
+}
+
+void
+E_DeferSetParentS(struct NeScene *s, NeEntityHandle ent, NeEntityHandle parent)
+{
+	// the hierarchy can still change before the command runs, so Scn_SetParent checks it again
+	if (!Scn_CanSetParent(s, ent, parent)) {
+		Sys_LogEntry(ENT_MOD, LOG_WARNING, "Cannot attach entity %s to %s", E_EntityName(ent), E_EntityName(parent));
+		return;
+	}
+
+	const struct NeEntityCommand cmd = { .type = ECMD_SET_PARENT, .entity = ent, .parent = parent };
+	RecordCommand(s, &cmd);
+}
+
+void
+ECS_ExecuteCommands(struct NeScene *s)
+{
+	// the commands of the threads outside the pool are executed from a copy, so those threads can keep recording
+	// while the commit runs; the commands they record now run in the next commit
+	const uint32_t shared = E_JobWorkerThreads();
+	struct NeArray *recorded = Rt_ArrayGet(&s->entityCommands, shared);
+	struct NeArray *executed = Rt_ArrayGet(&s->entityCommands, shared + 1);
+
+	Sys_AtomicLockWrite(&s->lock.command);
+	const struct NeArray tmp = *executed;
+	*executed = *recorded;
+	*recorded = tmp;
+	Sys_AtomicUnlockWrite(&s->lock.command);
+
+	for (int type = ECMD_CREATE_ENTITY; type <= ECMD_DESTROY_ENTITY; ++type) {
+		for (size_t i = 0; i < s->entityCommands.count; ++i) {
+			if (i == shared)
+				continue;
+
+			const struct NeArray *buff = Rt_ArrayGet(&s->entityCommands, i);
+			const struct NeEntityCommand *cmd;
+			Rt_ArrayForEach(cmd, buff)
+				if (cmd->type == (enum NeEntityCommandType)type)
+					ExecuteCommand(s, cmd);
+		}
+	}
+}
+
+void
+ECS_ExecuteParentCommands(struct NeScene *s)
+{
+	for (size_t i = 0; i < s->entityCommands.count; ++i) {
+		if (i == E_JobWorkerThreads())
+			continue;
+
+		struct NeArray *buff = Rt_ArrayGet(&s->entityCommands, i);
+		const struct NeEntityCommand *cmd;
+		Rt_ArrayForEach(cmd, buff)
+			if (cmd->type == ECMD_SET_PARENT)
+				ExecuteCommand(s, cmd);
+		Rt_ClearArray(buff, false);
+	}
 }
 
 bool
@@ -365,10 +790,17 @@ E_InitEntities(void)
 		return false;
 
 	ECS_mboxes = Sys_Alloc(sizeof(*ECS_mboxes), E_JobWorkerThreads() + 1, MH_System);
+	if (!ECS_mboxes)
+		return false;
+
 	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i)
-		if (!Rt_InitQueue(&ECS_mboxes[i], 10, sizeof(struct NeEntityMessage), MH_System))
+		if (!Rt_InitArray(&ECS_mboxes[i], 64, sizeof(struct NeEntityMessage), MH_System))
 			return false;
 
+	if (!Rt_InitArray(&f_messageBus, 64, sizeof(struct NeEntityMessage), MH_System) ||
+			!Rt_InitArray(&f_messageScratch, 64, sizeof(struct NeEntityMessage), MH_System))
+		return false;
+
 	E_ProcessFiles("/Entities", "ent", true, LoadEntity);
 
 	return true;
@@ -377,74 +809,178 @@ E_InitEntities(void)
 void
 E_DistributeMessages(void)
 {
+	const size_t count = f_messageBus.count;
+
 	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
-		struct NeQueue *mbox = &ECS_mboxes[i];
+		struct NeArray *mbox = &ECS_mboxes[i];
+		const bool shared = i == E_JobWorkerThreads();
+
+		if (shared)
+			Sys_AtomicLockWrite(&f_mboxLock);
 
-		while (mbox->count) {
-			struct NeEntityMessage msg = *(struct NeEntityMessage *)Rt_QueuePop(mbox);
-			struct NeEntity *ent = msg.dst;
-			Rt_QueuePush(&ent->mbox, &msg);
+		const struct NeEntityMessage *msg;
+		Rt_ArrayForEach(msg, mbox) {
+			// the destination was destroyed after the message was sent
+			if (ECS_EntityPtr(msg->dst) && !Rt_ArrayAdd(&f_messageBus, msg))
+				Sys_LogEntry(ENT_MOD, LOG_WARNING, "Failed to deliver message %u", msg->msg);
 		}
+
+		Rt_ClearArray(mbox, false);
+
+		if (shared)
+			Sys_AtomicUnlockWrite(&f_mboxLock);
 	}
+
+	if (f_messageBus.count != count)
+		SortMessages();
 }
 
 void
 E_ProcessMessages(struct NeScene *s)
 {
-	Sys_AtomicLockRead(&s->lock.entity);
-	E_DispatchJobs(s->entities.count, (NeJobProc)ProcessEntityMessages, (void **)s->entities.data, NULL, NULL);
+	if (!f_messageBus.count)
+		return;
 
-	struct NeEntity *ent = NULL;
-	Rt_ArrayForEachPtr(ent, &s->entities)
-		while (ent->mbox.count)
-			Sys_Yield();
+	atomic_store_explicit(&f_otherSceneMessages, 0, memory_order_relaxed);
 
+	Sys_AtomicLockRead(&s->lock.entity);
+	const char *label = E_SetJobLabel("ProcessMessages");
+	E_ParallelFor(0, f_messageBus.count, 0, (NeParallelForProc)ProcessEntityMessages, s);
+	E_SetJobLabel(label);
 	Sys_AtomicUnlockRead(&s->lock.entity);
+
+	if (!atomic_load_explicit(&f_otherSceneMessages, memory_order_relaxed)) {
+		Rt_ClearArray(&f_messageBus, false);
+		return;
+	}
+
+	// keep the messages of the other scenes' entities, in order
+	struct NeEntityMessage *msg = (struct NeEntityMessage *)f_messageBus.data;
+	size_t count = 0;
+	for (size_t i = 0; i < f_messageBus.count; ++i) {
+		const struct NeEntity *ent = ECS_EntityPtr(msg[i].dst);
+		if (ent && ent->sceneId != s->id)
+			msg[count++] = msg[i];
+	}
+	f_messageBus.count = count;
 }
 
-void
-ProcessEntityMessages(int workerId, struct NeEntity *ent)
+static void
+SortMessages(void)
+{
+	struct NeArray *bus = &f_messageBus;
+	const uint32_t digitBits = 11, digits = 1 << digitBits;
+	uint32_t count[1 << 11];
+	uint32_t maxSlot = 0;
+
+	if (bus->count < 2)
+		return;
+
+	if (f_messageScratch.size < bus->count && !Rt_ResizeArray(&f_messageScratch, bus->count)) {
+		Sys_LogEntry(ENT_MOD, LOG_WARNING, "Failed to sort messages, they will be processed in the order they were sent");
+		return;
+	}
+
+	const struct NeEntityMessage *msg;
+	Rt_ArrayForEach(msg, bus)
+		if (ECS_ENTITY_SLOT(msg->dst) > maxSlot)
+			maxSlot = ECS_ENTITY_SLOT(msg->dst);
+
+	// least significant digit first, each pass is stable
+	struct NeEntityMessage *src = (struct NeEntityMessage *)bus->data, *dst = (struct NeEntityMessage *)f_messageScratch.data;
+	uint32_t shift = 0;
+	do {
+		memset(count, 0x0, sizeof(count));
+
+		for (size_t i = 0; i < bus->count; ++i)
+			++count[(ECS_ENTITY_SLOT(src[i].dst) >> shift) & (digits - 1)];
+
+		for (uint32_t i = 0, offset = 0; i < digits; ++i) {
+			const uint32_t c = count[i];
+			count[i] = offset;
+			offset += c;
+		}
+
+		for (size_t i = 0; i < bus->count; ++i)
+			dst[count[(ECS_ENTITY_SLOT(src[i].dst) >> shift) & (digits - 1)]++] = src[i];
+
+		struct NeEntityMessage *tmp = src;
+		src = dst;
+		dst = tmp;
+
+		shift += digitBits;
+	} while (shift < 32 && (maxSlot >> shift));
+
+	if (src != (struct NeEntityMessage *)bus->data)
+		memcpy(bus->data, src, sizeof(*src) * bus->count);
+}
+
+static void
+ProcessEntityMessages(int workerId, uint64_t begin, uint64_t end, struct NeScene *s)
 {
-	int top = 0;
-	lua_State *vm = NULL;
-	uint64_t currentScript = 0;
+	const struct NeEntityMessage *msg = (const struct NeEntityMessage *)f_messageBus.data;
+	uint64_t otherScene = 0;
 
-	// TODO: The lua_state handling is messy. It should be moved to Entity and initialized when a script component
-	// is attached, that way state will be kept.
+	// the messages of a recipient are processed by the range that holds the first of them
+	while (begin < end && begin && msg[begin].dst == msg[begin - 1].dst)
+		++begin;
+
+	if (begin == end)
+		return;
+
+	while (end < f_messageBus.count && msg[end].dst == msg[end - 1].dst)
+		++end;
+
+	const struct NeEntity *ent = NULL;
+	for (uint64_t i = begin; i < end; ++i) {
+		if (i == begin || msg[i].dst != msg[i - 1].dst)
+			ent = ECS_EntityPtr(msg[i].dst);
+
+		// destroyed after the messages were distributed
+		if (!ent)
+			continue;
+
+		if (ent->sceneId != s->id) {
+			++otherScene;
+			continue;
+		}
 
-	while (ent->mbox.count) {
-		struct NeEntityMessage msg = *(struct NeEntityMessage *)Rt_QueuePop(&ent->mbox);
 		for (uint32_t j = 0; j < ent->compCount; ++j) {
 			const struct NeCompType *type = ECS_ComponentType(ent->comp[j].type);
-			if (type->messageHandler) {
-				type->messageHandler(E_ComponentPtr(ent->comp[j].handle), msg.msg, msg.data);
-			} else if (type->scriptMessageHandler) {
-				if (!vm) {
-					vm = Sc_CreateVM();
-					top = lua_gettop(vm);
-				}
-
-				const uint64_t hash = Rt_HashString(type->script);
-				if (currentScript != hash) {
-					lua_settop(vm, top);
-					Sc_LoadScriptFile(vm, type->script);
-				}
-
-				lua_getglobal(vm, "MessageHandler");
-				lua_pushlightuserdata(vm, E_ComponentPtr(ent->comp[j].handle));
-				lua_pushinteger(vm, msg.msg);
-				lua_pushlightuserdata(vm, (void *)msg.data);
-
-				if (lua_pcall(vm, 3, 0, 0)) {
-					Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to execute MessageHandler for %s: %s", type->name, lua_tostring(vm, -1));
-					Sc_LogStackDump(vm, LOG_CRITICAL);
-				}
-			}
+			if (type->messageHandler)
+				type->messageHandler(E_ComponentPtrS(s, ent->comp[j].handle), msg[i].msg, msg[i].data);
+			else if (type->scriptMessageHandler)
+				ScriptMessageHandler(type, E_ComponentPtrS(s, ent->comp[j].handle), &msg[i]);
 		}
 	}
 
-	if (vm)
-		Sc_DestroyVM(vm);
+	if (otherScene)
+		atomic_fetch_add_explicit(&f_otherSceneMessages, otherScene, memory_order_relaxed);
+}
+
+static inline void
+ScriptMessageHandler(const struct NeCompType *type, void *comp, const struct NeEntityMessage *msg)
+{
+	lua_State *vm = Sc_AcquireVM();
+	if (!vm) {
+		Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to acquire a VM for the MessageHandler of %s", type->name);
+		return;
+	}
+
+	if (!Sc_PushScriptFunction(vm, type->script, "MessageHandler"))
+		goto exit;
+
+	lua_pushlightuserdata(vm, comp);
+	lua_pushinteger(vm, msg->msg);
+	lua_pushlightuserdata(vm, (void *)msg->data);
+
+	if (lua_pcall(vm, 3, 0, 0)) {
+		Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to execute MessageHandler for %s: %s", type->name, lua_tostring(vm, -1));
+		Sc_LogStackDump(vm, LOG_CRITICAL);
+	}
+
+exit:
+	Sc_ReleaseVM(vm);
 }
 
 void
@@ -453,8 +989,10 @@ E_TermEntities(void)
 	Sys_AtomicLockWrite(&f_entityTypeLock);
 
 	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i)
-		Rt_TermQueue(&ECS_mboxes[i]);
+		Rt_TermArray(&ECS_mboxes[i]);
 	Sys_Free(ECS_mboxes);
+	Rt_TermArray(&f_messageBus);
+	Rt_TermArray(&f_messageScratch);
 
 	for (size_t i = 0; i < f_entityTypes.count; ++i) {
 		struct NeEntityType *type = Rt_ArrayGet(&f_entityTypes, i);
@@ -471,11 +1009,45 @@ E_TermEntities(void)
 	Rt_TermArray(&f_entityTypes);
 
 	Sys_AtomicUnlockWrite(&f_entityTypeLock);
+
+	Sys_AtomicLockWrite(&f_slotLock);
+
+	for (uint32_t i = 0; i < ECS_MAX_ENTITY_PAGES; ++i) {
+		Sys_Free(ECS_entitySlots[i]);
+		ECS_entitySlots[i] = NULL;
+	}
+
+	f_slotCount = 0;
+	f_freeSlot = UINT32_MAX;
+
+	Sys_AtomicUnlockWrite(&f_slotLock);
 }
 
 bool
 E_InitSceneEntities(struct NeScene *s)
 {
+	if (!(s->entityNames = Sys_Alloc(sizeof(*s->entityNames), 1, MH_Scene)))
+		return false;
+
+	struct NeEntityNameTable *t = AllocNameTable(MIN_NAME_TABLE);
+	if (!t)
+		return false;
+
+	Sys_InitAtomicLock(&s->entityNames->lock);
+	atomic_store(&s->entityNames->table, t);
+
+	// one command buffer for each worker, one shared by the threads outside the pool and the copy of it that
+	// Scn_Commit executes
+	const uint32_t buffers = E_JobWorkerThreads() + 2;
+	Sys_InitAtomicLock(&s->lock.command);
+
+	if (!Rt_InitArray(&s->entityCommands, buffers, sizeof(struct NeArray), MH_Scene))
+		return false;
+
+	for (uint32_t i = 0; i < buffers; ++i)
+		if (!Rt_InitArray(Rt_ArrayAllocate(&s->entityCommands), 16, sizeof(struct NeEntityCommand), MH_Scene))
+			return false;
+
 	return Rt_InitPtrArray(&s->entities, 100, MH_Scene) && Rt_InitPtrArray(&s->newEntities, 100, MH_Scene);
 }
 
@@ -483,41 +1055,95 @@ void
 E_TermSceneEntities(struct NeScene *s)
 {
 	struct NeEntity* ent;
-	Rt_ArrayForEachPtr(ent, &s->entities) {
-		Rt_TermQueue(&ent->mbox);
-		Sys_Free(ent);
-	}
+	Rt_ArrayForEachPtr(ent, &s->entities)
+		FreeEntity(ent);
 	Rt_TermArray(&s->entities);
 
-	for (size_t i = 0; i < s->newEntities.count; ++i)
-		Sys_Free(Rt_ArrayGetPtr(&s->newEntities, i));
+	Rt_ArrayForEachPtr(ent, &s->newEntities)
+		FreeEntity(ent);
 	Rt_TermArray(&s->newEntities);
+
+	// entities reserved by commands that never ran
+	struct NeArray *buff;
+	Rt_ArrayForEach(buff, &s->entityCommands) {
+		const struct NeEntityCommand *cmd;
+		Rt_ArrayForEach(cmd, buff)
+			if (cmd->type == ECMD_CREATE_ENTITY && (ent = ECS_EntityPtr(cmd->entity)))
+				FreeEntity(ent);
+		Rt_TermArray(buff);
+	}
+	Rt_TermArray(&s->entityCommands);
+
+	if (!s->entityNames)
+		return;
+
+	ECS_ReleaseEntityNames(s);
+	Sys_Free(atomic_load(&s->entityNames->table));
+	Sys_Free(s->entityNames);
+	s->entityNames = NULL;
+}
+
+void
+ECS_ReleaseEntityNames(struct NeScene *s)
+{
+	struct NeEntityNameTable *t = atomic_load(&s->entityNames->table);
+
+	while (t->retired) {
+		struct NeEntityNameTable *retired = t->retired;
+		t->retired = retired->retired;
+		Sys_Free(retired);
+	}
 }
 
 void *
 ECS_GetComponent(struct NeScene *s, NeEntityHandle handle, NeCompTypeId type)
 {
-	struct NeEntity *ent = handle;
-	struct NeArray *compData = (struct NeArray *)s->compData.data;
-	for (uint8_t i = 0; i < ent->compCount; ++i)
-		if (ent->comp[i].type == type)
-			return Rt_ArrayGet(&compData[E_HANDLE_TYPE(ent->comp[i].handle)], E_HANDLE_ID(ent->comp[i].handle));
-	return NULL;
+	const struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (!ent)
+		return NULL;
+
+	const uint32_t id = ECS_EntityComponentIndex(ent, type);
+	if (id == UINT32_MAX)
+		return NULL;
+
+	if (s->archetypeStorage)
+		return ECS_ArchetypeComponentPtr(s, ent->comp[id].handle);
+
+	return ECS_SlotComponent(s, E_HANDLE_TYPE(ent->comp[id].handle), E_HANDLE_ID(ent->comp[id].handle));
 }
 
 bool
-AddComponent(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type, NeCompHandle handle)
+AddComponent(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type, NeCompHandle handle, bool setOwner)
 {
 	struct NeEntityComp *comp = NULL;
 
-	for (uint32_t i = 0; i < ent->compCount; ++i)
-		if (ent->comp[i].type == type)
-			return false;
+	if (ECS_EntityComponentIndex(ent, type) != UINT32_MAX || ent->compCount == MAX_ENTITY_COMPONENTS)
+		return false;
 
 	comp = &ent->comp[ent->compCount++];
 	comp->type = type;
 	comp->handle = handle;
-	E_SetComponentOwnerS(s, handle, ent);
+
+	if (type < ent->compIndexSize)
+		ent->compIndex[type] = (uint8_t)ent->compCount;
+
+	// E_CreateComponentIdS sets the owner; looking up a pending component walks the pending array
+	if (setOwner)
+		E_SetComponentOwnerS(s, handle, ent->handle);
+
+	Sys_AtomicLockRead(&s->lock.comp);
+	const bool committed = ECS_CommitedComponentPtr(s, handle) != NULL;
+	Sys_AtomicUnlockRead(&s->lock.comp);
+
+	// components created this frame are added to the queries by Scn_Commit
+	if (committed) {
+		Sys_AtomicLockWrite(&s->lock.comp);
+		if (s->archetypeStorage)
+			ECS_ArchetypeComponentMoved(s, handle);
+		else
+			ECS_QueryComponentAdded(s, ent, type);
+		Sys_AtomicUnlockWrite(&s->lock.comp);
+	}
 
 	return true;
 }
@@ -525,12 +1151,12 @@ AddComponent(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type, NeCompH
 bool
 CreateComponent(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type, const void **args)
 {
-	NeCompHandle handle = E_CreateComponentIdS(s, type, ent, args);
+	NeCompHandle handle = E_CreateComponentIdS(s, type, ent->handle, args);
 
 	if (handle == NE_INVALID_HANDLE)
 		return false;
 
-	if (!AddComponent(s, ent, type, handle)) {
+	if (!AddComponent(s, ent, type, handle, false)) {
 		Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to add component of type [%d]", type);
 		return false;
 	}
@@ -538,6 +1164,147 @@ CreateComponent(struct NeScene *s, struct NeEntity *ent, NeCompTypeId type, cons
 	return true;
 }
 
+static inline bool
+RecordCommand(struct NeScene *s, const struct NeEntityCommand *cmd)
+{
+	// each worker records into its own buffer without locking; the threads outside the pool share one
+	const uint32_t worker = E_WorkerId();
+	const bool shared = worker == E_JobWorkerThreads();
+	struct NeArray *buff = Rt_ArrayGet(&s->entityCommands, worker);
+
+	if (shared)
+		Sys_AtomicLockWrite(&s->lock.command);
+	const bool added = Rt_ArrayAdd(buff, cmd);
+	if (shared)
+		Sys_AtomicUnlockWrite(&s->lock.command);
+
+	if (added)
+		return true;
+
+	Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to record entity command in scene %s", s->name);
+	return false;
+}
+
+static inline void
+ExecuteCommand(struct NeScene *s, const struct NeEntityCommand *cmd)
+{
+	struct NeEntity *ent = ECS_EntityPtr(cmd->entity);
+	if (!ent)
+		return;
+
+	switch (cmd->type) {
+	case ECMD_CREATE_ENTITY:
+		AddEntity(s, ent, cmd->name, true);
+	break;
+	case ECMD_ADD_COMPONENT:
+		CreateComponent(s, ent, cmd->comp.type, cmd->comp.args);
+	break;
+	case ECMD_REMOVE_COMPONENT:
+		E_RemoveComponentS(s, cmd->entity, cmd->comp.type);
+	break;
+	case ECMD_DESTROY_ENTITY:
+		E_DestroyEntityS(s, cmd->entity);
+	break;
+	case ECMD_SET_PARENT:
+		if (!Scn_SetParent(s, cmd->entity, cmd->parent))
+			Sys_LogEntry(ENT_MOD, LOG_WARNING, "Failed to set the parent of entity %s", ent->name);
+	break;
+	}
+}
+
+static inline void
+SetName(struct NeScene *s, struct NeEntity *ent, const char *name)
+{
+	// scenes that are not registered (Scn_GetScene returns NULL) are not indexed
+	if (s) {
+		Sys_AtomicLockWrite(&s->entityNames->lock);
+		RemoveName(s->entityNames, NameKey(ent->hash), ent->handle);
+	}
+
+	strlcpy(ent->name, name, MAX_ENTITY_NAME);
+	ent->hash = Rt_HashString(ent->name);
+
+	if (s) {
+		InsertName(s->entityNames, NameKey(ent->hash), ent->handle);
+		Sys_AtomicUnlockWrite(&s->entityNames->lock);
+	}
+}
+
+static inline void
+InsertName(struct NeEntityNameIndex *idx, uint64_t key, NeEntityHandle handle)
+{
+	struct NeEntityNameTable *t = atomic_load_explicit(&idx->table, memory_order_relaxed);
+
+	if ((t->used + 1) * 4 > (t->mask + 1) * 3) {
+		size_t size = MIN_NAME_TABLE;
+		while (size < (t->count + 1) * 4)
+			size *= 2;
+
+		struct NeEntityNameTable *nt = AllocNameTable(size);
+		if (!nt) {
+			Sys_LogEntry(ENT_MOD, LOG_CRITICAL, "Failed to grow entity name index");
+			return;
+		}
+
+		// removed entries are dropped
+		for (size_t i = 0; i <= t->mask; ++i) {
+			const uint64_t k = atomic_load_explicit(&t->names[i].key, memory_order_relaxed);
+			const uintptr_t h = atomic_load_explicit(&t->names[i].handle, memory_order_relaxed);
+			if (!k || !h)
+				continue;
+
+			size_t j = k & nt->mask;
+			while (atomic_load_explicit(&nt->names[j].key, memory_order_relaxed))
+				j = (j + 1) & nt->mask;
+
+			atomic_store_explicit(&nt->names[j].handle, h, memory_order_relaxed);
+			atomic_store_explicit(&nt->names[j].key, k, memory_order_relaxed);
+			++nt->used;
+			++nt->count;
+		}
+
+		// lookups running on other threads may still use the old table
+		nt->retired = t;
+		atomic_store_explicit(&idx->table, nt, memory_order_release);
+		t = nt;
+	}
+
+	size_t i = key & t->mask;
+	while (atomic_load_explicit(&t->names[i].key, memory_order_relaxed))
+		i = (i + 1) & t->mask;
+
+	atomic_store_explicit(&t->names[i].handle, (uintptr_t)handle, memory_order_relaxed);
+	atomic_store_explicit(&t->names[i].key, key, memory_order_release);
+	++t->used;
+	++t->count;
+}
+
+static inline void
+RemoveName(struct NeEntityNameIndex *idx, uint64_t key, NeEntityHandle handle)
+{
+	struct NeEntityNameTable *t = atomic_load_explicit(&idx->table, memory_order_relaxed);
+
+	uint64_t k;
+	for (size_t i = key & t->mask; (k = atomic_load_explicit(&t->names[i].key, memory_order_relaxed)); i = (i + 1) & t->mask) {
+		if (k != key || atomic_load_explicit(&t->names[i].handle, memory_order_relaxed) != (uintptr_t)handle)
+			continue;
+
+		// the key stays, so the entry still continues the search for the names after it
+		atomic_store_explicit(&t->names[i].handle, 0, memory_order_relaxed);
+		--t->count;
+		return;
+	}
+}
+
+static struct NeEntityNameTable *
+AllocNameTable(size_t size)
+{
+	struct NeEntityNameTable *t = Sys_Alloc(sizeof(*t) + sizeof(struct NeEntityName) * size, 1, MH_Scene);
+	if (t)
+		t->mask = size - 1;
+	return t;
+}
+
 static void
 LoadEntity(const char *path)
 {
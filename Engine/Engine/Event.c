@@ -34,10 +34,8 @@ struct NeProcessEventArgs
 static struct NeArray f_handlers, f_queue[2], *f_currentQueue;
 static int f_currentQueueId;
 static struct NeAtomicLock f_queueLock, f_handlerLock;
-static NE_ATOMIC_UINT f_jobCount;
 
 static void ProcessEvent(int worker, struct NeProcessEventArgs *args);
-static void JobCompleted(uint64_t id, void *args);
 
 void
 E_Broadcast(const char *event, void *args)
@@ -156,9 +154,10 @@ E_ProcessEvents(void)
 	f_currentQueue = &f_queue[f_currentQueueId];
 	Sys_AtomicUnlockWrite(&f_queueLock);
 
-	Sys_AtomicLockRead(&f_handlerLock);
+	struct NeJobCounter counter;
+	E_InitJobCounter(&counter);
 
-	atomic_store(&f_jobCount, 0);
+	Sys_AtomicLockRead(&f_handlerLock);
 
 	for (size_t i = 0; i < queue->count; ++i) {
 		evt = Rt_ArrayGet(queue, i);
@@ -176,8 +175,7 @@ E_ProcessEvents(void)
 			args->handler = *handler;
 			args->args = evt->args;
 
-			atomic_fetch_add_explicit(&f_jobCount, 1, memory_order_acquire);
-			E_ExecuteJob((NeJobProc)ProcessEvent, args, JobCompleted, NULL);
+			E_ExecuteDependentJob(JP_FrameCritical, (NeJobProc)ProcessEvent, args, NULL, NULL, NULL, &counter);
 		}
 	}
 
@@ -185,7 +183,7 @@ E_ProcessEvents(void)
 
 	Sys_AtomicUnlockRead(&f_handlerLock);
 
-	while (atomic_load(&f_jobCount)) ;
+	E_WaitForJobCounter(&counter);
 }
 
 static void
@@ -197,12 +195,6 @@ ProcessEvent(int worker, struct NeProcessEventArgs *args)
 	args->handler.proc(args->handler.user, args->args);
 }
 
-static void
-JobCompleted(uint64_t id, void *args)
-{
-	atomic_fetch_sub_explicit(&f_jobCount, 1, memory_order_release);
-}
-
 /* NekoEngine
  *
  * Event.c
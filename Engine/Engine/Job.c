@@ -8,12 +8,16 @@
 #include <System/Memory.h>
 #include <System/Thread.h>
 #include <System/AtomicLock.h>
+#include <Runtime/Array.h>
 
 #define JOBMOD	"JobSystem"
 
-#define ST_WAITING	0
-#define ST_RUNNING	1
-#define ST_DONE		2
+#define JQ_DEFAULT_SIZE		4096
+#define JD_INITIAL_SIZE		256
+#define JOB_SPIN_COUNT		64
+#define PF_SPLITS_PER_THREAD	4
+#define JT_DEFAULT_SIZE		65536
+#define JT_DEFAULT_FILE		"JobTrace.json"
 
 struct NeJob
 {
@@ -21,15 +25,115 @@ struct NeJob
 	NeJobProc exec;
 	uint64_t id;
 	NeJobCompletedProc completed;
+	struct NeJobCounter *counter;
+	enum NeJobPriority priority;
+	uint32_t submitter;
+	uint64_t submitted;
+	const char *label;
+};
+
+struct NeDependentJob
+{
+	struct NeJob job;
+	struct NeDependentJob *next;
+};
+
+/*
+ * Per-worker Chase-Lev deque. Only the owning worker pushes & pops (LIFO) at the bottom,
+ * every other thread steals (FIFO) from the top. Buffers are never freed while the job
+ * system is running because a thief might still be reading from an old one.
+ */
+struct NeJobBuffer
+{
+	int64_t size;
+	struct NeJobBuffer *prev;
+	struct NeJob jobs[];
+};
+
+struct NeJobDeque
+{
+	NE_ALIGN(64) _Atomic int64_t top;
+	NE_ALIGN(64) _Atomic int64_t bottom;
+	_Atomic(struct NeJobBuffer *) buffer;
+};
+
+/*
+ * Bounded MPMC queue used by threads that don't own a deque (the main thread & anything
+ * else that isn't a worker).
+ */
+struct NeJobCell
+{
+	_Atomic uint64_t sequence;
+	struct NeJob job;
 };
 
 struct NeJobQueue
 {
-	struct NeJob *jobs;
-	uint64_t head;
-	uint64_t tail;
-	uint64_t size;
+	struct NeJobCell *cells;
+	uint64_t mask;
+	NE_ALIGN(64) _Atomic uint64_t head;
+	NE_ALIGN(64) _Atomic uint64_t tail;
+};
+
+/*
+ * Jobs that didn't fit in the injection queue. The queue should only fill up when a burst of
+ * jobs is submitted from outside the pool, so a lock is fine here; count lets the workers skip
+ * it without taking the lock.
+ */
+struct NeJobOverflow
+{
 	NeFutex lock;
+	struct NeArray jobs;
+	size_t head;
+	_Atomic uint32_t count;
+};
+
+struct NeParallelForArgs
+{
+	NeParallelForProc proc;
+	void *userData;
+	uint64_t grain;
+	struct NeJobCounter *counter;
+};
+
+struct NeParallelForRange
+{
+	const struct NeParallelForArgs *pfa;
+	uint64_t begin, end;
+};
+
+/*
+ * Trace events are recorded by the thread that ran the job into its own buffer, so recording
+ * never takes a lock. The buffers are never freed while the job system is running; each one
+ * is reset by its owner the first time it records into a new trace.
+ */
+struct NeJobTraceEvent
+{
+	const char *label;
+	uint64_t id;
+	uint64_t submitted, start, end;
+	uint32_t submitter;
+	enum NeJobPriority priority;
+};
+
+struct NeJobTraceBuffer
+{
+	struct NeJobTraceBuffer *next;
+	uint32_t thread, size, dropped;
+	_Atomic uint32_t epoch;
+	_Atomic uint32_t count;
+	struct NeJobTraceEvent events[];
+};
+
+/*
+ * Workers steal from the workers that share their last level cache first, then from the ones on
+ * the same NUMA node and only then from everyone else.
+ */
+struct NeWorker
+{
+	const struct NeCpu *cpu;
+	uint32_t *victims;
+	uint32_t localVictims, nodeVictims, victimCount;
 };
 
 struct NeDispatchArgs
@@ -42,62 +146,163 @@ struct NeDispatchArgs
 	NeJobCompletedProc completedHandler;
 };
 
-static NeConditionVariable f_wakeCond;
+static NeConditionVariable f_wakeCond, f_counterCond;
 static NeFutex f_wakeLock;
 static NeThread *f_threads;
 static uint32_t f_numThreads;
-static volatile bool f_shutdown;
-static struct NeJobQueue f_jobQueue;
-static NE_ALIGN(16) volatile uint64_t f_submittedJobs;
-static THREAD_LOCAL uint32_t f_workerId;
+static atomic_bool f_shutdown;
+static struct NeJobQueue f_injectionQueue[JP_Count];
+static struct NeJobOverflow f_overflow[JP_Count];
+static struct NeJobDeque *f_deques;
+static struct NeWorker *f_workers;
+static uint32_t f_maxBackgroundWorkers;
+static NE_ALIGN(64) _Atomic uint32_t f_queueDepth[JP_Count];
+static NE_ALIGN(64) _Atomic uint32_t f_backgroundWorkers;
+static NE_ALIGN(64) _Atomic uint32_t f_sleepingWorkers;
+static NE_ALIGN(64) _Atomic uint32_t f_counterWaiters;
+static NE_ALIGN(64) _Atomic uint64_t f_submittedJobs;
+static atomic_bool f_tracing;
+static uint64_t f_traceStart;
+static uint32_t f_traceBufferSize;
+static _Atomic uint32_t f_traceEpoch, f_traceSession, f_traceThreads;
+static _Atomic(struct NeJobTraceBuffer *) f_traceBuffers;
+static THREAD_LOCAL uint32_t f_workerId = UINT32_MAX;
+static THREAD_LOCAL uint32_t f_stealSeed;
+static THREAD_LOCAL enum NeJobPriority f_priority;
+static THREAD_LOCAL const char *f_label;
+static THREAD_LOCAL struct NeJobTraceBuffer *f_traceBuffer;
+static THREAD_LOCAL uint32_t f_traceBufferSession;
 
 static void ThreadProc(void *args);
 static void DispatchWrapper(int worker, struct NeDispatchArgs *argPtr);
-static inline bool JQ_Push(struct NeJobQueue *jq, NeJobProc exec, void *args, NeJobCompletedProc completed, void *completionArgs, uint64_t *id);
+static void ParallelForJob(int worker, const struct NeParallelForRange *range);
+static inline void SubmitJob(const struct NeJob *job);
+static inline void SubmitDependentJobs(struct NeDependentJob *jobs, uint32_t count, struct NeJobCounter *dependency);
+static inline bool GetJob(uint32_t worker, struct NeJob *job, bool background);
+static inline bool TakeJob(uint32_t worker, enum NeJobPriority priority, struct NeJob *job);
+static inline bool StealJob(const uint32_t *victims, uint32_t count, enum NeJobPriority priority, struct NeJob *job);
+static inline uint32_t PlaceWorkers(const struct NeCpuTopology *topo, bool logical, const struct NeCpu **cpus);
+static inline bool InitWorkers(const struct NeCpu **cpus, uint32_t cpuCount);
+static inline void RunJob(uint32_t worker, const struct NeJob *job);
+static inline void SignalCounter(struct NeJobCounter *counter);
+static inline bool ReserveBackgroundWorker(void);
+static inline bool HasWork(bool background);
+static inline void WakeWorkers(uint32_t count);
+static inline bool JD_Init(struct NeJobDeque *jd);
+static inline bool JD_Push(struct NeJobDeque *jd, const struct NeJob *job);
+static inline bool JD_Pop(struct NeJobDeque *jd, struct NeJob *job);
+static inline bool JD_Steal(struct NeJobDeque *jd, struct NeJob *job);
+static inline void JD_Term(struct NeJobDeque *jd);
+static inline bool JQ_Push(struct NeJobQueue *jq, const struct NeJob *job);
+static inline bool JQ_Pop(struct NeJobQueue *jq, struct NeJob *job);
+static inline void JO_Push(struct NeJobOverflow *jo, const struct NeJob *job);
+static inline bool JO_Pop(struct NeJobOverflow *jo, struct NeJob *job);
+static inline uint64_t JT_Time(void);
+static void JT_Record(const struct NeJob *job, uint64_t start);
+static struct NeJobTraceBuffer *JT_Buffer(void);
+static void JT_WriteString(FILE *fp, const char *str);
 
 bool
 E_InitJobSystem(void)
 {
-	bool useLogicalCores = E_GetCVarBln("Engine_UseLogicalCores", false)->bln;
-	f_numThreads = (useLogicalCores ? Sys_CpuThreadCount() : Sys_CpuCount()) - 1;
-	f_numThreads = f_numThreads > 1 ? f_numThreads : 1;
+	const struct NeCpuTopology *topo = Sys_CpuTopology();
+	const struct NeCpu **cpus = Sys_Alloc(sizeof(*cpus), topo->cpuCount + 1, MH_Transient);
+	if (!cpus)
+		return false;
+
+	const bool useLogicalCores = E_GetCVarBln("Engine_UseLogicalCores", false)->bln;
+	const uint32_t usableCpus = PlaceWorkers(topo, useLogicalCores, cpus);
+
+	f_numThreads = usableCpus > 2 ? usableCpus - 1 : 1;
 
 	const int maxJobWorkers = CVAR_INT32("Engine_MaxJobWorkers");
 	if (maxJobWorkers)
 		f_numThreads = maxJobWorkers;
 
+	atomic_store(&f_shutdown, false);
+	atomic_store(&f_sleepingWorkers, 0);
+	atomic_store(&f_counterWaiters, 0);
+	atomic_store(&f_submittedJobs, 0);
+	atomic_store(&f_backgroundWorkers, 0);
+
+	// invalidates the trace buffers the threads kept from a previous run
+	atomic_fetch_add(&f_traceSession, 1);
+	atomic_store(&f_traceBuffers, NULL);
+	atomic_store(&f_traceThreads, 0);
+	f_traceBufferSize = E_GetCVarU32("Engine_JobTraceSize", JT_DEFAULT_SIZE)->u32;
+
 	Sys_InitConditionVariable(&f_wakeCond);
+	Sys_InitConditionVariable(&f_counterCond);
 	Sys_InitFutex(&f_wakeLock);
 
-	f_jobQueue.head = 0;
-	f_jobQueue.tail = 0;
-	f_jobQueue.size = 1000;
-	f_jobQueue.jobs = Sys_Alloc((size_t)f_jobQueue.size, sizeof(*f_jobQueue.jobs), MH_System);
+	uint64_t queueSize = 1;
+	while (queueSize < E_GetCVarU32("Engine_JobQueueSize", JQ_DEFAULT_SIZE)->u32)
+		queueSize <<= 1;
+
+	for (uint32_t i = 0; i < JP_Count; ++i) {
+		struct NeJobQueue *jq = &f_injectionQueue[i];
+		struct NeJobOverflow *jo = &f_overflow[i];
+
+		jq->cells = Sys_Alloc(sizeof(*jq->cells), (size_t)queueSize, MH_System);
+		if (!jq->cells)
+			return false;
+
+		for (uint64_t j = 0; j < queueSize; ++j)
+			atomic_store_explicit(&jq->cells[j].sequence, j, memory_order_relaxed);
 
-	if (!f_jobQueue.jobs)
+		jq->mask = queueSize - 1;
+		atomic_store(&jq->head, 0);
+		atomic_store(&jq->tail, 0);
+
+		if (!Rt_InitArray(&jo->jobs, JD_INITIAL_SIZE, sizeof(struct NeJob), MH_System))
+			return false;
+
+		Sys_InitFutex(&jo->lock);
+		jo->head = 0;
+		atomic_store(&jo->count, 0);
+
+		atomic_store(&f_queueDepth[i], 0);
+	}
+
+	// one deque per lane for each worker
+	f_deques = Sys_AlignedAlloc(sizeof(*f_deques), (size_t)f_numThreads * JP_Count, 64, MH_System);
+	if (!f_deques)
 		return false;
 
-	Sys_InitFutex(&f_jobQueue.lock);
+	for (uint32_t i = 0; i < f_numThreads * JP_Count; ++i)
+		if (!JD_Init(&f_deques[i]))
+			return false;
+
+	f_maxBackgroundWorkers = E_GetCVarU32("Engine_MaxBackgroundJobWorkers", 0)->u32;
+	if (!f_maxBackgroundWorkers)
+		f_maxBackgroundWorkers = f_numThreads > 4 ? f_numThreads / 4 : 1;
 
 	f_threads = Sys_Alloc(f_numThreads, sizeof(NeThread), MH_System);
 	if (!f_threads)
 		return false;
 
-	int step, coreId;
-	if (useLogicalCores)
-		step = coreId = 1;
-	else
-		step = coreId = Sys_CpuCount() == Sys_CpuThreadCount() ? 1 : 2;
+	if (!InitWorkers(cpus, topo->cpuCount))
+		return false;
+
+	f_workerId = f_numThreads;
+	f_stealSeed = f_numThreads + 1;
+	f_priority = JP_FrameCritical;
 
+	// The workers wait for this lock before allocating their heaps, so the memory is first touched
+	// after they were moved to their CPU and ends up on the right NUMA node.
+	Sys_LockFutex(f_wakeLock);
 	for (uint32_t i = 0; i < f_numThreads; ++i) {
-		char name[10];
+		char name[16];
 		snprintf(name, sizeof(name), "Worker %u", i);
-		Sys_InitThread(&f_threads[i], name, ThreadProc, &i);
-		Sys_SetThreadAffinity(f_threads[i], coreId);
-		coreId += step;
+		Sys_InitThread(&f_threads[i], name, ThreadProc, (void *)(uintptr_t)i);
+
+		if (f_workers[i].cpu)
+			Sys_SetThreadAffinity(f_threads[i], (int)f_workers[i].cpu->id);
 	}
+	Sys_UnlockFutex(f_wakeLock);
 
-	f_workerId = f_numThreads;
+	if (E_GetCVarBln("Engine_JobTrace", false)->bln)
+		E_StartJobTrace();
 
 	return true;
 }
@@ -108,26 +313,91 @@ E_JobWorkerThreads(void)
 	return f_numThreads;
 }
 
+const struct NeCpu *
+E_JobWorkerCpu(uint32_t worker)
+{
+	return worker < f_numThreads ? f_workers[worker].cpu : NULL;
+}
+
 uint32_t
 E_WorkerId(void)
 {
-	return f_workerId;
+	// threads outside the pool share the main thread's slot
+	return f_workerId < f_numThreads ? f_workerId : f_numThreads;
 }
 
 uint64_t
 E_ExecuteJob(NeJobProc proc, void *args, NeJobCompletedProc completed, void *completionArgs)
 {
-	uint64_t id;
+	return E_ExecuteDependentJob(JP_Normal, proc, args, completed, completionArgs, NULL, NULL);
+}
 
-	while (!JQ_Push(&f_jobQueue, proc, args, completed, completionArgs, &id))
-		Sys_Yield();
-	Sys_Signal(f_wakeCond);
+uint64_t
+E_DispatchJobs(uint64_t count, NeJobProc proc, void **args, NeJobCompletedProc completed, void *completionArgs)
+{
+	return E_DispatchDependentJobs(JP_Normal, count, proc, args, completed, completionArgs, NULL, NULL);
+}
+
+void
+E_InitJobCounter(struct NeJobCounter *counter)
+{
+	atomic_store(&counter->value, 0);
+	Sys_InitAtomicLock(&counter->lock);
+	counter->pending = NULL;
+}
+
+void
+E_RetainJobCounter(struct NeJobCounter *counter, uint32_t count)
+{
+	atomic_fetch_add(&counter->value, count);
+}
+
+void
+E_ReleaseJobCounter(struct NeJobCounter *counter)
+{
+	SignalCounter(counter);
+}
 
-	return id;
+uint64_t
+E_ExecuteDependentJob(enum NeJobPriority priority, NeJobProc proc, void *args, NeJobCompletedProc completed,
+					  void *completionArgs, struct NeJobCounter *dependency, struct NeJobCounter *counter)
+{
+	struct NeDependentJob dj =
+	{
+		.job =
+		{
+			.args = args,
+			.completionArgs = completionArgs,
+			.exec = proc,
+			.id = atomic_fetch_add_explicit(&f_submittedJobs, 1, memory_order_relaxed),
+			.completed = completed,
+			.counter = counter,
+			.priority = priority,
+			.submitter = f_workerId,
+			.submitted = JT_Time(),
+			.label = f_label
+		}
+	};
+
+	if (counter)
+		atomic_fetch_add(&counter->value, 1);
+
+	if (dependency) {
+		struct NeDependentJob *pending = Sys_Alloc(sizeof(*pending), 1, MH_Frame);
+		memcpy(pending, &dj, sizeof(*pending));
+		SubmitDependentJobs(pending, 1, dependency);
+	} else {
+		SubmitJob(&dj.job);
+		WakeWorkers(1);
+	}
+
+	return dj.job.id;
 }
 
 uint64_t
-E_DispatchJobs(uint64_t count, NeJobProc proc, void **args, NeJobCompletedProc completed, void *completionArgs)
+E_DispatchDependentJobs(enum NeJobPriority priority, uint64_t count, NeJobProc proc, void **args,
+						NeJobCompletedProc completed, void *completionArgs,
+						struct NeJobCounter *dependency, struct NeJobCounter *counter)
 {
 	uint64_t dispatches, id, endId;
 	uint64_t jobs, extraJobs, next_start = 0;
@@ -142,24 +412,29 @@ E_DispatchJobs(uint64_t count, NeJobProc proc, void **args, NeJobCompletedProc c
 		extraJobs = count - ((uint64_t)jobs * f_numThreads);
 	}
 
-	Sys_LockFutex(f_jobQueue.lock);
-	{
-		id = f_submittedJobs;
-		f_submittedJobs += dispatches;
-		endId = f_submittedJobs - 1;
-	}
-	Sys_UnlockFutex(f_jobQueue.lock);
+	if (!dispatches)
+		return 0;
+
+	id = atomic_fetch_add_explicit(&f_submittedJobs, dispatches, memory_order_relaxed);
+	endId = id + dispatches - 1;
+
+	if (counter)
+		atomic_fetch_add(&counter->value, (uint32_t)dispatches);
+
+	const uint64_t submitted = JT_Time();
 
 	_Atomic uint64_t *completedTasks = Sys_Alloc(sizeof(*completedTasks), 1, MH_Frame);
 	*completedTasks = 0;
 
+	struct NeDependentJob *pending = dependency ? Sys_Alloc(sizeof(*pending), dispatches, MH_Frame) : NULL;
+
 	for (int i = 0; i < dispatches; ++i) {
 		struct NeDispatchArgs *dargs = Sys_Alloc(sizeof(*dargs), 1, MH_Frame);
 
 		dargs->exec = proc;
 		dargs->count = jobs;
 		dargs->args = args ? &(args[next_start]) : NULL;
-		dargs->id = id++;
+		dargs->id = id;
 		dargs->endId = endId;
 		dargs->jobCount = count;
 		dargs->completed = completedTasks;
@@ -173,73 +448,295 @@ E_DispatchJobs(uint64_t count, NeJobProc proc, void **args, NeJobCompletedProc c
 
 		next_start += dargs->count;
 
-		while(!JQ_Push(&f_jobQueue, (NeJobProc)DispatchWrapper, dargs, NULL, NULL, NULL))
-			Sys_Yield();
+		struct NeJob job =
+		{
+			.args = dargs,
+			.exec = (NeJobProc)DispatchWrapper,
+			.id = id++,
+			.counter = counter,
+			.priority = priority,
+			.submitter = f_workerId,
+			.submitted = submitted,
+			.label = f_label
+		};
+		if (pending) {
+			pending[i].job = job;
+			pending[i].next = i < dispatches - 1 ? &pending[i + 1] : NULL;
+		} else {
+			SubmitJob(&job);
+		}
 	}
 
-	Sys_Broadcast(f_wakeCond);
+	if (pending)
+		SubmitDependentJobs(pending, (uint32_t)dispatches, dependency);
+	else
+		WakeWorkers((uint32_t)dispatches);
 
 	return endId;
 }
 
 void
-E_TermJobSystem(void)
+E_WaitForJobCounter(struct NeJobCounter *counter)
+{
+	struct NeJob job;
+	uint32_t spin = 0;
+
+	// Never start a background job while something is waiting on us, unless we're running
+	// one already (it's probably waiting for its own children).
+	const bool background = f_priority == JP_Background;
+
+	const uint32_t worker = E_WorkerId();
+
+	while (atomic_load(&counter->value)) {
+		if (GetJob(worker, &job, background)) {
+			RunJob(worker, &job);
+			spin = 0;
+			continue;
+		}
+
+		if (++spin < JOB_SPIN_COUNT) {
+			Sys_Yield();
+			continue;
+		}
+
+		// Same handshake as the parked workers; woken by new jobs and by counters reaching zero
+		Sys_LockFutex(f_wakeLock);
+		atomic_fetch_add(&f_counterWaiters, 1);
+
+		if (atomic_load(&counter->value) && !HasWork(background))
+			Sys_WaitFutex(f_counterCond, f_wakeLock);
+
+		atomic_fetch_sub(&f_counterWaiters, 1);
+		Sys_UnlockFutex(f_wakeLock);
+
+		spin = 0;
+	}
+
+	// The thread that released the counter might still be holding the lock; wait for it
+	// before the caller is allowed to destroy the counter.
+	Sys_AtomicLockWrite(&counter->lock);
+	Sys_AtomicUnlockWrite(&counter->lock);
+}
+
+uint32_t
+E_JobQueueDepth(enum NeJobPriority priority)
+{
+	return priority < JP_Count ? atomic_load_explicit(&f_queueDepth[priority], memory_order_relaxed) : 0;
+}
+
+void
+E_ParallelFor(uint64_t begin, uint64_t end, uint64_t grain, NeParallelForProc proc, void *userData)
+{
+	if (begin >= end)
+		return;
+
+	if (!grain) {
+		grain = (end - begin) / ((uint64_t)(f_numThreads + 1) * PF_SPLITS_PER_THREAD);
+		grain = grain ? grain : 1;
+	}
+
+	if (end - begin <= grain) {
+		proc(E_WorkerId(), begin, end, userData);
+		return;
+	}
+
+	struct NeJobCounter counter;
+	E_InitJobCounter(&counter);
+
+	const struct NeParallelForArgs pfa = { proc, userData, grain, &counter };
+	const struct NeParallelForRange range = { &pfa, begin, end };
+
+	// The calling thread does the first split and the left-most piece itself
+	ParallelForJob(E_WorkerId(), &range);
+	E_WaitForJobCounter(&counter);
+}
+
+const char *
+E_SetJobLabel(const char *label)
+{
+	const char *prev = f_label;
+	f_label = label;
+	return prev;
+}
+
+void
+E_StartJobTrace(void)
 {
-	f_shutdown = true;
+	f_traceStart = Sys_Time();
+	atomic_fetch_add(&f_traceEpoch, 1);
+	atomic_store(&f_tracing, true);
+
+	Sys_LogEntry(JOBMOD, LOG_INFORMATION, "Job trace started");
+}
+
+void
+E_StopJobTrace(void)
+{
+	atomic_store(&f_tracing, false);
+}
+
+bool
+E_WriteJobTrace(const char *file)
+{
+	if (!file)
+		file = E_GetCVarStr("Engine_JobTraceFile", JT_DEFAULT_FILE)->str;
+
+	FILE *fp = fopen(file, "w");
+	if (!fp) {
+		Sys_LogEntry(JOBMOD, LOG_CRITICAL, "Failed to open %s for writing", file);
+		return false;
+	}
 
-	Sys_LockFutex(f_jobQueue.lock);
-	f_jobQueue.head = 0;
-	f_jobQueue.tail = 0;
-	Sys_UnlockFutex(f_jobQueue.lock);
+	const uint32_t epoch = atomic_load(&f_traceEpoch);
+	uint32_t events = 0, dropped = 0;
+	const char *sep = "";
+
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", fp);
+
+	for (struct NeJobTraceBuffer *tb = atomic_load(&f_traceBuffers); tb; tb = tb->next) {
+		if (atomic_load(&tb->epoch) != epoch)
+			continue;
+
+		if (tb->thread < f_numThreads)
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"Worker %u\"}}",
+					sep, tb->thread, tb->thread);
+		else if (tb->thread == f_numThreads)
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"Main\"}}",
+					sep, tb->thread);
+		else
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+					sep, tb->thread, tb->thread - f_numThreads);
+		sep = ",\n";
+
+		const uint32_t count = atomic_load_explicit(&tb->count, memory_order_acquire);
+		for (uint32_t i = 0; i < count; ++i) {
+			const struct NeJobTraceEvent *evt = &tb->events[i];
+			static const char *lanes[JP_Count] = { "FrameCritical", "Normal", "Background" };
+
+			fprintf(fp, "%s{\"name\":\"", sep);
+			JT_WriteString(fp, evt->label ? evt->label : "Job");
+			fprintf(fp, "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+						"\"args\":{\"id\":%llu,\"submitter\":%d,\"wait\":%.3f}}",
+					lanes[evt->priority], tb->thread,
+					((double)evt->start - (double)f_traceStart) / 1000.0, (double)(evt->end - evt->start) / 1000.0,
+					(unsigned long long)evt->id, (int32_t)evt->submitter, (double)(evt->start - evt->submitted) / 1000.0);
+		}
+
+		events += count;
+		dropped += tb->dropped;
+	}
+
+	fputs("\n]}\n", fp);
+	fclose(fp);
 
+	Sys_LogEntry(JOBMOD, LOG_INFORMATION, "Wrote %u job trace events to %s", events, file);
+	if (dropped)
+		Sys_LogEntry(JOBMOD, LOG_WARNING, "%u job trace events were dropped; increase Engine_JobTraceSize", dropped);
+
+	return true;
+}
+
+void
+E_TermJobSystem(void)
+{
+	Sys_LockFutex(f_wakeLock);
+	atomic_store(&f_shutdown, true);
 	Sys_Broadcast(f_wakeCond);
+	Sys_UnlockFutex(f_wakeLock);
 
 	for (uint32_t i = 0; i < f_numThreads; ++i)
 		Sys_JoinThread(f_threads[i]);
 
-	Sys_TermFutex(f_jobQueue.lock);
-
 	Sys_TermConditionVariable(f_wakeCond);
+	Sys_TermConditionVariable(f_counterCond);
 	Sys_TermFutex(f_wakeLock);
 
-	Sys_Free(f_jobQueue.jobs);
+	if (atomic_load(&f_tracing)) {
+		E_StopJobTrace();
+		E_WriteJobTrace(NULL);
+	}
+
+	struct NeJobTraceBuffer *tb = atomic_load(&f_traceBuffers);
+	while (tb) {
+		struct NeJobTraceBuffer *next = tb->next;
+		Sys_Free(tb);
+		tb = next;
+	}
+	atomic_store(&f_traceBuffers, NULL);
+
+	for (uint32_t i = 0; i < f_numThreads * JP_Count; ++i)
+		JD_Term(&f_deques[i]);
+
+	for (uint32_t i = 0; i < JP_Count; ++i) {
+		Sys_Free(f_injectionQueue[i].cells);
+		Rt_TermArray(&f_overflow[i].jobs);
+		Sys_TermFutex(f_overflow[i].lock);
+	}
+
+	for (uint32_t i = 0; i <= f_numThreads; ++i)
+		Sys_Free(f_workers[i].victims);
+
+	Sys_Free(f_workers);
+	Sys_Free(f_deques);
 	Sys_Free(f_threads);
 }
 
 static void
 ThreadProc(void *args)
 {
-	static volatile _Atomic uint32_t workerId = 0;
-	uint32_t id = atomic_fetch_add_explicit(&workerId, 1, memory_order_acq_rel);
-	struct NeJob job = { 0, 0 };
+	const uint32_t id = (uint32_t)(uintptr_t)args;
+	uint32_t spin = 0;
+	struct NeJob job;
 
 	f_workerId = id;
+	f_stealSeed = id + 1;
+	f_priority = JP_Normal;
+
+	Sys_LockFutex(f_wakeLock);
+	Sys_UnlockFutex(f_wakeLock);
+
 	Sys_InitMemory();
 
 	Sys_LogEntry(JOBMOD, LOG_INFORMATION, "Worker %d started", f_workerId);
 
-	while (!f_shutdown) {
-		Sys_LockFutex(f_wakeLock);
+	while (!atomic_load_explicit(&f_shutdown, memory_order_relaxed)) {
+		const bool background = ReserveBackgroundWorker();
+		const bool found = GetJob(id, &job, background);
 
-		if (f_jobQueue.tail == f_jobQueue.head)
-			Sys_WaitFutex(f_wakeCond, f_wakeLock);
+		if (background && (!found || job.priority != JP_Background))
+			atomic_fetch_sub(&f_backgroundWorkers, 1);
+
+		if (found) {
+			RunJob(id, &job);
+			if (job.priority == JP_Background)
+				atomic_fetch_sub(&f_backgroundWorkers, 1);
 
-		Sys_LockFutex(f_jobQueue.lock);
-		if (f_jobQueue.tail != f_jobQueue.head) {
-			memcpy(&job, &f_jobQueue.jobs[f_jobQueue.tail], sizeof(job));
-			f_jobQueue.tail = (f_jobQueue.tail + 1) % f_jobQueue.size;
+			spin = 0;
+			continue;
 		}
-		Sys_UnlockFutex(f_jobQueue.lock);
 
-		Sys_UnlockFutex(f_wakeLock);
+		if (++spin < JOB_SPIN_COUNT) {
+			Sys_Yield();
+			continue;
+		}
 
-		if (job.exec) {
-			job.exec(id, job.args);
-			if (job.completed)
-				job.completed(job.id, job.completionArgs);
+		/*
+		 * Announce the intent to sleep before checking the queues one last time; submitters
+		 * publish the job before reading f_sleepingWorkers, so one of the two sides will
+		 * always see the other.
+		 */
+		Sys_LockFutex(f_wakeLock);
+		atomic_fetch_add(&f_sleepingWorkers, 1);
 
-			memset(&job, 0x0, sizeof(job));
-		}
+		// A worker that drops a background slot checks the queues again before it parks, so
+		// background jobs don't need to wake anyone while all the slots are taken.
+		if (!HasWork(atomic_load(&f_backgroundWorkers) < f_maxBackgroundWorkers) && !atomic_load(&f_shutdown))
+			Sys_WaitFutex(f_wakeCond, f_wakeLock);
+
+		atomic_fetch_sub(&f_sleepingWorkers, 1);
+		Sys_UnlockFutex(f_wakeLock);
+
+		spin = 0;
 	}
 
 	Sys_LogEntry(JOBMOD, LOG_INFORMATION, "Worker %d stopped", f_workerId);
@@ -263,35 +760,581 @@ DispatchWrapper(int worker, struct NeDispatchArgs *argPtr)
 	args.completedHandler(args.endId, args.completionArgs);
 }
 
+static void
+ParallelForJob(int worker, const struct NeParallelForRange *range)
+{
+	const struct NeParallelForArgs *pfa = range->pfa;
+	uint64_t begin = range->begin, end = range->end;
+
+	while (end - begin > pfa->grain) {
+		const uint64_t mid = begin + (end - begin) / 2;
+
+		struct NeParallelForRange *right = Sys_Alloc(sizeof(*right), 1, MH_Frame);
+		right->pfa = pfa;
+		right->begin = mid;
+		right->end = end;
+
+		E_ExecuteDependentJob(f_priority, (NeJobProc)ParallelForJob, right, NULL, NULL, NULL, pfa->counter);
+
+		end = mid;
+	}
+
+	pfa->proc(worker, begin, end, pfa->userData);
+}
+
+static inline void
+SubmitJob(const struct NeJob *job)
+{
+	// Counted before the job is visible, so the depth never goes below the number of queued jobs
+	atomic_fetch_add_explicit(&f_queueDepth[job->priority], 1, memory_order_relaxed);
+
+	if (f_workerId < f_numThreads) {
+		if (JD_Push(&f_deques[f_workerId * JP_Count + job->priority], job))
+			return;
+
+		// the deque could not grow; the job is not lost, it runs on this worker now
+		atomic_fetch_sub_explicit(&f_queueDepth[job->priority], 1, memory_order_relaxed);
+		RunJob(f_workerId, job);
+		return;
+	}
+
+	if (!JQ_Push(&f_injectionQueue[job->priority], job))
+		JO_Push(&f_overflow[job->priority], job);
+}
+
+static inline void
+SubmitDependentJobs(struct NeDependentJob *jobs, uint32_t count, struct NeJobCounter *dependency)
+{
+	bool queued = false;
+
+	// The counter only reaches zero while its lock is held, so the value can't change under us here
+	Sys_AtomicLockWrite(&dependency->lock);
+	if (atomic_load(&dependency->value)) {
+		struct NeDependentJob *last = &jobs[count - 1];
+		while (last->next)
+			last = last->next;
+
+		last->next = dependency->pending;
+		dependency->pending = jobs;
+		queued = true;
+	}
+	Sys_AtomicUnlockWrite(&dependency->lock);
+
+	if (queued)
+		return;
+
+	for (struct NeDependentJob *dj = jobs; dj; dj = dj->next)
+		SubmitJob(&dj->job);
+	WakeWorkers(count);
+}
+
+static inline void
+RunJob(uint32_t worker, const struct NeJob *job)
+{
+	// Jobs submitted from this one inherit its priority through E_ParallelFor, and its label
+	const enum NeJobPriority priority = f_priority;
+	const char *label = f_label;
+	const uint64_t start = JT_Time();
+
+	f_priority = job->priority;
+	f_label = job->label;
+
+	job->exec(worker, job->args);
+	if (job->completed)
+		job->completed(job->id, job->completionArgs);
+
+	if (unlikely(start))
+		JT_Record(job, start);
+
+	if (job->counter)
+		SignalCounter(job->counter);
+
+	f_priority = priority;
+	f_label = label;
+}
+
+static inline void
+SignalCounter(struct NeJobCounter *counter)
+{
+	uint32_t value = atomic_load(&counter->value);
+	while (value > 1)
+		if (atomic_compare_exchange_weak(&counter->value, &value, value - 1))
+			return;
+
+	// Last job; E_WaitForJobCounter relies on this transition happening under the lock
+	struct NeDependentJob *pending = NULL;
+	Sys_AtomicLockWrite(&counter->lock);
+	if (atomic_fetch_sub(&counter->value, 1) == 1) {
+		pending = counter->pending;
+		counter->pending = NULL;
+	}
+	Sys_AtomicUnlockWrite(&counter->lock);
+
+	uint32_t released = 0;
+	for (; pending; pending = pending->next, ++released)
+		SubmitJob(&pending->job);
+
+	WakeWorkers(released);
+
+	atomic_thread_fence(memory_order_seq_cst);
+	if (!atomic_load_explicit(&f_counterWaiters, memory_order_relaxed))
+		return;
+
+	Sys_LockFutex(f_wakeLock);
+	Sys_Broadcast(f_counterCond);
+	Sys_UnlockFutex(f_wakeLock);
+}
+
 static inline bool
-JQ_Push(struct NeJobQueue *jq, NeJobProc exec, void *args, NeJobCompletedProc completed, void *completionArgs, uint64_t *id)
+GetJob(uint32_t worker, struct NeJob *job, bool background)
 {
-	bool ret = false;
-	uint64_t next;
+	const uint32_t lanes = background ? JP_Count : JP_Background;
+
+	for (uint32_t i = 0; i < lanes; ++i) {
+		if (!atomic_load_explicit(&f_queueDepth[i], memory_order_relaxed))
+			continue;
+
+		if (TakeJob(worker, (enum NeJobPriority)i, job)) {
+			atomic_fetch_sub_explicit(&f_queueDepth[i], 1, memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static inline bool
+TakeJob(uint32_t worker, enum NeJobPriority priority, struct NeJob *job)
+{
+	if (worker < f_numThreads && JD_Pop(&f_deques[worker * JP_Count + priority], job))
+		return true;
+
+	if (JQ_Pop(&f_injectionQueue[priority], job))
+		return true;
+
+	if (atomic_load_explicit(&f_overflow[priority].count, memory_order_acquire) && JO_Pop(&f_overflow[priority], job))
+		return true;
+
+	const struct NeWorker *w = &f_workers[worker];
+	return StealJob(w->victims, w->localVictims, priority, job)
+		|| StealJob(w->victims + w->localVictims, w->nodeVictims - w->localVictims, priority, job)
+		|| StealJob(w->victims + w->nodeVictims, w->victimCount - w->nodeVictims, priority, job);
+}
+
+static inline bool
+StealJob(const uint32_t *victims, uint32_t count, enum NeJobPriority priority, struct NeJob *job)
+{
+	if (!count)
+		return false;
+
+	// xorshift32; start from a random victim so the thieves don't all hit the same deque
+	f_stealSeed ^= f_stealSeed << 13;
+	f_stealSeed ^= f_stealSeed >> 17;
+	f_stealSeed ^= f_stealSeed << 5;
+
+	const uint32_t start = f_stealSeed % count;
+	for (uint32_t i = 0; i < count; ++i)
+		if (JD_Steal(&f_deques[victims[(start + i) % count] * JP_Count + priority], job))
+			return true;
+
+	return false;
+}
+
+/*
+ * Orders the CPUs the workers will be placed on: one per performance core, then the efficiency
+ * cores, then the SMT siblings. The topology is sorted by cache domain, so neighbouring workers
+ * share their cache. Returns how many of them should get a thread.
+ */
+static inline uint32_t
+PlaceWorkers(const struct NeCpuTopology *topo, bool logical, const struct NeCpu **cpus)
+{
+	uint32_t count = 0, usable = 0;
+
+	for (uint32_t pass = 0; pass < 4; ++pass) {
+		const bool efficiency = pass & 1, sibling = pass & 2;
+
+		for (uint32_t i = 0; i < topo->cpuCount; ++i) {
+			const struct NeCpu *cpu = &topo->cpus[i];
+			if (cpu->efficiency == efficiency && (cpu->sibling > 0) == sibling)
+				cpus[count++] = cpu;
+		}
+
+		if (!sibling || logical)
+			usable = count;
+	}
+
+	return usable;
+}
+
+static inline bool
+InitWorkers(const struct NeCpu **cpus, uint32_t cpuCount)
+{
+	// The main thread is the last one and keeps the first CPU
+	f_workers = Sys_Alloc(sizeof(*f_workers), f_numThreads + 1, MH_System);
+	if (!f_workers)
+		return false;
+
+	for (uint32_t i = 0; i <= f_numThreads; ++i) {
+		if (cpuCount)
+			f_workers[i].cpu = cpus[i < f_numThreads ? (i + 1) % cpuCount : 0];
+
+		f_workers[i].victims = Sys_Alloc(sizeof(*f_workers[i].victims), f_numThreads, MH_System);
+		if (!f_workers[i].victims)
+			return false;
+	}
+
+	for (uint32_t i = 0; i <= f_numThreads; ++i) {
+		struct NeWorker *w = &f_workers[i];
+		const struct NeCpu *cpu = w->cpu;
+
+		for (uint32_t j = 0; j < f_numThreads; ++j)
+			if (j != i && (!cpu || (f_workers[j].cpu && f_workers[j].cpu->cacheDomain == cpu->cacheDomain)))
+				w->victims[w->victimCount++] = j;
+		w->localVictims = w->victimCount;
+
+		for (uint32_t j = 0; cpu && j < f_numThreads; ++j)
+			if (j != i && f_workers[j].cpu && f_workers[j].cpu->cacheDomain != cpu->cacheDomain
+					&& f_workers[j].cpu->node == cpu->node)
+				w->victims[w->victimCount++] = j;
+		w->nodeVictims = w->victimCount;
+
+		for (uint32_t j = 0; cpu && j < f_numThreads; ++j)
+			if (j != i && (!f_workers[j].cpu || f_workers[j].cpu->node != cpu->node))
+				w->victims[w->victimCount++] = j;
+	}
+
+	return true;
+}
+
+static inline bool
+ReserveBackgroundWorker(void)
+{
+	if (!atomic_load_explicit(&f_queueDepth[JP_Background], memory_order_relaxed))
+		return false;
 
-	Sys_LockFutex(jq->lock);
+	uint32_t workers = atomic_load_explicit(&f_backgroundWorkers, memory_order_relaxed);
+	while (workers < f_maxBackgroundWorkers)
+		if (atomic_compare_exchange_weak(&f_backgroundWorkers, &workers, workers + 1))
+			return true;
+
+	return false;
+}
+
+static inline bool
+HasWork(bool background)
+{
+	const uint32_t lanes = background ? JP_Count : JP_Background;
+
+	for (uint32_t i = 0; i < lanes; ++i)
+		if (atomic_load(&f_queueDepth[i]))
+			return true;
+
+	return false;
+}
+
+static inline void
+WakeWorkers(uint32_t count)
+{
+	if (!count)
+		return;
 
-	next = (jq->head + 1) % jq->size;
-	if (next != jq->tail) {
-		jq->jobs[jq->head].id = f_submittedJobs++;
-		jq->jobs[jq->head].args = args;
-		jq->jobs[jq->head].exec = exec;
-		jq->jobs[jq->head].completed = completed;
-		jq->jobs[jq->head].completionArgs = completionArgs;
+	atomic_thread_fence(memory_order_seq_cst);
 
-		if (id)
-			*id = jq->jobs[jq->head].id;
+	const uint32_t sleeping = atomic_load_explicit(&f_sleepingWorkers, memory_order_relaxed);
+	const uint32_t waiters = atomic_load_explicit(&f_counterWaiters, memory_order_relaxed);
+	if (!sleeping && !waiters)
+		return;
+
+	if (count > sleeping)
+		count = sleeping;
+
+	// Wake only as many workers as there are jobs; the rest stay parked. Threads blocked in
+	// E_WaitForJobCounter are few, and they might be the only ones able to run the new jobs.
+	Sys_LockFutex(f_wakeLock);
+	while (count--)
+		Sys_Signal(f_wakeCond);
+	if (waiters)
+		Sys_Broadcast(f_counterCond);
+	Sys_UnlockFutex(f_wakeLock);
+}
+
+static inline bool
+JD_Init(struct NeJobDeque *jd)
+{
+	struct NeJobBuffer *buff = Sys_Alloc(sizeof(*buff) + sizeof(*buff->jobs) * JD_INITIAL_SIZE, 1, MH_System);
+	if (!buff)
+		return false;
+
+	buff->size = JD_INITIAL_SIZE;
+	buff->prev = NULL;
+
+	atomic_store(&jd->top, 0);
+	atomic_store(&jd->bottom, 0);
+	atomic_store(&jd->buffer, buff);
+
+	return true;
+}
 
-		jq->head = next;
-		
+static inline bool
+JD_Push(struct NeJobDeque *jd, const struct NeJob *job)
+{
+	const int64_t b = atomic_load_explicit(&jd->bottom, memory_order_relaxed);
+	const int64_t t = atomic_load_explicit(&jd->top, memory_order_acquire);
+	struct NeJobBuffer *buff = atomic_load_explicit(&jd->buffer, memory_order_relaxed);
+
+	if (b - t > buff->size - 1) {
+		struct NeJobBuffer *new = Sys_Alloc(sizeof(*new) + sizeof(*new->jobs) * buff->size * 2, 1, MH_System);
+		if (unlikely(!new)) {
+			Sys_LogEntry(JOBMOD, LOG_CRITICAL, "Failed to grow the job queue of worker %d to %lld jobs", f_workerId, (long long)buff->size * 2);
+			return false;
+		}
+
+		new->size = buff->size * 2;
+		new->prev = buff;
+
+		for (int64_t i = t; i < b; ++i)
+			memcpy(&new->jobs[i & (new->size - 1)], &buff->jobs[i & (buff->size - 1)], sizeof(*new->jobs));
+
+		atomic_store_explicit(&jd->buffer, new, memory_order_release);
+		buff = new;
+	}
+
+	memcpy(&buff->jobs[b & (buff->size - 1)], job, sizeof(*job));
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&jd->bottom, b + 1, memory_order_relaxed);
+
+	return true;
+}
+
+static inline bool
+JD_Pop(struct NeJobDeque *jd, struct NeJob *job)
+{
+	const int64_t b = atomic_load_explicit(&jd->bottom, memory_order_relaxed) - 1;
+	struct NeJobBuffer *buff = atomic_load_explicit(&jd->buffer, memory_order_relaxed);
+
+	atomic_store_explicit(&jd->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	int64_t t = atomic_load_explicit(&jd->top, memory_order_relaxed);
+	if (t > b) {
+		atomic_store_explicit(&jd->bottom, b + 1, memory_order_relaxed);
+		return false;
+	}
+
+	memcpy(job, &buff->jobs[b & (buff->size - 1)], sizeof(*job));
+	if (t != b)
+		return true;
+
+	// last job in the deque; race the thieves for it
+	const bool ret = atomic_compare_exchange_strong_explicit(&jd->top, &t, t + 1,
+											memory_order_seq_cst, memory_order_relaxed);
+	atomic_store_explicit(&jd->bottom, b + 1, memory_order_relaxed);
+
+	return ret;
+}
+
+static inline bool
+JD_Steal(struct NeJobDeque *jd, struct NeJob *job)
+{
+	int64_t t = atomic_load_explicit(&jd->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	const int64_t b = atomic_load_explicit(&jd->bottom, memory_order_acquire);
+
+	if (t >= b)
+		return false;
+
+	struct NeJobBuffer *buff = atomic_load_explicit(&jd->buffer, memory_order_acquire);
+	memcpy(job, &buff->jobs[t & (buff->size - 1)], sizeof(*job));
+
+	return atomic_compare_exchange_strong_explicit(&jd->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+static inline void
+JD_Term(struct NeJobDeque *jd)
+{
+	struct NeJobBuffer *buff = atomic_load(&jd->buffer);
+	while (buff) {
+		struct NeJobBuffer *prev = buff->prev;
+		Sys_Free(buff);
+		buff = prev;
+	}
+}
+
+static inline bool
+JQ_Push(struct NeJobQueue *jq, const struct NeJob *job)
+{
+	struct NeJobCell *cell;
+	uint64_t pos = atomic_load_explicit(&jq->head, memory_order_relaxed);
+
+	for (;;) {
+		cell = &jq->cells[pos & jq->mask];
+
+		const uint64_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		const int64_t diff = (int64_t)seq - (int64_t)pos;
+
+		if (!diff) {
+			if (atomic_compare_exchange_weak_explicit(&jq->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = atomic_load_explicit(&jq->head, memory_order_relaxed);
+		}
+	}
+
+	memcpy(&cell->job, job, sizeof(*job));
+	atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+	return true;
+}
+
+static inline bool
+JQ_Pop(struct NeJobQueue *jq, struct NeJob *job)
+{
+	struct NeJobCell *cell;
+	uint64_t pos = atomic_load_explicit(&jq->tail, memory_order_relaxed);
+
+	for (;;) {
+		cell = &jq->cells[pos & jq->mask];
+
+		const uint64_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		const int64_t diff = (int64_t)seq - (int64_t)(pos + 1);
+
+		if (!diff) {
+			if (atomic_compare_exchange_weak_explicit(&jq->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = atomic_load_explicit(&jq->tail, memory_order_relaxed);
+		}
+	}
+
+	memcpy(job, &cell->job, sizeof(*job));
+	atomic_store_explicit(&cell->sequence, pos + jq->mask + 1, memory_order_release);
+
+	return true;
+}
+
+static inline void
+JO_Push(struct NeJobOverflow *jo, const struct NeJob *job)
+{
+	Sys_LockFutex(jo->lock);
+
+	while (!Rt_ArrayAdd(&jo->jobs, job)) {
+		Sys_UnlockFutex(jo->lock);
+		Sys_Yield();
+		Sys_LockFutex(jo->lock);
+	}
+
+	atomic_fetch_add_explicit(&jo->count, 1, memory_order_release);
+	Sys_UnlockFutex(jo->lock);
+}
+
+static inline bool
+JO_Pop(struct NeJobOverflow *jo, struct NeJob *job)
+{
+	bool ret = false;
+
+	Sys_LockFutex(jo->lock);
+
+	if (jo->head < jo->jobs.count) {
+		memcpy(job, Rt_ArrayGet(&jo->jobs, jo->head++), sizeof(*job));
+		atomic_fetch_sub_explicit(&jo->count, 1, memory_order_relaxed);
 		ret = true;
 	}
 
-	Sys_UnlockFutex(jq->lock);
+	// drained; start over from the beginning of the array instead of growing it forever
+	if (jo->head == jo->jobs.count)
+		jo->head = jo->jobs.count = 0;
+
+	Sys_UnlockFutex(jo->lock);
 
 	return ret;
 }
 
+static inline uint64_t
+JT_Time(void)
+{
+	return unlikely(atomic_load_explicit(&f_tracing, memory_order_relaxed)) ? Sys_Time() : 0;
+}
+
+static void
+JT_Record(const struct NeJob *job, uint64_t start)
+{
+	const uint64_t end = Sys_Time();
+
+	struct NeJobTraceBuffer *tb = JT_Buffer();
+	if (!tb)
+		return;
+
+	const uint32_t epoch = atomic_load_explicit(&f_traceEpoch, memory_order_relaxed);
+	if (atomic_load_explicit(&tb->epoch, memory_order_relaxed) != epoch) {
+		atomic_store_explicit(&tb->count, 0, memory_order_relaxed);
+		atomic_store_explicit(&tb->epoch, epoch, memory_order_relaxed);
+		tb->dropped = 0;
+	}
+
+	const uint32_t count = atomic_load_explicit(&tb->count, memory_order_relaxed);
+	if (count == tb->size) {
+		++tb->dropped;
+		return;
+	}
+
+	struct NeJobTraceEvent *evt = &tb->events[count];
+	evt->label = job->label;
+	evt->id = job->id;
+	evt->submitted = job->submitted && job->submitted < start ? job->submitted : start;
+	evt->start = start;
+	evt->end = end;
+	evt->submitter = job->submitter;
+	evt->priority = job->priority;
+
+	atomic_store_explicit(&tb->count, count + 1, memory_order_release);
+}
+
+static struct NeJobTraceBuffer *
+JT_Buffer(void)
+{
+	const uint32_t session = atomic_load_explicit(&f_traceSession, memory_order_relaxed);
+	if (f_traceBuffer && f_traceBufferSession == session)
+		return f_traceBuffer;
+
+	struct NeJobTraceBuffer *tb = Sys_Alloc(sizeof(*tb) + sizeof(*tb->events) * f_traceBufferSize, 1, MH_System);
+	if (!tb)
+		return NULL;
+
+	tb->size = f_traceBufferSize;
+	if (f_workerId <= f_numThreads)
+		tb->thread = f_workerId;
+	else
+		tb->thread = f_numThreads + atomic_fetch_add(&f_traceThreads, 1) + 1;
+
+	atomic_store(&tb->epoch, atomic_load(&f_traceEpoch));
+	atomic_store(&tb->count, 0);
+
+	tb->next = atomic_load(&f_traceBuffers);
+	while (!atomic_compare_exchange_weak(&f_traceBuffers, &tb->next, tb))
+		;
+
+	f_traceBuffer = tb;
+	f_traceBufferSession = session;
+
+	return tb;
+}
+
+static void
+JT_WriteString(FILE *fp, const char *str)
+{
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			fputc('\\', fp);
+
+		if ((unsigned char)*str >= 0x20)
+			fputc(*str, fp);
+	}
+}
+
 /* NekoEngine
  *
  * Job.c
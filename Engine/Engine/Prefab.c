@@ -0,0 +1,304 @@
+#include <Engine/IO.h>
+#include <Engine/Asset.h>
+#include <Engine/Prefab.h>
+#include <Asset/NPrefab.h>
+#include <System/Log.h>
+#include <Runtime/Runtime.h>
+
+#include "ECS.h"
+
+#define PREFAB_MOD	"Prefab"
+
+static inline void *AllocTemplate(const struct NeCompType *type);
+static bool ReadComponent(struct NeStream *stm, uint32_t size, struct NePrefabComp *pc);
+static bool WriteComponent(struct NeStream *stm, const struct NePrefabComp *pc);
+static inline bool Write(struct NeStream *stm, const void *ptr, int64_t size) { return E_WriteStream(stm, ptr, size) == size; }
+
+struct NePrefab *
+E_CreatePrefab(const char *name, const NeCompTypeId *compTypes, const void ***compArgs, uint8_t typeCount)
+{
+	if (typeCount > MAX_ENTITY_COMPONENTS)
+		return NULL;
+
+	struct NePrefab *p = Sys_Alloc(sizeof(*p), 1, MH_Asset);
+	if (!p)
+		return NULL;
+
+	strlcpy(p->name, name ? name : "unnamed", sizeof(p->name));
+
+	for (uint8_t i = 0; i < typeCount; ++i) {
+		const struct NeCompType *type = ECS_ComponentType(compTypes[i]);
+		if (!type)
+			goto error;
+
+		for (uint32_t j = 0; j < p->compCount; ++j)
+			if (p->comp[j].type == compTypes[i])
+				goto error;
+
+		struct NePrefabComp *pc = &p->comp[p->compCount++];
+		pc->type = compTypes[i];
+
+		if (compArgs && compArgs[i] && compArgs[i][0] && !(pc->args = ECS_CopyComponentArgs(compArgs[i], MH_Asset)))
+			goto error;
+
+		// the init function may refer to the scene of the component, so the template can only be built without it
+		if (!ECS_CopyableComponent(type) || (type->init && !type->initTemplate))
+			continue;
+
+		if (!(pc->data = AllocTemplate(type)))
+			goto error;
+
+		if (type->initTemplate && !type->initTemplate(pc->data, pc->args))
+			goto error;
+	}
+
+	return p;
+
+error:
+	Sys_LogEntry(PREFAB_MOD, LOG_CRITICAL, "Failed to create prefab %s", p->name);
+	E_DestroyPrefab(p);
+	return NULL;
+}
+
+struct NePrefab *
+E_CreatePrefabFromEntityS(struct NeScene *s, NeEntityHandle handle, const char *name)
+{
+	const struct NeEntity *ent = ECS_EntityPtr(handle);
+	if (!ent)
+		return NULL;
+
+	struct NePrefab *p = Sys_Alloc(sizeof(*p), 1, MH_Asset);
+	if (!p)
+		return NULL;
+
+	strlcpy(p->name, name ? name : ent->name, sizeof(p->name));
+
+	for (uint32_t i = 0; i < ent->compCount; ++i) {
+		const struct NeCompType *type = ECS_ComponentType(ent->comp[i].type);
+		struct NePrefabComp *pc = &p->comp[p->compCount++];
+		pc->type = ent->comp[i].type;
+
+		if (!ECS_CopyableComponent(type)) {
+			Sys_LogEntry(PREFAB_MOD, LOG_WARNING, "Component %s of entity %s can't be copied, the instances of prefab %s will initialize it without arguments",
+							type->name, ent->name, p->name);
+			continue;
+		}
+
+		const void *comp = E_ComponentPtrS(s, ent->comp[i].handle);
+		if (!comp || !(pc->data = AllocTemplate(type)))
+			goto error;
+
+		// the handle, owner and scene are set for each instance
+		memcpy(pc->data, comp, type->size);
+		Sys_ZeroMemory(pc->data, sizeof(struct NeCompBase));
+	}
+
+	return p;
+
+error:
+	Sys_LogEntry(PREFAB_MOD, LOG_CRITICAL, "Failed to create prefab %s from entity %s", p->name, ent->name);
+	E_DestroyPrefab(p);
+	return NULL;
+}
+
+struct NePrefab *
+E_LoadPrefab(struct NeStream *stm)
+{
+	struct NePrefab *p = Sys_Alloc(sizeof(*p), 1, MH_Asset);
+	if (!p)
+		return NULL;
+
+	ASSET_READ_INIT();
+
+	ASSET_CHECK_GUARD(NPREFAB_1_HEADER);
+
+	while (!E_EndOfStream(stm)) {
+		ASSET_READ_ID();
+
+		if (a.id == NPREFAB_INFO_ID) {
+			if (a.size != sizeof(p->name) || E_ReadStream(stm, p->name, sizeof(p->name)) != sizeof(p->name))
+				goto error;
+			p->name[sizeof(p->name) - 1] = 0x0;
+		} else if (a.id == NPREFAB_COMP_ID) {
+			if (p->compCount == MAX_ENTITY_COMPONENTS || !ReadComponent(stm, a.size, &p->comp[p->compCount++]))
+				goto error;
+		} else if (a.id == NPREFAB_END_ID) {
+			E_SeekStream(stm, -((int64_t)sizeof(a)), IO_SEEK_CUR);
+			break;
+		} else {
+			Sys_LogEntry(PREFAB_MOD, LOG_WARNING, "Unknown section id = 0x%x, size = %d", a.id, a.size);
+			E_SeekStream(stm, a.size, IO_SEEK_CUR);
+		}
+
+		ASSET_CHECK_GUARD(NPREFAB_SEC_FOOTER);
+	}
+
+	ASSET_CHECK_GUARD(NPREFAB_FOOTER);
+
+	return p;
+
+error:
+	Sys_LogEntry(PREFAB_MOD, LOG_CRITICAL, "Failed to load prefab %s", p->name);
+	E_DestroyPrefab(p);
+	return NULL;
+}
+
+bool
+E_SavePrefab(const struct NePrefab *p, struct NeStream *stm)
+{
+	const uint64_t header = NPREFAB_1_HEADER, footer = NPREFAB_FOOTER, secFooter = NPREFAB_SEC_FOOTER;
+	const uint32_t info[2] = { NPREFAB_INFO_ID, sizeof(p->name) };
+
+	bool rc = Write(stm, &header, sizeof(header)) && Write(stm, info, sizeof(info)) &&
+				Write(stm, p->name, sizeof(p->name)) && Write(stm, &secFooter, sizeof(secFooter));
+
+	for (uint32_t i = 0; rc && i < p->compCount; ++i)
+		rc = WriteComponent(stm, &p->comp[i]) && Write(stm, &secFooter, sizeof(secFooter));
+
+	if (rc && Write(stm, &footer, sizeof(footer)))
+		return true;
+
+	Sys_LogEntry(PREFAB_MOD, LOG_CRITICAL, "Failed to save prefab %s", p->name);
+	return false;
+}
+
+void
+E_DestroyPrefab(struct NePrefab *p)
+{
+	if (!p)
+		return;
+
+	for (uint32_t i = 0; i < p->compCount; ++i) {
+		Sys_Free(p->comp[i].data);
+		Sys_Free((void *)p->comp[i].args);
+	}
+
+	Sys_Free(p);
+}
+
+static inline void *
+AllocTemplate(const struct NeCompType *type)
+{
+	return Sys_AlignedAlloc(type->size, 1, type->alignment, MH_Asset);
+}
+
+static bool
+ReadComponent(struct NeStream *stm, uint32_t size, struct NePrefabComp *pc)
+{
+	struct NPrefabComp info;
+
+	if (size < sizeof(info) || E_ReadStream(stm, &info, sizeof(info)) != sizeof(info) ||
+			size != sizeof(info) + (uint64_t)info.dataSize + info.argSize)
+		return false;
+
+	info.type[sizeof(info.type) - 1] = 0x0;
+	pc->type = E_ComponentTypeId(info.type);
+
+	const struct NeCompType *type = ECS_ComponentType(pc->type);
+	if (!type) {
+		Sys_LogEntry(PREFAB_MOD, LOG_CRITICAL, "Component type %s not found", info.type);
+		return false;
+	}
+
+	if (info.dataSize) {
+		// without reflection data, the size is the only check that the layout of the component did not change
+		if (info.dataSize != type->size) {
+			Sys_LogEntry(PREFAB_MOD, LOG_CRITICAL, "Size of component %s does not match: expected %zu, got %u", info.type, type->size, info.dataSize);
+			return false;
+		}
+
+		if (!(pc->data = AllocTemplate(type)) || E_ReadStream(stm, pc->data, info.dataSize) != info.dataSize)
+			return false;
+
+		// the type lost its instantiate function since the prefab was saved
+		if (!ECS_CopyableComponent(type)) {
+			Sys_Free(pc->data);
+			pc->data = NULL;
+		}
+	}
+
+	if (!info.argCount)
+		return !info.argSize;
+
+	const void **args = Sys_Alloc(1, sizeof(*args) * (info.argCount + 1) + info.argSize, MH_Asset);
+	if (!args)
+		return false;
+
+	pc->args = args;
+
+	char *str = (char *)(args + info.argCount + 1);
+	if (!info.argSize || E_ReadStream(stm, str, info.argSize) != info.argSize || str[info.argSize - 1])
+		return false;
+
+	for (uint32_t i = 0; i < info.argCount; ++i) {
+		if (str == (char *)(args + info.argCount + 1) + info.argSize)
+			return false;
+
+		args[i] = str;
+		str += strlen(str) + 1;
+	}
+
+	return true;
+}
+
+static bool
+WriteComponent(struct NeStream *stm, const struct NePrefabComp *pc)
+{
+	const struct NeCompType *type = ECS_ComponentType(pc->type);
+	struct NPrefabComp info = { .dataSize = pc->data ? (uint32_t)type->size : 0 };
+
+	strlcpy(info.type, type->name, sizeof(info.type));
+	for (const void **arg = pc->args; arg && *arg; ++arg, ++info.argCount)
+		info.argSize += (uint32_t)strlen(*arg) + 1;
+
+	const uint32_t sec[2] = { NPREFAB_COMP_ID, (uint32_t)sizeof(info) + info.dataSize + info.argSize };
+	if (!Write(stm, sec, sizeof(sec)) || !Write(stm, &info, sizeof(info)))
+		return false;
+
+	if (info.dataSize && !Write(stm, pc->data, info.dataSize))
+		return false;
+
+	for (const void **arg = pc->args; arg && *arg; ++arg)
+		if (!Write(stm, *arg, strlen(*arg) + 1))
+			return false;
+
+	return true;
+}
+
+/* NekoEngine
+ *
+ * Prefab.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
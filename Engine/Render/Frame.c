@@ -39,6 +39,7 @@ Re_RenderFrame(void)
 void
 Re_RenderScene(struct NeScene *scn, NeHandle camHandle, struct NeRenderGraph *graph, const struct NeTextureDesc *desc, struct NeTexture *target)
 {
+	Scn_UpdateTransforms(scn);
 	E_ExecuteSystemGroupS(scn, ECSYS_GROUP_PRE_RENDER_HASH);
 
 	const struct NeCamera *cam = E_ComponentPtr(camHandle);
@@ -87,7 +87,7 @@ NeDebugBoundsPass_Execute(struct NeDebugBoundsPass *pass, const struct NeArray *
 
 	constants.vertexAddress = Re_BufferAddress(pass->vertexBuffer, 0);
 
-	for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
+	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
 		const struct NeArray *drawables = &Scn_activeScene->collect.opaqueDrawableArrays[i];
 		if (!drawables->count)
 			continue;
@@ -94,7 +94,7 @@ NeDepthPrePass_Execute(struct NeDepthPrePass *pass, const struct NeArray *resour
 
 	Re_CmdBindPipeline(pass->pipeline);
 
-	for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
+	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
 		const uint32_t instanceOffset = Scn_activeScene->collect.instanceOffset[i];
 		const NeArray *drawables = &Scn_activeScene->collect.opaqueDrawableArrays[i];
 
@@ -132,7 +132,7 @@ NeOpaquePass_Execute(struct NeOpaquePass *pass, const struct NeArray *resources)
 	Re_CmdSetViewport(0.f, 0.f, (float)outDesc->width, (float)outDesc->height, 0.f, 1.f);
 	Re_CmdSetScissor(0, 0, outDesc->width, outDesc->height);
 
-	for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
+	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
 		const uint32_t instanceOffset = Scn_activeScene->collect.instanceOffset[i];
 		const struct NeArray *drawables = &Scn_activeScene->collect.opaqueDrawableArrays[i];
 
@@ -75,7 +75,7 @@ NeShadowMap_Execute(struct NeShadowMap *pass, const struct NeArray *resources)
 
 	Re_CmdBindPipeline(pass->pipeline);
 
-	for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
+	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
 		const uint32_t instanceOffset = Scn_activeScene->collect.instanceOffset[i];
 		const NeArray *drawables = &Scn_activeScene->collect.opaqueDrawableArrays[i];
 
@@ -4,6 +4,7 @@
 #include <Render/Systems.h>
 #include <Render/Material.h>
 #include <Render/Components/ModelRender.h>
+#include <Engine/Job.h>
 #include <Engine/Resource.h>
 #include <Engine/ECSystem.h>
 #include <Scene/Transform.h>
@@ -18,7 +19,8 @@ NE_SYSTEM(RE_COLLECT_DRAWABLES, ECSYS_GROUP_MANUAL, 0, false, struct NeCollectDr
 	struct NeModel *mdl = NULL;
 	struct NeMatrix mvp{};
 
-	const uint32_t array = atomic_fetch_add(&args->nextArray, 1);
+	// one set of arrays per thread, including the main thread which may help execute the system
+	const uint32_t array = E_WorkerId();
 	struct NeArray *drawables = &args->opaqueDrawableArrays[array];
 	struct NeArray *blendedDrawables = &args->blendedDrawableArrays[array];
 	struct NeArray *instances = &args->instanceArrays[array];
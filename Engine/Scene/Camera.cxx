@@ -59,7 +59,7 @@ InitCamera(struct NeCamera *cam, const char **args)
 	return true;
 }
 
-NE_SYSTEM(SCN_UPDATE_CAMERA, ECSYS_GROUP_PRE_RENDER, ECSYS_PRI_CAM_VIEW, true, void, 2, NE_TRANSFORM, NE_CAMERA)
+NE_SYSTEM(SCN_UPDATE_CAMERA, ECSYS_GROUP_PRE_RENDER, ECSYS_PRI_CAM_VIEW, true, void, 2, ECSYS_READ(NE_TRANSFORM), NE_CAMERA)
 {
 	struct NeTransform *xform = (struct NeTransform *)comp[0];
 	struct NeCamera *cam = (struct NeCamera *)comp[1];
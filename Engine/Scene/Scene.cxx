@@ -116,7 +116,7 @@ Scn_StartSceneLoad(const char *path)
 	if (E_GetCVarBln("Engine_SingleThreadSceneLoad", false))
 		LoadJob(0, s);
 	else
-		E_ExecuteJob((NeJobProc)LoadJob, s, NULL, NULL);
+		E_ExecuteDependentJob(JP_Background, (NeJobProc)LoadJob, s, NULL, NULL, NULL, NULL);
 
 	return s;
 }
@@ -124,7 +124,7 @@ Scn_StartSceneLoad(const char *path)
 void
 Scn_UnloadScene(struct NeScene *s)
 {
-	for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
+	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
 		Rt_TermArray(&s->collect.instanceArrays[i]);
 		Rt_TermArray(&s->collect.opaqueDrawableArrays[i]);
 		Rt_TermArray(&s->collect.blendedDrawableArrays[i]);
@@ -141,9 +141,12 @@ Scn_UnloadScene(struct NeScene *s)
 
 	Re_Destroy(s->sceneData);
 
+	Scn_TermTransforms(s);
+	E_TermSceneQueries(s);
 	E_TermSceneEntities(s);
 	E_TermSceneComponents(s);
 
+	f_scenes[s->id] = NULL;
 	Sys_Free(s);
 }
 
@@ -178,14 +181,13 @@ Scn_DataAddress(const struct NeScene *s, uint64_t *sceneAddress, uint64_t *insta
 void
 Scn_StartDrawableCollection(struct NeScene *s, const struct NeCamera *c)
 {
-	s->collect.nextArray = 0;
 	M_Store(&s->collect.vp, XMMatrixMultiply(M_Load(&c->viewMatrix), M_Load(&c->projMatrix)));
 	M_FrustumFromVP(&s->collect.camFrustum, &s->collect.vp);
 
 	const struct NeTransform *camXform = (struct NeTransform *)E_GetComponent(c->_owner, NE_TRANSFORM_ID);
 	memcpy(&s->collect.camPos, &camXform->position, sizeof(s->collect.camPos));
 
-	for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
+	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
 		Rt_ClearArray(&s->collect.opaqueDrawableArrays[i], false);
 		Rt_ClearArray(&s->collect.blendedDrawableArrays[i], false);
 		Rt_ClearArray(&s->collect.instanceArrays[i], false);
@@ -196,7 +198,7 @@ Scn_StartDrawableCollection(struct NeScene *s, const struct NeCamera *c)
 
 	uint32_t offset = 0;
 	uint8_t *dst = s->dataPtr + DataOffset(s) + sizeof(struct NeSceneData) + s->lightDataSize;
-	for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
+	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
 		s->collect.instanceOffset[i] = offset;
 		offset += (uint32_t)s->collect.instanceArrays[i].count;
 
@@ -273,9 +275,24 @@ Scn_StartDataUpdate(struct NeScene *s, const struct NeCamera *c)
 void
 Scn_Commit(struct NeScene *scn)
 {
+	ECS_ExecuteCommands(scn);
+
 	Sys_AtomicLockWrite(&scn->lock.comp);
 	Sys_AtomicLockWrite(&scn->lock.newComp);
 
+	// before the components are committed, the creation events hold pointers to them
+	if (ECS_compactionBudget)
+		ECS_CompactStorage(scn, ECS_compactionBudget);
+
+	ECS_SyncQueries(scn);
+
+	if (scn->archetypeStorage)
+		ECS_CommitArchetypes(scn);
+
+	ECS_CommitChanges(scn);
+	ECS_CommitSlices(scn);
+	Scn_CommitTransforms(scn);
+
 	for (size_t i = 0; i < scn->compData.count; ++i) {
 		struct NeArray *c = (struct NeArray *)Rt_ArrayGet(&scn->compData, i);
 		struct NeArray *nc = (struct NeArray *)Rt_ArrayGet(&scn->newCompData, i);
@@ -283,21 +300,62 @@ Scn_Commit(struct NeScene *scn)
 		if (!nc->count)
 			continue;
 
-		Rt_ResizeArray(c, c->size + nc->count);
+		if (!scn->archetypeStorage)
+			Rt_ResizeArray(c, c->size + nc->count);
+
+		// the components of each type are announced in one event
+		struct NeComponentCreationData *created = (struct NeComponentCreationData *)Sys_Alloc(sizeof(*created), nc->count, MH_Frame);
+		uint32_t createdCount = 0;
 
 		for (size_t j = 0; j < nc->count; ++j) {
 			struct NeCompBase *comp = (struct NeCompBase *)Rt_ArrayGet(nc, j);
-			if (comp->_handleId >= c->count)
-				Rt_ArrayAdd(c, comp);
-			else
-				Rt_ArrayInsert(c, comp, comp->_handleId);
-
-			struct NeComponentCreationData *ccd = (struct NeComponentCreationData *)Sys_Alloc(sizeof(*ccd), 1, MH_Frame);
-			ccd->type = comp->_typeId;
-			ccd->handle = comp->_handleId | (uint64_t)comp->_typeId << 32;
-			ccd->owner = comp->_owner;
-			ccd->ptr = Rt_ArrayGet(c, comp->_handleId);
-			E_Broadcast(EVT_COMPONENT_CREATED, ccd);
+			const NeCompHandle handle = comp->_handleId | (uint64_t)comp->_typeId << 32;
+
+			// the slot table covers every id handed out; an id taken from the free list is written over its old slot,
+			// unless compaction released it, then the component is appended
+			uint32_t *slot = nullptr;
+			if (!scn->archetypeStorage) {
+				slot = ECS_GrowSlots(scn, i, comp->_handleId);
+				if (slot && comp->_valid) {
+					if (*slot == ECS_INVALID_SLOT)
+						*slot = (uint32_t)c->count++;
+					memcpy(Rt_ArrayGet(c, *slot), comp, c->elemSize);
+				}
+			}
+
+			// destroyed before it was committed
+			if (!comp->_valid)
+				continue;
+
+			void *ptr = scn->archetypeStorage ? ECS_ArchetypeComponentPtr(scn, handle) : (slot ? Rt_ArrayGet(c, *slot) : nullptr);
+			if (!ptr)
+				continue;
+
+			ECS_ComponentCreated(scn, handle);
+
+			if (created) {
+				struct NeComponentCreationData *ccd = &created[createdCount++];
+				ccd->type = comp->_typeId;
+				ccd->handle = handle;
+				ccd->owner = comp->_owner;
+				ccd->ptr = ptr;
+			}
+
+			struct NeEntity *owner = ECS_EntityPtr(comp->_owner);
+			if (owner && !scn->archetypeStorage)
+				ECS_QueryComponentAdded(scn, owner, i);
+		}
+
+		if (createdCount)
+			E_ComponentOrderChangedS(scn, i);
+
+		struct NeComponentCreationBatch *batch = createdCount ?
+			(struct NeComponentCreationBatch *)Sys_Alloc(sizeof(*batch), 1, MH_Frame) : nullptr;
+		if (batch) {
+			batch->type = i;
+			batch->count = createdCount;
+			batch->components = created;
+			E_Broadcast(EVT_COMPONENTS_CREATED, batch);
 		}
 
 		Rt_ClearArray(nc, false);
@@ -308,6 +366,9 @@ Scn_Commit(struct NeScene *scn)
 	Sys_AtomicUnlockWrite(&scn->lock.newComp);
 	Sys_AtomicUnlockWrite(&scn->lock.comp);
 
+	ECS_ExecuteParentCommands(scn);
+	ECS_ReleaseEntityNames(scn);
+
 	if (!scn->newEntities.count)
 		return;
 
@@ -317,8 +378,10 @@ Scn_Commit(struct NeScene *scn)
 	Rt_ResizeArray(&scn->entities, scn->entities.size + scn->newEntities.count);
 
 	NeEntity *ent;
-	Rt_ArrayForEachPtr(ent, &scn->newEntities, NeEntity *)
+	Rt_ArrayForEachPtr(ent, &scn->newEntities, NeEntity *) {
+		ent->id = scn->entities.count;
 		Rt_ArrayAddPtr(&scn->entities, ent);
+	}
 
 	Rt_ClearArray(&scn->newEntities, false);
 
@@ -342,7 +405,9 @@ InitScene(struct NeScene *s)
 	Sys_InitAtomicLock(&s->lock.entity);
 	Sys_InitAtomicLock(&s->lock.newEntity);
 
-	if (!E_InitSceneComponents(s) || !E_InitSceneEntities(s))
+	s->archetypeStorage = E_GetCVarBln("Engine_ArchetypeStorage", false)->bln;
+
+	if (!E_InitSceneComponents(s) || !E_InitSceneEntities(s) || !E_InitSceneQueries(s))
 		goto error;
 
 	s->lightDataSize = NE_ROUND_UP(sizeof(struct NeLightData) * s->maxLights, 16);
@@ -363,23 +428,23 @@ InitScene(struct NeScene *s)
 	if (!s->dataPtr)
 		goto error;
 
-	s->collect.opaqueDrawableArrays = (struct NeArray *)Sys_Alloc(E_JobWorkerThreads(), sizeof(struct NeArray), MH_Scene);
+	s->collect.opaqueDrawableArrays = (struct NeArray *)Sys_Alloc(E_JobWorkerThreads() + 1, sizeof(struct NeArray), MH_Scene);
 	if (!s->collect.opaqueDrawableArrays)
 		goto error;
 
-	s->collect.blendedDrawableArrays = (struct NeArray *)Sys_Alloc(E_JobWorkerThreads(), sizeof(struct NeArray), MH_Scene);
+	s->collect.blendedDrawableArrays = (struct NeArray *)Sys_Alloc(E_JobWorkerThreads() + 1, sizeof(struct NeArray), MH_Scene);
 	if (!s->collect.blendedDrawableArrays)
 		goto error;
 
-	s->collect.instanceArrays = (struct NeArray *)Sys_Alloc(E_JobWorkerThreads(), sizeof(struct NeArray), MH_Scene);
+	s->collect.instanceArrays = (struct NeArray *)Sys_Alloc(E_JobWorkerThreads() + 1, sizeof(struct NeArray), MH_Scene);
 	if (!s->collect.instanceArrays)
 		goto error;
 
-	s->collect.instanceOffset = (uint32_t *)Sys_Alloc(E_JobWorkerThreads(), sizeof(uint32_t), MH_Scene);
+	s->collect.instanceOffset = (uint32_t *)Sys_Alloc(E_JobWorkerThreads() + 1, sizeof(uint32_t), MH_Scene);
 	if (!s->collect.instanceOffset)
 		goto error;
 
-	for (uint32_t i = 0; i < E_JobWorkerThreads(); ++i) {
+	for (uint32_t i = 0; i < E_JobWorkerThreads() + 1; ++i) {
 		if (!Rt_InitArray(&s->collect.opaqueDrawableArrays[i], 10, sizeof(struct NeDrawable), MH_Scene))
 			goto error;
 
@@ -403,6 +468,7 @@ error:
 	if (s->sceneData)
 		Re_Destroy(s->sceneData);
 
+	E_TermSceneQueries(s);
 	E_TermSceneEntities(s);
 	E_TermSceneComponents(s);
 
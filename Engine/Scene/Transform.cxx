@@ -1,17 +1,131 @@
 #include <Scene/Scene.h>
-#include <Scene/Systems.h>
+#include <Engine/Job.h>
 #include <Engine/Entity.h>
-#include <Engine/ECSystem.h>
+#include <Engine/Prefab.h>
+#include <System/Log.h>
+#include <System/Memory.h>
 #include <Scene/Transform.h>
 #include <Scene/Components.h>
 
+#define XFORM_MOD		"Transform"
+#define XFORM_GRAIN		256
+#define XFORM_ROOT		UINT32_MAX
+
+/*
+ * The transforms of a scene are kept in one node array per depth, so every parent is computed before its children;
+ * the nodes of a level are split across the job workers. Destroying or reparenting a transform queues it in the
+ * pending list of its scene and Scn_Commit adds the transforms it commits; the commit moves the queue to the change
+ * list and bumps the version, and the next update moves only the queued subtrees. Removed nodes are left in their
+ * level, with an invalid handle, until half of the level is removed.
+ */
+struct NeTransformNode
+{
+	NeCompHandle handle;
+	uint32_t parent;
+	bool changed, placed;
+	struct NeTransform *xform;
+};
+
+struct NeTransformDepth
+{
+	struct NeArray nodes;
+	uint32_t removed;
+};
+
+struct NeTransformPlace
+{
+	uint32_t level, node;
+};
+
+struct NeTransformChange
+{
+	NeCompHandle handle;
+	bool destroyed;
+};
+
+struct NeTransformInsert
+{
+	NeCompHandle handle;
+	uint32_t level, parent;
+};
+
+struct NeTransformHierarchy
+{
+	uint32_t version, built;
+	bool rebuild, lost;
+	struct NeArray levels, place, pending, changes;
+	struct NeArray insert, remove, remap;
+	struct NeAtomicLock lock;
+};
+
+struct NeTransformLevel
+{
+	struct NeScene *s;
+	struct NeTransformNode *nodes;
+	const struct NeTransformNode *parents;
+};
+
+struct NeTransformRoots
+{
+	struct NeScene *s;
+	struct NeTransformHierarchy *h;
+	bool ok;
+};
+
 static bool InitTransform(struct NeTransform *xform, const char **args);
 static void TermTransform(struct NeTransform *xform);
+static bool InstantiateTransform(struct NeTransform *xform, const struct NePrefabTransform *pt);
+static bool TemplateTransform(struct NeTransform *xform, const char **args);
+static bool ReadTransform(struct NeTransform *xform, const char **args, struct NeScene *s);
+static uint64_t TransformSortKey(struct NeScene *s, const struct NeTransform *xform);
+static void QueueChange(struct NeTransformHierarchy *h, NeCompHandle handle, bool destroyed);
+static bool BuildHierarchy(struct NeScene *s, struct NeTransformHierarchy *h);
+static bool ApplyChanges(struct NeScene *s, struct NeTransformHierarchy *h);
+static bool AddRoot(struct NeTransform *xform, struct NeTransformRoots *r);
+static bool PlaceSubtree(struct NeScene *s, struct NeTransformHierarchy *h, NeCompHandle handle);
+static bool InsertSubtree(struct NeScene *s, struct NeTransformHierarchy *h, NeCompHandle handle, uint32_t level, uint32_t parent);
+static bool RemoveSubtree(struct NeScene *s, struct NeTransformHierarchy *h, NeCompHandle handle);
+static bool CompactLevel(struct NeTransformHierarchy *h, uint32_t level);
+static void UpdateLevel(int worker, uint64_t begin, uint64_t end, const struct NeTransformLevel *l);
+static inline XMMATRIX LocalMatrix(const struct NeTransform *t);
+static inline struct NeTransform *TransformPtr(struct NeScene *s, NeCompHandle handle);
+static inline bool IsAncestor(struct NeScene *s, const struct NeTransform *xform, const struct NeTransform *of);
+static inline struct NeTransformPlace *PlaceOf(struct NeTransformHierarchy *h, NeCompHandle handle);
+static inline struct NeTransformNode *NodeAt(struct NeTransformHierarchy *h, const struct NeTransformPlace *p);
 
 NE_REGISTER_COMPONENT(NE_TRANSFORM, struct NeTransform, 16, InitTransform, nullptr, TermTransform)
 
+NE_INITIALIZER(NeCompInstantiate_Transform)
+{
+	E_SetComponentInstantiateProc(NE_TRANSFORM_ID, (NeCompInstantiateProc)InstantiateTransform);
+	E_SetComponentTemplateProc(NE_TRANSFORM_ID, (NeCompInitProc)TemplateTransform);
+	E_SetComponentSortProc(NE_TRANSFORM_ID, (NeCompSortKeyProc)TransformSortKey);
+}
+
 static bool
 InitTransform(struct NeTransform *xform, const char **args)
+{
+	return ReadTransform(xform, args, Scn_GetScene((uint8_t)xform->_sceneId)) &&
+		Rt_InitArray(&xform->children, 2, sizeof(NeCompHandle), MH_Scene);
+}
+
+static bool
+TemplateTransform(struct NeTransform *xform, const char **args)
+{
+	return ReadTransform(xform, args, nullptr);
+}
+
+// Transforms are stored in the order of the hierarchy: by depth, then by node, so the children of a parent are next
+// to each other; the ones that are not placed yet go last
+static uint64_t
+TransformSortKey(struct NeScene *s, const struct NeTransform *xform)
+{
+	const struct NeTransformPlace *p = s->transforms ? PlaceOf(s->transforms, E_ComponentHandle(xform)) : nullptr;
+	return p ? (uint64_t)p->level << 32 | p->node : UINT64_MAX;
+}
+
+static bool
+ReadTransform(struct NeTransform *xform, const char **args, struct NeScene *s)
 {
 	xform->position.x = xform->position.y = xform->position.z = 0.f;
 	xform->scale.x = xform->scale.y = xform->scale.z = 1.f;
@@ -30,13 +144,17 @@ InitTransform(struct NeTransform *xform, const char **args)
 		const size_t len = strlen(arg);
 
 		if (!strncmp(arg, "Parent", len)) {
-			struct NeScene *s = Scn_GetScene((uint8_t)xform->_sceneId);
+			// templates are not part of a scene
+			if (!s) {
+				++args;
+				continue;
+			}
 
 			NeEntityHandle parent = E_FindEntityS(s, (char *)*(++args));
 			xform->parent = E_GetComponentHandle(parent, NE_TRANSFORM_ID);
 
 			struct NeTransform *parentPtr = (struct NeTransform *)E_ComponentPtrS(s, xform->parent);
-			const NeCompHandle self = xform->_handleId;
+			const NeCompHandle self = E_ComponentHandle(xform);
 			Rt_ArrayAdd(&parentPtr->children, &self);
 		} else if (!strncmp(arg, "Position", len)) {
 			char *ptr = (char *)*(++args);
@@ -63,23 +181,543 @@ InitTransform(struct NeTransform *xform, const char **args)
 		}
 	}
 
-	Rt_InitArray(&xform->children, 2, sizeof(NeCompHandle), MH_Scene);
-
 	return true;
 }
 
 static void
 TermTransform(struct NeTransform *xform)
 {
+	struct NeScene *s = xform->_owner ? Scn_GetScene((uint8_t)xform->_sceneId) : nullptr;
+	const NeCompHandle handle = E_ComponentHandle(xform);
+
+	// a transform that was never placed in a scene (e.g. a prefab template) has no handle to detach or remove
+	if (!s || E_ComponentPtrS(s, handle) != xform) {
+		Rt_TermArray(&xform->children);
+		return;
+	}
+
+	// the slot can be reused before the next commit, so the handle must not be left in the parent or the children
+	struct NeTransform *parent = TransformPtr(s, xform->parent);
+	if (parent) {
+		const size_t id = Rt_ArrayFindId(&parent->children, &handle, Rt_U64CmpFunc);
+		if (id != RT_NOT_FOUND)
+			Rt_ArrayRemove(&parent->children, id);
+	}
+
+	for (size_t i = 0; i < xform->children.count; ++i) {
+		const NeCompHandle child = *(const NeCompHandle *)Rt_ArrayGet(&xform->children, i);
+		struct NeTransform *c = TransformPtr(s, child);
+		if (!c || c->parent != handle)
+			continue;
+
+		// the children become roots
+		c->parent = NE_INVALID_HANDLE;
+		c->dirty = true;
+
+		if (s->transforms)
+			QueueChange(s->transforms, child, false);
+	}
+
+	// transforms are added to the hierarchy when they are committed, but removed when they are destroyed
+	if (s->transforms)
+		QueueChange(s->transforms, handle, true);
+
 	Rt_TermArray(&xform->children);
 }
 
-NE_SYSTEM(SCN_UPDATE_TRANSFORM, ECSYS_GROUP_PRE_RENDER, ECSYS_PRI_TRANSFORM, false, void, 1, NE_TRANSFORM)
+static bool
+InstantiateTransform(struct NeTransform *xform, const struct NePrefabTransform *pt)
+{
+	// the hierarchy of the template is not copied
+	xform->parent = NE_INVALID_HANDLE;
+	xform->dirty = true;
+
+	if (pt) {
+		xform->position = pt->position;
+		xform->rotation = pt->rotation;
+		xform->scale = pt->scale;
+		Xform_UpdateOrientation(xform);
+	}
+
+	return Rt_InitArray(&xform->children, 2, sizeof(NeCompHandle), MH_Scene);
+}
+
+bool
+Scn_SetParent(struct NeScene *scn, NeEntityHandle child, NeEntityHandle parent)
+{
+	const NeCompHandle handle = E_GetComponentHandle(child, NE_TRANSFORM_ID);
+	struct NeTransform *xform = (struct NeTransform *)E_ComponentPtrS(scn, handle);
+	if (!xform)
+		return false;
+
+	const NeCompHandle parentHandle = parent ? E_GetComponentHandle(parent, NE_TRANSFORM_ID) : NE_INVALID_HANDLE;
+	struct NeTransform *parentPtr = (struct NeTransform *)E_ComponentPtrS(scn, parentHandle);
+	if ((parent && !parentPtr) || IsAncestor(scn, xform, parentPtr))
+		return false;
+
+	struct NeTransform *oldParent = (struct NeTransform *)E_ComponentPtrS(scn, xform->parent);
+	if (oldParent) {
+		const size_t id = Rt_ArrayFindId(&oldParent->children, &handle, Rt_U64CmpFunc);
+		if (id != RT_NOT_FOUND)
+			Rt_ArrayRemove(&oldParent->children, id);
+	}
+
+	xform->parent = parentHandle;
+	Xform_MarkDirty(xform);
+
+	if (scn->transforms)
+		QueueChange(scn->transforms, handle, false);
+
+	return !parentPtr || Rt_ArrayAdd(&parentPtr->children, &handle);
+}
+
+bool
+Scn_CanSetParent(struct NeScene *scn, NeEntityHandle child, NeEntityHandle parent)
+{
+	if (!parent)
+		return true;
+
+	const struct NeTransform *xform = TransformPtr(scn, E_GetComponentHandle(child, NE_TRANSFORM_ID));
+	const struct NeTransform *parentPtr = TransformPtr(scn, E_GetComponentHandle(parent, NE_TRANSFORM_ID));
+
+	return xform && parentPtr && !IsAncestor(scn, xform, parentPtr);
+}
+
+void
+Scn_CommitTransforms(struct NeScene *s)
+{
+	struct NeTransformHierarchy *h = s->transforms;
+	if (!h) {
+		h = (struct NeTransformHierarchy *)Sys_Alloc(sizeof(*h), 1, MH_Scene);
+		if (!h)
+			return;
+
+		Sys_InitAtomicLock(&h->lock);
+		h->version = 1;
+		h->built = 0;
+		h->rebuild = true;
+		h->lost = false;
+
+		if (!Rt_InitArray(&h->levels, 8, sizeof(struct NeTransformDepth), MH_Scene) ||
+				!Rt_InitArray(&h->place, 64, sizeof(struct NeTransformPlace), MH_Scene) ||
+				!Rt_InitArray(&h->pending, 16, sizeof(struct NeTransformChange), MH_Scene) ||
+				!Rt_InitArray(&h->changes, 16, sizeof(struct NeTransformChange), MH_Scene) ||
+				!Rt_InitArray(&h->insert, 16, sizeof(struct NeTransformInsert), MH_Scene) ||
+				!Rt_InitArray(&h->remove, 16, sizeof(NeCompHandle), MH_Scene) ||
+				!Rt_InitArray(&h->remap, 64, sizeof(uint32_t), MH_Scene)) {
+			Sys_LogEntry(XFORM_MOD, LOG_CRITICAL, "Failed to allocate the transform hierarchy of scene %s", s->name);
+			s->transforms = h;
+			Scn_TermTransforms(s);
+			return;
+		}
+
+		// the first update builds the hierarchy from the committed transforms
+		s->transforms = h;
+		return;
+	}
+
+	const struct NeArray *nc = (const struct NeArray *)Rt_ArrayGet(&s->newCompData, NE_TRANSFORM_ID);
+
+	Sys_AtomicLockWrite(&h->lock);
+
+	bool changed = h->pending.count || h->lost;
+	if (!Rt_ArrayAddArray(&h->changes, &h->pending))
+		h->lost = true;
+	Rt_ClearArray(&h->pending, false);
+
+	for (size_t i = 0; nc && i < nc->count; ++i) {
+		const struct NeCompBase *comp = (const struct NeCompBase *)Rt_ArrayGet(nc, i);
+		if (!comp->_valid)
+			continue;
+
+		const struct NeTransformChange c = { comp->_handleId | (uint64_t)comp->_typeId << 32, false };
+		if (!Rt_ArrayAdd(&h->changes, &c))
+			h->lost = true;
+		changed = true;
+	}
+
+	// a change that could not be queued is only picked up by building the hierarchy again
+	if (h->lost) {
+		h->rebuild = true;
+		h->lost = false;
+	}
+
+	Sys_AtomicUnlockWrite(&h->lock);
+
+	// the places of the transforms, which they are sorted by, change with the next update
+	if (changed) {
+		++h->version;
+		E_ComponentOrderChangedS(s, NE_TRANSFORM_ID);
+	}
+}
+
+void
+Scn_UpdateTransforms(struct NeScene *s)
+{
+	struct NeTransformHierarchy *h = s->transforms;
+	if (!h)
+		return;
+
+	Sys_AtomicLockRead(&s->lock.comp);
+
+	// changes made after the last commit are applied after the next one
+	if (h->built != h->version) {
+		bool done = !h->rebuild && ApplyChanges(s, h);
+		if (!done)
+			done = BuildHierarchy(s, h);
+
+		if (done) {
+			Rt_ClearArray(&h->changes, false);
+			h->built = h->version;
+			h->rebuild = false;
+		} else {
+			Sys_LogEntry(XFORM_MOD, LOG_CRITICAL, "Failed to build the transform hierarchy of scene %s", s->name);
+			h->rebuild = true;
+		}
+	}
+
+	const struct NeTransformDepth *levels = (const struct NeTransformDepth *)h->levels.data;
+	for (size_t i = 0; i < h->levels.count; ++i) {
+		const struct NeTransformLevel l =
+		{
+			s,
+			(struct NeTransformNode *)levels[i].nodes.data,
+			i ? (const struct NeTransformNode *)levels[i - 1].nodes.data : nullptr
+		};
+		E_ParallelFor(0, levels[i].nodes.count, XFORM_GRAIN, (NeParallelForProc)UpdateLevel, (void *)&l);
+	}
+
+	Sys_AtomicUnlockRead(&s->lock.comp);
+}
+
+void
+Scn_TermTransforms(struct NeScene *s)
+{
+	struct NeTransformHierarchy *h = s->transforms;
+	if (!h)
+		return;
+
+	for (size_t i = 0; i < h->levels.count; ++i)
+		Rt_TermArray(&((struct NeTransformDepth *)Rt_ArrayGet(&h->levels, i))->nodes);
+
+	Rt_TermArray(&h->levels);
+	Rt_TermArray(&h->place);
+	Rt_TermArray(&h->pending);
+	Rt_TermArray(&h->changes);
+	Rt_TermArray(&h->insert);
+	Rt_TermArray(&h->remove);
+	Rt_TermArray(&h->remap);
+	Sys_Free(h);
+
+	s->transforms = NULL;
+}
+
+static void
+QueueChange(struct NeTransformHierarchy *h, NeCompHandle handle, bool destroyed)
+{
+	const struct NeTransformChange c = { handle, destroyed };
+
+	Sys_AtomicLockWrite(&h->lock);
+	if (!Rt_ArrayAdd(&h->pending, &c))
+		h->lost = true;
+	Sys_AtomicUnlockWrite(&h->lock);
+}
+
+static bool
+BuildHierarchy(struct NeScene *s, struct NeTransformHierarchy *h)
+{
+	struct NeTransformRoots r = { s, h, true };
+
+	for (size_t i = 0; i < h->levels.count; ++i) {
+		struct NeTransformDepth *d = (struct NeTransformDepth *)Rt_ArrayGet(&h->levels, i);
+		Rt_ClearArray(&d->nodes, false);
+		d->removed = 0;
+	}
+
+	// a handle past the end of the array is not placed
+	Rt_ClearArray(&h->place, false);
+
+	// transforms in a parent cycle are never reached
+	E_ForEachComponentS(s, NE_TRANSFORM_ID, (NeCompIteratorProc)AddRoot, &r);
+	return r.ok;
+}
+
+static bool
+ApplyChanges(struct NeScene *s, struct NeTransformHierarchy *h)
+{
+	const struct NeTransformChange *c = (const struct NeTransformChange *)h->changes.data;
+
+	// the children of a destroyed transform are queued after it, so its node is removed alone
+	for (size_t i = 0; i < h->changes.count; ++i) {
+		struct NeTransformPlace *p = c[i].destroyed ? PlaceOf(h, c[i].handle) : nullptr;
+		if (!p)
+			continue;
+
+		NodeAt(h, p)->handle = NE_INVALID_HANDLE;
+		++((struct NeTransformDepth *)Rt_ArrayGet(&h->levels, p->level))->removed;
+		p->level = XFORM_ROOT;
+	}
+
+	for (size_t i = 0; i < h->changes.count; ++i)
+		if (!c[i].destroyed && !PlaceSubtree(s, h, c[i].handle))
+			return false;
+
+	for (uint32_t i = 0; i < h->levels.count; ++i) {
+		const struct NeTransformDepth *d = (const struct NeTransformDepth *)Rt_ArrayGet(&h->levels, i);
+		if (d->removed && d->removed * 2 >= d->nodes.count && !CompactLevel(h, i))
+			return false;
+	}
+
+	return true;
+}
+
+static bool
+AddRoot(struct NeTransform *xform, struct NeTransformRoots *r)
+{
+	// transforms whose parent was destroyed are roots too
+	if (xform->parent != NE_INVALID_HANDLE && TransformPtr(r->s, xform->parent))
+		return true;
+
+	r->ok = InsertSubtree(r->s, r->h, E_ComponentHandle(xform), 0, XFORM_ROOT);
+	return r->ok;
+}
+
+static bool
+PlaceSubtree(struct NeScene *s, struct NeTransformHierarchy *h, NeCompHandle handle)
+{
+	const struct NeTransform *xform = TransformPtr(s, handle);
+	if (!xform)
+		return true;
+
+	uint32_t level = 0, parent = XFORM_ROOT;
+	if (TransformPtr(s, xform->parent)) {
+		// the subtree is placed with its parent
+		const struct NeTransformPlace *pp = PlaceOf(h, xform->parent);
+		if (!pp)
+			return RemoveSubtree(s, h, handle);
+
+		level = pp->level + 1;
+		parent = pp->node;
+	}
+
+	const struct NeTransformPlace *p = PlaceOf(h, handle);
+	if (p && p->level == level && NodeAt(h, p)->parent == parent)
+		return true;
+
+	return RemoveSubtree(s, h, handle) && InsertSubtree(s, h, handle, level, parent);
+}
+
+static bool
+InsertSubtree(struct NeScene *s, struct NeTransformHierarchy *h, NeCompHandle handle, uint32_t level, uint32_t parent)
+{
+	const struct NeTransformInsert root = { handle, level, parent };
+
+	Rt_ClearArray(&h->insert, false);
+	if (!Rt_ArrayAdd(&h->insert, &root))
+		return false;
+
+	for (size_t i = 0; i < h->insert.count; ++i) {
+		const struct NeTransformInsert in = *(const struct NeTransformInsert *)Rt_ArrayGet(&h->insert, i);
+		const struct NeTransform *xform = TransformPtr(s, in.handle);
+
+		while (h->levels.count <= in.level) {
+			struct NeTransformDepth d = { {}, 0 };
+			if (!Rt_InitArray(&d.nodes, 64, sizeof(struct NeTransformNode), MH_Scene) || !Rt_ArrayAdd(&h->levels, &d)) {
+				Rt_TermArray(&d.nodes);
+				return false;
+			}
+		}
+
+		const size_t id = E_HANDLE_ID(in.handle);
+		if (h->place.count <= id) {
+			const size_t count = h->place.count;
+			if (h->place.size <= id && !Rt_ResizeArray(&h->place, id < h->place.size * 2 ? h->place.size * 2 : id + 1))
+				return false;
+
+			memset(h->place.data + count * h->place.elemSize, 0xFF, (id + 1 - count) * h->place.elemSize);
+			h->place.count = id + 1;
+		}
+
+		struct NeTransformDepth *d = (struct NeTransformDepth *)Rt_ArrayGet(&h->levels, in.level);
+		const struct NeTransformNode node = { in.handle, in.parent, false, true, nullptr };
+		if (!Rt_ArrayAdd(&d->nodes, &node))
+			return false;
+
+		const struct NeTransformPlace place = { in.level, (uint32_t)d->nodes.count - 1 };
+		*(struct NeTransformPlace *)Rt_ArrayGet(&h->place, id) = place;
+
+		for (size_t j = 0; j < xform->children.count; ++j) {
+			const NeCompHandle child = *(const NeCompHandle *)Rt_ArrayGet(&xform->children, j);
+			const struct NeTransform *c = TransformPtr(s, child);
+			if (!c || c->parent != in.handle)
+				continue;
+
+			// a child that was not moved yet is still placed under its previous parent
+			if (PlaceOf(h, child) && !RemoveSubtree(s, h, child))
+				return false;
+
+			const struct NeTransformInsert next = { child, in.level + 1, place.node };
+			if (!Rt_ArrayAdd(&h->insert, &next))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+RemoveSubtree(struct NeScene *s, struct NeTransformHierarchy *h, NeCompHandle handle)
+{
+	Rt_ClearArray(&h->remove, false);
+	if (!Rt_ArrayAdd(&h->remove, &handle))
+		return false;
+
+	for (size_t i = 0; i < h->remove.count; ++i) {
+		const NeCompHandle next = *(const NeCompHandle *)Rt_ArrayGet(&h->remove, i);
+		struct NeTransformPlace *pp = PlaceOf(h, next);
+		if (!pp)
+			continue;
+
+		const struct NeTransformPlace p = *pp;
+		NodeAt(h, &p)->handle = NE_INVALID_HANDLE;
+		++((struct NeTransformDepth *)Rt_ArrayGet(&h->levels, p.level))->removed;
+		pp->level = XFORM_ROOT;
+
+		const struct NeTransform *xform = TransformPtr(s, next);
+		for (size_t j = 0; xform && j < xform->children.count; ++j) {
+			const NeCompHandle child = *(const NeCompHandle *)Rt_ArrayGet(&xform->children, j);
+			const struct NeTransformPlace *cp = PlaceOf(h, child);
+			if (cp && cp->level == p.level + 1 && NodeAt(h, cp)->parent == p.node && !Rt_ArrayAdd(&h->remove, &child))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+CompactLevel(struct NeTransformHierarchy *h, uint32_t level)
+{
+	struct NeTransformDepth *d = (struct NeTransformDepth *)Rt_ArrayGet(&h->levels, level);
+	struct NeTransformNode *nodes = (struct NeTransformNode *)d->nodes.data;
+
+	if (!Rt_ResizeArray(&h->remap, d->nodes.count))
+		return false;
+
+	uint32_t *remap = (uint32_t *)h->remap.data;
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < d->nodes.count; ++i) {
+		if (nodes[i].handle == NE_INVALID_HANDLE) {
+			remap[i] = XFORM_ROOT;
+			continue;
+		}
+
+		remap[i] = count;
+		nodes[count] = nodes[i];
+		PlaceOf(h, nodes[count].handle)->node = count;
+		++count;
+	}
+
+	d->nodes.count = count;
+	d->removed = 0;
+
+	// a child of a removed node that was not moved is left as a root
+	if (level + 1 < h->levels.count) {
+		struct NeTransformDepth *cd = (struct NeTransformDepth *)Rt_ArrayGet(&h->levels, level + 1);
+		struct NeTransformNode *children = (struct NeTransformNode *)cd->nodes.data;
+		for (size_t i = 0; i < cd->nodes.count; ++i)
+			if (children[i].parent != XFORM_ROOT)
+				children[i].parent = remap[children[i].parent];
+	}
+
+	return true;
+}
+
+static void
+UpdateLevel(int worker, uint64_t begin, uint64_t end, const struct NeTransformLevel *l)
+{
+	for (uint64_t i = begin; i < end; ++i) {
+		struct NeTransformNode *n = &l->nodes[i];
+		const struct NeTransformNode *parent = n->parent != XFORM_ROOT ? &l->parents[n->parent] : nullptr;
+		struct NeTransform *t = TransformPtr(l->s, n->handle);
+
+		n->xform = t;
+		n->changed = false;
+
+		// the roots are always computed, the children when they or one of their parents moved or when they were
+		// placed; a transform destroyed after the commit keeps its node, and its children, until the next one
+		if (!t || (parent && (!parent->xform || !(n->placed || t->dirty || parent->changed))))
+			continue;
+
+		XMMATRIX mat = LocalMatrix(t);
+		if (parent)
+			mat = XMMatrixMultiply(mat, M_Load(&parent->xform->mat));
+
+		struct NeMatrix world;
+		M_Store(&world, mat);
+
+		// only the transforms whose matrix changed are marked, and only their children are computed
+		n->changed = memcmp(&world, &t->mat, sizeof(world)) != 0;
+		if (n->changed) {
+			t->mat = world;
+
+			// children are updated with their parent without being marked dirty
+			if (!t->dirty)
+				E_MarkComponentChangedS(l->s, n->handle);
+		}
+
+		n->placed = false;
+		t->dirty = false;
+	}
+}
+
+static inline struct NeTransformPlace *
+PlaceOf(struct NeTransformHierarchy *h, NeCompHandle handle)
+{
+	const size_t id = E_HANDLE_ID(handle);
+	if (handle == NE_INVALID_HANDLE || id >= h->place.count)
+		return nullptr;
+
+	struct NeTransformPlace *p = (struct NeTransformPlace *)Rt_ArrayGet(&h->place, id);
+	return p->level != XFORM_ROOT ? p : nullptr;
+}
+
+static inline struct NeTransformNode *
+NodeAt(struct NeTransformHierarchy *h, const struct NeTransformPlace *p)
+{
+	const struct NeTransformDepth *d = (const struct NeTransformDepth *)Rt_ArrayGet(&h->levels, p->level);
+	return (struct NeTransformNode *)Rt_ArrayGet(&d->nodes, p->node);
+}
+
+static inline XMMATRIX
+LocalMatrix(const struct NeTransform *t)
+{
+	// scale * rotation * translation: the rotation rows are scaled and the translation is the last row
+	XMMATRIX mat = XMMatrixRotationQuaternion(M_Load(&t->rotation));
+	mat.r[0] = XMVectorScale(mat.r[0], t->scale.x);
+	mat.r[1] = XMVectorScale(mat.r[1], t->scale.y);
+	mat.r[2] = XMVectorScale(mat.r[2], t->scale.z);
+	mat.r[3] = XMVectorSet(t->position.x, t->position.y, t->position.z, 1.f);
+	return mat;
+}
+
+static inline bool
+IsAncestor(struct NeScene *s, const struct NeTransform *xform, const struct NeTransform *of)
+{
+	// attaching xform to one of its descendants would make a cycle that the hierarchy never reaches
+	for (const struct NeTransform *t = of; t; t = TransformPtr(s, t->parent))
+		if (t == xform)
+			return true;
+
+	return false;
+}
+
+static inline struct NeTransform *
+TransformPtr(struct NeScene *s, NeCompHandle handle)
 {
-	struct NeTransform *xform = (struct NeTransform *)comp[0];
-	
-	if (xform->parent == NE_INVALID_HANDLE)
-		Xform_Update(xform);
+	// the slot of a destroyed component stays addressable until it is reused
+	struct NeTransform *t = (struct NeTransform *)E_ComponentPtrS(s, handle);
+	return t && t->_valid ? t : nullptr;
 }
 
 /* NekoEngine
@@ -21,6 +21,10 @@ SIF_NUMBER(DeltaTime, (float)E_deltaTime);
 SIF_INTEGER(WorkerId, E_WorkerId());
 SIF_NUMBER(Time, (float)E_Time());
 SIF_INTEGER(JobWorkerThreads, E_JobWorkerThreads());
+SIF_INTEGER(JobQueueDepth, E_JobQueueDepth((enum NeJobPriority)luaL_checkinteger(vm, 1)));
+SIF_VOID(StartJobTrace, E_StartJobTrace);
+SIF_VOID(StopJobTrace, E_StopJobTrace);
+SIF_BOOL(WriteJobTrace, E_WriteJobTrace(luaL_optstring(vm, 1, NULL)));
 SIF_BOOL(PluginLoaded, E_PluginLoaded(luaL_checkstring(vm, 1)));
 
 // Entity
@@ -225,6 +229,10 @@ NE_SCRIPT_INTEFACE(NeEngine)
 		SIF_REG(Log),
 		SIF_REG(WorkerId),
 		SIF_REG(JobWorkerThreads),
+		SIF_REG(JobQueueDepth),
+		SIF_REG(StartJobTrace),
+		SIF_REG(StopJobTrace),
+		SIF_REG(WriteJobTrace),
 		SIF_REG(PluginLoaded),
 		SIF_REG(Shutdown),
 		SIF_ENDREG()
@@ -258,6 +266,19 @@ NE_SCRIPT_INTEFACE(NeEngine)
 	}
 	lua_setglobal(vm, "SystemGroup");
 
+	lua_newtable(vm);
+	{
+		lua_pushinteger(vm, JP_FrameCritical);
+		lua_setfield(vm, -2, "FrameCritical");
+
+		lua_pushinteger(vm, JP_Normal);
+		lua_setfield(vm, -2, "Normal");
+
+		lua_pushinteger(vm, JP_Background);
+		lua_setfield(vm, -2, "Background");
+	}
+	lua_setglobal(vm, "JobPriority");
+
 	lua_newtable(vm);
 	{
 		lua_pushinteger(vm, LOG_DEBUG);
@@ -1,15 +1,24 @@
+#include <stdatomic.h>
+
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
 
 #include <Engine/IO.h>
+#include <Engine/Job.h>
 #include <Engine/Config.h>
 #include <System/Log.h>
 #include <System/Memory.h>
+#include <System/AtomicLock.h>
 #include <Runtime/Runtime.h>
 #include <Script/Interface.h>
 
-#define SCRIPTMOD	"Script"
+#define SCRIPTMOD			"Script"
+
+#define POOL_ENV_KEY		"NePoolEnvironment"
+#define POOL_CHUNKS_KEY		"NePoolChunks"
+#define POOL_CHECKOUT_KEY	"NePoolCheckout"
+#define POOL_VERSION_KEY	"NePoolScriptVersion"
 
 static const luaL_Reg f_luaLibs[] = {
 	// Core Lua libs
@@ -33,9 +42,28 @@ struct ScriptInterface
 	size_t scriptLen;
 };
 
+/*
+ * Every job worker keeps the VMs it released, with the libraries loaded; the threads outside the pool share one list.
+ * A pooled VM keeps the compiled chunk of each script file until Sc_InvalidateScripts is called. Each checkout runs
+ * a script at most once, in a new globals table which falls back to the library globals, so the globals a script sets
+ * don't outlive the checkout. Modules loaded with require use the library globals.
+ */
+struct NeVMPool
+{
+	struct NeArray idle;
+	struct NeAtomicLock lock;
+};
+
 static struct NeArray f_scriptIfaces;
+static struct NeVMPool *f_vmPools;
+static uint32_t f_vmPoolCount;
+static _Atomic lua_Integer f_scriptVersion;
+
 static void *LuaAlloc(void *ud, void *ptr, size_t oSize, size_t nSize);
 static int LuaSearcher(lua_State *vm);
+static lua_State *CreatePooledVM(void);
+static bool CompileScriptFile(lua_State *vm, const char *path);
+static bool PushScriptEnv(lua_State *vm, const char *path);
 
 lua_State *
 Sc_CreateVM(void)
@@ -56,6 +84,9 @@ Sc_CreateVM(void)
 	luaL_requiref(vm, "NeScriptComponent", SIface_ScriptComponent, 0);
 	lua_pop(vm, 1);
 
+	luaL_requiref(vm, "NeComponentView", SIface_ComponentView, 0);
+	lua_pop(vm, 1);
+
 	lua_getglobal(vm, "package");
 	lua_getfield(vm, -1, "searchers");
 
@@ -114,6 +145,17 @@ Sc_LoadScript(lua_State *vm, const char *source)
 bool
 Sc_LoadScriptFile(lua_State *vm, const char *path)
 {
+	// a checked out VM runs the script once; its globals are read with Sc_PushScriptFunction
+	if (lua_getfield(vm, LUA_REGISTRYINDEX, POOL_CHECKOUT_KEY) == LUA_TTABLE) {
+		lua_pop(vm, 1);
+
+		const bool rc = PushScriptEnv(vm, path);
+		if (rc)
+			lua_pop(vm, 1);
+		return rc;
+	}
+	lua_pop(vm, 1);
+
 	struct NeStream stm;
 	if (!E_FileStream(path, IO_READ, &stm))
 		return false;
@@ -143,6 +185,38 @@ Sc_LoadScriptStream(lua_State *vm, struct NeStream *stm)
 	return true;
 }
 
+bool
+Sc_PushScriptFunction(lua_State *vm, const char *path, const char *name)
+{
+	if (lua_getfield(vm, LUA_REGISTRYINDEX, POOL_CHECKOUT_KEY) != LUA_TTABLE) {
+		lua_pop(vm, 1);
+
+		if (!Sc_LoadScriptFile(vm, path))
+			return false;
+
+		if (lua_getglobal(vm, name) == LUA_TFUNCTION)
+			return true;
+
+		lua_pop(vm, 1);
+		return false;
+	}
+	lua_pop(vm, 1);
+
+	if (!PushScriptEnv(vm, path))
+		return false;
+
+	// leave only the function on the stack
+	lua_pushstring(vm, name);
+	const bool found = lua_rawget(vm, -2) == LUA_TFUNCTION;
+	lua_remove(vm, -2);
+
+	if (found)
+		return true;
+
+	lua_pop(vm, 1);
+	return false;
+}
+
 void
 Sc_LogStackDump(lua_State *vm, int severity)
 {
@@ -215,6 +289,80 @@ Sc_DestroyVM(lua_State *vm)
 		lua_close(vm);
 }
 
+lua_State *
+Sc_AcquireVM(void)
+{
+	lua_State *vm = NULL;
+
+	if (!f_vmPools)
+		return Sc_CreateVM();
+
+	struct NeVMPool *pool = &f_vmPools[E_WorkerId()];
+
+	Sys_AtomicLockWrite(&pool->lock);
+	if (pool->idle.count) {
+		vm = Rt_ArrayGetPtr(&pool->idle, pool->idle.count - 1);
+		--pool->idle.count;
+	}
+	Sys_AtomicUnlockWrite(&pool->lock);
+
+	if (!vm && !(vm = CreatePooledVM()))
+		return NULL;
+
+	// drop the scripts compiled before they changed
+	const lua_Integer version = atomic_load_explicit(&f_scriptVersion, memory_order_relaxed);
+	lua_getfield(vm, LUA_REGISTRYINDEX, POOL_VERSION_KEY);
+	if (lua_tointeger(vm, -1) != version) {
+		lua_newtable(vm);
+		lua_setfield(vm, LUA_REGISTRYINDEX, POOL_CHUNKS_KEY);
+		lua_pushinteger(vm, version);
+		lua_setfield(vm, LUA_REGISTRYINDEX, POOL_VERSION_KEY);
+	}
+	lua_pop(vm, 1);
+
+	// the scripts run in this checkout, by path, with their globals
+	lua_newtable(vm);
+	lua_setfield(vm, LUA_REGISTRYINDEX, POOL_CHECKOUT_KEY);
+
+	return vm;
+}
+
+void
+Sc_ReleaseVM(lua_State *vm)
+{
+	if (!vm)
+		return;
+
+	lua_settop(vm, 0);
+
+	const bool pooled = lua_getfield(vm, LUA_REGISTRYINDEX, POOL_CHUNKS_KEY) == LUA_TTABLE;
+	lua_pop(vm, 1);
+
+	// the globals of the scripts are not kept for the next checkout
+	lua_pushnil(vm);
+	lua_setfield(vm, LUA_REGISTRYINDEX, POOL_CHECKOUT_KEY);
+
+	if (!f_vmPools || !pooled) {
+		Sc_DestroyVM(vm);
+		return;
+	}
+
+	struct NeVMPool *pool = &f_vmPools[E_WorkerId()];
+
+	Sys_AtomicLockWrite(&pool->lock);
+	const bool added = Rt_ArrayAddPtr(&pool->idle, vm);
+	Sys_AtomicUnlockWrite(&pool->lock);
+
+	if (!added)
+		Sc_DestroyVM(vm);
+}
+
+void
+Sc_InvalidateScripts(void)
+{
+	atomic_fetch_add_explicit(&f_scriptVersion, 1, memory_order_relaxed);
+}
+
 bool
 Sc_InitScriptSystem(void)
 {
@@ -226,12 +374,36 @@ Sc_InitScriptSystem(void)
 	E_GetCVarBln("Script_CheckComponentFieldAccess", true);
 #endif
 
+	f_vmPoolCount = E_JobWorkerThreads() + 1;
+	f_vmPools = Sys_Alloc(sizeof(*f_vmPools), f_vmPoolCount, MH_System);
+	if (!f_vmPools)
+		return false;
+
+	for (uint32_t i = 0; i < f_vmPoolCount; ++i) {
+		Sys_InitAtomicLock(&f_vmPools[i].lock);
+
+		lua_State *vm = CreatePooledVM();
+		if (!Rt_InitPtrArray(&f_vmPools[i].idle, 4, MH_System) || !vm || !Rt_ArrayAddPtr(&f_vmPools[i].idle, vm)) {
+			Sc_DestroyVM(vm);
+			return false;
+		}
+	}
+
 	return true;
 }
 
 void
 Sc_TermScriptSystem(void)
 {
+	for (uint32_t i = 0; f_vmPools && i < f_vmPoolCount; ++i) {
+		lua_State *vm;
+		Rt_ArrayForEachPtr(vm, &f_vmPools[i].idle)
+			Sc_DestroyVM(vm);
+		Rt_TermArray(&f_vmPools[i].idle);
+	}
+	Sys_Free(f_vmPools);
+	f_vmPools = NULL;
+
 	struct ScriptInterface *si;
 	Rt_ArrayForEach(si, &f_scriptIfaces)
 		Sys_Free(si->script);
@@ -246,6 +418,8 @@ LuaAlloc(void *ud, void *ptr, size_t oSize, size_t nSize)
 
 	if (nSize == 0)
 		Sys_Free(ptr);
+	else if (!ptr)	// Lua initializes everything it allocates
+		new = Sys_AlignedAllocNoZero(nSize, 1, 16, MH_Script);
 	else
 		new = Sys_AlignedReAlloc(ptr, nSize, 1, 16, MH_Script);
 
@@ -288,6 +462,100 @@ LuaSearcher(lua_State *vm)
 	return 1;
 }
 
+static lua_State *
+CreatePooledVM(void)
+{
+	lua_State *vm = Sc_CreateVM();
+	if (!vm)
+		return NULL;
+
+	lua_createtable(vm, 0, 1);
+	lua_rawgeti(vm, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+	lua_setfield(vm, -2, "__index");
+	lua_setfield(vm, LUA_REGISTRYINDEX, POOL_ENV_KEY);
+
+	lua_newtable(vm);
+	lua_setfield(vm, LUA_REGISTRYINDEX, POOL_CHUNKS_KEY);
+	lua_pushinteger(vm, atomic_load_explicit(&f_scriptVersion, memory_order_relaxed));
+	lua_setfield(vm, LUA_REGISTRYINDEX, POOL_VERSION_KEY);
+
+	return vm;
+}
+
+static bool
+CompileScriptFile(lua_State *vm, const char *path)
+{
+	struct NeStream stm;
+	if (!E_FileStream(path, IO_READ, &stm))
+		return false;
+
+	const int64_t len = E_StreamLength(&stm);
+	char *source = Sys_Alloc((size_t)len + 1, 1, MH_Transient);
+
+	E_ReadStream(&stm, source, len);
+	E_CloseStream(&stm);
+
+	if (luaL_loadbufferx(vm, source, (size_t)len, path, "t") != LUA_OK) {
+		Sys_LogEntry(SCRIPTMOD, LOG_CRITICAL, "Failed to load script: %s", lua_tostring(vm, -1));
+		lua_pop(vm, 1);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+PushScriptEnv(lua_State *vm, const char *path)
+{
+	lua_getfield(vm, LUA_REGISTRYINDEX, POOL_CHECKOUT_KEY);
+	const int checkout = lua_gettop(vm);
+
+	if (lua_getfield(vm, checkout, path) == LUA_TTABLE) {
+		lua_remove(vm, checkout);
+		return true;
+	}
+	lua_pop(vm, 1);
+
+	// the chunk is compiled once per VM
+	lua_getfield(vm, LUA_REGISTRYINDEX, POOL_CHUNKS_KEY);
+	if (lua_getfield(vm, -1, path) != LUA_TFUNCTION) {
+		lua_pop(vm, 1);
+
+		if (!CompileScriptFile(vm, path)) {
+			lua_settop(vm, checkout - 1);
+			return false;
+		}
+
+		lua_pushvalue(vm, -1);
+		lua_setfield(vm, -3, path);
+	}
+	lua_remove(vm, -2);
+
+	lua_createtable(vm, 0, 8);
+	lua_pushvalue(vm, -1);
+	lua_setfield(vm, -2, LUA_GNAME);
+	lua_getfield(vm, LUA_REGISTRYINDEX, POOL_ENV_KEY);
+	lua_setmetatable(vm, -2);
+
+	// the first upvalue of the chunk is _ENV
+	lua_pushvalue(vm, -1);
+	if (!lua_setupvalue(vm, -3, 1))
+		lua_pop(vm, 1);
+
+	lua_insert(vm, -2);
+	if (lua_pcall(vm, 0, 0, 0)) {
+		Sys_LogEntry(SCRIPTMOD, LOG_CRITICAL, "Failed to load script: %s", lua_tostring(vm, -1));
+		lua_settop(vm, checkout - 1);
+		return false;
+	}
+
+	lua_pushvalue(vm, -1);
+	lua_setfield(vm, checkout, path);
+	lua_remove(vm, checkout);
+
+	return true;
+}
+
 /* NekoEngine
  *
  * Script.c
@@ -0,0 +1,213 @@
+#include <string.h>
+
+#include <Engine/Component.h>
+#include <Script/Interface.h>
+
+/*
+ * Batched script systems receive one view per component type. In view mode the system indexes the components, which
+ * pushes a wrapper for each access; in columns mode it indexes a field, as described by E_SetComponentFields, and then
+ * the components, which reads and writes the field in place.
+ */
+struct NeScriptColumn
+{
+	const struct NeScriptView *view;
+	const struct NeComponentField *field;
+};
+
+static inline void *
+ColumnField(lua_State *vm, const struct NeScriptColumn *col)
+{
+	const lua_Integer i = luaL_checkinteger(vm, 2);
+	if (i < 1 || i > col->view->count)
+		luaL_argerror(vm, 2, "Index out of range");
+
+	return (uint8_t *)col->view->comp[i - 1] + col->field->offset;
+}
+
+SIF_FUNC(View_Index)
+{
+	const struct NeScriptView *v = luaL_checkudata(vm, 1, SIF_NE_COMPONENT_VIEW);
+	const lua_Integer i = luaL_checkinteger(vm, 2);
+
+	if (i < 1 || i > v->count)
+		luaL_argerror(vm, 2, "Index out of range");
+
+	Sc_PushScriptWrapper(vm, v->comp[i - 1], E_ComponentTypeName(v->type));
+	return 1;
+}
+
+SIF_FUNC(View_Len)
+{
+	const struct NeScriptView *v = lua_touserdata(vm, 1);
+	lua_pushinteger(vm, v->count);
+	return 1;
+}
+
+SIF_FUNC(Columns_Index)
+{
+	const struct NeScriptView *v = luaL_checkudata(vm, 1, SIF_NE_COMPONENT_COLUMNS);
+	const char *name = luaL_checkstring(vm, 2);
+
+	uint32_t count;
+	const struct NeComponentField *fields = E_ComponentFields(v->type, &count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		if (strcmp(fields[i].name, name))
+			continue;
+
+		struct NeScriptColumn *col = lua_newuserdatauv(vm, sizeof(*col), 1);
+		luaL_setmetatable(vm, SIF_NE_COMPONENT_COLUMN);
+		col->view = v;
+		col->field = &fields[i];
+
+		// keep the view alive while the column is referenced
+		lua_pushvalue(vm, 1);
+		lua_setiuservalue(vm, -2, 1);
+
+		return 1;
+	}
+
+	return luaL_error(vm, "Component %s has no field %s", E_ComponentTypeName(v->type), name);
+}
+
+SIF_FUNC(Column_Index)
+{
+	const struct NeScriptColumn *col = lua_touserdata(vm, 1);
+	const void *p = ColumnField(vm, col);
+
+	switch (col->field->type) {
+	case CFT_UInt8: lua_pushinteger(vm, *(const uint8_t *)p); break;
+	case CFT_UInt16: lua_pushinteger(vm, *(const uint16_t *)p); break;
+	case CFT_UInt32: lua_pushinteger(vm, *(const uint32_t *)p); break;
+	case CFT_UInt64: lua_pushinteger(vm, (lua_Integer)*(const uint64_t *)p); break;
+	case CFT_Int8: lua_pushinteger(vm, *(const int8_t *)p); break;
+	case CFT_Int16: lua_pushinteger(vm, *(const int16_t *)p); break;
+	case CFT_Int32: lua_pushinteger(vm, *(const int32_t *)p); break;
+	case CFT_Int64: lua_pushinteger(vm, *(const int64_t *)p); break;
+	case CFT_Float: lua_pushnumber(vm, *(const float *)p); break;
+	case CFT_Double: lua_pushnumber(vm, *(const double *)p); break;
+	case CFT_Vec3: SIface_PushVec3(vm, p); break;
+	case CFT_Vec4: SIface_PushVec4(vm, p); break;
+	case CFT_Matrix: SIface_PushMatrix(vm, p); break;
+	case CFT_String: lua_pushstring(vm, *(const char **)p); break;
+	case CFT_Bool: lua_pushboolean(vm, *(const bool *)p); break;
+	default: return luaL_error(vm, "Field %s can't be read from a script", col->field->name);
+	}
+
+	return 1;
+}
+
+SIF_FUNC(Column_NewIndex)
+{
+	const struct NeScriptColumn *col = lua_touserdata(vm, 1);
+	void *p = ColumnField(vm, col);
+
+	if (col->view->readOnly)
+		return luaL_error(vm, "Component %s is read only", E_ComponentTypeName(col->view->type));
+
+	switch (col->field->type) {
+	case CFT_UInt8: *(uint8_t *)p = (uint8_t)luaL_checkinteger(vm, 3); break;
+	case CFT_UInt16: *(uint16_t *)p = (uint16_t)luaL_checkinteger(vm, 3); break;
+	case CFT_UInt32: *(uint32_t *)p = (uint32_t)luaL_checkinteger(vm, 3); break;
+	case CFT_UInt64: *(uint64_t *)p = (uint64_t)luaL_checkinteger(vm, 3); break;
+	case CFT_Int8: *(int8_t *)p = (int8_t)luaL_checkinteger(vm, 3); break;
+	case CFT_Int16: *(int16_t *)p = (int16_t)luaL_checkinteger(vm, 3); break;
+	case CFT_Int32: *(int32_t *)p = (int32_t)luaL_checkinteger(vm, 3); break;
+	case CFT_Int64: *(int64_t *)p = (int64_t)luaL_checkinteger(vm, 3); break;
+	case CFT_Float: *(float *)p = (float)luaL_checknumber(vm, 3); break;
+	case CFT_Double: *(double *)p = luaL_checknumber(vm, 3); break;
+	case CFT_Vec3: memcpy(p, luaL_checkudata(vm, 3, SIF_NE_VEC3), sizeof(float) * 3); break;
+	case CFT_Vec4: memcpy(p, luaL_checkudata(vm, 3, SIF_NE_VEC4), sizeof(float) * 4); break;
+	case CFT_Matrix: memcpy(p, luaL_checkudata(vm, 3, SIF_NE_MATRIX), sizeof(float) * 16); break;
+	case CFT_Bool: *(bool *)p = lua_toboolean(vm, 3); break;
+	default: return luaL_error(vm, "Field %s can't be written from a script", col->field->name);
+	}
+
+	return 0;
+}
+
+SIF_FUNC(Column_Len)
+{
+	const struct NeScriptColumn *col = lua_touserdata(vm, 1);
+	lua_pushinteger(vm, col->view->count);
+	return 1;
+}
+
+int
+SIface_ComponentView(lua_State *vm)
+{
+	luaL_Reg viewMeta[] =
+	{
+		{ "__index", Sif_View_Index },
+		{ "__len", Sif_View_Len },
+		SIF_ENDREG()
+	};
+
+	luaL_Reg columnsMeta[] =
+	{
+		{ "__index", Sif_Columns_Index },
+		{ "__len", Sif_View_Len },
+		SIF_ENDREG()
+	};
+
+	luaL_Reg columnMeta[] =
+	{
+		{ "__index", Sif_Column_Index },
+		{ "__newindex", Sif_Column_NewIndex },
+		{ "__len", Sif_Column_Len },
+		SIF_ENDREG()
+	};
+
+	luaL_newmetatable(vm, SIF_NE_COMPONENT_VIEW);
+	luaL_setfuncs(vm, viewMeta, 0);
+	lua_pop(vm, 1);
+
+	luaL_newmetatable(vm, SIF_NE_COMPONENT_COLUMNS);
+	luaL_setfuncs(vm, columnsMeta, 0);
+	lua_pop(vm, 1);
+
+	luaL_newmetatable(vm, SIF_NE_COMPONENT_COLUMN);
+	luaL_setfuncs(vm, columnMeta, 0);
+	lua_pop(vm, 1);
+
+	lua_pushboolean(vm, true);
+	return 1;
+}
+
+/* NekoEngine
+ *
+ * l_ComponentView.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
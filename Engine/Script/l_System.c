@@ -1,5 +1,6 @@
 #include <System/Log.h>
 #include <System/Endian.h>
+#include <System/Memory.h>
 #include <System/System.h>
 #include <Script/Interface.h>
 
@@ -49,6 +50,37 @@ SIF_FUNC(Rand)
 	return 1;
 }
 
+SIF_FUNC(HeapStatistics)
+{
+	struct NeMemoryHeapStatistics hs;
+	Sys_HeapStatistics((enum NeMemoryHeap)luaL_checkinteger(vm, 1), &hs);
+
+	lua_createtable(vm, 0, 7);
+
+	lua_pushinteger(vm, (lua_Integer)hs.inUse);
+	lua_setfield(vm, -2, "inUse");
+
+	lua_pushinteger(vm, (lua_Integer)hs.allocations);
+	lua_setfield(vm, -2, "allocations");
+
+	lua_pushinteger(vm, (lua_Integer)hs.peak);
+	lua_setfield(vm, -2, "peak");
+
+	lua_pushinteger(vm, (lua_Integer)hs.totalAllocations);
+	lua_setfield(vm, -2, "totalAllocations");
+
+	lua_pushinteger(vm, (lua_Integer)hs.totalFrees);
+	lua_setfield(vm, -2, "totalFrees");
+
+	lua_pushinteger(vm, (lua_Integer)hs.frameAllocations);
+	lua_setfield(vm, -2, "frameAllocations");
+
+	lua_pushinteger(vm, (lua_Integer)hs.frameFrees);
+	lua_setfield(vm, -2, "frameFrees");
+
+	return 1;
+}
+
 NE_SCRIPT_INTEFACE(NeSystem)
 {
 	luaL_Reg reg[] =
@@ -58,6 +90,7 @@ NE_SCRIPT_INTEFACE(NeSystem)
 		SIF_REG(MSleep),
 		SIF_REG(USleep),
 		SIF_REG(Rand),
+		SIF_REG(HeapStatistics),
 		SIF_REG(ScreenVisible),
 		SIF_REG(Hostname),
 		SIF_REG(Machine),
@@ -96,6 +129,15 @@ NE_SCRIPT_INTEFACE(NeSystem)
 	}
 	lua_setglobal(vm, "MessageBox");
 
+	lua_newtable(vm);
+	{
+		for (enum NeMemoryHeap i = MH_Transient; i < MH_Count; ++i) {
+			lua_pushinteger(vm, i);
+			lua_setfield(vm, -2, Sys_MemoryHeapName(i));
+		}
+	}
+	lua_setglobal(vm, "MemoryHeap");
+
 	return 1;
 }
 
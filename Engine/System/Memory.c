@@ -10,97 +10,191 @@
 
 #include <Render/Render.h>
 
+#include NE_ATOMIC_HDR
+
+#ifdef NE_ALLOC_TRACE
+#	undef Sys_AlignedAlloc
+#	undef Sys_Alloc
+#	undef Sys_AlignedAllocNoZero
+#	undef Sys_AllocNoZero
+#	undef Sys_AlignedReAlloc
+#	undef Sys_ReAlloc
+#endif
+
 #define MMOD					"MemoryManager"
 #define MAGIC					0x53544954		// TITS, in little endian format
+#define POOL_MAGIC				0x4C4F4F50		// POOL, in little endian format
 
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
 
 struct NeAllocation
 {
 	uint32_t magic;
 	enum NeMemoryHeap heap;
 	uint64_t size;
+#ifdef NE_ALLOC_TRACE
+	uint32_t site, padding[3];
+#endif
+};
+
+/*
+ * The frame and transient heaps are chains of linear blocks owned by a single thread. When the
+ * current block is full the next one is used, or a new one is linked in; blocks beyond what
+ * the heap needed over the last Engine_HeapShrinkFrames resets are released again.
+ * Sys_ResetHeap only advances the heap's epoch; each thread resets its own heap the next time
+ * it touches it.
+ */
+struct NeHeapBlock
+{
+	struct NeHeapBlock *next;
+	uint8_t *end;
 };
 
 struct NeHeap
 {
-	uint8_t *heap, *ptr;
+	struct NeHeapBlock *first, *block;
+	uint8_t *ptr;
 	uint64_t *size;
-	uint64_t peak;
+	uint64_t used, peak, windowPeak;
+	uint64_t epoch, frames, allocations;
+	_Atomic uint64_t *globalEpoch;
+	enum NeMemoryHeap type;
 };
 
-static inline bool InitHeap(struct NeHeap *heap, uint64_t *size);
+/*
+ * Heap statistics are kept per thread and summed when queried. Only the owning thread writes
+ * a record; the records are never freed so the counters of threads that exited still count.
+ */
+struct NeThreadHeapStatistics
+{
+	_Atomic int64_t bytes[MH_Count];
+	_Atomic uint64_t allocations[MH_Count], frees[MH_Count];
+	struct NeThreadHeapStatistics *next;
+};
+
+void *Sys_PoolAlloc(size_t size);
+void Sys_PoolFree(void *mem, size_t size);
+bool Sys_PoolResize(size_t oldSize, size_t newSize);
+void Sys_FlushPoolCache(void);
+
+#ifdef NE_ALLOC_TRACE
+void Sys_InitAllocationTrace(void);
+uint32_t Sys_TraceAllocation(const char *file, int line, enum NeMemoryHeap heap, uint64_t size);
+void Sys_TraceFree(uint32_t id, uint64_t size);
+void Sys_TraceResize(uint32_t id, int64_t delta);
+void Sys_TraceFrame(void);
+void Sys_LogAllocationLeaks(void);
+#endif
+
+static inline void *Allocate(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, bool zero, const char *file, int line);
+static inline void *ReAllocate(void *mem, size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, const char *file, int line);
+static inline void Track(enum NeMemoryHeap heap, int64_t bytes, uint64_t allocations, uint64_t frees);
+static inline bool InitHeap(struct NeHeap *heap, enum NeMemoryHeap type, uint64_t *size, _Atomic uint64_t *epoch);
+static inline struct NeHeap *ThreadHeap(enum NeMemoryHeap heap);
 static inline void *HeapAllocate(struct NeHeap *heap, size_t size, size_t alignment);
+static bool NextBlock(struct NeHeap *heap, size_t size);
 static inline void ResetHeap(struct NeHeap *heap);
+static void ShrinkHeap(struct NeHeap *heap);
+static inline uint32_t HeapBlocks(const struct NeHeap *heap);
 static inline void TermHeap(struct NeHeap *heap);
-static void ResetTransientJob(int workerId, void *data);
-static void ResetFrameJob(int workerId, void *data);
 
 static THREAD_LOCAL struct NeHeap f_transientHeap;
 static THREAD_LOCAL struct NeHeap f_frameHeap[RE_NUM_FRAMES];
+static _Atomic uint64_t f_transientEpoch, f_frameEpoch[RE_NUM_FRAMES];
+static uint32_t *f_shrinkFrames;
+static bool f_usePools = true;
+
+static THREAD_LOCAL struct NeThreadHeapStatistics *f_threadStats;
+static _Atomic(struct NeThreadHeapStatistics *) f_heapStats;
+static uint64_t f_heapPeak[MH_Count], f_lastAllocations[MH_Count], f_lastFrees[MH_Count];
+static uint64_t f_frameAllocations[MH_Count], f_frameFrees[MH_Count];
+
+static const char *f_heapNames[MH_Count] =
+{
+	"Transient", "Frame", "Secure", "Audio", "Render", "Scene", "Asset", "Script",
+	"AudioBackend", "RenderBackend", "Debug", "System", "Editor", "Network", "Plugin", "ManualAlign"
+};
 
 void *
 Sys_AlignedAlloc(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap)
 {
-	void *ret = NULL;
-	struct NeAllocation *alloc = NULL;
-
-	size_t totalSize = size * count + sizeof(struct NeAllocation);
-	if ((count >= NE_MUL_NO_OVERFLOW || size >= NE_MUL_NO_OVERFLOW) && count > 0 && SIZE_MAX / count < size)
-		return NULL;
-
-	totalSize = NE_ROUND_UP(totalSize, alignment);
-	if (heap == MH_Transient)
-		ret = HeapAllocate(&f_transientHeap, totalSize, alignment);
-	else if (heap == MH_Frame)
-		ret = HeapAllocate(&f_frameHeap[Re_frameId], totalSize, alignment);
-	else
-		ret = aligned_alloc(alignment, totalSize);
-
-	assert("Out of memory" && ret);
-	if (!ret)
-		return NULL;
-
-	Sys_ZeroMemory(ret, totalSize);
+	return Allocate(size, count, alignment, heap, true, NULL, 0);
+}
 
-	alloc = ret;
-	alloc->magic = MAGIC;
-	alloc->heap = heap;
-	alloc->size = totalSize - sizeof(struct NeAllocation);
+void *
+Sys_AlignedAllocNoZero(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap)
+{
+	return Allocate(size, count, alignment, heap, heap == MH_Secure, NULL, 0);
+}
 
-	if (alloc->heap == MH_Secure)
-		Sys_LockMemory(alloc, alloc->size);
+void *
+Sys_AlignedReAlloc(void *mem, size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap)
+{
+	return ReAllocate(mem, size, count, alignment, heap, NULL, 0);
+}
 
-	ret = (uint8_t *)ret + sizeof(*alloc);
+void *
+Sys_TraceAlignedAlloc(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, const char *file, int line)
+{
+	return Allocate(size, count, alignment, heap, true, file, line);
+}
 
-	return ret;
+void *
+Sys_TraceAlignedAllocNoZero(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, const char *file, int line)
+{
+	return Allocate(size, count, alignment, heap, heap == MH_Secure, file, line);
 }
 
 void *
-Sys_AlignedReAlloc(void *mem, size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap)
+Sys_TraceAlignedReAlloc(void *mem, size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, const char *file, int line)
+{
+	return ReAllocate(mem, size, count, alignment, heap, file, line);
+}
+
+static inline void *
+ReAllocate(void *mem, size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, const char *file, int line)
 {
 	void *new = NULL;
 	struct NeAllocation *alloc;
 
 	if (!mem)
-		return Sys_Alloc(size, count, heap);
+		return Allocate(size, count, alignment, heap, true, file, line);
 
 	size_t totalSize = size * count + sizeof(*alloc);
 	if ((count >= NE_MUL_NO_OVERFLOW || size >= NE_MUL_NO_OVERFLOW) && count > 0 && SIZE_MAX / count < size)
 		return NULL;
 
 	alloc = (struct NeAllocation *)((uint8_t *)mem - (sizeof(*alloc)));
-	if (alloc->magic != MAGIC) {
+	if (alloc->magic == POOL_MAGIC) {
+		totalSize = NE_ROUND_UP(totalSize, alignment);
+		if (alignment <= NE_DEFAULT_ALIGNMENT && Sys_PoolResize(alloc->size + sizeof(*alloc), totalSize)) {
+			Track(alloc->heap, (int64_t)totalSize - (int64_t)(alloc->size + sizeof(*alloc)), 0, 0);
+#ifdef NE_ALLOC_TRACE
+			Sys_TraceResize(alloc->site, (int64_t)totalSize - (int64_t)(alloc->size + sizeof(*alloc)));
+#endif
+			alloc->size = totalSize - sizeof(*alloc);
+			return mem;
+		}
+
+		new = Allocate(size, count, alignment, alloc->heap, false, file, line);
+		if (!new)
+			return NULL;
+
+		memcpy(new, mem, MIN(alloc->size, totalSize - sizeof(*alloc)));
+		Sys_Free(mem);
+
+		return new;
+	} else if (alloc->magic != MAGIC) {
 		Sys_LogEntry(MMOD, LOG_DEBUG, "Sys_ReAlloc called with unrecognized block %p, calling realloc.", mem);
 		return realloc(mem, totalSize);
 	}
 
-	if (heap == MH_Transient) {
-		new = HeapAllocate(&f_transientHeap, totalSize, alignment);
-		memcpy(new, mem, alloc->size);
-	} else if (heap == MH_Frame) {
-		new = HeapAllocate(&f_frameHeap[Re_frameId], totalSize, alignment);
-		memcpy(new, mem, alloc->size);
+	if (heap == MH_Transient || heap == MH_Frame) {
+		totalSize = NE_ROUND_UP(totalSize, alignment);
+		new = HeapAllocate(ThreadHeap(heap), totalSize, alignment);
+		if (new)
+			memcpy(new, alloc, sizeof(*alloc) + MIN(alloc->size, totalSize - sizeof(*alloc)));
 	} else {
 #ifndef SYS_PLATFORM_WINDOWS
 		new = realloc(alloc, totalSize);
@@ -108,6 +202,17 @@ Sys_AlignedReAlloc(void *mem, size_t size, size_t count, size_t alignment, enum
 		new = _aligned_realloc(alloc, totalSize, alignment);
 #endif
 		assert("Out of memory" && new);
+
+		if (new) {
+			alloc = new;
+			Track(alloc->heap, (int64_t)totalSize - (int64_t)(alloc->size + sizeof(*alloc)), 0, 0);
+
+#ifdef NE_ALLOC_TRACE
+			// the memory now belongs to the site that resized it
+			Sys_TraceFree(alloc->site, alloc->size + sizeof(*alloc));
+			alloc->site = Sys_TraceAllocation(file, line, alloc->heap, totalSize);
+#endif
+		}
 	}
 
 	if (!new)
@@ -131,15 +236,30 @@ Sys_Free(void *mem)
 		return;
 
 	alloc = (struct NeAllocation *)((uint8_t *)mem - (sizeof(*alloc)));
-	if (alloc->magic != MAGIC) {
+	if (alloc->magic == POOL_MAGIC) {
+		Track(alloc->heap, -(int64_t)(alloc->size + sizeof(*alloc)), 0, 1);
+#ifdef NE_ALLOC_TRACE
+		Sys_TraceFree(alloc->site, alloc->size + sizeof(*alloc));
+#endif
+
+		alloc->magic = 0;
+		Sys_PoolFree(alloc, alloc->size + sizeof(*alloc));
+		return;
+	} else if (alloc->magic != MAGIC) {
 		Sys_LogEntry(MMOD, LOG_DEBUG, "Sys_Free called with unrecognized block %p, calling free.", mem);
 		free(mem);
 		return;
 	}
 
-	if (alloc->heap == MH_Transient || alloc->heap == MH_Frame) {
+	if (alloc->heap == MH_Transient || alloc->heap == MH_Frame)
 		return;
-	} else if (alloc->heap == MH_Secure) {
+
+	Track(alloc->heap, -(int64_t)(alloc->size + sizeof(*alloc)), 0, 1);
+#ifdef NE_ALLOC_TRACE
+	Sys_TraceFree(alloc->site, alloc->size + sizeof(*alloc));
+#endif
+
+	if (alloc->heap == MH_Secure) {
 		Sys_ZeroMemory(alloc, alloc->size);
 		Sys_UnlockMemory(alloc, alloc->size);
 	}
@@ -154,11 +274,18 @@ Sys_Free(void *mem)
 bool
 Sys_InitMemory(void)
 {
-	if (!InitHeap(&f_transientHeap, &E_GetCVarU64("Engine_TransientHeapSize", 4 * 1024 * 1024)->u64))
+	f_usePools = E_GetCVarBln("Engine_PoolAllocator", true)->bln;
+	f_shrinkFrames = &E_GetCVarU32("Engine_HeapShrinkFrames", 300)->u32;
+
+#ifdef NE_ALLOC_TRACE
+	Sys_InitAllocationTrace();
+#endif
+
+	if (!InitHeap(&f_transientHeap, MH_Transient, &E_GetCVarU64("Engine_TransientHeapSize", 4 * 1024 * 1024)->u64, &f_transientEpoch))
 		return false;
 
 	for (uint32_t i = 0; i < RE_NUM_FRAMES; ++i)
-		if (!InitHeap(&f_frameHeap[i], &E_GetCVarU64("Engine_FrameHeapSize", 4 * 1024 * 1024)->u64))
+		if (!InitHeap(&f_frameHeap[i], MH_Frame, &E_GetCVarU64("Engine_FrameHeapSize", 4 * 1024 * 1024)->u64, &f_frameEpoch[i]))
 			return false;
 
 	return true;
@@ -167,13 +294,97 @@ Sys_InitMemory(void)
 void
 Sys_ResetHeap(enum NeMemoryHeap heap)
 {
-	if (heap == MH_Transient) {
-		ResetHeap(&f_transientHeap);
-		E_DispatchJobs(E_JobWorkerThreads(), ResetTransientJob, NULL, NULL, NULL);
-	} else if (heap == MH_Frame) {
-		ResetHeap(&f_frameHeap[Re_frameId]);
-		E_DispatchJobs(E_JobWorkerThreads(), ResetFrameJob, NULL, NULL, NULL);
+	if (heap == MH_Transient)
+		atomic_fetch_add_explicit(&f_transientEpoch, 1, memory_order_release);
+	else if (heap == MH_Frame)
+		atomic_fetch_add_explicit(&f_frameEpoch[Re_frameId], 1, memory_order_release);
+}
+
+void
+Sys_PushHeapMarker(enum NeMemoryHeap heap, struct NeHeapMarker *marker)
+{
+	struct NeHeap *h = ThreadHeap(heap);
+	assert(h);
+
+	if (h->epoch != atomic_load_explicit(h->globalEpoch, memory_order_acquire))
+		ResetHeap(h);
+
+	marker->heap = h;
+	marker->block = h->block;
+	marker->ptr = h->ptr;
+	marker->used = h->used;
+	marker->allocations = h->allocations;
+	marker->epoch = h->epoch;
+}
+
+void
+Sys_PopHeapMarker(const struct NeHeapMarker *marker)
+{
+	struct NeHeap *h = marker->heap;
+	assert("Heap marker popped on a different thread" && (h == &f_transientHeap || (h >= f_frameHeap && h < f_frameHeap + RE_NUM_FRAMES)));
+
+	// everything allocated after the marker is already gone if the heap was reset in the meantime
+	if (h->epoch != marker->epoch)
+		return;
+
+	Track(h->type, -(int64_t)(h->used - marker->used), 0, h->allocations - marker->allocations);
+
+	h->block = marker->block;
+	h->ptr = marker->ptr;
+	h->used = marker->used;
+	h->allocations = marker->allocations;
+}
+
+const char *
+Sys_MemoryHeapName(enum NeMemoryHeap heap)
+{
+	return heap < MH_Count ? f_heapNames[heap] : "Unknown";
+}
+
+void
+Sys_HeapStatistics(enum NeMemoryHeap heap, struct NeMemoryHeapStatistics *stats)
+{
+	int64_t bytes = 0;
+	uint64_t allocations = 0, frees = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	if (heap >= MH_Count)
+		return;
+
+	for (struct NeThreadHeapStatistics *ts = atomic_load_explicit(&f_heapStats, memory_order_acquire); ts; ts = ts->next) {
+		bytes += atomic_load_explicit(&ts->bytes[heap], memory_order_relaxed);
+		allocations += atomic_load_explicit(&ts->allocations[heap], memory_order_relaxed);
+		frees += atomic_load_explicit(&ts->frees[heap], memory_order_relaxed);
 	}
+
+	// the counters are read one at a time, a sum can briefly be behind its parts
+	stats->inUse = bytes > 0 ? (uint64_t)bytes : 0;
+	stats->allocations = allocations > frees ? allocations - frees : 0;
+	stats->peak = MAX(f_heapPeak[heap], stats->inUse);
+	stats->totalAllocations = allocations;
+	stats->totalFrees = frees;
+	stats->frameAllocations = f_frameAllocations[heap];
+	stats->frameFrees = f_frameFrees[heap];
+}
+
+void
+Sys_UpdateHeapStatistics(void)
+{
+	struct NeMemoryHeapStatistics stats;
+
+	for (enum NeMemoryHeap i = MH_Transient; i < MH_Count; ++i) {
+		Sys_HeapStatistics(i, &stats);
+
+		f_heapPeak[i] = stats.peak;
+		f_frameAllocations[i] = stats.totalAllocations - f_lastAllocations[i];
+		f_frameFrees[i] = stats.totalFrees - f_lastFrees[i];
+		f_lastAllocations[i] = stats.totalAllocations;
+		f_lastFrees[i] = stats.totalFrees;
+	}
+
+#ifdef NE_ALLOC_TRACE
+	Sys_TraceFrame();
+#endif
 }
 
 void
@@ -181,90 +392,302 @@ Sys_LogMemoryStatistics(void)
 {
 	if (E_WorkerId() == E_JobWorkerThreads()) {
 		for (uint32_t i = 0; i < RE_NUM_FRAMES; ++i)
-			Sys_LogEntry(MMOD, LOG_INFORMATION, "Main thread frame heap peak: %u/%u B (%.02f%%)",
-						f_frameHeap[i].peak, *f_frameHeap[i].size,
-						((double)f_frameHeap[i].peak / (double)*f_frameHeap[i].size) * 100.0);
+			Sys_LogEntry(MMOD, LOG_INFORMATION, "Main thread frame heap peak: %llu B, %u blocks of %llu B",
+						f_frameHeap[i].peak, HeapBlocks(&f_frameHeap[i]), *f_frameHeap[i].size);
+
+		Sys_LogEntry(MMOD, LOG_INFORMATION, "Main thread transient heap peak: %llu B, %u blocks of %llu B",
+					f_transientHeap.peak, HeapBlocks(&f_transientHeap), *f_transientHeap.size);
+
+		struct NeMemoryPoolStatistics ps;
+		Sys_PoolStatistics(&ps);
+		Sys_LogEntry(MMOD, LOG_INFORMATION, "Pool allocator: %llu allocations, %llu/%llu/%llu B requested/allocated/reserved in %llu spans",
+					ps.allocations, ps.requested, ps.allocated, ps.reserved, ps.spans);
+		Sys_LogEntry(MMOD, LOG_INFORMATION, "Pool allocator fragmentation: %.02f%% internal, %.02f%% external",
+					ps.internalFragmentation * 100.0, ps.externalFragmentation * 100.0);
 
-		Sys_LogEntry(MMOD, LOG_INFORMATION, "Main thread transient heap peak: %u/%u B (%.02f%%)",
-					f_transientHeap.peak, *f_transientHeap.size,
-					((double)f_transientHeap.peak / (double)*f_transientHeap.size) * 100.0);
+		for (enum NeMemoryHeap i = MH_Transient; i < MH_Count; ++i) {
+			struct NeMemoryHeapStatistics hs;
+			Sys_HeapStatistics(i, &hs);
+
+			if (!hs.totalAllocations)
+				continue;
+
+			Sys_LogEntry(MMOD, LOG_INFORMATION, "%s heap: %llu B in %llu allocations, peak %llu B, %llu allocations and %llu frees in total",
+						f_heapNames[i], hs.inUse, hs.allocations, hs.peak, hs.totalAllocations, hs.totalFrees);
+		}
+
+#ifdef NE_ALLOC_TRACE
+		Sys_LogAllocationLeaks();
+#endif
 	} else {
 		for (uint32_t i = 0; i < RE_NUM_FRAMES; ++i)
-			Sys_LogEntry(MMOD, LOG_INFORMATION, "Worker %d frame heap peak: %u/%u B (%.02f%%)",
-						E_WorkerId(), f_frameHeap[i].peak, *f_frameHeap[i].size,
-						((double)f_frameHeap[i].peak / (double)*f_frameHeap[i].size) * 100.0);
+			Sys_LogEntry(MMOD, LOG_INFORMATION, "Worker %d frame heap peak: %llu B, %u blocks of %llu B",
+						E_WorkerId(), f_frameHeap[i].peak, HeapBlocks(&f_frameHeap[i]), *f_frameHeap[i].size);
 
-		Sys_LogEntry(MMOD, LOG_INFORMATION, "Worker %d transient heap peak: %u/%u B (%.02f%%)",
-					E_WorkerId(), f_transientHeap.peak, *f_transientHeap.size,
-					((double)f_transientHeap.peak / (double)*f_transientHeap.size) * 100.0);
+		Sys_LogEntry(MMOD, LOG_INFORMATION, "Worker %d transient heap peak: %llu B, %u blocks of %llu B",
+					E_WorkerId(), f_transientHeap.peak, HeapBlocks(&f_transientHeap), *f_transientHeap.size);
 	}
 }
 
 void
 Sys_TermMemory(void)
 {
+	Sys_FlushPoolCache();
+
 	for (uint32_t i = 0; i < RE_NUM_FRAMES; ++i)
 		TermHeap(&f_frameHeap[i]);
 	TermHeap(&f_transientHeap);
 }
 
+static inline void *
+Allocate(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, bool zero, const char *file, int line)
+{
+	void *ret = NULL;
+	uint32_t magic = MAGIC;
+	struct NeAllocation *alloc = NULL;
+
+	size_t totalSize = size * count + sizeof(struct NeAllocation);
+	if ((count >= NE_MUL_NO_OVERFLOW || size >= NE_MUL_NO_OVERFLOW) && count > 0 && SIZE_MAX / count < size)
+		return NULL;
+
+	totalSize = NE_ROUND_UP(totalSize, alignment);
+	if (heap == MH_Transient || heap == MH_Frame) {
+		ret = HeapAllocate(ThreadHeap(heap), totalSize, alignment);
+	} else if (f_usePools && alignment <= NE_DEFAULT_ALIGNMENT &&
+				(heap == MH_Scene || heap == MH_Asset || heap == MH_Render || heap == MH_Script)) {
+		// blocks too large for the pool fall through to the system allocator
+		if ((ret = Sys_PoolAlloc(totalSize)))
+			magic = POOL_MAGIC;
+	}
+
+	if (!ret)
+		ret = aligned_alloc(alignment, totalSize);
+
+	assert("Out of memory" && ret);
+	if (!ret)
+		return NULL;
+
+	if (heap != MH_Transient && heap != MH_Frame)
+		Track(heap, (int64_t)totalSize, 1, 0);
+
+	if (zero)
+		Sys_ZeroMemory(ret, totalSize);
+
+	alloc = ret;
+	alloc->magic = magic;
+	alloc->heap = heap;
+	alloc->size = totalSize - sizeof(struct NeAllocation);
+
+#ifdef NE_ALLOC_TRACE
+	// the frame and transient heaps are meant for per frame allocations and are never freed
+	alloc->site = (heap == MH_Transient || heap == MH_Frame) ? 0 : Sys_TraceAllocation(file, line, heap, totalSize);
+#endif
+
+	if (alloc->heap == MH_Secure)
+		Sys_LockMemory(alloc, alloc->size);
+
+	ret = (uint8_t *)ret + sizeof(*alloc);
+
+	return ret;
+}
+
+static inline void
+Track(enum NeMemoryHeap heap, int64_t bytes, uint64_t allocations, uint64_t frees)
+{
+	struct NeThreadHeapStatistics *ts = f_threadStats;
+
+	if (heap >= MH_Count)
+		return;
+
+	if (!ts) {
+		ts = calloc(1, sizeof(*ts));
+		if (!ts)
+			return;
+
+		ts->next = atomic_load_explicit(&f_heapStats, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak_explicit(&f_heapStats, &ts->next, ts, memory_order_release, memory_order_relaxed))
+			;
+
+		f_threadStats = ts;
+	}
+
+	// only the owning thread writes these, so there is no need for atomic read-modify-write
+	atomic_store_explicit(&ts->bytes[heap], atomic_load_explicit(&ts->bytes[heap], memory_order_relaxed) + bytes, memory_order_relaxed);
+	if (allocations)
+		atomic_store_explicit(&ts->allocations[heap], atomic_load_explicit(&ts->allocations[heap], memory_order_relaxed) + allocations, memory_order_relaxed);
+	if (frees)
+		atomic_store_explicit(&ts->frees[heap], atomic_load_explicit(&ts->frees[heap], memory_order_relaxed) + frees, memory_order_relaxed);
+}
+
 static inline bool
-InitHeap(struct NeHeap *heap, uint64_t *size)
+InitHeap(struct NeHeap *heap, enum NeMemoryHeap type, uint64_t *size, _Atomic uint64_t *epoch)
 {
+	heap->type = type;
 	heap->size = size;
-	heap->heap = aligned_alloc(NE_DEFAULT_ALIGNMENT, (size_t)*heap->size);
+	heap->globalEpoch = epoch;
+	heap->epoch = atomic_load_explicit(epoch, memory_order_acquire);
+	heap->used = heap->peak = heap->windowPeak = heap->frames = heap->allocations = 0;
 
-	if (!heap->heap)
+	heap->first = aligned_alloc(NE_DEFAULT_ALIGNMENT, NE_ROUND_UP((size_t)*heap->size, NE_DEFAULT_ALIGNMENT));
+	if (!heap->first)
 		return false;
 
-	heap->ptr = heap->heap;
+	heap->first->next = NULL;
+	heap->first->end = (uint8_t *)heap->first + NE_ROUND_UP((size_t)*heap->size, NE_DEFAULT_ALIGNMENT);
+
+	heap->block = heap->first;
+	heap->ptr = (uint8_t *)(heap->first + 1);
 
 	return true;
 }
 
+static inline struct NeHeap *
+ThreadHeap(enum NeMemoryHeap heap)
+{
+	if (heap == MH_Transient)
+		return &f_transientHeap;
+	else if (heap == MH_Frame)
+		return &f_frameHeap[Re_frameId];
+	else
+		return NULL;
+}
+
 static inline void *
 HeapAllocate(struct NeHeap *heap, size_t size, size_t alignment)
 {
-	heap->ptr = (uint8_t *)NE_ROUND_UP((uintptr_t)heap->ptr, alignment);
+	if (heap->epoch != atomic_load_explicit(heap->globalEpoch, memory_order_acquire))
+		ResetHeap(heap);
+
+	const uint64_t used = heap->used;
+	uint8_t *ptr = (uint8_t *)NE_ROUND_UP((uintptr_t)heap->ptr, alignment);
+	while (ptr > heap->block->end || (size_t)(heap->block->end - ptr) < size) {
+		if (!NextBlock(heap, size + alignment)) {
+			Sys_LogEntry(MMOD, LOG_CRITICAL, "Worker %d: Out of transient memory ! Alloc Size = %llu", E_WorkerId(), size);
+			assert(!"Out of transient memory");
+			return NULL;
+		}
+
+		ptr = (uint8_t *)NE_ROUND_UP((uintptr_t)heap->ptr, alignment);
+	}
+
+	heap->used += (ptr + size) - heap->ptr;
+	heap->ptr = ptr + size;
+	heap->peak = MAX(heap->peak, heap->used);
+	++heap->allocations;
+
+	Track(heap->type, (int64_t)(heap->used - used), 1, 0);
 
-	if ((heap->ptr - heap->heap) + size > *heap->size) {
-		Sys_LogEntry(MMOD, LOG_CRITICAL, "Worker %d: Out of transient memory ! Alloc Size = %llu", E_WorkerId(), size);
-		assert(!"Out of transient memory");
+	return ptr;
+}
+
+static bool
+NextBlock(struct NeHeap *heap, size_t size)
+{
+	struct NeHeapBlock *next = heap->block->next;
+
+	if (!next || (size_t)(next->end - (uint8_t *)(next + 1)) < size) {
+		// allocations larger than the block size get a block of their own
+		const size_t blockSize = NE_ROUND_UP(MAX((size_t)*heap->size, size + sizeof(*next)), NE_DEFAULT_ALIGNMENT);
+
+		next = aligned_alloc(NE_DEFAULT_ALIGNMENT, blockSize);
+		if (!next)
+			return false;
+
+		next->end = (uint8_t *)next + blockSize;
+		next->next = heap->block->next;
+		heap->block->next = next;
 	}
 
-	void *ret = heap->ptr;
-	heap->ptr += size;
+	// the unused end of the block counts as used, the heap needed a new block anyway
+	heap->used += heap->block->end - heap->ptr;
 
-	return ret;
+	heap->block = next;
+	heap->ptr = (uint8_t *)(next + 1);
+
+	return true;
 }
 
 static inline void
 ResetHeap(struct NeHeap *heap)
 {
-	heap->peak = MAX(heap->peak, (size_t)(heap->ptr - heap->heap));
-	heap->ptr = heap->heap;
+	const uint64_t epoch = atomic_load_explicit(heap->globalEpoch, memory_order_acquire);
+
+	heap->windowPeak = MAX(heap->windowPeak, heap->used);
+
+	// resets this thread slept through count as frames in which the heap was not needed
+	heap->frames += epoch - heap->epoch;
+	heap->epoch = epoch;
+
+	if (heap->frames >= *f_shrinkFrames) {
+		ShrinkHeap(heap);
+		heap->frames = 0;
+		heap->windowPeak = 0;
+	}
+
+	Track(heap->type, -(int64_t)heap->used, 0, heap->allocations);
+
+	heap->block = heap->first;
+	heap->ptr = (uint8_t *)(heap->first + 1);
+	heap->used = 0;
+	heap->allocations = 0;
 }
 
-static inline void
-TermHeap(struct NeHeap *heap)
+static void
+ShrinkHeap(struct NeHeap *heap)
 {
+	uint64_t capacity = 0;
+	struct NeHeapBlock *last = heap->first;
+
+	for (;;) {
+		capacity += last->end - (uint8_t *)(last + 1);
+		if (capacity >= heap->windowPeak || !last->next)
+			break;
+		last = last->next;
+	}
+
+	struct NeHeapBlock *block = last->next;
+	last->next = NULL;
+
+	while (block) {
+		struct NeHeapBlock *next = block->next;
 #ifndef SYS_PLATFORM_WINDOWS
-	free(heap->heap);
+		free(block);
 #else
-	_aligned_free(heap->heap);
+		_aligned_free(block);
 #endif
+		block = next;
+	}
 }
 
-static void
-ResetTransientJob(int workerId, void *data)
+static inline uint32_t
+HeapBlocks(const struct NeHeap *heap)
 {
-	ResetHeap(&f_transientHeap);
+	uint32_t count = 0;
+	for (const struct NeHeapBlock *block = heap->first; block; block = block->next)
+		++count;
+	return count;
 }
 
-static void
-ResetFrameJob(int workerId, void *data)
+static inline void
+TermHeap(struct NeHeap *heap)
 {
-	ResetHeap(&f_frameHeap[Re_frameId]);
+	struct NeHeapBlock *block = heap->first;
+
+	Track(heap->type, -(int64_t)heap->used, 0, heap->allocations);
+	heap->used = heap->allocations = 0;
+
+	while (block) {
+		struct NeHeapBlock *next = block->next;
+#ifndef SYS_PLATFORM_WINDOWS
+		free(block);
+#else
+		_aligned_free(block);
+#endif
+		block = next;
+	}
+
+	heap->first = heap->block = NULL;
+	heap->ptr = NULL;
 }
 
 /* NekoEngine
@@ -0,0 +1,382 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <System/PlatformDetect.h>
+#include <System/Memory.h>
+#include <System/System.h>
+#include <System/Thread.h>
+#include <System/AtomicLock.h>
+
+#include NE_ATOMIC_HDR
+
+/*
+ * Size-class allocator for the long-lived heaps. Blocks are carved out of aligned spans that
+ * each serve a single class; each thread keeps a small free list per class and only returns
+ * to the shared span lists (under a lock) in batches. A span whose blocks have all been freed
+ * goes back to carving from its start; one empty span per class is kept around, the rest are
+ * returned to the system.
+ */
+
+#define POOL_SPAN_SIZE		(64 * 1024)
+#define POOL_SPAN_HEADER	64
+#define POOL_MAX_SIZE		(16 * 1024)
+#define POOL_CACHE_SIZE		(16 * 1024)
+#define POOL_MAX_BATCH		64
+#define POOL_CLASS_COUNT	35
+
+struct NePoolBlock
+{
+	struct NePoolBlock *next;
+};
+
+struct NePoolSpan
+{
+	struct NePoolBlock *free;
+	uint8_t *cursor, *end;
+	struct NePoolSpan *prev, *next;
+	uint32_t used;
+	bool partial;
+};
+
+struct NePoolClass
+{
+	struct NeAtomicLock lock;
+	struct NePoolSpan *partial, *empty;
+	uint32_t size, batch;
+};
+
+struct NePoolCache
+{
+	struct NePoolBlock *free;
+	uint32_t count;
+};
+
+struct NePoolThreadStats
+{
+	_Atomic int64_t allocated, requested, allocations;
+	struct NePoolThreadStats *next;
+};
+
+static inline uint32_t SizeClass(size_t size);
+static inline void AddStats(int64_t allocated, int64_t requested, int64_t allocations);
+static bool Refill(struct NePoolClass *pc, struct NePoolCache *cache);
+static void Release(struct NePoolClass *pc, struct NePoolCache *cache, uint32_t count);
+static inline struct NePoolSpan *NewSpan(struct NePoolClass *pc);
+static inline void ResetSpan(struct NePoolClass *pc, struct NePoolSpan *span);
+static inline void LinkSpan(struct NePoolClass *pc, struct NePoolSpan *span);
+static inline void UnlinkSpan(struct NePoolClass *pc, struct NePoolSpan *span);
+
+static struct NePoolClass f_classes[POOL_CLASS_COUNT] =
+{
+	{ .size = 32 }, { .size = 48 }, { .size = 64 }, { .size = 80 }, { .size = 96 }, { .size = 112 }, { .size = 128 },
+	{ .size = 160 }, { .size = 192 }, { .size = 224 }, { .size = 256 },
+	{ .size = 320 }, { .size = 384 }, { .size = 448 }, { .size = 512 },
+	{ .size = 640 }, { .size = 768 }, { .size = 896 }, { .size = 1024 },
+	{ .size = 1280 }, { .size = 1536 }, { .size = 1792 }, { .size = 2048 },
+	{ .size = 2560 }, { .size = 3072 }, { .size = 3584 }, { .size = 4096 },
+	{ .size = 5120 }, { .size = 6144 }, { .size = 7168 }, { .size = 8192 },
+	{ .size = 10240 }, { .size = 12288 }, { .size = 14336 }, { .size = 16384 }
+};
+
+static _Atomic uint64_t f_reserved, f_spans;
+static _Atomic(struct NePoolThreadStats *) f_threadStats;
+
+static THREAD_LOCAL struct NePoolCache f_cache[POOL_CLASS_COUNT];
+static THREAD_LOCAL struct NePoolThreadStats *f_stats;
+
+void *
+Sys_PoolAlloc(size_t size)
+{
+	if (size > POOL_MAX_SIZE)
+		return NULL;
+
+	const uint32_t id = SizeClass(size);
+	struct NePoolCache *cache = &f_cache[id];
+
+	if (!cache->free && !Refill(&f_classes[id], cache))
+		return NULL;
+
+	struct NePoolBlock *block = cache->free;
+	cache->free = block->next;
+	--cache->count;
+
+	AddStats(f_classes[id].size, (int64_t)size, 1);
+
+	return block;
+}
+
+void
+Sys_PoolFree(void *mem, size_t size)
+{
+	const uint32_t id = SizeClass(size);
+	struct NePoolCache *cache = &f_cache[id];
+	struct NePoolBlock *block = mem;
+
+	block->next = cache->free;
+	cache->free = block;
+
+	if (++cache->count > f_classes[id].batch * 2)
+		Release(&f_classes[id], cache, f_classes[id].batch);
+
+	AddStats(-(int64_t)f_classes[id].size, -(int64_t)size, -1);
+}
+
+bool
+Sys_PoolResize(size_t oldSize, size_t newSize)
+{
+	if (newSize > POOL_MAX_SIZE || SizeClass(oldSize) != SizeClass(newSize))
+		return false;
+
+	AddStats(0, (int64_t)newSize - (int64_t)oldSize, 0);
+	return true;
+}
+
+void
+Sys_FlushPoolCache(void)
+{
+	for (uint32_t i = 0; i < POOL_CLASS_COUNT; ++i)
+		if (f_cache[i].count)
+			Release(&f_classes[i], &f_cache[i], f_cache[i].count);
+}
+
+void
+Sys_PoolStatistics(struct NeMemoryPoolStatistics *stats)
+{
+	int64_t allocated = 0, requested = 0, allocations = 0;
+
+	for (struct NePoolThreadStats *ts = atomic_load_explicit(&f_threadStats, memory_order_acquire); ts; ts = ts->next) {
+		allocated += atomic_load_explicit(&ts->allocated, memory_order_relaxed);
+		requested += atomic_load_explicit(&ts->requested, memory_order_relaxed);
+		allocations += atomic_load_explicit(&ts->allocations, memory_order_relaxed);
+	}
+
+	// blocks freed on a different thread than the one that allocated them can make a partial sum negative
+	stats->reserved = atomic_load_explicit(&f_reserved, memory_order_relaxed);
+	stats->allocated = allocated > 0 ? (uint64_t)allocated : 0;
+	stats->requested = requested > 0 ? (uint64_t)requested : 0;
+	stats->allocations = allocations > 0 ? (uint64_t)allocations : 0;
+	stats->spans = atomic_load_explicit(&f_spans, memory_order_relaxed);
+
+	stats->internalFragmentation = stats->allocated ? 1.0 - (double)stats->requested / (double)stats->allocated : 0.0;
+	stats->externalFragmentation = stats->reserved ? 1.0 - (double)stats->allocated / (double)stats->reserved : 0.0;
+}
+
+static inline uint32_t
+SizeClass(size_t size)
+{
+	// 16 byte steps up to 128 bytes, then four classes for each power of two
+	if (size <= 128)
+		return size <= 32 ? 0 : (uint32_t)((size + 15) / 16) - 2;
+
+	uint32_t p = 7;
+	while (((size - 1) >> (p + 1)) != 0)
+		++p;
+
+	return 7 + (p - 7) * 4 + (uint32_t)(((size - 1) >> (p - 2)) & 3);
+}
+
+static inline void
+AddStats(int64_t allocated, int64_t requested, int64_t allocations)
+{
+	struct NePoolThreadStats *ts = f_stats;
+
+	if (!ts) {
+		// one record per thread, kept for the lifetime of the process so the totals stay correct
+		ts = calloc(1, sizeof(*ts));
+		if (!ts)
+			return;
+
+		ts->next = atomic_load_explicit(&f_threadStats, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak_explicit(&f_threadStats, &ts->next, ts, memory_order_release, memory_order_relaxed))
+			;
+
+		f_stats = ts;
+	}
+
+	// only the owning thread writes these
+	atomic_store_explicit(&ts->allocated, atomic_load_explicit(&ts->allocated, memory_order_relaxed) + allocated, memory_order_relaxed);
+	atomic_store_explicit(&ts->requested, atomic_load_explicit(&ts->requested, memory_order_relaxed) + requested, memory_order_relaxed);
+	atomic_store_explicit(&ts->allocations, atomic_load_explicit(&ts->allocations, memory_order_relaxed) + allocations, memory_order_relaxed);
+}
+
+static bool
+Refill(struct NePoolClass *pc, struct NePoolCache *cache)
+{
+	uint32_t count = 0;
+
+	Sys_AtomicLockWrite(&pc->lock);
+
+	if (!pc->batch) {
+		pc->batch = POOL_CACHE_SIZE / pc->size;
+		pc->batch = pc->batch < 2 ? 2 : (pc->batch > POOL_MAX_BATCH ? POOL_MAX_BATCH : pc->batch);
+	}
+
+	while (count < pc->batch) {
+		struct NePoolSpan *span = pc->partial;
+		if (!span) {
+			if (count || !(span = NewSpan(pc)))
+				break;
+		}
+
+		while (count < pc->batch) {
+			struct NePoolBlock *block = span->free;
+
+			if (block) {
+				span->free = block->next;
+			} else if (span->cursor != span->end) {
+				block = (struct NePoolBlock *)span->cursor;
+				span->cursor += pc->size;
+			} else {
+				break;
+			}
+
+			block->next = cache->free;
+			cache->free = block;
+			++span->used;
+			++count;
+		}
+
+		if (!span->free && span->cursor == span->end)
+			UnlinkSpan(pc, span);
+	}
+
+	Sys_AtomicUnlockWrite(&pc->lock);
+
+	cache->count += count;
+	return count > 0;
+}
+
+static void
+Release(struct NePoolClass *pc, struct NePoolCache *cache, uint32_t count)
+{
+	Sys_AtomicLockWrite(&pc->lock);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		struct NePoolBlock *block = cache->free;
+		struct NePoolSpan *span = (struct NePoolSpan *)((uintptr_t)block & ~(uintptr_t)(POOL_SPAN_SIZE - 1));
+
+		cache->free = block->next;
+
+		if (!--span->used) {
+			ResetSpan(pc, span);
+			continue;
+		}
+
+		block->next = span->free;
+		span->free = block;
+
+		if (!span->partial)
+			LinkSpan(pc, span);
+	}
+
+	Sys_AtomicUnlockWrite(&pc->lock);
+
+	cache->count -= count;
+}
+
+static inline struct NePoolSpan *
+NewSpan(struct NePoolClass *pc)
+{
+	struct NePoolSpan *span = pc->empty;
+
+	if (span) {
+		pc->empty = NULL;
+	} else {
+		span = aligned_alloc(POOL_SPAN_SIZE, POOL_SPAN_SIZE);
+		if (!span)
+			return NULL;
+
+		atomic_fetch_add_explicit(&f_reserved, POOL_SPAN_SIZE, memory_order_relaxed);
+		atomic_fetch_add_explicit(&f_spans, 1, memory_order_relaxed);
+	}
+
+	span->free = NULL;
+	span->cursor = (uint8_t *)span + POOL_SPAN_HEADER;
+	span->end = span->cursor + ((POOL_SPAN_SIZE - POOL_SPAN_HEADER) / pc->size) * pc->size;
+	span->used = 0;
+	span->partial = false;
+
+	LinkSpan(pc, span);
+
+	return span;
+}
+
+static inline void
+ResetSpan(struct NePoolClass *pc, struct NePoolSpan *span)
+{
+	if (span->partial)
+		UnlinkSpan(pc, span);
+
+	if (!pc->empty) {
+		pc->empty = span;
+		return;
+	}
+
+	atomic_fetch_sub_explicit(&f_reserved, POOL_SPAN_SIZE, memory_order_relaxed);
+	atomic_fetch_sub_explicit(&f_spans, 1, memory_order_relaxed);
+
+	aligned_free(span);
+}
+
+static inline void
+LinkSpan(struct NePoolClass *pc, struct NePoolSpan *span)
+{
+	span->prev = NULL;
+	span->next = pc->partial;
+	if (pc->partial)
+		pc->partial->prev = span;
+	pc->partial = span;
+	span->partial = true;
+}
+
+static inline void
+UnlinkSpan(struct NePoolClass *pc, struct NePoolSpan *span)
+{
+	if (span->prev)
+		span->prev->next = span->next;
+	else
+		pc->partial = span->next;
+
+	if (span->next)
+		span->next->prev = span->prev;
+
+	span->partial = false;
+}
+
+/* NekoEngine
+ *
+ * MemoryPool.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <Engine/Config.h>
+#include <System/Log.h>
+#include <System/Memory.h>
+#include <System/AtomicLock.h>
+
+#include NE_ATOMIC_HDR
+
+#ifdef NE_ALLOC_TRACE
+
+/*
+ * Allocation call site table for builds with ENABLE_ALLOC_TRACE. The Sys_Alloc family of macros
+ * passes __FILE__ and __LINE__; each site is looked up in an open addressing table the first
+ * time it allocates and its counters are updated atomically afterwards. Site 0 collects
+ * allocations made without a call site.
+ */
+
+#define TMOD				"AllocationTrace"
+#define TRACE_MAX_SITES		8192
+
+struct NeTraceSite
+{
+	const char *file;
+	int line;
+	enum NeMemoryHeap heap;
+	_Atomic bool used;
+	_Atomic int64_t bytes, live;
+	_Atomic uint64_t allocations, steadyState;
+	uint64_t lastAllocations, frameAllocations;
+};
+
+static inline uint32_t FindSite(const char *file, int line, enum NeMemoryHeap heap);
+static int SiteCompare(const void *a, const void *b);
+
+static struct NeTraceSite f_sites[TRACE_MAX_SITES] = { [0] = { .file = "(unknown)", .used = true } };
+static uint32_t f_siteIds[TRACE_MAX_SITES];
+static _Atomic uint32_t f_siteCount = 1;
+static struct NeAtomicLock f_siteLock;
+static _Atomic uint64_t f_frame;
+static uint32_t *f_steadyStateFrames;
+
+void
+Sys_InitAllocationTrace(void)
+{
+	f_steadyStateFrames = &E_GetCVarU32("Engine_AllocSteadyStateFrames", 0)->u32;
+}
+
+uint32_t
+Sys_TraceAllocation(const char *file, int line, enum NeMemoryHeap heap, uint64_t size)
+{
+	const uint32_t id = file ? FindSite(file, line, heap) : 0;
+	struct NeTraceSite *site = &f_sites[id];
+
+	atomic_fetch_add_explicit(&site->bytes, (int64_t)size, memory_order_relaxed);
+	atomic_fetch_add_explicit(&site->live, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&site->allocations, 1, memory_order_relaxed);
+
+	const uint32_t warmUp = f_steadyStateFrames ? *f_steadyStateFrames : 0;
+	if (warmUp && atomic_load_explicit(&f_frame, memory_order_relaxed) > warmUp) {
+		// report each site once, the counter keeps the total
+		if (!atomic_fetch_add_explicit(&site->steadyState, 1, memory_order_relaxed))
+			Sys_LogEntry(TMOD, LOG_WARNING, "Steady state allocation of %llu B from the %s heap at %s:%d (frame %llu)",
+						size, Sys_MemoryHeapName(heap), site->file, site->line, atomic_load(&f_frame));
+	}
+
+	return id;
+}
+
+void
+Sys_TraceFree(uint32_t id, uint64_t size)
+{
+	struct NeTraceSite *site = &f_sites[id < TRACE_MAX_SITES ? id : 0];
+
+	atomic_fetch_sub_explicit(&site->bytes, (int64_t)size, memory_order_relaxed);
+	atomic_fetch_sub_explicit(&site->live, 1, memory_order_relaxed);
+}
+
+void
+Sys_TraceResize(uint32_t id, int64_t delta)
+{
+	atomic_fetch_add_explicit(&f_sites[id < TRACE_MAX_SITES ? id : 0].bytes, delta, memory_order_relaxed);
+}
+
+void
+Sys_TraceFrame(void)
+{
+	const uint32_t count = atomic_load_explicit(&f_siteCount, memory_order_acquire);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		struct NeTraceSite *site = &f_sites[f_siteIds[i]];
+		const uint64_t allocations = atomic_load_explicit(&site->allocations, memory_order_relaxed);
+
+		site->frameAllocations = allocations - site->lastAllocations;
+		site->lastAllocations = allocations;
+	}
+
+	atomic_fetch_add_explicit(&f_frame, 1, memory_order_relaxed);
+}
+
+void
+Sys_LogAllocationLeaks(void)
+{
+	const uint32_t count = atomic_load_explicit(&f_siteCount, memory_order_acquire);
+	uint32_t *ids = calloc(count, sizeof(*ids)), leaks = 0;
+	int64_t bytes = 0;
+
+	if (!ids)
+		return;
+
+	for (uint32_t i = 0; i < count; ++i)
+		if (atomic_load_explicit(&f_sites[f_siteIds[i]].live, memory_order_relaxed) > 0)
+			ids[leaks++] = f_siteIds[i];
+
+	qsort(ids, leaks, sizeof(*ids), SiteCompare);
+
+	for (uint32_t i = 0; i < leaks; ++i) {
+		const struct NeTraceSite *site = &f_sites[ids[i]];
+		bytes += atomic_load(&site->bytes);
+
+		Sys_LogEntry(TMOD, LOG_WARNING, "%lld B in %lld allocations from the %s heap still allocated at %s:%d",
+					atomic_load(&site->bytes), atomic_load(&site->live), Sys_MemoryHeapName(site->heap), site->file, site->line);
+	}
+
+	Sys_LogEntry(TMOD, leaks ? LOG_WARNING : LOG_INFORMATION, "%u allocation sites with %lld B still allocated", leaks, bytes);
+
+	free(ids);
+}
+
+uint32_t
+Sys_AllocationSites(struct NeAllocationSite *sites, uint32_t max)
+{
+	const uint32_t count = atomic_load_explicit(&f_siteCount, memory_order_acquire);
+	uint32_t i;
+
+	for (i = 0; i < count && i < max; ++i) {
+		const struct NeTraceSite *site = &f_sites[f_siteIds[i]];
+
+		sites[i].file = site->file;
+		sites[i].line = site->line;
+		sites[i].heap = site->heap;
+		sites[i].bytes = atomic_load_explicit(&site->bytes, memory_order_relaxed);
+		sites[i].allocations = atomic_load_explicit(&site->live, memory_order_relaxed);
+		sites[i].totalAllocations = atomic_load_explicit(&site->allocations, memory_order_relaxed);
+		sites[i].frameAllocations = site->frameAllocations;
+		sites[i].steadyStateAllocations = atomic_load_explicit(&site->steadyState, memory_order_relaxed);
+	}
+
+	return i;
+}
+
+static inline uint32_t
+FindSite(const char *file, int line, enum NeMemoryHeap heap)
+{
+	const uint32_t hash = (uint32_t)(((uintptr_t)file >> 3) * 2654435761u) ^ ((uint32_t)line * 40503u);
+	uint32_t id = hash & (TRACE_MAX_SITES - 1);
+
+	// lookups don't lock; a slot's key is written before it is marked as used
+	for (uint32_t i = 0; i < TRACE_MAX_SITES; ++i, id = (id + 1) & (TRACE_MAX_SITES - 1)) {
+		if (!id)
+			continue;
+
+		struct NeTraceSite *site = &f_sites[id];
+		if (!atomic_load_explicit(&site->used, memory_order_acquire)) {
+			Sys_AtomicLockWrite(&f_siteLock);
+
+			// another thread might have taken the slot in the meantime
+			if (!atomic_load_explicit(&site->used, memory_order_acquire)) {
+				site->file = file;
+				site->line = line;
+				site->heap = heap;
+				atomic_store_explicit(&site->used, true, memory_order_release);
+
+				const uint32_t count = atomic_load_explicit(&f_siteCount, memory_order_relaxed);
+				f_siteIds[count] = id;
+				atomic_store_explicit(&f_siteCount, count + 1, memory_order_release);
+
+				Sys_AtomicUnlockWrite(&f_siteLock);
+				return id;
+			}
+
+			Sys_AtomicUnlockWrite(&f_siteLock);
+		}
+
+		if (site->line == line && site->file == file)
+			return id;
+	}
+
+	return 0;
+}
+
+static int
+SiteCompare(const void *a, const void *b)
+{
+	const int64_t sa = atomic_load(&f_sites[*(const uint32_t *)a].bytes);
+	const int64_t sb = atomic_load(&f_sites[*(const uint32_t *)b].bytes);
+	return sa < sb ? 1 : (sa > sb ? -1 : 0);
+}
+
+#else
+
+uint32_t
+Sys_AllocationSites(struct NeAllocationSite *sites, uint32_t max)
+{
+	return 0;
+}
+
+#endif
+
+/* NekoEngine
+ *
+ * MemoryTrace.c
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
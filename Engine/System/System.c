@@ -3,6 +3,13 @@
 
 bool Sys_InitPlatform(void);
 void Sys_TermPlatform(void);
+bool Sys_PlatformCpuTopology(struct NeCpuTopology *topo);
+
+static struct NeCpuTopology f_topology;
+
+static inline bool FlatTopology(struct NeCpuTopology *topo);
+static inline void SortTopology(struct NeCpuTopology *topo);
+static int CpuCmp(const void *a, const void *b);
 
 bool
 Sys_Init(void)
@@ -10,6 +17,12 @@ Sys_Init(void)
 	if (!Sys_InitPlatform())
 		return false;
 
+	// The platform reports raw ids, they are sorted & renumbered here
+	if (!Sys_PlatformCpuTopology(&f_topology) && !FlatTopology(&f_topology))
+		return false;
+
+	SortTopology(&f_topology);
+
 #ifdef _DEBUG
 	if (!Sys_InitDbgOut())
 		return false;
@@ -25,9 +38,100 @@ Sys_Term(void)
 	Sys_TermDbgOut();
 #endif
 
+	free(f_topology.cpus);
+	memset(&f_topology, 0x0, sizeof(f_topology));
+
 	Sys_TermPlatform();
 }
 
+const struct NeCpuTopology *
+Sys_CpuTopology(void)
+{
+	return &f_topology;
+}
+
+static inline bool
+FlatTopology(struct NeCpuTopology *topo)
+{
+	// No topology information; assume the SMT siblings are numbered next to each other
+	const uint32_t cores = Sys_CpuCount() ? Sys_CpuCount() : 1;
+	const uint32_t threads = Sys_CpuThreadCount() > cores ? Sys_CpuThreadCount() : cores;
+	const uint32_t smt = threads / cores;
+
+	topo->cpus = calloc(threads, sizeof(*topo->cpus));
+	if (!topo->cpus)
+		return false;
+
+	topo->cpuCount = threads;
+	for (uint32_t i = 0; i < threads; ++i) {
+		topo->cpus[i].id = i;
+		topo->cpus[i].core = i / smt;
+	}
+
+	return true;
+}
+
+static inline void
+SortTopology(struct NeCpuTopology *topo)
+{
+	qsort(topo->cpus, topo->cpuCount, sizeof(*topo->cpus), CpuCmp);
+
+	uint32_t *packages = calloc(topo->cpuCount, sizeof(*packages));
+	struct NeCpu prev = { 0 };
+
+	topo->coreCount = topo->cacheDomainCount = topo->nodeCount = topo->packageCount = 0;
+
+	for (uint32_t i = 0; i < topo->cpuCount; ++i) {
+		struct NeCpu *cpu = &topo->cpus[i];
+		const struct NeCpu raw = *cpu;
+
+		// nodes, cache domains & cores are contiguous after sorting, so they can be numbered in order
+		const bool newNode = !i || raw.node != prev.node;
+		const bool newDomain = newNode || raw.cacheDomain != prev.cacheDomain;
+		const bool newCore = newDomain || raw.core != prev.core;
+
+		topo->nodeCount += newNode;
+		topo->cacheDomainCount += newDomain;
+		topo->coreCount += newCore;
+
+		cpu->node = topo->nodeCount - 1;
+		cpu->cacheDomain = topo->cacheDomainCount - 1;
+		cpu->core = topo->coreCount - 1;
+		cpu->sibling = newCore ? 0 : topo->cpus[i - 1].sibling + 1;
+
+		uint32_t package = 0;
+		if (packages) {
+			while (package < topo->packageCount && packages[package] != raw.package)
+				++package;
+
+			if (package == topo->packageCount)
+				packages[topo->packageCount++] = raw.package;
+		}
+		cpu->package = package;
+
+		prev = raw;
+	}
+
+	if (!topo->packageCount)
+		topo->packageCount = 1;
+
+	free(packages);
+}
+
+static int
+CpuCmp(const void *a, const void *b)
+{
+	const struct NeCpu *ca = a, *cb = b;
+
+	if (ca->node != cb->node)
+		return ca->node < cb->node ? -1 : 1;
+	if (ca->cacheDomain != cb->cacheDomain)
+		return ca->cacheDomain < cb->cacheDomain ? -1 : 1;
+	if (ca->core != cb->core)
+		return ca->core < cb->core ? -1 : 1;
+	return ca->id < cb->id ? -1 : (ca->id > cb->id);
+}
+
 /* NekoEngine
  *
  * System.c
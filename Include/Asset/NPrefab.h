@@ -0,0 +1,62 @@
+#ifndef NE_ASSET_NPREFAB_H
+#define NE_ASSET_NPREFAB_H
+
+#include <Engine/Types.h>
+#include <Engine/Entity.h>
+
+#define NPREFAB_1_HEADER		0x000031424146504Ellu	// NPFAB1
+#define NPREFAB_FOOTER			0x0042414650444E45llu	// ENDPFAB
+#define NPREFAB_SEC_FOOTER		0x0054434553444E45llu	// ENDSECT
+#define NPREFAB_INFO_ID			0x4F464E49u				// INFO
+#define NPREFAB_COMP_ID			0x504D4F43u				// COMP
+#define NPREFAB_END_ID			0x50444E45u				// ENDP
+
+// A COMP section holds this structure, followed by the component's data and by argCount NUL terminated arguments
+struct NPrefabComp
+{
+	char type[MAX_ENTITY_NAME];
+	uint32_t dataSize;
+	uint32_t argCount;
+	uint32_t argSize;
+	uint32_t reserved;
+};
+
+#endif /* NE_ASSET_NPREFAB_H */
+
+/* NekoEngine
+ *
+ * NPrefab.h
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
@@ -23,11 +23,58 @@ struct NeComponentCreationData
 	void *ptr;
 };
 
+// Sent with EVT_COMPONENTS_CREATED once per type and commit, for the components of the type committed by Scn_Commit
+struct NeComponentCreationBatch
+{
+	NeCompTypeId type;
+	uint32_t count;
+	const struct NeComponentCreationData *components;
+};
+
 struct NeCompBase
 {
 	NE_COMPONENT_BASE;
 };
 
+// The field types of the header tool (nht), in the same order
+enum NeComponentFieldType
+{
+	CFT_Unknown,
+	CFT_UInt8,
+	CFT_UInt16,
+	CFT_UInt32,
+	CFT_UInt64,
+	CFT_Int8,
+	CFT_Int16,
+	CFT_Int32,
+	CFT_Int64,
+	CFT_Float,
+	CFT_Double,
+	CFT_Vec3,
+	CFT_Vec4,
+	CFT_Matrix,
+	CFT_String,
+	CFT_Bool,
+	CFT_Array
+};
+
+struct NeComponentField
+{
+	enum NeComponentFieldType type;
+	uint32_t offset;
+	const char *name;
+};
+
+#define NE_COMPONENT_FIELD(comp, field, type) { type, (uint32_t)offsetof(comp, field), #field }
+
+// Layout of the components of a type; span is the number of slots iteration walks and minSpan the number it would
+// walk if the storage was compact
+struct NeCompStorageInfo
+{
+	size_t count, span, minSpan, memory;
+	float fragmentation;
+};
+
 struct NeScene *Scn_GetScene(uint8_t);
 ENGINE_API extern struct NeScene *Scn_activeScene;
 
@@ -63,15 +110,69 @@ static inline NeEntityHandle E_ComponentOwner(NeCompHandle comp) { return E_Comp
 void E_SetComponentOwnerS(struct NeScene *s, NeCompHandle comp, NeEntityHandle owner);
 static inline void E_SetComponentOwner(NeCompHandle comp, NeEntityHandle owner) { E_SetComponentOwnerS(Scn_activeScene, comp, owner); }
 
+// Not available in scenes that use archetype storage, where the components of a type are not contiguous
 const struct NeArray *E_GetAllComponentsS(struct NeScene *s, NeCompTypeId type);
 static inline const struct NeArray *E_GetAllComponents(NeCompTypeId type) { return E_GetAllComponentsS(Scn_activeScene, type); }
 
+// Calls proc for every valid component of the type until it returns false
+void E_ForEachComponentS(struct NeScene *s, NeCompTypeId type, NeCompIteratorProc proc, void *user);
+static inline void E_ForEachComponent(NeCompTypeId type, NeCompIteratorProc proc, void *user) { E_ForEachComponentS(Scn_activeScene, type, proc, user); }
+
+bool E_ComponentStorageInfoS(struct NeScene *s, NeCompTypeId type, struct NeCompStorageInfo *info);
+static inline bool E_ComponentStorageInfo(NeCompTypeId type, struct NeCompStorageInfo *info) { return E_ComponentStorageInfoS(Scn_activeScene, type, info); }
+
+// Compacts the component storage of the scene for up to budget nanoseconds, continuing from where the previous call
+// stopped. Scn_Commit calls this when the Engine_CompactionBudget CVar is set (microseconds, 0 by default). The
+// components are moved over the free slots, keeping their order, and in per-type storage the types that have a sort
+// key are sorted by it; handles stay valid, but pointers to the components are invalidated as by Scn_Commit.
+void E_CompactComponentsS(struct NeScene *s, uint64_t budget);
+static inline void E_CompactComponents(uint64_t budget) { E_CompactComponentsS(Scn_activeScene, budget); }
+
+// Marks the order of the type's components as stale, so that the next compaction sorts them again; Scn_Commit calls
+// this for the types it commits components of, the types whose sort keys change call it too
+void E_ComponentOrderChangedS(struct NeScene *s, NeCompTypeId type);
+static inline void E_ComponentOrderChanged(NeCompTypeId type) { E_ComponentOrderChangedS(Scn_activeScene, type); }
+
+// Records a change of the component for the systems that filter its type with ECSYS_CHANGED
+void E_MarkComponentChangedS(struct NeScene *s, NeCompHandle comp);
+static inline void E_MarkComponentChanged(NeCompHandle comp) { E_MarkComponentChangedS(Scn_activeScene, comp); }
+
+// Returns the component for writing and marks it as changed
+static inline void *
+E_MutableComponentPtrS(struct NeScene *s, NeCompHandle comp)
+{
+	void *ptr = E_ComponentPtrS(s, comp);
+	if (ptr)
+		E_MarkComponentChangedS(s, comp);
+	return ptr;
+}
+static inline void *E_MutableComponentPtr(NeCompHandle comp) { return E_MutableComponentPtrS(Scn_activeScene, comp); }
+
 #define E_ComponentHandle(comp) ((comp)->_handleId | (uint64_t)(comp)->_typeId << 32)
 static inline NeEntityHandle E_ComponentOwnerHandle(struct NeCompBase *comp) { return comp->_owner; }
 static inline struct NeScene *E_ComponentScene(struct NeCompBase *comp) { return Scn_GetScene((uint8_t)comp->_sceneId); }
 
 bool E_RegisterComponent(const char *name, size_t size, size_t alignment, NeCompInitProc init, NeCompMessageHandlerProc handler, NeCompTermProc release, NeCompTypeId *id);
 
+// Components instantiated from a prefab are copied from its template, then this is called to acquire the resources the
+// component owns, without using the template's, and to apply the transform of the instance, which can be NULL.
+// Types that have a termination function but no instantiate function are initialized with the prefab's arguments.
+bool E_SetComponentInstantiateProc(NeCompTypeId type, NeCompInstantiateProc instantiate);
+
+// Initializes the template of a prefab created from arguments (see E_CreatePrefab). The template is not part of a
+// scene, so this must not acquire resources or look up other entities and components. The prefabs of types that have
+// an initialization function but no template function keep only the arguments.
+bool E_SetComponentTemplateProc(NeCompTypeId type, NeCompInitProc initTemplate);
+
+// Gives the key compaction sorts the components of a type by in per-type storage, e.g. the place of a transform in
+// the hierarchy. The key is read while the scene is committed, so it must not lock the scene.
+bool E_SetComponentSortProc(NeCompTypeId type, NeCompSortKeyProc sortKey);
+
+// Describes the fields of a type, as the header tool reports them, so batched script systems can access them in
+// place. The names must remain valid while the type is registered.
+bool E_SetComponentFields(NeCompTypeId type, const struct NeComponentField *fields, uint32_t count);
+const struct NeComponentField *E_ComponentFields(NeCompTypeId type, uint32_t *count);
+
 #define NE_REGISTER_COMPONENT(name, type, alignment, init, handler, release) \
 	NeCompTypeId name ## _ID;\
 	NE_INITIALIZER(NeCompRegister_ ## name) { E_RegisterComponent(name, sizeof(type), alignment, (NeCompInitProc)init, (NeCompMessageHandlerProc)handler, (NeCompTermProc)release, &name ## _ID); }
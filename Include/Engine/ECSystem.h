@@ -29,8 +29,63 @@ extern "C" {
 
 ENGINE_API extern struct NeScene *Scn_activeScene;
 
-bool E_RegisterSystem(const char *name, uint64_t group, const char **comp, size_t numComp, NeECSysExecProc proc, int32_t priority, bool singleThread);
-bool E_RegisterSystemId(const char *name, uint64_t group, const NeCompTypeId *comp, size_t numComp, NeECSysExecProc proc, int32_t priority, bool singleThread);
+/*
+ * Components are passed to the system as writable unless they're declared read-only with ECSYS_READ (names,
+ * e.g. ECSYS_READ(NE_TRANSFORM)) or ECSYS_READ_ID (type ids); script systems use "const Transform".
+ * E_ExecuteSystemGroupS runs the systems of a group concurrently, except for the ones that access the same
+ * component type with at least one of them writing it, which run in priority order. Single threaded systems
+ * always run on the calling thread. Systems must not touch other components than the ones they declare, unless they
+ * are registered with ECSYS_EXCLUSIVE, which keeps them from running at the same time as any other system of the
+ * group; script systems are always exclusive, since they can look up any component. Engine_ValidateSystemAccess logs
+ * systems that look up undeclared types or write to read-only ones, and makes the former exclusive.
+ *
+ * Systems that declare types with ECSYS_CHANGED (e.g. ECSYS_READ(ECSYS_CHANGED(NE_TRANSFORM)), or "const changed
+ * Transform" in scripts) only run for the entities that have at least one of these components changed since the
+ * start of their previous run. Components are changed when they're created and when they're marked with
+ * E_MarkComponentChanged or accessed with E_MutableComponentPtr; writing through the pointer a system receives
+ * doesn't mark the component.
+ */
+#define ECSYS_READ_ONLY_BIT				((NeCompTypeId)1 << (sizeof(NeCompTypeId) * 8 - 1))
+#define ECSYS_READ_ONLY_PREFIX			"const "
+#define ECSYS_READ(type)				ECSYS_READ_ONLY_PREFIX type
+#define ECSYS_READ_ID(id)				((id) | ECSYS_READ_ONLY_BIT)
+
+#define ECSYS_CHANGED_BIT				(ECSYS_READ_ONLY_BIT >> 1)
+#define ECSYS_CHANGED_PREFIX			"changed "
+#define ECSYS_CHANGED(type)				ECSYS_CHANGED_PREFIX type
+#define ECSYS_CHANGED_ID(id)			((id) | ECSYS_CHANGED_BIT)
+
+/*
+ * Registration flags. Passing true or false is the same as ECSYS_SINGLE_THREAD or no flags.
+ *
+ * Systems that don't need to visit every component each frame can be time-sliced. ECSYS_AMORTIZE(n) runs a rotating
+ * 1/n of the components on every execution, so all of them are visited once every n executions. ECSYS_BUDGET(us)
+ * runs as many components as fit in the budget, in microseconds, predicted from the time the previous slices took,
+ * and the next execution continues from there; ECSYS_AMORTIZE takes precedence if both are set. Script systems set
+ * "amortize" and "budget" in their NeSystem table. Slices are made of entities, or components for systems of one type
+ * in scenes that don't use archetype storage. Each scene keeps its own progress; a system registered or reloaded since
+ * the last commit of a scene runs all its components there once.
+ * Time-sliced systems can't filter on changed components; the flags are ignored for them.
+ */
+#define ECSYS_SINGLE_THREAD				0x00000001u
+#define ECSYS_EXCLUSIVE					0x00000002u
+#define ECSYS_AMORTIZE(frames)			(((uint32_t)(frames) & 0xff) << 8)
+#define ECSYS_BUDGET(us)				(((uint32_t)(us) & 0xffff) << 16)
+
+struct NeSystemStats
+{
+	uint64_t runs;			// executions
+	uint64_t passes;		// executions that reached the last component
+	uint64_t items;			// components, entities or chunks (if not time-sliced) visited by the last execution
+	uint64_t lastTime;		// duration of the last execution, in nanoseconds
+	uint64_t averageTime;	// moving average of the durations
+	uint64_t maxTime;
+};
+
+bool E_RegisterSystem(const char *name, uint64_t group, const char **comp, size_t numComp, NeECSysExecProc proc, int32_t priority, uint32_t flags);
+bool E_RegisterSystemId(const char *name, uint64_t group, const NeCompTypeId *comp, size_t numComp, NeECSysExecProc proc, int32_t priority, uint32_t flags);
+
+bool E_SystemStats(uint64_t hash, struct NeSystemStats *stats);
 
 void E_ExecuteSystemS(struct NeScene *s, uint64_t hash, void *args);
 static inline void E_ExecuteSystemByNameS(struct NeScene *s, const char *name, void *args) { E_ExecuteSystemS(s, Rt_HashString(name), args); }
@@ -42,17 +97,17 @@ static inline void E_ExecuteSystemGroupByNameS(struct NeScene *s, const char *na
 static inline void E_ExecuteSystemGroup(uint64_t hash) { E_ExecuteSystemGroupS(Scn_activeScene, hash); }
 static inline void E_ExecuteSystemGroupByName(const char *name) { E_ExecuteSystemGroupByNameS(Scn_activeScene, name); }
 
-#define NE_REGISTER_SYSTEM(name, group, proc, priority, singleThread, compCount, ...)													\
+#define NE_REGISTER_SYSTEM(name, group, proc, priority, flags, compCount, ...)															\
 	NE_INITIALIZER(NeSysRegister_ ## name) {																							\
 		const char *components[compCount] = { __VA_ARGS__ };																			\
-		E_RegisterSystem(name, Rt_HashLiteral(group), components, compCount, (NeECSysExecProc)proc, priority, singleThread);			\
+		E_RegisterSystem(name, Rt_HashLiteral(group), components, compCount, (NeECSysExecProc)proc, priority, flags);					\
 	}
 
-#define NE_SYSTEM(name, group, priority, singleThread, argsType, compCount, ...)														\
+#define NE_SYSTEM(name, group, priority, flags, argsType, compCount, ...)																\
 	static void NeSys_ ## name(void **comp, argsType *args);																			\
 	NE_INITIALIZER(NeSysRegister_ ## name) {																							\
 		const char *components[compCount] = { __VA_ARGS__ };																			\
-		E_RegisterSystem(name, Rt_HashLiteral(group), components, compCount, (NeECSysExecProc)NeSys_ ## name, priority, singleThread);	\
+		E_RegisterSystem(name, Rt_HashLiteral(group), components, compCount, (NeECSysExecProc)NeSys_ ## name, priority, flags);			\
 	}																																	\
 	static void NeSys_ ## name(void **comp, argsType *args)
 
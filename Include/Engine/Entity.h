@@ -47,6 +47,7 @@ NeEntityHandle E_CreateEntityWithComponentsS(struct NeScene *s, const char *name
 
 bool E_AddComponent(NeEntityHandle handle, NeCompTypeId type, NeCompHandle comp);
 bool E_AddNewComponent(NeEntityHandle handle, NeCompTypeId type, const void **args);
+bool E_AddNewComponentS(struct NeScene *s, NeEntityHandle handle, NeCompTypeId type, const void **args);
 
 void *E_GetComponent(NeEntityHandle ent, NeCompTypeId type);
 NeCompHandle E_GetComponentHandle(NeEntityHandle ent, NeCompTypeId type);
@@ -56,8 +57,15 @@ NeCompHandle E_GetComponentHandle(NeEntityHandle ent, NeCompTypeId type);
 //
 void E_GetComponents(NeEntityHandle ent, struct NeArray *comp);
 void E_RemoveComponent(NeEntityHandle ent, NeCompTypeId type);
+void E_RemoveComponentS(struct NeScene *s, NeEntityHandle ent, NeCompTypeId type);
 void E_DestroyEntity(NeEntityHandle ent);
+void E_DestroyEntityS(struct NeScene *s, NeEntityHandle ent);
+
+//
+// Handles of destroyed entities are detected; E_EntityPtr returns NULL for them.
+//
 void *E_EntityPtr(NeEntityHandle ent);
+static inline bool E_IsValidEntity(NeEntityHandle ent) { return E_EntityPtr(ent) != NULL; }
 
 bool E_RegisterEntityType(const char *name, const NeCompTypeId *compTypes, uint8_t type_count);
 
@@ -72,6 +80,30 @@ static inline NeEntityHandle E_FindEntity(const char *name) { return E_FindEntit
 
 void E_SendMessage(NeEntityHandle dst, uint32_t msg, const void *data);
 
+//
+// Deferred structural changes, safe to record from systems running on job workers. The commands are recorded in a
+// buffer of the calling worker, without locking, and Scn_Commit applies them by kind: entities are created, then
+// components added, components removed and entities destroyed; parents are set after the new components are committed.
+// Commands of the same kind run in the order they were recorded, workers in order. The component arguments must
+// stay valid until Scn_Commit. E_DeferCreateEntityS returns the handle of the entity it will create, so the other
+// commands can refer to it.
+//
+NeEntityHandle E_DeferCreateEntityS(struct NeScene *s, const char *name);
+static inline NeEntityHandle E_DeferCreateEntity(const char *name) { return E_DeferCreateEntityS(Scn_activeScene, name); }
+
+void E_DeferAddComponentS(struct NeScene *s, NeEntityHandle ent, NeCompTypeId type, const void **args);
+static inline void E_DeferAddComponent(NeEntityHandle ent, NeCompTypeId type, const void **args)
+{ E_DeferAddComponentS(Scn_activeScene, ent, type, args); }
+
+void E_DeferRemoveComponentS(struct NeScene *s, NeEntityHandle ent, NeCompTypeId type);
+static inline void E_DeferRemoveComponent(NeEntityHandle ent, NeCompTypeId type) { E_DeferRemoveComponentS(Scn_activeScene, ent, type); }
+
+void E_DeferDestroyEntityS(struct NeScene *s, NeEntityHandle ent);
+static inline void E_DeferDestroyEntity(NeEntityHandle ent) { E_DeferDestroyEntityS(Scn_activeScene, ent); }
+
+void E_DeferSetParentS(struct NeScene *s, NeEntityHandle ent, NeEntityHandle parent);
+static inline void E_DeferSetParent(NeEntityHandle ent, NeEntityHandle parent) { E_DeferSetParentS(Scn_activeScene, ent, parent); }
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,7 +17,7 @@ extern "C" {
 #define EVT_ENTITY_CREATED				"EntityCreated"
 #define EVT_ENTITY_DESTROYED			"EntityDestroyed"
 
-#define EVT_COMPONENT_CREATED			"ComponentCreated"
+#define EVT_COMPONENTS_CREATED			"ComponentsCreated"
 #define EVT_COMPONENT_DESTROYED			"ComponentDestroyed"
 
 #ifdef __cplusplus
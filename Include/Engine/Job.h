@@ -4,21 +4,110 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include <System/AtomicLock.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * Workers always take jobs from the highest priority lane that has any. Background jobs are
+ * for asset streaming & decompression; they only run on a limited number of workers at a time
+ * (Engine_MaxBackgroundJobWorkers) and threads waiting on a counter never pick them up, so
+ * long loads can't delay the frame.
+ */
+enum NeJobPriority
+{
+	JP_FrameCritical,
+	JP_Normal,
+	JP_Background,
+
+	JP_Count
+};
+
 typedef void (*NeJobProc)(int worker, void *args);
 typedef void (*NeJobCompletedProc)(uint64_t id, void *args);
+typedef void (*NeParallelForProc)(int worker, uint64_t begin, uint64_t end, void *userData);
+
+/*
+ * Counts the jobs submitted with it that haven't finished yet. Jobs submitted with a counter as
+ * their dependency are queued until it reaches zero. The counter must outlive every job that
+ * references it; pending jobs are allocated from the frame heap of the submitting thread.
+ */
+struct NeJobCounter
+{
+	NE_ATOMIC_UINT value;
+	struct NeAtomicLock lock;
+	struct NeDependentJob *pending;
+};
 
 bool E_InitJobSystem(void);
 
 uint32_t E_JobWorkerThreads(void);
 uint32_t E_WorkerId(void);
 
+/*
+ * The CPU the worker is pinned to, from Sys_CpuTopology; NULL for the main thread or if the
+ * topology is unknown. The workers allocate their heaps after they're pinned.
+ */
+const struct NeCpu *E_JobWorkerCpu(uint32_t worker);
+
 uint64_t E_ExecuteJob(NeJobProc proc, void *args, NeJobCompletedProc completed, void *completionArgs);
 uint64_t E_DispatchJobs(uint64_t count, NeJobProc proc, void **args, NeJobCompletedProc completed, void *completionArgs);
 
+void E_InitJobCounter(struct NeJobCounter *counter);
+
+/*
+ * Counters can also track work that isn't a job: E_RetainJobCounter adds to the counter and every
+ * E_ReleaseJobCounter takes one back, releasing the dependent jobs & waiters when it reaches zero,
+ * same as a finished job.
+ */
+void E_RetainJobCounter(struct NeJobCounter *counter, uint32_t count);
+void E_ReleaseJobCounter(struct NeJobCounter *counter);
+
+uint64_t E_ExecuteDependentJob(enum NeJobPriority priority, NeJobProc proc, void *args, NeJobCompletedProc completed,
+							   void *completionArgs, struct NeJobCounter *dependency, struct NeJobCounter *counter);
+uint64_t E_DispatchDependentJobs(enum NeJobPriority priority, uint64_t count, NeJobProc proc, void **args,
+								 NeJobCompletedProc completed, void *completionArgs,
+								 struct NeJobCounter *dependency, struct NeJobCounter *counter);
+
+/*
+ * Blocks until the counter reaches zero. The calling thread executes pending jobs while it waits
+ * and only sleeps when there's nothing left to run.
+ */
+void E_WaitForJobCounter(struct NeJobCounter *counter);
+
+/*
+ * Jobs submitted to the lane that haven't started yet. A background depth that keeps growing
+ * means the lane is being starved.
+ */
+uint32_t E_JobQueueDepth(enum NeJobPriority priority);
+
+/*
+ * Calls proc for sub-ranges of [begin, end) no larger than grain and returns when all of them finished.
+ * The range is split in half recursively, so the largest pieces are the ones left for other workers
+ * to steal. A grain of 0 picks one based on the number of workers. The sub-ranges run
+ * with the priority of the calling job (frame-critical on the main thread).
+ */
+void E_ParallelFor(uint64_t begin, uint64_t end, uint64_t grain, NeParallelForProc proc, void *userData);
+
+/*
+ * Names the jobs submitted by the calling thread in job traces, until it's changed again; jobs
+ * inherit the label of the job that submitted them. The string must remain valid until the trace
+ * is written. Returns the previous label so it can be restored.
+ */
+const char *E_SetJobLabel(const char *label);
+
+/*
+ * Records the start & end time, worker and queue wait time of every job that runs while the trace
+ * is active. E_WriteJobTrace saves the events in the Chrome trace event format (chrome://tracing,
+ * ui.perfetto.dev); a NULL file uses Engine_JobTraceFile. Setting Engine_JobTrace starts tracing
+ * when the job system starts and writes the trace when it stops.
+ */
+void E_StartJobTrace(void);
+void E_StopJobTrace(void);
+bool E_WriteJobTrace(const char *file);
+
 void E_TermJobSystem(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,89 @@
+#ifndef NE_ENGINE_PREFAB_H
+#define NE_ENGINE_PREFAB_H
+
+#include <Math/Types.h>
+#include <Engine/Types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Placement of a prefab instance, applied by the instantiate function of the component that holds it
+struct NePrefabTransform
+{
+	struct NeVec3 position;
+	struct NeQuaternion rotation;
+	struct NeVec3 scale;
+};
+
+ENGINE_API extern struct NeScene *Scn_activeScene;
+
+//
+// A prefab holds an initialized copy of each component of an entity, so instances are created by copying the copies
+// instead of parsing the arguments of every component. Components that own resources are copied only if their type
+// has an instantiate function (see E_SetComponentInstantiateProc), and components that have an initialization function
+// only if their type has a template function (see E_SetComponentTemplateProc); the others are initialized with the
+// arguments the prefab was created with. Arguments that refer to other entities, like the parent of a transform, are
+// not supported.
+//
+struct NePrefab *E_CreatePrefab(const char *name, const NeCompTypeId *compTypes, const void ***compArgs, uint8_t typeCount);
+
+struct NePrefab *E_CreatePrefabFromEntityS(struct NeScene *s, NeEntityHandle ent, const char *name);
+static inline struct NePrefab *E_CreatePrefabFromEntity(NeEntityHandle ent, const char *name) { return E_CreatePrefabFromEntityS(Scn_activeScene, ent, name); }
+
+struct NePrefab *E_LoadPrefab(struct NeStream *stm);
+bool E_SavePrefab(const struct NePrefab *prefab, struct NeStream *stm);
+void E_DestroyPrefab(struct NePrefab *prefab);
+
+//
+// Creates count entities, named after the prefab, allocating their components of each type at once; the entities and
+// their components are committed by Scn_Commit. transforms, if not NULL, holds the placement of each instance and
+// entities, if not NULL, receives their handles.
+//
+bool E_InstantiatePrefabS(struct NeScene *s, const struct NePrefab *prefab, uint32_t count, const struct NePrefabTransform *transforms, NeEntityHandle *entities);
+static inline bool E_InstantiatePrefab(const struct NePrefab *prefab, uint32_t count, const struct NePrefabTransform *transforms, NeEntityHandle *entities)
+{ return E_InstantiatePrefabS(Scn_activeScene, prefab, count, transforms, entities); }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NE_ENGINE_PREFAB_H */
+
+/* NekoEngine
+ *
+ * Prefab.h
+ * Author: Alexandru Naiman
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015-2023, Alexandru Naiman
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ALEXANDRU NAIMAN "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL ALEXANDRU NAIMAN BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * -----------------------------------------------------------------------------
+ */
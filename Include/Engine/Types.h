@@ -117,6 +117,9 @@ struct NeAnimationClipCreateInfo;
 
 struct NeEntityComp;
 struct NeComponentCreationData;
+struct NeComponentCreationBatch;
+struct NePrefab;
+struct NePrefabTransform;
 
 struct NeMorph;
 struct NeMorphPack;
@@ -152,6 +155,9 @@ typedef NeHandle NeCompHandle;
 typedef bool (*NeCompInitProc)(void *comp, const void **args);
 typedef void (*NeCompMessageHandlerProc)(void *comp, uint32_t msg, const void *data);
 typedef void (*NeCompTermProc)(void *comp);
+typedef bool (*NeCompIteratorProc)(void *comp, void *user);
+typedef bool (*NeCompInstantiateProc)(void *comp, const struct NePrefabTransform *xform);
+typedef uint64_t (*NeCompSortKeyProc)(struct NeScene *s, const void *comp);
 
 typedef void (*NeECSysExecProc)(void **comp, void *args);
 
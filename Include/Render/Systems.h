@@ -36,7 +36,7 @@ struct NeCollectDrawablesArgs
 	struct NeArray *opaqueDrawableArrays, *blendedDrawableArrays, *instanceArrays, blendedDrawables;
 	uint32_t *instanceOffset;
 	uint32_t maxDrawables, requiredDrawables, drawableCount;
-	NE_ALIGN(16) NE_ATOMIC_UINT nextArray, totalDrawables, visibleDrawables;
+	NE_ALIGN(16) NE_ATOMIC_UINT totalDrawables, visibleDrawables;
 	struct NeScene *s;
 	struct NeVec3 camPos;
 	struct NeFrustum camFrustum;
@@ -68,6 +68,7 @@ Rt_ResizeQueue(struct NeQueue *q, size_t size)
 	if (q->size == size)
 		return true;
 
+	const size_t oldSize = q->size;
 	uint8_t *tmp = q->data;
 	if ((q->data = (uint8_t *)Sys_ReAlloc(q->data, size, q->elemSize, q->heap)) == NULL) {
 		q->data = tmp;
@@ -76,6 +77,18 @@ Rt_ResizeQueue(struct NeQueue *q, size_t size)
 
 	q->size = size;
 
+	// move the part before the wrap point to the end of the new buffer
+	if (q->count && size > oldSize) {
+		if (q->start == oldSize)
+			q->start = 0;
+
+		if (q->end <= q->start) {
+			const size_t tail = oldSize - q->start;
+			memmove(q->data + q->elemSize * (size - tail), q->data + q->elemSize * q->start, q->elemSize * tail);
+			q->start = size - tail;
+		}
+	}
+
 	if (q->size < q->count)
 		q->count = q->size;
 
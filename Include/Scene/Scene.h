@@ -16,7 +16,7 @@ extern "C" {
 
 struct NeScene
 {
-	struct NeArray entities, compData, compFree;
+	struct NeArray entities, compData, compSlot, compFree;
 	struct NeCollectDrawablesArgs collect;
 	NeBufferHandle sceneData;
 	uint32_t maxLights, maxInstances, lightCount;
@@ -24,7 +24,7 @@ struct NeScene
 	NeHandle camera;
 
 	struct {
-		struct NeAtomicLock comp, newComp, entity, newEntity;
+		struct NeAtomicLock comp, newComp, entity, newEntity, command;
 	} lock;
 
 	uint8_t *dataPtr;
@@ -39,6 +39,16 @@ struct NeScene
 	uint8_t id;
 
 	struct NeArray newEntities, newCompData, newCompOffset;
+	struct NeEntityNameIndex *entityNames;
+	struct NeArray entityCommands;
+	struct NeArray queries, systemSlices;
+	struct NeSceneChanges *changes;
+	struct NeTransformHierarchy *transforms;
+
+	bool archetypeStorage;
+	struct NeArray archetypes, compLocation, movedComp, destroyedComp;
+	struct NeArray compCompact;
+	uint32_t compactArchetype, compactType;
 };
 
 struct NeTerrainCreateInfo
@@ -72,6 +82,20 @@ const struct NeLightData * const Scn_VisibleLights(struct NeScene *scn);
 
 bool Scn_CreateTerrain(struct NeScene *scn, const struct NeTerrainCreateInfo *tci);
 
+// Attaches the transform of child to the transform of parent; a NULL parent detaches it
+bool Scn_SetParent(struct NeScene *scn, NeEntityHandle child, NeEntityHandle parent);
+
+// False when parent has no transform, or it is child or one of its descendants
+bool Scn_CanSetParent(struct NeScene *scn, NeEntityHandle child, NeEntityHandle parent);
+
+// Computes the matrices of the transforms that moved, parents before children; Re_RenderScene calls it before the
+// pre-render systems
+void Scn_UpdateTransforms(struct NeScene *scn);
+void Scn_TermTransforms(struct NeScene *scn);
+
+// Queues the transforms committed by Scn_Commit and the ones moved since the last commit for the next update
+void Scn_CommitTransforms(struct NeScene *scn);
+
 uint32_t Scn_LightCount(struct NeScene *scn);
 
 #ifdef __cplusplus
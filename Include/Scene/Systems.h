@@ -7,7 +7,6 @@
 extern "C" {
 #endif
 
-#define SCN_UPDATE_TRANSFORM	"Scn_UpdateTransform"
 #define SCN_UPDATE_CAMERA		"Scn_UpdateCamera"
 
 #define UI_RESET_CONTEXT		"UI_ResetContext"
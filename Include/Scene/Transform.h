@@ -27,8 +27,6 @@ struct NeTransform
 	struct NeArray children;
 };
 
-void Scn_UpdateTransform(void **comp, void *args);
-
 static inline void
 Xform_UpdateOrientation(struct NeTransform *t)
 {
@@ -38,11 +36,19 @@ Xform_UpdateOrientation(struct NeTransform *t)
 	M_Store(&t->up,      XMVector4Transform(XMVectorSet(0.f, 1.f, 0.f, 1.f), mat));
 }
 
+// Flags the matrix for update and marks the component as changed
+static inline void
+Xform_MarkDirty(struct NeTransform *t)
+{
+	t->dirty = true;
+	E_MarkComponentChangedS(Scn_GetScene((uint8_t)t->_sceneId), E_ComponentHandle(t));
+}
+
 static inline void
 Xform_Move(struct NeTransform *t, const struct NeVec3 *movement)
 {
 	M_Store(&t->position, XMVectorAdd(M_Load(&t->position), M_Load(movement)));
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
@@ -51,21 +57,21 @@ Xform_Rotate(struct NeTransform *t, float angle, const struct NeVec3 *axis)
 	M_Store(&t->rotation,
 		XMQuaternionMultiply(M_Load(&t->rotation), XMQuaternionRotationAxis(M_Load(axis), XMConvertToRadians(angle))));
 	Xform_UpdateOrientation(t);
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
 Xform_Scale(struct NeTransform *t, const struct NeVec3 *scale)
 {
 	M_Store(&t->position, XMVectorMultiply(M_Load(&t->position), M_Load(scale)));
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
 Xform_SetPosition(struct NeTransform *t, const struct NeVec3 *pos)
 {
 	memcpy(&t->position, pos, sizeof(t->position));
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
@@ -73,7 +79,7 @@ Xform_SetRotation(struct NeTransform *t, const struct NeQuaternion *rot)
 {
 	memcpy(&t->rotation, rot, sizeof(t->rotation));
 	Xform_UpdateOrientation(t);
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
@@ -83,7 +89,7 @@ Xform_SetScale(struct NeTransform *t, const struct NeVec3 *scale)
 	t->scale.x = fmaxf(t->scale.x, .0000001f);
 	t->scale.y = fmaxf(t->scale.y, .0000001f);
 	t->scale.z = fmaxf(t->scale.z, .0000001f);
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
@@ -110,6 +116,10 @@ Xform_Update(struct NeTransform *t)
 
 	M_Store(&t->mat, mat);
 
+	// children are updated with their parent without being marked dirty
+	if (!t->dirty)
+		E_MarkComponentChangedS(s, E_ComponentHandle(t));
+
 	for (size_t i = 0; i < t->children.count; ++i)
 		Xform_Update((struct NeTransform *) E_ComponentPtrS(s, *((NeCompHandle *) Rt_ArrayGet(&t->children, i))));
 
@@ -183,7 +193,7 @@ static inline void
 Xform_MoveForward(struct NeTransform *t, float distance)
 {
 	M_Store(&t->position, XMVectorMultiplyAdd(M_Load(&t->forward), XMVectorReplicate(-distance), M_Load(&t->position)));
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
@@ -196,7 +206,7 @@ static inline void
 Xform_MoveRight(struct NeTransform *t, float distance)
 {
 	M_Store(&t->position, XMVectorMultiplyAdd(M_Load(&t->right), XMVectorReplicate(distance), M_Load(&t->position)));
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
@@ -209,7 +219,7 @@ static inline void
 Xform_MoveUp(struct NeTransform *t, float distance)
 {
 	M_Store(&t->position, XMVectorMultiplyAdd(M_Load(&t->up), XMVectorReplicate(distance), M_Load(&t->position)));
-	t->dirty = true;
+	Xform_MarkDirty(t);
 }
 
 static inline void
@@ -30,6 +30,12 @@
 #define SIF_NE_ENTITY				"NeEntity"
 #define NE_SCRIPT_COMPONENT			"NeScriptComponent"
 
+#define SIF_NE_COMPONENT_VIEW		"NeComponentView"
+#define SIF_NE_COMPONENT_COLUMNS	"NeComponentColumns"
+#define SIF_NE_COMPONENT_COLUMN		"NeComponentColumn"
+
+#define SC_VIEW_CAPACITY			256
+
 #define SIF_VOID(name, func)		\
 static int							\
 Sif_ ## name(lua_State *vm)			\
@@ -137,6 +143,16 @@ struct NeScriptWrapper
 	};
 };
 
+// Components of one type passed to a batched script system; view[i] returns the wrapper of a component and
+// columns.field[i] its field
+struct NeScriptView
+{
+	NeCompTypeId type;
+	uint32_t count;
+	bool readOnly;
+	void *comp[SC_VIEW_CAPACITY];
+};
+
 enum NeScriptFieldType
 {
 	SFT_Integer,
@@ -336,6 +352,7 @@ extern "C" {
 #endif
 
 int SIface_ScriptComponent(lua_State *vm);
+int SIface_ComponentView(lua_State *vm);
 
 void SIface_PushVec2(lua_State *vm, const struct NeVec2 *v2);
 void SIface_PushVec3(lua_State *vm, const struct NeVec3 *v3);
@@ -27,6 +27,25 @@ bool Sc_RegisterInterfaceScript(const char *name, const char *script);
 
 void Sc_DestroyVM(lua_State *vm);
 
+/*
+ * Check out a VM from the pool of the calling worker. The VM has the standard and engine libraries loaded; the
+ * scripts it loads with Sc_LoadScriptFile are compiled once per VM and run once per checkout, each in a new globals
+ * table. It must be returned with Sc_ReleaseVM from the thread that acquired it.
+ */
+lua_State *Sc_AcquireVM(void);
+void Sc_ReleaseVM(lua_State *vm);
+
+/*
+ * Push the global function name of the script at path. In a checked out VM the script runs the first time one of its
+ * functions is pushed; nothing is pushed if the script fails to load or has no such function.
+ */
+bool Sc_PushScriptFunction(lua_State *vm, const char *path, const char *name);
+
+/*
+ * Compile the scripts used by pooled VMs again, after script files changed.
+ */
+void Sc_InvalidateScripts(void);
+
 bool Sc_InitScriptSystem(void);
 void Sc_TermScriptSystem(void);
 
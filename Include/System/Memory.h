@@ -2,6 +2,7 @@
 #define NE_SYSTEM_MEMORY_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #ifdef __cplusplus
@@ -36,26 +37,110 @@ enum NeMemoryHeap
 
 	MH_ManualAlign,
 
+	MH_Count,
+
 	MH_FORCE_UINT32 = 0xFFFFFFFF
 };
 
 #define NE_DEFAULT_ALIGNMENT		16
 
+// Position in a frame or transient heap; see Sys_PushHeapMarker
+struct NeHeapMarker
+{
+	struct NeHeap *heap;
+	struct NeHeapBlock *block;
+	void *ptr;
+	uint64_t used, allocations, epoch;
+};
+
+struct NeMemoryHeapStatistics
+{
+	uint64_t inUse;						// bytes, including allocation headers
+	uint64_t allocations;				// live allocations
+	uint64_t peak;						// highest inUse seen at a frame boundary or query
+	uint64_t totalAllocations, totalFrees;
+	uint64_t frameAllocations, frameFrees;	// during the last frame
+};
+
+struct NeMemoryPoolStatistics
+{
+	uint64_t reserved;					// bytes obtained from the system
+	uint64_t allocated;					// bytes in blocks handed out
+	uint64_t requested;					// bytes requested for those blocks
+	uint64_t allocations;
+	uint64_t spans;
+	double internalFragmentation;		// share of the allocated blocks lost to size class rounding
+	double externalFragmentation;		// share of the reserved memory sitting in free lists
+};
+
+struct NeAllocationSite
+{
+	const char *file;
+	int line;
+	enum NeMemoryHeap heap;
+	int64_t bytes, allocations;			// still allocated
+	uint64_t totalAllocations;
+	uint64_t frameAllocations;			// during the last frame
+	uint64_t steadyStateAllocations;	// after Engine_AllocSteadyStateFrames
+};
+
 void *Sys_AlignedAlloc(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap);
 static inline void *Sys_Alloc(size_t size, size_t count, enum NeMemoryHeap heap)
 { return Sys_AlignedAlloc(size, count, NE_DEFAULT_ALIGNMENT, heap); }
 
+// Same as Sys_AlignedAlloc, but the memory is not cleared; the secure heap is always cleared.
+void *Sys_AlignedAllocNoZero(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap);
+static inline void *Sys_AllocNoZero(size_t size, size_t count, enum NeMemoryHeap heap)
+{ return Sys_AlignedAllocNoZero(size, count, NE_DEFAULT_ALIGNMENT, heap); }
+
 void *Sys_AlignedReAlloc(void *mem, size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap);
 static inline void *Sys_ReAlloc(void *mem, size_t size, size_t count, enum NeMemoryHeap heap)
 { return Sys_AlignedReAlloc(mem, size, count, NE_DEFAULT_ALIGNMENT, heap); }
 
 void Sys_Free(void *mem);
 
+/*
+ * Allocation tracing. When the engine is built with ENABLE_ALLOC_TRACE the allocation functions
+ * above are replaced by macros that record the call site; Sys_AllocationSites returns the sites
+ * seen so far, or nothing in other builds.
+ */
+void *Sys_TraceAlignedAlloc(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, const char *file, int line);
+void *Sys_TraceAlignedAllocNoZero(size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, const char *file, int line);
+void *Sys_TraceAlignedReAlloc(void *mem, size_t size, size_t count, size_t alignment, enum NeMemoryHeap heap, const char *file, int line);
+uint32_t Sys_AllocationSites(struct NeAllocationSite *sites, uint32_t max);
+
+#ifdef NE_ALLOC_TRACE
+#	define Sys_AlignedAlloc(size, count, alignment, heap) Sys_TraceAlignedAlloc(size, count, alignment, heap, __FILE__, __LINE__)
+#	define Sys_Alloc(size, count, heap) Sys_TraceAlignedAlloc(size, count, NE_DEFAULT_ALIGNMENT, heap, __FILE__, __LINE__)
+#	define Sys_AlignedAllocNoZero(size, count, alignment, heap) Sys_TraceAlignedAllocNoZero(size, count, alignment, heap, __FILE__, __LINE__)
+#	define Sys_AllocNoZero(size, count, heap) Sys_TraceAlignedAllocNoZero(size, count, NE_DEFAULT_ALIGNMENT, heap, __FILE__, __LINE__)
+#	define Sys_AlignedReAlloc(mem, size, count, alignment, heap) Sys_TraceAlignedReAlloc(mem, size, count, alignment, heap, __FILE__, __LINE__)
+#	define Sys_ReAlloc(mem, size, count, heap) Sys_TraceAlignedReAlloc(mem, size, count, NE_DEFAULT_ALIGNMENT, heap, __FILE__, __LINE__)
+#endif
+
 void Sys_ZeroMemory(void *mem, size_t size);
 
 bool Sys_InitMemory(void);
 void Sys_ResetHeap(enum NeMemoryHeap heap);
+
+/*
+ * Save the current position of the calling thread's frame or transient heap; popping the marker
+ * releases everything allocated after it. Markers must be popped on the thread that pushed them,
+ * in reverse order. Popping a marker after the heap was reset does nothing.
+ */
+void Sys_PushHeapMarker(enum NeMemoryHeap heap, struct NeHeapMarker *marker);
+void Sys_PopHeapMarker(const struct NeHeapMarker *marker);
 void Sys_LogMemoryStatistics(void);
+void Sys_PoolStatistics(struct NeMemoryPoolStatistics *stats);
+
+/*
+ * Per heap counters, summed over all threads without locking; a reset of the frame or transient
+ * heap counts as freeing everything allocated from it. Sys_UpdateHeapStatistics is called by the
+ * engine once per frame to sample the peaks and the per frame counters.
+ */
+const char *Sys_MemoryHeapName(enum NeMemoryHeap heap);
+void Sys_HeapStatistics(enum NeMemoryHeap heap, struct NeMemoryHeapStatistics *stats);
+void Sys_UpdateHeapStatistics(void);
 void Sys_TermMemory(void);
 
 bool Sys_LockMemory(void *mem, size_t size);
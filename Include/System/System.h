@@ -53,6 +53,23 @@ struct NeSysVersion
 	uint32_t revision;
 };
 
+struct NeCpu
+{
+	uint32_t id;			// logical CPU number, as passed to Sys_SetThreadAffinity
+	uint32_t core;			// SMT siblings share the same core
+	uint32_t sibling;		// index of the CPU among the siblings of its core
+	uint32_t cacheDomain;	// CPUs sharing the last level cache (L3 or CCX)
+	uint32_t node;			// NUMA node
+	uint32_t package;
+	bool efficiency;		// efficiency core on hybrid CPUs
+};
+
+struct NeCpuTopology
+{
+	uint32_t cpuCount, coreCount, cacheDomainCount, nodeCount, packageCount;
+	struct NeCpu *cpus;		// sorted by node, cache domain, core and sibling
+};
+
 #if defined(__GNUC__) || defined(__clang__)
 #	define likely(x)		__builtin_expect(!!(x), 1)
 #	define unlikely(x)		__builtin_expect(!!(x), 0)
@@ -81,6 +98,7 @@ const char *Sys_CpuName(void);
 uint32_t Sys_CpuFreq(void);
 uint32_t Sys_CpuCount(void);
 uint32_t Sys_CpuThreadCount(void);
+const struct NeCpuTopology *Sys_CpuTopology(void);
 
 uint64_t Sys_TotalMemory(void);
 uint64_t Sys_FreeMemory(void);
@@ -225,6 +225,12 @@ Sys_CpuThreadCount(void)
 	return f_cpuThreadCount;
 }
 
+bool
+Sys_PlatformCpuTopology(struct NeCpuTopology *topo)
+{
+	return false;
+}
+
 uint64_t
 Sys_TotalMemory(void)
 {
@@ -154,6 +154,12 @@ Sys_CpuThreadCount(void)
 	return f_cpuThreadCount;
 }
 
+extern "C" bool
+Sys_PlatformCpuTopology(struct NeCpuTopology *topo)
+{
+	return false;
+}
+
 uint64_t
 Sys_TotalMemory(void)
 {
@@ -27,7 +27,7 @@ Sys_InitThread(NeThread *t, const char *name, void (*proc)(void *), void *args)
 {
 	(void)name;
 	
-	if (!pthread_create((pthread_t *)t, NULL, (void *(*)(void *))proc, args))
+	if (pthread_create((pthread_t *)t, NULL, (void *(*)(void *))proc, args))
 		return false;
 		
 	#if defined(__linux__)
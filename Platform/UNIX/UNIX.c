@@ -44,6 +44,7 @@
 #if defined(SYS_PLATFORM_FREEBSD) || defined(SYS_PLATFORM_OPENBSD) || defined(SYS_PLATFORM_NETBSD)
 #	include <sys/sysctl.h>
 #elif defined(SYS_PLATFORM_LINUX)
+#	include <dirent.h>
 #	include <sys/inotify.h>
 #	include <linux/limits.h>
 #elif defined(SYS_PLATFORM_QNX)
@@ -69,6 +70,12 @@ static struct utsname f_uname;
 
 static inline void CpuInfo(void);
 
+#ifdef SYS_PLATFORM_LINUX
+static inline int64_t ReadSysInt(const char *path);
+static inline bool ReadCpuList(const char *path, bool *cpus, uint32_t max);
+static inline uint32_t CpuNode(uint32_t cpu);
+#endif
+
 int
 Sys_Main(int argc, char *argv[])
 {
@@ -220,6 +227,88 @@ Sys_CpuThreadCount(void)
 	return f_cpuThreadCount;
 }
 
+bool
+Sys_PlatformCpuTopology(struct NeCpuTopology *topo)
+{
+#ifdef SYS_PLATFORM_LINUX
+	char path[256];
+	const uint32_t max = (uint32_t)sysconf(_SC_NPROCESSORS_CONF);
+
+	bool *online = calloc(max, sizeof(*online)), *atom = calloc(max, sizeof(*atom));
+	topo->cpus = calloc(max, sizeof(*topo->cpus));
+
+	if (!online || !atom || !topo->cpus || !ReadCpuList("/sys/devices/system/cpu/online", online, max)) {
+		free(online);
+		free(atom);
+		free(topo->cpus);
+		topo->cpus = NULL;
+		return false;
+	}
+
+	// Intel hybrid CPUs list their efficiency cores here; ARM reports a lower capacity for them instead
+	const bool hybrid = ReadCpuList("/sys/devices/cpu_atom/cpus", atom, max);
+	int64_t maxCapacity = 0, minCapacity = INT64_MAX;
+
+	topo->cpuCount = 0;
+	for (uint32_t i = 0; i < max; ++i) {
+		if (!online[i])
+			continue;
+
+		struct NeCpu *cpu = &topo->cpus[topo->cpuCount++];
+		cpu->id = i;
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", i);
+		const int64_t package = ReadSysInt(path);
+		cpu->package = package > 0 ? (uint32_t)package : 0;
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", i);
+		const int64_t core = ReadSysInt(path);
+		cpu->core = (cpu->package << 16) | (core >= 0 ? (uint32_t)core : i);
+
+		// The caches are listed in ascending level order; the CPUs sharing the last one form a cache
+		// domain and are identified by the first CPU in the list.
+		cpu->cacheDomain = i;
+		for (uint32_t j = 0; ; ++j) {
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/shared_cpu_list", i, j);
+			const int64_t first = ReadSysInt(path);
+			if (first < 0)
+				break;
+			cpu->cacheDomain = (uint32_t)first;
+		}
+
+		cpu->node = CpuNode(i);
+
+		if (hybrid) {
+			cpu->efficiency = atom[i];
+		} else {
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpu_capacity", i);
+			const int64_t capacity = ReadSysInt(path);
+			if (capacity > 0) {
+				maxCapacity = capacity > maxCapacity ? capacity : maxCapacity;
+				minCapacity = capacity < minCapacity ? capacity : minCapacity;
+			}
+		}
+	}
+
+	if (!hybrid && maxCapacity != minCapacity && maxCapacity) {
+		for (uint32_t i = 0; i < topo->cpuCount; ++i) {
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpu_capacity", topo->cpus[i].id);
+			topo->cpus[i].efficiency = ReadSysInt(path) < maxCapacity;
+		}
+	}
+
+	free(online);
+	free(atom);
+
+	if (topo->cpuCount)
+		return true;
+
+	free(topo->cpus);
+	topo->cpus = NULL;
+#endif
+	return false;
+}
+
 uint64_t
 Sys_TotalMemory(void)
 {
@@ -956,6 +1045,78 @@ CpuInfo(void)
 	f_cpuThreadCount = f_cpuCount;
 }
 
+#ifdef SYS_PLATFORM_LINUX
+
+static inline int64_t
+ReadSysInt(const char *path)
+{
+	long long value;
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	if (fscanf(fp, "%lld", &value) != 1)
+		value = -1;
+
+	fclose(fp);
+	return value;
+}
+
+static inline bool
+ReadCpuList(const char *path, bool *cpus, uint32_t max)
+{
+	char buff[4096];
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return false;
+
+	const bool rc = fgets(buff, sizeof(buff), fp) != NULL;
+	fclose(fp);
+
+	if (!rc)
+		return false;
+
+	// ranges and single CPUs separated by commas: 0-3,8,10-11
+	bool any = false;
+	char *ptr = buff;
+	while (*ptr >= '0' && *ptr <= '9') {
+		uint32_t first = (uint32_t)strtoul(ptr, &ptr, 10), last = first;
+		if (*ptr == '-')
+			last = (uint32_t)strtoul(ptr + 1, &ptr, 10);
+
+		for (uint32_t i = first; i <= last && i < max; ++i)
+			any = cpus[i] = true;
+
+		if (*ptr == ',')
+			++ptr;
+	}
+
+	return any;
+}
+
+static inline uint32_t
+CpuNode(uint32_t cpu)
+{
+	char path[256];
+	uint32_t node = 0;
+
+	// the CPU's directory has a link to its NUMA node
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
+	DIR *dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)))
+		if (!strncmp(ent->d_name, "node", 4) && ent->d_name[4] >= '0' && ent->d_name[4] <= '9')
+			node = (uint32_t)atoi(ent->d_name + 4);
+
+	closedir(dir);
+	return node;
+}
+
+#endif
+
 // Directory Watch
 
 #ifdef SYS_PLATFORM_LINUX
@@ -150,6 +150,12 @@ Sys_CpuThreadCount(void)
 	return Darwin_numCpus;
 }
 
+bool
+Sys_PlatformCpuTopology(struct NeCpuTopology *topo)
+{
+	return false;
+}
+
 uint64_t
 Sys_TotalMemory(void)
 {
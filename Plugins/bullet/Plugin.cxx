@@ -67,14 +67,18 @@ TermPlugin(void)
 static bool
 RayCast(struct NeScene *scn, struct NeVec3 *start, struct NeVec3 *end, struct NeHitInfo *hi)
 {
-	const struct NeArray *entities = E_GetAllComponentsS(scn, NE_PHYSICS_WORLD_ID);
-	if (!entities->count)
+	const btCollisionWorld *world = NULL;
+	E_ForEachComponentS(scn, NE_PHYSICS_WORLD_ID, [](void *comp, void *world) -> bool {
+		*(const btCollisionWorld **)world = (btCollisionWorld *)comp;
+		return false;
+	}, &world);
+
+	if (!world)
 		return false;
 
 	const btVector3 s{ start->x, start->y, start->z }, e{ end->x, end->y, end->z };
 	btCollisionWorld::ClosestRayResultCallback cb(s, e);
 
-	const btCollisionWorld *world = (btCollisionWorld *)Rt_ArrayGet(entities, 0);
 	world->rayTest(s, e, cb);
 	if (!cb.hasHit())
 		return false;
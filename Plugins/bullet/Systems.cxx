@@ -55,7 +55,7 @@ BT_UpdateCollider(void **comp, void *args)
 	collider->shape->setLocalScaling({ v.x, v.y, v.z });
 }
 
-NE_REGISTER_SYSTEM(BT_UPDATE_BOX_COLLIDER, ECSYS_GROUP_LOGIC, BT_UpdateCollider, 0, false, 2, NE_TRANSFORM, NE_BOX_COLLIDER)
-NE_REGISTER_SYSTEM(BT_UPDATE_SPHERE_COLLIDER, ECSYS_GROUP_LOGIC, BT_UpdateCollider, 0, false, 2, NE_TRANSFORM, NE_SPHERE_COLLIDER)
-NE_REGISTER_SYSTEM(BT_UPDATE_CAPSULE_COLLIDER, ECSYS_GROUP_LOGIC, BT_UpdateCollider, 0, false, 2, NE_TRANSFORM, NE_CAPSULE_COLLIDER)
-NE_REGISTER_SYSTEM(BT_UPDATE_MESH_COLLIDER, ECSYS_GROUP_LOGIC, BT_UpdateCollider, 0, false, 2, NE_TRANSFORM, NE_MESH_COLLIDER)
+NE_REGISTER_SYSTEM(BT_UPDATE_BOX_COLLIDER, ECSYS_GROUP_LOGIC, BT_UpdateCollider, 0, false, 2, ECSYS_READ(ECSYS_CHANGED(NE_TRANSFORM)), ECSYS_CHANGED(NE_BOX_COLLIDER))
+NE_REGISTER_SYSTEM(BT_UPDATE_SPHERE_COLLIDER, ECSYS_GROUP_LOGIC, BT_UpdateCollider, 0, false, 2, ECSYS_READ(ECSYS_CHANGED(NE_TRANSFORM)), ECSYS_CHANGED(NE_SPHERE_COLLIDER))
+NE_REGISTER_SYSTEM(BT_UPDATE_CAPSULE_COLLIDER, ECSYS_GROUP_LOGIC, BT_UpdateCollider, 0, false, 2, ECSYS_READ(ECSYS_CHANGED(NE_TRANSFORM)), ECSYS_CHANGED(NE_CAPSULE_COLLIDER))
+NE_REGISTER_SYSTEM(BT_UPDATE_MESH_COLLIDER, ECSYS_GROUP_LOGIC, BT_UpdateCollider, 0, false, 2, ECSYS_READ(ECSYS_CHANGED(NE_TRANSFORM)), ECSYS_CHANGED(NE_MESH_COLLIDER))
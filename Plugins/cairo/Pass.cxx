@@ -150,16 +150,18 @@ UpdateImage(int workerId, struct NeCairoUI *pass)
 {
 	memset(CRUI_imageData + CRUI_bufferSize * Re_frameId, 0x0, CRUI_bufferSize);
 
-	const struct NeArray *comp = E_GetAllComponents(NE_CAIRO_CONTEXT_ID);
-	struct NeCairoContext *ctx;
-	Rt_ArrayForEach(ctx, comp, struct NeCairoContext *) {
+	E_ForEachComponent(NE_CAIRO_CONTEXT_ID, [](void *comp, void *user) -> bool {
+		struct NeCairoContext *ctx = (struct NeCairoContext *)comp;
+
 		cairo_set_source_surface(CRUI_cairo[Re_frameId], ctx->surface, 0.0, 0.0);
 		cairo_paint(CRUI_cairo[Re_frameId]);
 
 		cairo_set_operator(ctx->cairo, CAIRO_OPERATOR_CLEAR);
 		cairo_paint(ctx->cairo);
 		cairo_set_operator(ctx->cairo, CAIRO_OPERATOR_OVER);
-	}
+
+		return true;
+	}, NULL);
 
 	if (E_ConsoleVisible())
 		CRUI_DrawConsole();
@@ -43,6 +43,7 @@ EXPORT struct NePluginInterface PluginInterfaces[] =
 static bool CreateCairo(void);
 static void DestroyCairo(void);
 static void ScreenResized(void *user, void *args);
+static bool ResizeContext(struct NeCairoContext *ctx, void *user);
 
 EXPORT bool
 InitPlugin(void)
@@ -128,15 +129,19 @@ ScreenResized(void *user, void *args)
 	DestroyCairo();
 	CreateCairo();
 
-	const struct NeArray *comp = E_GetAllComponents(NE_CAIRO_CONTEXT_ID);
-	struct NeCairoContext *ctx;
-	Rt_ArrayForEach(ctx, comp) {
-		cairo_destroy(ctx->cairo);
-		cairo_surface_destroy(ctx->surface);
+	E_ForEachComponent(NE_CAIRO_CONTEXT_ID, (NeCompIteratorProc)ResizeContext, NULL);
+}
 
-		ctx->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, *E_screenWidth, *E_screenHeight);
-		ctx->cairo = cairo_create(ctx->surface);
-	}
+static bool
+ResizeContext(struct NeCairoContext *ctx, void *user)
+{
+	cairo_destroy(ctx->cairo);
+	cairo_surface_destroy(ctx->surface);
+
+	ctx->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, *E_screenWidth, *E_screenHeight);
+	ctx->cairo = cairo_create(ctx->surface);
+
+	return true;
 }
 
 /* NekoEngine Cairo UI Plugin